@@ -0,0 +1,146 @@
+#include "PhysicsBVH4.h"
+
+#include "PhysicsDynamicAABBTree.h"
+#include "PhysicsMemory.h"
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsBVH4
+//--------------------------------------------------------------------------------------------------
+PhysicsBVH4::PhysicsBVH4( )
+	: m_nodes( NULL )
+	, m_count( 0 )
+	, m_capacity( 0 )
+	, m_root( Null )
+{
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBVH4::~PhysicsBVH4( )
+{
+	if ( m_nodes )
+		PhysicsFree( m_nodes );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBVH4::Build( const PhysicsDynamicAABBTree& tree )
+{
+	Clear( );
+
+	if ( tree.m_root == PhysicsDynamicAABBTree::Node::Null )
+		return;
+
+	// A binary tree with n leaves has n - 1 branches, collapsing never
+	// needs more nodes than that
+	int capacity = glm::max( tree.m_count / 2, 1 );
+
+	if ( capacity > m_capacity )
+	{
+		if ( m_nodes )
+			PhysicsFree( m_nodes );
+
+		m_capacity = capacity;
+		m_nodes = (PhysicsBVH4Node *)PhysicsAlloc( sizeof( PhysicsBVH4Node ) * m_capacity );
+	}
+
+	m_root = Collapse( tree, tree.m_root );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBVH4::Clear( )
+{
+	m_count = 0;
+	m_root = Null;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsBVH4::GetNodeCount( ) const
+{
+	return m_count;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsBVH4::Collapse( const PhysicsDynamicAABBTree& tree, int index )
+{
+	const PhysicsDynamicAABBTree::Node *nodes = tree.m_nodes;
+
+	assert( m_count < m_capacity );
+	int id = m_count++;
+	PhysicsBVH4Node *node = m_nodes + id;
+
+	// A single leaf root still gets a node
+	int slots[ 4 ];
+	int count = 0;
+
+	if ( nodes[ index ].IsLeaf( ) )
+	{
+		slots[ count++ ] = index;
+	}
+
+	else
+	{
+		slots[ count++ ] = nodes[ index ].left;
+		slots[ count++ ] = nodes[ index ].right;
+	}
+
+	// Open up the largest branch until all four slots are used
+	while ( count < 4 )
+	{
+		int best = -1;
+		float bestArea = float( -1.0 );
+
+		for ( int i = 0; i < count; ++i )
+		{
+			const PhysicsDynamicAABBTree::Node *n = nodes + slots[ i ];
+
+			if ( n->IsLeaf( ) )
+				continue;
+
+			float area = n->aabb.SurfaceArea( );
+			if ( area > bestArea )
+			{
+				bestArea = area;
+				best = i;
+			}
+		}
+
+		if ( best < 0 )
+			break;
+
+		int branch = slots[ best ];
+		slots[ best ] = nodes[ branch ].left;
+		slots[ count++ ] = nodes[ branch ].right;
+	}
+
+	node->count = count;
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( i >= count )
+		{
+			// Empty slots never overlap anything
+			PhysicsAABB empty;
+			empty.min = glm::vec3( Q3_R32_MAX );
+			empty.max = glm::vec3( -Q3_R32_MAX );
+			SetChild( node, i, empty, Null );
+			continue;
+		}
+
+		const PhysicsDynamicAABBTree::Node *n = nodes + slots[ i ];
+		int child = n->IsLeaf( ) ? ~slots[ i ] : Collapse( tree, slots[ i ] );
+		SetChild( node, i, n->aabb, child );
+	}
+
+	return id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBVH4::SetChild( PhysicsBVH4Node *node, int slot, const PhysicsAABB& aabb, int child )
+{
+	node->minX[ slot ] = aabb.min.x;
+	node->minY[ slot ] = aabb.min.y;
+	node->minZ[ slot ] = aabb.min.z;
+	node->maxX[ slot ] = aabb.max.x;
+	node->maxY[ slot ] = aabb.max.y;
+	node->maxZ[ slot ] = aabb.max.z;
+	node->children[ slot ] = child;
+}
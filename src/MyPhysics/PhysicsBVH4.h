@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Common.h"
+#include "PhysicsRaycastData.h"
+
+class PhysicsDynamicAABBTree;
+
+// One node of the 4-wide tree, exactly two cache lines. Child bounds are
+// stored per axis so one SSE op tests all four children at once.
+struct PhysicsBVH4Node
+{
+	float minX[ 4 ];
+	float minY[ 4 ];
+	float minZ[ 4 ];
+	float maxX[ 4 ];
+	float maxY[ 4 ];
+	float maxZ[ 4 ];
+
+	// Node index for branches, ~leafId for leaves
+	int children[ 4 ];
+	int count;
+
+	int pad[ 3 ];
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsBVH4
+//--------------------------------------------------------------------------------------------------
+// Read only 4-wide copy of a PhysicsDynamicAABBTree. Every node of the
+// binary tree is collapsed with up to three of its descendants. Queries
+// report the leaf ids of the source tree, so proxy ids stay the same.
+class PhysicsBVH4
+{
+public:
+	PhysicsBVH4( );
+	~PhysicsBVH4( );
+
+	// Replaces the contents with a collapsed copy of tree. Has to be called
+	// again after the tree changed.
+	void Build( const PhysicsDynamicAABBTree& tree );
+	void Clear( );
+
+	int GetNodeCount( ) const;
+
+	// Same contract as the PhysicsDynamicAABBTree queries
+	template <typename T>
+	void Query( T *cb, const PhysicsAABB& aabb ) const;
+	template <typename T>
+	void Query( T *cb, PhysicsRaycastData& rayCast ) const;
+	template <typename T>
+	void Query( T *cb, PhysicsRayPacket& packet ) const;
+	template <typename T>
+	float RayCast( T *cb, const PhysicsRaycastData& rayCast ) const;
+
+private:
+	int Collapse( const PhysicsDynamicAABBTree& tree, int index );
+	void SetChild( PhysicsBVH4Node *node, int slot, const PhysicsAABB& aabb, int child );
+
+	PhysicsBVH4Node *m_nodes;
+	int m_count;
+	int m_capacity;
+	int m_root;
+
+	static const int Null = -1;
+};
+
+#include "PhysicsBVH4.inl"
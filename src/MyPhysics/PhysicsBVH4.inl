@@ -0,0 +1,287 @@
+#include "PhysicsBVH4.h"
+#include "PhysicsSimd.h"
+
+#include <cassert>
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline void PhysicsBVH4::Query( T *cb, const PhysicsAABB& aabb ) const
+{
+	if ( m_root == Null )
+		return;
+
+	const int k_stackCapacity = 256;
+	int stack[ k_stackCapacity ];
+	int sp = 1;
+
+	*stack = m_root;
+
+	PhysicsFloat4 qMinX = PhysicsSplat4( aabb.min.x );
+	PhysicsFloat4 qMinY = PhysicsSplat4( aabb.min.y );
+	PhysicsFloat4 qMinZ = PhysicsSplat4( aabb.min.z );
+	PhysicsFloat4 qMaxX = PhysicsSplat4( aabb.max.x );
+	PhysicsFloat4 qMaxY = PhysicsSplat4( aabb.max.y );
+	PhysicsFloat4 qMaxZ = PhysicsSplat4( aabb.max.z );
+
+	while ( sp )
+	{
+		const PhysicsBVH4Node *n = m_nodes + stack[ --sp ];
+
+		PhysicsFloat4 overlap = PhysicsAnd4(
+			PhysicsAnd4(
+				PhysicsAnd4( PhysicsLessEqual4( PhysicsLoad4( n->minX ), qMaxX ), PhysicsLessEqual4( qMinX, PhysicsLoad4( n->maxX ) ) ),
+				PhysicsAnd4( PhysicsLessEqual4( PhysicsLoad4( n->minY ), qMaxY ), PhysicsLessEqual4( qMinY, PhysicsLoad4( n->maxY ) ) ) ),
+			PhysicsAnd4( PhysicsLessEqual4( PhysicsLoad4( n->minZ ), qMaxZ ), PhysicsLessEqual4( qMinZ, PhysicsLoad4( n->maxZ ) ) ) );
+
+		int hits = PhysicsMask4( overlap ) & ((1 << n->count) - 1);
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			if ( !(hits & (1 << i)) )
+				continue;
+
+			int child = n->children[ i ];
+
+			if ( child < 0 )
+			{
+				if ( !cb->TreeCallBack( ~child ) )
+					return;
+			}
+
+			else
+			{
+				// k_stackCapacity too small
+				assert( sp < k_stackCapacity );
+				stack[ sp++ ] = child;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline void PhysicsBVH4::Query( T *cb, PhysicsRaycastData& rayCast ) const
+{
+	if ( m_root == Null )
+		return;
+
+	const int k_stackCapacity = 256;
+	int stack[ k_stackCapacity ];
+	int sp = 1;
+
+	*stack = m_root;
+
+	// Slab test of the segment start -> start + dir * t, parametrized on [0, 1]
+	glm::vec3 p0 = rayCast.start;
+	glm::vec3 d = rayCast.dir * rayCast.t;
+	glm::vec3 inv;
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		const float k_huge = float( 1.0e30 );
+		inv[ i ] = Abs( d[ i ] ) > float( 1.0e-12 ) ? float( 1.0 ) / d[ i ] : (d[ i ] < float( 0.0 ) ? -k_huge : k_huge);
+	}
+
+	PhysicsFloat4 pX = PhysicsSplat4( p0.x );
+	PhysicsFloat4 pY = PhysicsSplat4( p0.y );
+	PhysicsFloat4 pZ = PhysicsSplat4( p0.z );
+	PhysicsFloat4 iX = PhysicsSplat4( inv.x );
+	PhysicsFloat4 iY = PhysicsSplat4( inv.y );
+	PhysicsFloat4 iZ = PhysicsSplat4( inv.z );
+	PhysicsFloat4 zero = PhysicsSplat4( float( 0.0 ) );
+	PhysicsFloat4 one = PhysicsSplat4( float( 1.0 ) );
+
+	while ( sp )
+	{
+		const PhysicsBVH4Node *n = m_nodes + stack[ --sp ];
+
+		PhysicsFloat4 x0 = (PhysicsLoad4( n->minX ) - pX) * iX;
+		PhysicsFloat4 x1 = (PhysicsLoad4( n->maxX ) - pX) * iX;
+		PhysicsFloat4 y0 = (PhysicsLoad4( n->minY ) - pY) * iY;
+		PhysicsFloat4 y1 = (PhysicsLoad4( n->maxY ) - pY) * iY;
+		PhysicsFloat4 z0 = (PhysicsLoad4( n->minZ ) - pZ) * iZ;
+		PhysicsFloat4 z1 = (PhysicsLoad4( n->maxZ ) - pZ) * iZ;
+
+		PhysicsFloat4 tEnter = PhysicsMax4( PhysicsMax4( PhysicsMin4( x0, x1 ), PhysicsMin4( y0, y1 ) ), PhysicsMax4( PhysicsMin4( z0, z1 ), zero ) );
+		PhysicsFloat4 tExit = PhysicsMin4( PhysicsMin4( PhysicsMax4( x0, x1 ), PhysicsMax4( y0, y1 ) ), PhysicsMin4( PhysicsMax4( z0, z1 ), one ) );
+
+		int hits = PhysicsMask4( PhysicsLessEqual4( tEnter, tExit ) ) & ((1 << n->count) - 1);
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			if ( !(hits & (1 << i)) )
+				continue;
+
+			int child = n->children[ i ];
+
+			if ( child < 0 )
+			{
+				if ( !cb->TreeCallBack( ~child ) )
+					return;
+			}
+
+			else
+			{
+				// k_stackCapacity too small
+				assert( sp < k_stackCapacity );
+				stack[ sp++ ] = child;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline void PhysicsBVH4::Query( T *cb, PhysicsRayPacket& packet ) const
+{
+	if ( m_root == Null )
+		return;
+
+	const int k_stackCapacity = 256;
+	int stack[ k_stackCapacity ];
+	int sp = 1;
+
+	*stack = m_root;
+
+	while ( sp )
+	{
+		const PhysicsBVH4Node *n = m_nodes + stack[ --sp ];
+
+		// One child against four rays at a time, the lanes of a node hold
+		// different children so they can not be tested together with rays
+		for ( int i = 0; i < n->count; ++i )
+		{
+			PhysicsVec3x4 min;
+			min.x = PhysicsSplat4( n->minX[ i ] );
+			min.y = PhysicsSplat4( n->minY[ i ] );
+			min.z = PhysicsSplat4( n->minZ[ i ] );
+
+			PhysicsVec3x4 max;
+			max.x = PhysicsSplat4( n->maxX[ i ] );
+			max.y = PhysicsSplat4( n->maxY[ i ] );
+			max.z = PhysicsSplat4( n->maxZ[ i ] );
+
+			int lanes = PhysicsRayPacketOverlap( packet, min, max );
+
+			if ( !lanes )
+				continue;
+
+			int child = n->children[ i ];
+
+			if ( child < 0 )
+			{
+				if ( !cb->TreeCallBack( ~child, lanes ) )
+					return;
+			}
+
+			else
+			{
+				// k_stackCapacity too small
+				assert( sp < k_stackCapacity );
+				stack[ sp++ ] = child;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline float PhysicsBVH4::RayCast( T *cb, const PhysicsRaycastData& rayCast ) const
+{
+	float maxT = rayCast.t;
+
+	if ( m_root == Null )
+		return maxT;
+
+	struct Entry
+	{
+		int id;
+		float t;
+	};
+
+	const int k_stackCapacity = 256;
+	Entry stack[ k_stackCapacity ];
+	int sp = 1;
+
+	stack[ 0 ].id = m_root;
+	stack[ 0 ].t = float( 0.0 );
+
+	glm::vec3 invDir = PhysicsRayInvDir( rayCast.dir );
+
+	PhysicsFloat4 pX = PhysicsSplat4( rayCast.start.x );
+	PhysicsFloat4 pY = PhysicsSplat4( rayCast.start.y );
+	PhysicsFloat4 pZ = PhysicsSplat4( rayCast.start.z );
+	PhysicsFloat4 iX = PhysicsSplat4( invDir.x );
+	PhysicsFloat4 iY = PhysicsSplat4( invDir.y );
+	PhysicsFloat4 iZ = PhysicsSplat4( invDir.z );
+	PhysicsFloat4 zero = PhysicsSplat4( float( 0.0 ) );
+
+	while ( sp )
+	{
+		Entry entry = stack[ --sp ];
+
+		if ( entry.t > maxT )
+			continue;
+
+		// Leaves are pushed as ~leafId like in the nodes
+		if ( entry.id < 0 )
+		{
+			maxT = cb->RayCastCallBack( ~entry.id, maxT );
+
+			if ( maxT <= float( 0.0 ) )
+				return maxT;
+
+			continue;
+		}
+
+		const PhysicsBVH4Node *n = m_nodes + entry.id;
+
+		PhysicsFloat4 x0 = (PhysicsLoad4( n->minX ) - pX) * iX;
+		PhysicsFloat4 x1 = (PhysicsLoad4( n->maxX ) - pX) * iX;
+		PhysicsFloat4 y0 = (PhysicsLoad4( n->minY ) - pY) * iY;
+		PhysicsFloat4 y1 = (PhysicsLoad4( n->maxY ) - pY) * iY;
+		PhysicsFloat4 z0 = (PhysicsLoad4( n->minZ ) - pZ) * iZ;
+		PhysicsFloat4 z1 = (PhysicsLoad4( n->maxZ ) - pZ) * iZ;
+
+		PhysicsFloat4 tEnter = PhysicsMax4( PhysicsMax4( PhysicsMin4( x0, x1 ), PhysicsMin4( y0, y1 ) ), PhysicsMax4( PhysicsMin4( z0, z1 ), zero ) );
+		PhysicsFloat4 tExit = PhysicsMin4( PhysicsMin4( PhysicsMax4( x0, x1 ), PhysicsMax4( y0, y1 ) ), PhysicsMin4( PhysicsMax4( z0, z1 ), PhysicsSplat4( maxT ) ) );
+
+		int hits = PhysicsMask4( PhysicsLessEqual4( tEnter, tExit ) ) & ((1 << n->count) - 1);
+
+		if ( !hits )
+			continue;
+
+		float t[ 4 ];
+		PhysicsStore4( t, tEnter );
+
+		// Sort the hit children far to near, the nearest is pushed last
+		int order[ 4 ];
+		int count = 0;
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			if ( !(hits & (1 << i)) )
+				continue;
+
+			int j = count++;
+			while ( j > 0 && t[ order[ j - 1 ] ] < t[ i ] )
+			{
+				order[ j ] = order[ j - 1 ];
+				--j;
+			}
+
+			order[ j ] = i;
+		}
+
+		// k_stackCapacity too small
+		assert( sp + count <= k_stackCapacity );
+
+		for ( int k = 0; k < count; ++k )
+		{
+			stack[ sp ].id = n->children[ order[ k ] ];
+			stack[ sp++ ].t = t[ order[ k ] ];
+		}
+	}
+
+	return maxT;
+}
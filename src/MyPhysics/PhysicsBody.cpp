@@ -42,6 +42,10 @@ PhysicsBody::PhysicsBody(const PhysicsBodyDef &def, PhysicsScene *scene)
 	m_layers = def.layers;
 	m_userData = def.userData;
 	m_scene = scene;
+	m_island = NULL;
+	m_islandPrev = NULL;
+	m_islandNext = NULL;
+	m_creationIndex = 0;
 	m_flags = 0;
 	m_linearDamping = def.linearDamping;
 	m_angularDamping = def.angularDamping;
@@ -82,6 +86,9 @@ PhysicsBody::PhysicsBody(const PhysicsBodyDef &def, PhysicsScene *scene)
 	if (def.lockAxisZ)
 		m_flags |= eLockAxisZ;
 
+	if (def.continuous)
+		m_flags |= eContinuous;
+
 	m_boxes = NULL;
 	m_contactList = NULL;
 }
@@ -91,24 +98,45 @@ const PhysicsBox *PhysicsBody::AddBox(const PhysicsBoxDef &def)
 {
 	PhysicsAABB aabb;
 	PhysicsBox *box = (PhysicsBox *)m_scene->m_heap.Allocate(sizeof(PhysicsBox));
+	LinkBox(box, def);
+	box->ComputeAABB(m_tx, &aabb);
+
+	CalculateMassData();
+
+	m_scene->m_contactManager.m_broadphase->InsertBox(box, aabb);
+	m_scene->m_newBox = true;
+
+	return box;
+}
+
+//--------------------------------------------------------------------------------------------------
+const PhysicsBox *PhysicsBody::AddBox(const PhysicsBoxDef &def, int threadIndex)
+{
+	assert(m_flags & ePending);
+	assert(threadIndex >= 0 && threadIndex < m_scene->m_creationContextCount);
+
+	PhysicsBlockCache *cache = &m_scene->m_creationContexts[threadIndex].boxCache;
+	PhysicsBox *box = (PhysicsBox *)cache->Allocate(&m_scene->m_heap, &m_scene->m_heapMutex, sizeof(PhysicsBox));
+	LinkBox(box, def);
+
+	CalculateMassData();
+
+	return box;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBody::LinkBox(PhysicsBox *box, const PhysicsBoxDef &def)
+{
 	box->local = def.m_tx;
 	box->e = def.m_e;
 	box->next = m_boxes;
 	m_boxes = box;
-	box->ComputeAABB(m_tx, &aabb);
 
 	box->body = this;
 	box->friction = def.m_friction;
 	box->restitution = def.m_restitution;
 	box->density = def.m_density;
 	box->sensor = def.m_sensor;
-
-	CalculateMassData();
-
-	m_scene->m_contactManager.m_broadphase.InsertBox(box, aabb);
-	m_scene->m_newBox = true;
-
-	return box;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -158,7 +186,7 @@ void PhysicsBody::RemoveBox(const PhysicsBox *box)
 			m_scene->m_contactManager.RemoveContact(contact);
 	}
 
-	m_scene->m_contactManager.m_broadphase.RemoveBox(box);
+	m_scene->m_contactManager.m_broadphase->RemoveBox(box);
 
 	CalculateMassData();
 
@@ -168,17 +196,18 @@ void PhysicsBody::RemoveBox(const PhysicsBox *box)
 //--------------------------------------------------------------------------------------------------
 void PhysicsBody::RemoveAllBoxes()
 {
+	// Contacts are looked up by the proxy ids of their boxes
+	m_scene->m_contactManager.RemoveContactsFromBody(this);
+
 	while (m_boxes)
 	{
 		PhysicsBox *next = m_boxes->next;
 
-		m_scene->m_contactManager.m_broadphase.RemoveBox(m_boxes);
+		m_scene->m_contactManager.m_broadphase->RemoveBox(m_boxes);
 		m_scene->m_heap.Free((void *)m_boxes);
 
 		m_boxes = next;
 	}
-
-	m_scene->m_contactManager.RemoveContactsFromBody(this);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -228,12 +257,25 @@ void PhysicsBody::SetToAwake()
 	{
 		m_flags |= eAwake;
 		m_sleepTime = float(0.0);
+
+		if (!(m_flags & eStatic))
+			m_scene->m_contactManager.WakeContacts(this);
 	}
+
+	// The rest of the island wakes up with the body
+	if (m_island && !m_island->awake)
+		m_scene->m_contactManager.m_islands.WakeIsland(m_island);
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsBody::SetToSleep()
 {
+	if ((m_flags & eAwake) && !(m_flags & eStatic))
+	{
+		m_flags &= ~eAwake;
+		m_scene->m_contactManager.SleepContacts(this);
+	}
+
 	m_flags &= ~eAwake;
 	m_sleepTime = float(0.0);
 	m_linearVelocity = glm::vec3{0};
@@ -272,6 +314,21 @@ void PhysicsBody::SetGravityScale(float scale)
 	m_gravityScale = scale;
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsBody::SetContinuous(bool continuous)
+{
+	if (continuous)
+		m_flags |= eContinuous;
+	else
+		m_flags &= ~eContinuous;
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsBody::IsContinuous() const
+{
+	return m_flags & eContinuous ? true : false;
+}
+
 //--------------------------------------------------------------------------------------------------
 const glm::vec3 PhysicsBody::GetLocalPoint(const glm::vec3 &p) const
 {
@@ -390,7 +447,7 @@ void PhysicsBody::SetTransform(const glm::vec3 &position)
 {
 	m_worldCenter = position;
 
-	SynchronizeProxies();
+	SynchronizeProxies(float(0.0));
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -401,7 +458,7 @@ void PhysicsBody::SetTransform(const glm::vec3 &position, const glm::vec3 &axis,
 	m_q = glm::angleAxis(angle, axis);
 	m_tx.rotation = glm::mat3_cast(m_q);
 
-	SynchronizeProxies();
+	SynchronizeProxies(float(0.0));
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -512,6 +569,7 @@ void PhysicsBody::Dump(FILE *file, int index) const
 	fprintf(file, "\tbd.lockAxisX = bool( %d );\n", m_flags & eLockAxisX);
 	fprintf(file, "\tbd.lockAxisY = bool( %d );\n", m_flags & eLockAxisY);
 	fprintf(file, "\tbd.lockAxisZ = bool( %d );\n", m_flags & eLockAxisZ);
+	fprintf(file, "\tbd.continuous = bool( %d );\n", m_flags & eContinuous);
 	fprintf(file, "\tbodies[ %d ] = scene.CreateBody( bd );\n\n", index);
 
 	PhysicsBox *box = m_boxes;
@@ -610,19 +668,33 @@ void PhysicsBody::CalculateMassData()
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBody::SynchronizeProxies()
+void PhysicsBody::SynchronizeProxies(float dt)
 {
-	PhysicsBroadPhase *broadphase = &m_scene->m_contactManager.m_broadphase;
+	PhysicsBroadPhase *broadphase = m_scene->m_contactManager.m_broadphase;
 
 	m_tx.position = m_worldCenter - TransformMul(m_tx.rotation, m_localCenter);
 
 	PhysicsAABB aabb;
 	PhysicsTransform tx = m_tx;
 
+	// Sweep along the linear motion, rotation grows the box on all sides
+	glm::vec3 sweep = m_linearVelocity * dt;
+	float angularSpeed = glm::length(m_angularVelocity) * dt;
+	bool continuous = (m_flags & eContinuous) && dt > float(0.0);
+
 	PhysicsBox *box = m_boxes;
 	while (box)
 	{
 		box->ComputeAABB(tx, &aabb);
+
+		if (continuous)
+		{
+			float radius = glm::length(box->e) + glm::length(box->local.position - m_localCenter);
+			glm::vec3 grow(angularSpeed * radius);
+			aabb.min = glm::min(aabb.min, aabb.min + sweep) - grow;
+			aabb.max = glm::max(aabb.max, aabb.max + sweep) + grow;
+		}
+
 		broadphase->Update(box->broadPhaseIndex, aabb);
 		box = box->next;
 	}
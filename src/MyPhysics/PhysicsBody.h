@@ -39,6 +39,7 @@ class PhysicsBoxDef;
 class PhysicsBox;
 class PhysicsBodyDef;
 struct PhysicsContactEdge;
+struct PhysicsPersistentIsland;
 
 enum PhysicsBodyType
 {
@@ -56,6 +57,12 @@ public:
     // will be created until the next q3Scene::Step( ) call.
     const PhysicsBox *AddBox(const PhysicsBoxDef &def);
 
+    // Adds a box to a body created by PhysicsScene::CreateBody(def,
+    // threadIndex) that has not joined the scene yet. Only the thread that
+    // created the body may call this, with its own thread index. The box
+    // enters the broadphase together with the body.
+    const PhysicsBox *AddBox(const PhysicsBoxDef &def, int threadIndex);
+
     // Removes this box from the body and broadphase. Forces the body
     // to recompute its mass if the body is dynamic. Frees the memory
     // pointed to by the box pointer.
@@ -74,6 +81,11 @@ public:
     bool IsAwake() const;
     float GetGravityScale() const;
     void SetGravityScale(float scale);
+
+    // Continuous bodies get speculative contacts, see PhysicsBodyDef::continuous
+    void SetContinuous(bool continuous);
+    bool IsContinuous() const;
+
     const glm::vec3 GetLocalPoint(const glm::vec3 &p) const;
     const glm::vec3 GetLocalVector(const glm::vec3 &v) const;
     const glm::vec3 GetWorldPoint(const glm::vec3 &p) const;
@@ -133,6 +145,8 @@ private:
         eLockAxisX = 0x100,
         eLockAxisY = 0x200,
         eLockAxisZ = 0x400,
+        eContinuous = 0x800,
+        ePending = 0x1000,
     };
 
     glm::mat3 m_invInertiaModel;
@@ -159,6 +173,12 @@ private:
     PhysicsBody *m_prev;
     int m_islandIndex;
 
+    // Persistent island of a non-static body, see PhysicsIslandManager
+    PhysicsPersistentIsland *m_island;
+    PhysicsBody *m_islandPrev;
+    PhysicsBody *m_islandNext;
+    int m_creationIndex;
+
     float m_linearDamping;
     float m_angularDamping;
 
@@ -167,13 +187,22 @@ private:
     friend class PhysicsScene;
     friend struct PhysicsManifold;
     friend class PhysicsContactManager;
+    friend class PhysicsBroadPhase;
+    friend struct PhysicsPairQuery;
     friend struct PhysicsIsland;
     friend struct PhysicsContactSolver;
+    friend class PhysicsIslandManager;
 
     PhysicsBody(const PhysicsBodyDef &def, PhysicsScene *scene);
 
     void CalculateMassData();
-    void SynchronizeProxies();
+
+    // Fills in box from def and adds it to the box list, leaves the mass
+    // data and the broadphase to the caller
+    void LinkBox(PhysicsBox *box, const PhysicsBoxDef &def);
+
+    // Continuous bodies also cover where their boxes will be after dt
+    void SynchronizeProxies(float dt);
 };
 
 class PhysicsBodyDef
@@ -201,6 +230,7 @@ public:
         lockAxisX = false;
         lockAxisY = false;
         lockAxisZ = false;
+        continuous = false;
 
         linearDamping = float(0.0);
         angularDamping = float(0.1);
@@ -231,4 +261,11 @@ public:
     bool lockAxisX;  // Locked rotation on the x axis.
     bool lockAxisY;  // Locked rotation on the y axis.
     bool lockAxisZ;  // Locked rotation on the z axis.
+
+    // Fast moving bodies can pass through thin boxes within one step. Contacts
+    // of continuous bodies are built ahead of time, up to as far apart as the
+    // bodies can close in one step, and the solver only lets them close that
+    // gap. Such contacts are reported to the contact listener before the
+    // boxes touch and restitution only applies once they do.
+    bool continuous;
 };
\ No newline at end of file
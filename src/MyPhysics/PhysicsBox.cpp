@@ -110,6 +110,82 @@ bool PhysicsBox::Raycast( const PhysicsTransform& tx, PhysicsRaycastData* raycas
 	return true;
 }
 
+//--------------------------------------------------------------------------------------------------
+int PhysicsBox::Raycast( const PhysicsTransform& tx, PhysicsRayPacket* packet, int lanes, glm::vec3* normals ) const
+{
+	PhysicsTransform world = TransformMul( tx, local );
+
+	// Bring all four rays into box space, p = R^T * (start - position)
+	PhysicsVec3x4 axis[ 3 ];
+	for ( int i = 0; i < 3; ++i )
+		axis[ i ] = PhysicsSplat3x4( world.rotation[ i ] );
+
+	PhysicsVec3x4 start = PhysicsLoad3x4( packet->startX, packet->startY, packet->startZ ) - PhysicsSplat3x4( world.position );
+	PhysicsVec3x4 dir = PhysicsLoad3x4( packet->dirX, packet->dirY, packet->dirZ );
+
+	PhysicsFloat4 p[ 3 ];
+	PhysicsFloat4 d[ 3 ];
+	for ( int i = 0; i < 3; ++i )
+	{
+		p[ i ] = PhysicsDot4( axis[ i ], start );
+		d[ i ] = PhysicsDot4( axis[ i ], dir );
+	}
+
+	const PhysicsFloat4 epsilon = PhysicsSplat4( float( 1.0e-8 ) );
+	const PhysicsFloat4 huge = PhysicsSplat4( float( 1.0e30 ) );
+	PhysicsFloat4 tEnter = PhysicsSplat4( float( 0.0 ) );
+	PhysicsFloat4 tExit = PhysicsLoad4( packet->t );
+	PhysicsFloat4 tNear[ 3 ];
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		// Rays parallel to the slab get a huge inverse, the slab then either
+		// contains the whole ray or none of it
+		PhysicsFloat4 inv = PhysicsSelect4( PhysicsLess4( PhysicsAbs4( d[ i ] ), epsilon ), huge, PhysicsSplat4( float( 1.0 ) ) / d[ i ] );
+		PhysicsFloat4 ei = PhysicsSplat4( e[ i ] );
+		PhysicsFloat4 t0 = (-ei - p[ i ]) * inv;
+		PhysicsFloat4 t1 = (ei - p[ i ]) * inv;
+
+		tNear[ i ] = PhysicsMin4( t0, t1 );
+		tEnter = PhysicsMax4( tEnter, tNear[ i ] );
+		tExit = PhysicsMin4( tExit, PhysicsMax4( t0, t1 ) );
+	}
+
+	int hits = PhysicsMask4( PhysicsLessEqual4( tEnter, tExit ) ) & lanes;
+
+	if ( !hits )
+		return 0;
+
+	float toi[ 4 ];
+	float nearT[ 3 ][ 4 ];
+	float dirT[ 3 ][ 4 ];
+	PhysicsStore4( toi, tEnter );
+	for ( int i = 0; i < 3; ++i )
+	{
+		PhysicsStore4( nearT[ i ], tNear[ i ] );
+		PhysicsStore4( dirT[ i ], d[ i ] );
+	}
+
+	for ( int lane = 0; lane < 4; ++lane )
+	{
+		if ( !(hits & (1 << lane)) )
+			continue;
+
+		// The slab entered last is the face that was hit
+		int face = 0;
+		for ( int i = 1; i < 3; ++i )
+		{
+			if ( nearT[ i ][ lane ] > nearT[ face ][ lane ] )
+				face = i;
+		}
+
+		packet->t[ lane ] = toi[ lane ];
+		normals[ lane ] = world.rotation[ face ] * -PhysicsSign( dirT[ face ][ lane ] );
+	}
+
+	return hits;
+}
+
 //--------------------------------------------------------------------------------------------------
 void PhysicsBox::ComputeAABB( const PhysicsTransform& tx, PhysicsAABB* aabb ) const
 {
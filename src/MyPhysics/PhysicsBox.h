@@ -55,6 +55,11 @@ public:
 
 	bool TestPoint(const PhysicsTransform &tx, const glm::vec3 &p) const;
 	bool Raycast(const PhysicsTransform &tx, PhysicsRaycastData *raycast) const;
+
+	// Tests the rays of the packet in lanes. Every lane hitting closer than
+	// its current t gets t set to the time of impact and normals[ lane ]
+	// set. Returns the mask of those lanes.
+	int Raycast(const PhysicsTransform &tx, PhysicsRayPacket *packet, int lanes, glm::vec3 *normals) const;
 	void ComputeAABB(const PhysicsTransform &tx, PhysicsAABB *aabb) const;
 	void ComputeMass(PhysicsMassData *md) const;
 
@@ -26,15 +26,22 @@
 
 
 
+
+
 #include "PhysicsBroadPhase.h"
 
 #include "PhysicsBox.h"
+#include "PhysicsBody.h"
 #include "PhysicsContactManager.h"
+#include "PhysicsGridBroadPhase.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsSAPBroadPhase.h"
+#include "PhysicsSettings.h"
+#include "PhysicsTreeBroadPhase.h"
 
 #include "Common.h"
 
-#include <algorithm>
-
+#include <new>
 #include <string.h>
 //--------------------------------------------------------------------------------------------------
 // PhysicsBroadPhase
@@ -45,123 +52,208 @@ PhysicsBroadPhase::PhysicsBroadPhase( PhysicsContactManager *manager )
 
 	m_pairCount = 0;
 	m_pairCapacity = 64;
-	m_pairBuffer = (PhysicsContactPair*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsContactPair ) );
+	m_pairBuffer = (PhysicsPairKey*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsPairKey ) );
+	m_sortBuffer = (PhysicsPairKey*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsPairKey ) );
 
-	m_moveCount = 0;
-	m_moveCapacity = 64;
-	m_moveBuffer = (int*)PhysicsAlloc( m_moveCapacity * sizeof( int ) );
+	m_histograms = NULL;
+	m_histogramCapacity = 0;
+	m_blockCount = 0;
+	m_sortShift = 0;
 }
 
 //--------------------------------------------------------------------------------------------------
 PhysicsBroadPhase::~PhysicsBroadPhase( )
 {
-	PhysicsFree( m_moveBuffer );
+	if ( m_histograms )
+		PhysicsFree( m_histograms );
+
+	PhysicsFree( m_sortBuffer );
 	PhysicsFree( m_pairBuffer );
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBroadPhase::InsertBox( PhysicsBox *box, const PhysicsAABB& aabb )
+PhysicsBroadPhase *PhysicsBroadPhase::Create( PhysicsBroadPhaseType type, PhysicsContactManager *manager )
+{
+	switch ( type )
+	{
+	case eGridBroadPhase:
+		return new (PhysicsAlloc( sizeof( PhysicsGridBroadPhase ) )) PhysicsGridBroadPhase( manager );
+
+	case eSweepAndPruneBroadPhase:
+		return new (PhysicsAlloc( sizeof( PhysicsSAPBroadPhase ) )) PhysicsSAPBroadPhase( manager );
+
+	case eTreeBroadPhase:
+	default:
+		return new (PhysicsAlloc( sizeof( PhysicsTreeBroadPhase ) )) PhysicsTreeBroadPhase( manager );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBroadPhase::Destroy( PhysicsBroadPhase *broadPhase )
 {
-	int id = m_tree.Insert( aabb, box );
-	box->broadPhaseIndex = id;
-	BufferMove( id );
+	broadPhase->~PhysicsBroadPhase( );
+	PhysicsFree( broadPhase );
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBroadPhase::RemoveBox( const PhysicsBox *box )
+void PhysicsBroadPhase::InsertBoxes( PhysicsBox **boxes, const PhysicsAABB *aabbs, int count )
 {
-	m_tree.Remove( box->broadPhaseIndex );
+	for ( int i = 0; i < count; ++i )
+		InsertBox( boxes[ i ], aabbs[ i ] );
 }
 
 //--------------------------------------------------------------------------------------------------
-inline bool ContactPairSort( const PhysicsContactPair& lhs, const PhysicsContactPair& rhs )
+bool PhysicsBroadPhase::IsDynamic( const PhysicsBox *box )
 {
-	if ( lhs.A < rhs.A )
-		return true;
+	return (box->body->m_flags & PhysicsBody::eDynamic) != 0;
+}
 
-	if ( lhs.A == rhs.A )
-		return lhs.B < rhs.B;
+//--------------------------------------------------------------------------------------------------
+bool PhysicsBroadPhase::IsStatic( const PhysicsBox *box )
+{
+	return (box->body->m_flags & PhysicsBody::eStatic) != 0;
+}
 
-	return false;
+//--------------------------------------------------------------------------------------------------
+void PhysicsBroadPhase::Reserve( int, int pairCount )
+{
+	ReservePairs( pairCount );
+	ReserveHistograms( m_manager->m_jobPool->GetThreadCount( ) );
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBroadPhase::UpdatePairs( )
+void PhysicsBroadPhase::ReservePairs( int count )
 {
-	m_pairCount = 0;
+	if ( count <= m_pairCapacity )
+		return;
 
-	// Query the tree with all moving boxs
-	for ( int i = 0; i < m_moveCount; ++i)
-	{
-		m_currentIndex = m_moveBuffer[ i ];
-		PhysicsAABB aabb = m_tree.GetFatAABB( m_currentIndex );
-
-		// @TODO: Use a static and non-static tree and query one against the other.
-		//        This will potentially prevent (gotta think about this more) time
-		//        wasted with queries of static bodies against static bodies, and
-		//        kinematic to kinematic.
-		m_tree.Query( this, aabb );
-	}
+	while ( m_pairCapacity < count )
+		m_pairCapacity *= 2;
 
-	// Reset the move buffer
-	m_moveCount = 0;
+	PhysicsPairKey* oldPairs = m_pairBuffer;
+	m_pairBuffer = (PhysicsPairKey*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsPairKey ) );
+	memcpy( m_pairBuffer, oldPairs, m_pairCount * sizeof( PhysicsPairKey ) );
+	PhysicsFree( oldPairs );
 
+	PhysicsFree( m_sortBuffer );
+	m_sortBuffer = (PhysicsPairKey*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsPairKey ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBroadPhase::PushPair( PhysicsPairKey key )
+{
+	ReservePairs( m_pairCount + 1 );
+	m_pairBuffer[ m_pairCount++ ] = key;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBroadPhase::AddPairs( PhysicsPairKey keyBits )
+{
 	// Sort pairs to expose duplicates
-	std::sort( m_pairBuffer, m_pairBuffer + m_pairCount, ContactPairSort );
+	SortPairs( keyBits );
 
 	// Queue manifolds for solving
+	int i = 0;
+	while ( i < m_pairCount )
 	{
-		int i = 0;
-		while ( i < m_pairCount )
-		{
-			// Add contact to manager
-			PhysicsContactPair* pair = m_pairBuffer + i;
-			PhysicsBox *A = (PhysicsBox*)m_tree.GetUserData( pair->A );
-			PhysicsBox *B = (PhysicsBox*)m_tree.GetUserData( pair->B );
-			m_manager->AddContact( A, B );
+		// Add contact to manager
+		PhysicsPairKey pair = m_pairBuffer[ i ];
+		PhysicsBox *A = (PhysicsBox*)GetUserData( (int)(pair >> 32) );
+		PhysicsBox *B = (PhysicsBox*)GetUserData( (int)(pair & 0xFFFFFFFF) );
+		m_manager->AddContact( A, B );
 
+		++i;
+
+		// Skip duplicate pairs by iterating i until we find a unique pair
+		while ( i < m_pairCount && m_pairBuffer[ i ] == pair )
 			++i;
+	}
 
-			// Skip duplicate pairs by iterating i until we find a unique pair
-			while ( i < m_pairCount )
-			{
-				PhysicsContactPair* potentialDup = m_pairBuffer + i;
+	m_pairCount = 0;
+}
 
-				if ( pair->A != potentialDup->A || pair->B != potentialDup->B )
-					break;
+//--------------------------------------------------------------------------------------------------
+void PhysicsBroadPhase::ReserveHistograms( int blockCount )
+{
+	if ( m_histogramCapacity >= blockCount * 256 )
+		return;
 
-				++i;
-			}
-		}
-	}
+	if ( m_histograms )
+		PhysicsFree( m_histograms );
 
-	m_tree.Validate( );
+	m_histogramCapacity = blockCount * 256;
+	m_histograms = (int*)PhysicsAlloc( m_histogramCapacity * sizeof( int ) );
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBroadPhase::Update( int id, const PhysicsAABB& aabb )
+void PhysicsBroadPhase::SortPairs( PhysicsPairKey keyBits )
 {
-	if ( m_tree.Update( id, aabb ) )
-		BufferMove( id );
+	PhysicsJobPool* jobPool = m_manager->m_jobPool;
+
+	// Small buffers are sorted on the calling thread in a single block
+	m_blockCount = glm::clamp( m_pairCount / Q3_BROADPHASE_SORT_BLOCK, 1, jobPool->GetThreadCount( ) );
+
+	ReserveHistograms( m_blockCount );
+
+	// Least significant digit first, 8 bits per pass
+	for ( m_sortShift = 0; m_sortShift < 64; m_sortShift += 8 )
+	{
+		if ( !((keyBits >> m_sortShift) & 0xFF) )
+			continue;
+
+		jobPool->Run( HistogramJob, this, m_blockCount );
+
+		// Turn counts into scatter offsets, block order keeps the sort stable
+		int offset = 0;
+		for ( int digit = 0; digit < 256; ++digit )
+		{
+			for ( int block = 0; block < m_blockCount; ++block )
+			{
+				int* bucket = m_histograms + block * 256 + digit;
+				int count = *bucket;
+				*bucket = offset;
+				offset += count;
+			}
+		}
+
+		jobPool->Run( ScatterJob, this, m_blockCount );
+
+		PhysicsPairKey* sorted = m_sortBuffer;
+		m_sortBuffer = m_pairBuffer;
+		m_pairBuffer = sorted;
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
-bool PhysicsBroadPhase::TestOverlap( int A, int B ) const
+void PhysicsBroadPhase::HistogramJob( void* param, int index, int threadIndex )
 {
-	return PhysicsAABBtoAABB( m_tree.GetFatAABB( A ), m_tree.GetFatAABB( B ) );
+	PhysicsBroadPhase* broadphase = (PhysicsBroadPhase*)param;
+	int* histogram = broadphase->m_histograms + index * 256;
+	int begin = (int)((long long)broadphase->m_pairCount * index / broadphase->m_blockCount);
+	int end = (int)((long long)broadphase->m_pairCount * (index + 1) / broadphase->m_blockCount);
+	int shift = broadphase->m_sortShift;
+
+	memset( histogram, 0, sizeof( int ) * 256 );
+
+	const PhysicsPairKey* keys = broadphase->m_pairBuffer;
+	for ( int i = begin; i < end; ++i )
+		++histogram[ (keys[ i ] >> shift) & 0xFF ];
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsBroadPhase::BufferMove( int id )
+void PhysicsBroadPhase::ScatterJob( void* param, int index, int threadIndex )
 {
-	if ( m_moveCount == m_moveCapacity )
+	PhysicsBroadPhase* broadphase = (PhysicsBroadPhase*)param;
+	int* offsets = broadphase->m_histograms + index * 256;
+	int begin = (int)((long long)broadphase->m_pairCount * index / broadphase->m_blockCount);
+	int end = (int)((long long)broadphase->m_pairCount * (index + 1) / broadphase->m_blockCount);
+	int shift = broadphase->m_sortShift;
+
+	const PhysicsPairKey* keys = broadphase->m_pairBuffer;
+	PhysicsPairKey* sorted = broadphase->m_sortBuffer;
+	for ( int i = begin; i < end; ++i )
 	{
-		int* oldBuffer = m_moveBuffer;
-		m_moveCapacity *= 2;
-		m_moveBuffer = (int*)PhysicsAlloc( m_moveCapacity * sizeof( int ) );
-		memcpy( m_moveBuffer, oldBuffer, m_moveCount * sizeof( int ) );
-		PhysicsFree( oldBuffer );
+		PhysicsPairKey key = keys[ i ];
+		sorted[ offsets[ (key >> shift) & 0xFF ]++ ] = key;
 	}
-
-	m_moveBuffer[ m_moveCount++ ] = id;
 }
@@ -25,83 +25,145 @@
 //--------------------------------------------------------------------------------------------------
 
 
+
 #pragma once
 
-#include "PhysicsDynamicAABBTree.h"
 #include "PhysicsMemory.h"
-
-#include <string.h>
+#include "PhysicsPairTable.h"
+#include "PhysicsRaycastData.h"
 
 class PhysicsContactManager;
 class PhysicsBox;
-struct PhysicsTransform;
 struct PhysicsAABB;
 
-struct PhysicsContactPair
+// BroadPhaseBenchmark times all three on the same scenes.
+enum PhysicsBroadPhaseType
+{
+	// Dynamic AABB tree, the fastest or close to it everywhere
+	eTreeBroadPhase,
+
+	// Only on par with the tree when the boxes move little relative to each
+	// other, like a resting pile, and several times slower for scene queries
+	// and for boxes flying across the scene. Meant for scenes that rarely
+	// query and mostly settle.
+	eSweepAndPruneBroadPhase,
+
+	// Uniform grid, a little faster than the tree when most boxes are about
+	// the same size
+	eGridBroadPhase
+};
+
+// Receives the proxies found by the broadphase scene queries. Each query
+// only calls the function matching its kind.
+class PhysicsBroadPhaseCallback
 {
-	int A;
-	int B;
+public:
+	virtual ~PhysicsBroadPhaseCallback( )
+	{
+	}
+
+	// AABB and ray queries, returning false ends the query
+	virtual bool TreeCallBack( int )
+	{
+		return true;
+	}
+
+	// Packet queries, lanes is the mask of rays touching the proxy
+	virtual bool TreeCallBack( int, int )
+	{
+		return true;
+	}
+
+	// Closest and any hit ray casts, returns the new end of the ray
+	virtual float RayCastCallBack( int, float t )
+	{
+		return t;
+	}
 };
 
+//--------------------------------------------------------------------------------------------------
+// PhysicsBroadPhase
+//--------------------------------------------------------------------------------------------------
+// Finds pairs of boxes with overlapping fat AABBs. Every backend keeps its
+// own proxies and collects candidate pairs into m_pairBuffer, AddPairs then
+// sorts them, drops duplicates and hands them to the contact manager.
 class PhysicsBroadPhase
 {
 public:
 	PhysicsBroadPhase( PhysicsContactManager *manager );
-	~PhysicsBroadPhase( );
+	virtual ~PhysicsBroadPhase( );
+
+	// Creates and frees the backend selected when constructing the scene
+	static PhysicsBroadPhase *Create( PhysicsBroadPhaseType type, PhysicsContactManager *manager );
+	static void Destroy( PhysicsBroadPhase *broadPhase );
+
+	virtual void InsertBox( PhysicsBox *shape, const PhysicsAABB& aabb ) = 0;
 
-	void InsertBox( PhysicsBox *shape, const PhysicsAABB& aabb );
-	void RemoveBox( const PhysicsBox *shape );
+	// Inserts count boxes with their tight AABBs. Backends that can build
+	// their structure faster in one go override this, the default inserts
+	// the boxes one by one.
+	virtual void InsertBoxes( PhysicsBox **boxes, const PhysicsAABB *aabbs, int count );
+	virtual void RemoveBox( const PhysicsBox *shape ) = 0;
 
 	// Generates the contact list. All previous contacts are returned to the allocator
 	// before generation occurs.
-	void UpdatePairs( void );
+	virtual void UpdatePairs( void ) = 0;
 
-	void Update( int id, const PhysicsAABB& aabb );
+	virtual void Update( int id, const PhysicsAABB& aabb ) = 0;
 
-	bool TestOverlap( int A, int B ) const;
+	// Sizes the buffers UpdatePairs works in for up to proxyCount proxies
+	// and pairCount candidate pairs per call on the current number of job
+	// pool threads. Backends override this to size their own buffers too.
+	virtual void Reserve( int proxyCount, int pairCount );
 
-private:
-	PhysicsContactManager *m_manager;
+	virtual bool TestOverlap( int A, int B ) const = 0;
 
-	PhysicsContactPair* m_pairBuffer;
-	int m_pairCount;
-	int m_pairCapacity;
+	virtual void *GetUserData( int id ) const = 0;
 
-	int* m_moveBuffer;
-	int m_moveCount;
-	int m_moveCapacity;
+	// Runs cb->TreeCallBack( proxyId ) for every proxy overlapping the
+	// query. Scene queries use these.
+	virtual void Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const = 0;
+	virtual void Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const = 0;
 
-	PhysicsDynamicAABBTree m_tree;
-	int m_currentIndex;
+	// Packet version, calls cb->TreeCallBack( proxyId, lanes )
+	virtual void Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const = 0;
 
-	void BufferMove( int id );
-	bool TreeCallBack( int index );
+	// Closest and any hit ray cast, calls t = cb->RayCastCallBack( proxyId, t )
+	// like PhysicsDynamicAABBTree::RayCast. Returns the final end of the ray.
+	virtual float RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const = 0;
 
-	friend class PhysicsDynamicAABBTree;
-	friend class PhysicsScene;
-};
+	// Only pairs with at least one dynamic box are reported
+	static bool IsDynamic( const PhysicsBox *box );
+	static bool IsStatic( const PhysicsBox *box );
 
-inline bool PhysicsBroadPhase::TreeCallBack( int index )
-{
-	// Cannot collide with self
-	if ( index == m_currentIndex )
-		return true;
+protected:
+	// Grows the pair buffer to hold count pairs, keeps the pairs in it
+	void ReservePairs( int count );
+	void PushPair( PhysicsPairKey key );
 
-	if ( m_pairCount == m_pairCapacity )
-	{
-		PhysicsContactPair* oldBuffer = m_pairBuffer;
-		m_pairCapacity *= 2;
-		m_pairBuffer = (PhysicsContactPair*)PhysicsAlloc( m_pairCapacity * sizeof( PhysicsContactPair ) );
-		memcpy( m_pairBuffer, oldBuffer, m_pairCount * sizeof( PhysicsContactPair ) );
-		PhysicsFree( oldBuffer );
-	}
+	// Sorts the pair buffer, adds a contact for every unique pair and
+	// empties the buffer. Only bits set in keyBits are sorted on, bits
+	// that are the same in every key do not affect the order.
+	void AddPairs( PhysicsPairKey keyBits );
 
-	int iA = glm::min( index, m_currentIndex );
-	int iB = glm::max( index, m_currentIndex );
+	PhysicsContactManager *m_manager;
 
-	m_pairBuffer[ m_pairCount ].A = iA;
-	m_pairBuffer[ m_pairCount ].B = iB;
-	++m_pairCount;
+	// Pairs found by the backend, m_sortBuffer is the radix sort scratch
+	PhysicsPairKey* m_pairBuffer;
+	PhysicsPairKey* m_sortBuffer;
+	int m_pairCount;
+	int m_pairCapacity;
 
-	return true;
-}
\ No newline at end of file
+private:
+	void ReserveHistograms( int blockCount );
+	void SortPairs( PhysicsPairKey keyBits );
+
+	static void HistogramJob( void* param, int index, int threadIndex );
+	static void ScatterJob( void* param, int index, int threadIndex );
+
+	// Radix sort state shared with the sort jobs
+	int* m_histograms;
+	int m_histogramCapacity;
+	int m_blockCount;
+	int m_sortShift;
+};
@@ -29,13 +29,15 @@
 
 #include "PhysicsBody.h"
 #include "PhysicsContact.h"
+#include "PhysicsSimd.h"
 
 //--------------------------------------------------------------------------------------------------
 // qBoxtoBox
 //--------------------------------------------------------------------------------------------------
-inline bool PhysicsTrackFaceAxis( int* axis, int n, float s, float* sMax, const glm::vec3& normal, glm::vec3* axisNormal )
+// Both return true when the axis separates the boxes by more than margin
+inline bool PhysicsTrackFaceAxis( int* axis, int n, float s, float* sMax, const glm::vec3& normal, glm::vec3* axisNormal, float margin )
 {
-	if ( s > float( 0.0 ) )
+	if ( s > margin )
 		return true;
 
 	if ( s > *sMax )
@@ -49,14 +51,14 @@ inline bool PhysicsTrackFaceAxis( int* axis, int n, float s, float* sMax, const
 }
 
 //--------------------------------------------------------------------------------------------------
-inline bool PhysicsTrackEdgeAxis( int* axis, int n, float s, float* sMax, const glm::vec3& normal, glm::vec3* axisNormal )
+inline bool PhysicsTrackEdgeAxis( int* axis, int n, float s, float* sMax, const glm::vec3& normal, glm::vec3* axisNormal, float margin )
 {
-	if ( s > float( 0.0 ) )
-		return true;
-
 	float l = float( 1.0 ) / glm::length( normal );
 	s *= l;
 
+	if ( s > margin )
+		return true;
+
 	if ( s > *sMax )
 	{
 		*sMax = s;
@@ -349,7 +351,7 @@ int PhysicsOrthographic( float sign, float e, int axis, int clipEdge, PhysicsCli
 //--------------------------------------------------------------------------------------------------
 // Resources (also see PhysicsBoxtoBox's resources):
 // http://www.randygaul.net/2013/10/27/sutherland-hodgman-clipping/
-int PhysicsClip( const glm::vec3& rPos, const glm::vec3& e, unsigned char* clipEdges, const glm::mat3& basis, PhysicsClipVertex* incident, PhysicsClipVertex* outVerts, float* outDepths )
+int PhysicsClip( const glm::vec3& rPos, const glm::vec3& e, unsigned char* clipEdges, const glm::mat3& basis, PhysicsClipVertex* incident, PhysicsClipVertex* outVerts, float* outDepths, float maxDepth )
 {
 	int inCount = 4;
 	int outCount;
@@ -376,13 +378,14 @@ int PhysicsClip( const glm::vec3& rPos, const glm::vec3& e, unsigned char* clipE
 
 	inCount = PhysicsOrthographic( float( -1.0 ), e.y, 1, clipEdges[ 3 ], out, outCount, in );
 
-	// Keep incident vertices behind the reference face
+	// Keep incident vertices behind the reference face, or at most maxDepth
+	// in front of it for speculative contacts
 	outCount = 0;
 	for ( int i = 0; i < inCount; ++i )
 	{
 		float d = in[ i ].v.z - e.z;
 
-		if ( d <= float( 0.0 ) )
+		if ( d <= maxDepth )
 		{
 			outVerts[ outCount ].v = TransformMul( basis, in[ i ].v ) + rPos;
 			outVerts[ outCount ].f = in[ i ].f;
@@ -395,6 +398,102 @@ int PhysicsClip( const glm::vec3& rPos, const glm::vec3& e, unsigned char* clipE
 	return outCount;
 }
 
+//--------------------------------------------------------------------------------------------------
+// Keeps the deepest point, the point farthest from it and the points
+// farthest to either side of the line through both. Surviving points keep
+// their feature pairs and their clipping order, so warm starting still
+// finds them by key. n is the reference face normal.
+int PhysicsReduceContacts( const glm::vec3& n, PhysicsClipVertex* verts, float* depths, int count )
+{
+	if ( count <= Q3_MAX_MANIFOLD_CONTACTS )
+		return count;
+
+	// Deepest point, depths are negative
+	int i0 = 0;
+	for ( int i = 1; i < count; ++i )
+	{
+		if ( depths[ i ] < depths[ i0 ] )
+			i0 = i;
+	}
+
+	// Farthest point from the deepest one
+	glm::vec3 p0 = verts[ i0 ].v;
+	int i1 = -1;
+	float maxDistance = -Q3_R32_MAX;
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( i == i0 )
+			continue;
+
+		glm::vec3 d = verts[ i ].v - p0;
+		float distance = glm::dot( d, d );
+
+		if ( distance > maxDistance )
+		{
+			maxDistance = distance;
+			i1 = i;
+		}
+	}
+
+	// Largest triangle areas on both sides of the edge p0 p1
+	glm::vec3 edge = verts[ i1 ].v - p0;
+	int i2 = -1;
+	int i3 = -1;
+	float maxArea = float( 0.0 );
+	float minArea = float( 0.0 );
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( i == i0 || i == i1 )
+			continue;
+
+		float area = glm::dot( glm::cross( edge, verts[ i ].v - p0 ), n );
+
+		if ( i2 < 0 || area > maxArea )
+		{
+			maxArea = area;
+			i2 = i;
+		}
+
+		if ( area < minArea )
+		{
+			minArea = area;
+			i3 = i;
+		}
+	}
+
+	// All remaining points on one side, take the second largest triangle
+	if ( i3 < 0 )
+	{
+		for ( int i = 0; i < count; ++i )
+		{
+			if ( i == i0 || i == i1 || i == i2 )
+				continue;
+
+			float area = glm::dot( glm::cross( edge, verts[ i ].v - p0 ), n );
+
+			if ( i3 < 0 || area > minArea )
+			{
+				minArea = area;
+				i3 = i;
+			}
+		}
+	}
+
+	int outCount = 0;
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( i != i0 && i != i1 && i != i2 && i != i3 )
+			continue;
+
+		verts[ outCount ] = verts[ i ];
+		depths[ outCount++ ] = depths[ i ];
+	}
+
+	assert( outCount == Q3_MAX_MANIFOLD_CONTACTS );
+
+	return outCount;
+}
+
 //--------------------------------------------------------------------------------------------------
 inline void PhysicsEdgesContact( glm::vec3 *CA, glm::vec3 *CB, const glm::vec3& PA, const glm::vec3& QA, const glm::vec3& PB, const glm::vec3& QB )
 {
@@ -475,184 +574,56 @@ void PhysicsSupportEdge( const PhysicsTransform& tx, const glm::vec3& e, glm::ve
 }
 
 //--------------------------------------------------------------------------------------------------
-// Resources:
-// http://www.randygaul.net/2014/05/22/deriving-obb-to-obb-intersection-sat/
-// https://box2d.googlecode.com/files/GDC2007_ErinCatto.zip
-// https://box2d.googlecode.com/files/Box2D_Lite.zip
-void PhysicsBoxtoBox( PhysicsManifold* m, PhysicsBox* a, PhysicsBox* b )
+// Best axis of each kind found by the separating axis test of two boxes that
+// overlap. Edge normals are in A's space, face normals in world space.
+struct PhysicsBoxAxes
 {
-	PhysicsTransform atx = a->body->GetTransform( );
-	PhysicsTransform btx = b->body->GetTransform( );
-	PhysicsTransform aL = a->local;
-	PhysicsTransform bL = b->local;
-	atx = TransformMul( atx, aL );
-	btx = TransformMul( btx, bL );
-	glm::vec3 eA = a->e;
-	glm::vec3 eB = b->e;
-
-	// B's frame in A's space
-	glm::mat3 C = glm::transpose( atx.rotation ) * btx.rotation;
-
-	glm::mat3 absC;
-	bool parallel = false;
-	const float kCosTol = float( 1.0e-6 );
-	for ( int i = 0; i < 3; ++i )
-	{
-		for ( int j = 0; j < 3; ++j )
-		{
-			float val = Abs( C[ i ][ j ] );
-			absC[ i ][ j ] = val;
-
-			if ( val + kCosTol >= float( 1.0 ) )
-				parallel = true;
-		}
-	}
-
-	// Vector from center A to center B in A's space
-	glm::vec3 t = TransformMulTranspose( atx.rotation, btx.position - atx.position );
-
-	// Query states
-	float s;
-	float aMax = -Q3_R32_MAX;
-	float bMax = -Q3_R32_MAX;
-	float eMax = -Q3_R32_MAX;
-	int aAxis = ~0;
-	int bAxis = ~0;
-	int eAxis = ~0;
+	float aMax;
+	float bMax;
+	float eMax;
+	int aAxis;
+	int bAxis;
+	int eAxis;
 	glm::vec3 nA;
 	glm::vec3 nB;
 	glm::vec3 nE;
+};
 
-	// Face axis checks
-
-	// a's x axis
-	s = Abs( t.x ) - (eA.x + glm::dot( glm::vec3(absC[0][0], absC[1][0], absC[2][0]), eB ));
-	if ( PhysicsTrackFaceAxis( &aAxis, 0, s, &aMax, atx.rotation[0], &nA ) )
-		return;
-
-	// a's y axis
-	s = Abs( t.y ) - (eA.y + glm::dot( glm::vec3(absC[0][1], absC[1][1], absC[2][1]), eB ));
-	if ( PhysicsTrackFaceAxis( &aAxis, 1, s, &aMax, atx.rotation[1], &nA ) )
-		return;
-
-	// a's z axis
-	s = Abs( t.z ) - (eA.z + glm::dot( glm::vec3(absC[0][2], absC[1][2], absC[2][2]), eB ));
-	if ( PhysicsTrackFaceAxis( &aAxis, 2, s, &aMax, atx.rotation[2], &nA ) )
-		return;
-
-	// b's x axis
-	s = Abs( glm::dot( t, C[0] ) ) - (eB.x + glm::dot( absC[0], eA ));
-	if ( PhysicsTrackFaceAxis( &bAxis, 3, s, &bMax, btx.rotation[0], &nB ) )
-		return;
-
-	// b's y axis
-	s = Abs( glm::dot( t, C[1] ) ) - (eB.y + glm::dot( absC[1], eA ));
-	if ( PhysicsTrackFaceAxis( &bAxis, 4, s, &bMax, btx.rotation[1], &nB ) )
-		return;
-
-	// b's z axis
-	s = Abs( glm::dot( t, C[2] ) ) - (eB.z + glm::dot( absC[2], eA ));
-	if ( PhysicsTrackFaceAxis( &bAxis, 5, s, &bMax, btx.rotation[2], &nB ) )
-		return;
-
-	if ( !parallel )
-	{
-		// Edge axis checks
-		float rA;
-		float rB;
-
-		// Cross( a.x, b.x )
-		rA = eA.y * absC[ 0 ][ 2 ] + eA.z * absC[ 0 ][ 1 ];
-		rB = eB.y * absC[ 2 ][ 0 ] + eB.z * absC[ 1 ][ 0 ];
-		s = Abs( t.z * C[ 0 ][ 1 ] - t.y * C[ 0 ][ 2 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 6, s, &eMax, glm::vec3( float( 0.0 ), -C[ 0 ][ 2 ], C[ 0 ][ 1 ] ), &nE ) )
-			return;
-
-		// Cross( a.x, b.y )
-		rA = eA.y * absC[ 1 ][ 2 ] + eA.z * absC[ 1 ][ 1 ];
-		rB = eB.x * absC[ 2 ][ 0 ] + eB.z * absC[ 0 ][ 0 ];
-		s = Abs( t.z * C[ 1 ][ 1 ] - t.y * C[ 1 ][ 2 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 7, s, &eMax, glm::vec3( float( 0.0 ), -C[ 1 ][ 2 ], C[ 1 ][ 1 ] ), &nE ) )
-			return;
-
-		// Cross( a.x, b.z )
-		rA = eA.y * absC[ 2 ][ 2 ] + eA.z * absC[ 2 ][ 1 ];
-		rB = eB.x * absC[ 1 ][ 0 ] + eB.y * absC[ 0 ][ 0 ];
-		s = Abs( t.z * C[ 2 ][ 1 ] - t.y * C[ 2 ][ 2 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 8, s, &eMax, glm::vec3( float( 0.0 ), -C[ 2 ][ 2 ], C[ 2 ][ 1 ] ), &nE ) )
-			return;
-
-		// Cross( a.y, b.x )
-		rA = eA.x * absC[ 0 ][ 2 ] + eA.z * absC[ 0 ][ 0 ];
-		rB = eB.y * absC[ 2 ][ 1 ] + eB.z * absC[ 1 ][ 1 ];
-		s = Abs( t.x * C[ 0 ][ 2 ] - t.z * C[ 0 ][ 0 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 9, s, &eMax, glm::vec3( C[ 0 ][ 2 ], float( 0.0 ), -C[ 0 ][ 0 ] ), &nE ) )
-			return;
-
-		// Cross( a.y, b.y )
-		rA = eA.x * absC[ 1 ][ 2 ] + eA.z * absC[ 1 ][ 0 ];
-		rB = eB.x * absC[ 2 ][ 1 ] + eB.z * absC[ 0 ][ 1 ];
-		s = Abs( t.x * C[ 1 ][ 2 ] - t.z * C[ 1 ][ 0 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 10, s, &eMax, glm::vec3( C[ 1 ][ 2 ], float( 0.0 ), -C[ 1 ][ 0 ] ), &nE ) )
-			return;
-
-		// Cross( a.y, b.z )
-		rA = eA.x * absC[ 2 ][ 2 ] + eA.z * absC[ 2 ][ 0 ];
-		rB = eB.x * absC[ 1 ][ 1 ] + eB.y * absC[ 0 ][ 1 ];
-		s = Abs( t.x * C[ 2 ][ 2 ] - t.z * C[ 2 ][ 0 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 11, s, &eMax, glm::vec3( C[ 2 ][ 2 ], float( 0.0 ), -C[ 2 ][ 0 ] ), &nE ) )
-			return;
-
-		// Cross( a.z, b.x )
-		rA = eA.x * absC[ 0 ][ 1 ] + eA.y * absC[ 0 ][ 0 ];
-		rB = eB.y * absC[ 2 ][ 2 ] + eB.z * absC[ 1 ][ 2 ];
-		s = Abs( t.y * C[ 0 ][ 0 ] - t.x * C[ 0 ][ 1 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 12, s, &eMax, glm::vec3( -C[ 0 ][ 1 ], C[ 0 ][ 0 ], float( 0.0 ) ), &nE ) )
-			return;
-
-		// Cross( a.z, b.y )
-		rA = eA.x * absC[ 1 ][ 1 ] + eA.y * absC[ 1 ][ 0 ];
-		rB = eB.x * absC[ 2 ][ 2 ] + eB.z * absC[ 0 ][ 2 ];
-		s = Abs( t.y * C[ 1 ][ 0 ] - t.x * C[ 1 ][ 1 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 13, s, &eMax, glm::vec3( -C[ 1 ][ 1 ], C[ 1 ][ 0 ], float( 0.0 ) ), &nE ) )
-			return;
-
-		// Cross( a.z, b.z )
-		rA = eA.x * absC[ 2 ][ 1 ] + eA.y * absC[ 2 ][ 0 ];
-		rB = eB.x * absC[ 1 ][ 2 ] + eB.y * absC[ 0 ][ 2 ];
-		s = Abs( t.y * C[ 2 ][ 0 ] - t.x * C[ 2 ][ 1 ] ) - (rA + rB);
-		if ( PhysicsTrackEdgeAxis( &eAxis, 14, s, &eMax, glm::vec3( -C[ 2 ][ 1 ], C[ 2 ][ 0 ], float( 0.0 ) ), &nE ) )
-			return;
-	}
-
+//--------------------------------------------------------------------------------------------------
+// Picks the contact axis and builds the manifold, either by clipping the
+// incident face against the reference face or from the closest points of
+// two edges. Contacts up to the speculative distance of the manifold apart
+// are kept with a positive penetration.
+static void PhysicsBoxContacts( PhysicsManifold* m, const PhysicsTransform& atx, const PhysicsTransform& btx, const glm::vec3& eA, const glm::vec3& eB, const PhysicsBoxAxes& axes )
+{
 	// Artificial axis bias to improve frame coherence
 	const float kRelTol = float( 0.95 );
 	const float kAbsTol = float( 0.01 );
 	int axis;
 	float sMax;
 	glm::vec3 n;
-	float faceMax = glm::max( aMax, bMax );
-	if ( kRelTol * eMax > faceMax + kAbsTol )
+	float faceMax = glm::max( axes.aMax, axes.bMax );
+	if ( kRelTol * axes.eMax > faceMax + kAbsTol )
 	{
-		axis = eAxis;
-		sMax = eMax;
-		n = nE;
+		axis = axes.eAxis;
+		sMax = axes.eMax;
+		n = axes.nE;
 	}
 
 	else
 	{
-		if ( kRelTol * bMax > aMax + kAbsTol )
+		if ( kRelTol * axes.bMax > axes.aMax + kAbsTol )
 		{
-			axis = bAxis;
-			sMax = bMax;
-			n = nB;
+			axis = axes.bAxis;
+			sMax = axes.bMax;
+			n = axes.nB;
 		}
 
 		else
 		{
-			axis = aAxis;
-			sMax = aMax;
-			n = nA;
+			axis = axes.aAxis;
+			sMax = axes.aMax;
+			n = axes.nA;
 		}
 	}
 
@@ -701,7 +672,8 @@ void PhysicsBoxtoBox( PhysicsManifold* m, PhysicsBox* a, PhysicsBox* b )
 		PhysicsClipVertex out[ 8 ];
 		float depths[ 8 ];
 		int outNum;
-		outNum = PhysicsClip( rtx.position, e, clipEdges, basis, incident, out, depths );
+		outNum = PhysicsClip( rtx.position, e, clipEdges, basis, incident, out, depths, m->speculativeDistance );
+		outNum = PhysicsReduceContacts( n, out, depths, outNum );
 
 		if ( outNum )
 		{
@@ -753,3 +725,546 @@ void PhysicsBoxtoBox( PhysicsManifold* m, PhysicsBox* a, PhysicsBox* b )
 		c->position = (CA + CB) * float( 0.5 );
 	}
 }
+
+//--------------------------------------------------------------------------------------------------
+// C is B's frame in A's space and t the vector from center A to center B in
+// A's space. Parallel is set when any axis of A is parallel to one of B.
+static void PhysicsBoxRelativeFrame( const PhysicsTransform& atx, const PhysicsTransform& btx, glm::mat3* C, glm::mat3* absC, bool* parallel, glm::vec3* t )
+{
+	*C = glm::transpose( atx.rotation ) * btx.rotation;
+	*parallel = false;
+
+	const float kCosTol = float( 1.0e-6 );
+	for ( int i = 0; i < 3; ++i )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			float val = Abs( (*C)[ i ][ j ] );
+			(*absC)[ i ][ j ] = val;
+
+			if ( val + kCosTol >= float( 1.0 ) )
+				*parallel = true;
+		}
+	}
+
+	*t = TransformMulTranspose( atx.rotation, btx.position - atx.position );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unnormalized edge axis normal in A's space, C is B's frame in A's space
+static glm::vec3 PhysicsEdgeNormal( const glm::mat3& C, int axis )
+{
+	switch ( axis )
+	{
+	case 6: return glm::vec3( float( 0.0 ), -C[ 0 ][ 2 ], C[ 0 ][ 1 ] );
+	case 7: return glm::vec3( float( 0.0 ), -C[ 1 ][ 2 ], C[ 1 ][ 1 ] );
+	case 8: return glm::vec3( float( 0.0 ), -C[ 2 ][ 2 ], C[ 2 ][ 1 ] );
+	case 9: return glm::vec3( C[ 0 ][ 2 ], float( 0.0 ), -C[ 0 ][ 0 ] );
+	case 10: return glm::vec3( C[ 1 ][ 2 ], float( 0.0 ), -C[ 1 ][ 0 ] );
+	case 11: return glm::vec3( C[ 2 ][ 2 ], float( 0.0 ), -C[ 2 ][ 0 ] );
+	case 12: return glm::vec3( -C[ 0 ][ 1 ], C[ 0 ][ 0 ], float( 0.0 ) );
+	case 13: return glm::vec3( -C[ 1 ][ 1 ], C[ 1 ][ 0 ], float( 0.0 ) );
+	default: return glm::vec3( -C[ 2 ][ 1 ], C[ 2 ][ 0 ], float( 0.0 ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+// Separation of the boxes along one of the 15 axes, axes 0-2 are the faces
+// of A, 3-5 the faces of B and 6-14 Cross( a[ i ], b[ j ] ) at 6 + 3 * i + j.
+// Positive when the axis separates the boxes, edge axes are not normalized.
+static float PhysicsBoxAxisSeparation( int axis, const glm::mat3& C, const glm::mat3& absC, const glm::vec3& t, const glm::vec3& eA, const glm::vec3& eB )
+{
+	float rA;
+	float rB;
+
+	switch ( axis )
+	{
+	case 0:
+	case 1:
+	case 2:
+		return Abs( t[ axis ] ) - (eA[ axis ] + glm::dot( glm::vec3( absC[ 0 ][ axis ], absC[ 1 ][ axis ], absC[ 2 ][ axis ] ), eB ));
+
+	case 3:
+	case 4:
+	case 5:
+		return Abs( glm::dot( t, C[ axis - 3 ] ) ) - (eB[ axis - 3 ] + glm::dot( absC[ axis - 3 ], eA ));
+
+	// Cross( a.x, b.x )
+	case 6:
+		rA = eA.y * absC[ 0 ][ 2 ] + eA.z * absC[ 0 ][ 1 ];
+		rB = eB.y * absC[ 2 ][ 0 ] + eB.z * absC[ 1 ][ 0 ];
+		return Abs( t.z * C[ 0 ][ 1 ] - t.y * C[ 0 ][ 2 ] ) - (rA + rB);
+
+	// Cross( a.x, b.y )
+	case 7:
+		rA = eA.y * absC[ 1 ][ 2 ] + eA.z * absC[ 1 ][ 1 ];
+		rB = eB.x * absC[ 2 ][ 0 ] + eB.z * absC[ 0 ][ 0 ];
+		return Abs( t.z * C[ 1 ][ 1 ] - t.y * C[ 1 ][ 2 ] ) - (rA + rB);
+
+	// Cross( a.x, b.z )
+	case 8:
+		rA = eA.y * absC[ 2 ][ 2 ] + eA.z * absC[ 2 ][ 1 ];
+		rB = eB.x * absC[ 1 ][ 0 ] + eB.y * absC[ 0 ][ 0 ];
+		return Abs( t.z * C[ 2 ][ 1 ] - t.y * C[ 2 ][ 2 ] ) - (rA + rB);
+
+	// Cross( a.y, b.x )
+	case 9:
+		rA = eA.x * absC[ 0 ][ 2 ] + eA.z * absC[ 0 ][ 0 ];
+		rB = eB.y * absC[ 2 ][ 1 ] + eB.z * absC[ 1 ][ 1 ];
+		return Abs( t.x * C[ 0 ][ 2 ] - t.z * C[ 0 ][ 0 ] ) - (rA + rB);
+
+	// Cross( a.y, b.y )
+	case 10:
+		rA = eA.x * absC[ 1 ][ 2 ] + eA.z * absC[ 1 ][ 0 ];
+		rB = eB.x * absC[ 2 ][ 1 ] + eB.z * absC[ 0 ][ 1 ];
+		return Abs( t.x * C[ 1 ][ 2 ] - t.z * C[ 1 ][ 0 ] ) - (rA + rB);
+
+	// Cross( a.y, b.z )
+	case 11:
+		rA = eA.x * absC[ 2 ][ 2 ] + eA.z * absC[ 2 ][ 0 ];
+		rB = eB.x * absC[ 1 ][ 1 ] + eB.y * absC[ 0 ][ 1 ];
+		return Abs( t.x * C[ 2 ][ 2 ] - t.z * C[ 2 ][ 0 ] ) - (rA + rB);
+
+	// Cross( a.z, b.x )
+	case 12:
+		rA = eA.x * absC[ 0 ][ 1 ] + eA.y * absC[ 0 ][ 0 ];
+		rB = eB.y * absC[ 2 ][ 2 ] + eB.z * absC[ 1 ][ 2 ];
+		return Abs( t.y * C[ 0 ][ 0 ] - t.x * C[ 0 ][ 1 ] ) - (rA + rB);
+
+	// Cross( a.z, b.y )
+	case 13:
+		rA = eA.x * absC[ 1 ][ 1 ] + eA.y * absC[ 1 ][ 0 ];
+		rB = eB.x * absC[ 2 ][ 2 ] + eB.z * absC[ 0 ][ 2 ];
+		return Abs( t.y * C[ 1 ][ 0 ] - t.x * C[ 1 ][ 1 ] ) - (rA + rB);
+
+	// Cross( a.z, b.z )
+	default:
+		rA = eA.x * absC[ 2 ][ 1 ] + eA.y * absC[ 2 ][ 0 ];
+		rB = eB.x * absC[ 1 ][ 2 ] + eB.y * absC[ 0 ][ 2 ];
+		return Abs( t.y * C[ 2 ][ 0 ] - t.x * C[ 2 ][ 1 ] ) - (rA + rB);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+// Returns true when the axis that separated the pair at its last test still
+// separates it, which is what the full test would find as well
+static bool PhysicsBoxTestCache( const PhysicsManifold* m, const glm::mat3& C, const glm::mat3& absC, bool parallel, const glm::vec3& t, const glm::vec3& eA, const glm::vec3& eB )
+{
+	int axis = m->separatingAxis;
+	float margin = m->speculativeDistance;
+
+	// The full test skips edge axes of parallel boxes, so does the cache
+	if ( axis == ~0 || (axis >= 6 && parallel) )
+		return false;
+
+	float s = PhysicsBoxAxisSeparation( axis, C, absC, t, eA, eB );
+
+	if ( axis >= 6 && margin > float( 0.0 ) )
+		s /= glm::length( PhysicsEdgeNormal( C, axis ) );
+
+	return s > margin;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Full separating axis test of one pair, C, absC, parallel and t as given by
+// PhysicsBoxRelativeFrame
+static void PhysicsBoxtoBoxFull( PhysicsManifold* m, const PhysicsTransform& atx, const PhysicsTransform& btx, const glm::vec3& eA, const glm::vec3& eB, const glm::mat3& C, const glm::mat3& absC, bool parallel, const glm::vec3& t )
+{
+	float margin = m->speculativeDistance;
+	m->contactCount = 0;
+
+	// Query states
+	float s;
+	float aMax = -Q3_R32_MAX;
+	float bMax = -Q3_R32_MAX;
+	float eMax = -Q3_R32_MAX;
+	int aAxis = ~0;
+	int bAxis = ~0;
+	int eAxis = ~0;
+	glm::vec3 nA;
+	glm::vec3 nB;
+	glm::vec3 nE;
+
+	// Face axis checks
+	for ( int i = 0; i < 3; ++i )
+	{
+		s = PhysicsBoxAxisSeparation( i, C, absC, t, eA, eB );
+		if ( PhysicsTrackFaceAxis( &aAxis, i, s, &aMax, atx.rotation[ i ], &nA, margin ) )
+		{
+			m->separatingAxis = i;
+			return;
+		}
+	}
+
+	for ( int i = 3; i < 6; ++i )
+	{
+		s = PhysicsBoxAxisSeparation( i, C, absC, t, eA, eB );
+		if ( PhysicsTrackFaceAxis( &bAxis, i, s, &bMax, btx.rotation[ i - 3 ], &nB, margin ) )
+		{
+			m->separatingAxis = i;
+			return;
+		}
+	}
+
+	// Edge axis checks
+	if ( !parallel )
+	{
+		for ( int i = 6; i < 15; ++i )
+		{
+			s = PhysicsBoxAxisSeparation( i, C, absC, t, eA, eB );
+			if ( PhysicsTrackEdgeAxis( &eAxis, i, s, &eMax, PhysicsEdgeNormal( C, i ), &nE, margin ) )
+			{
+				m->separatingAxis = i;
+				return;
+			}
+		}
+	}
+
+	PhysicsBoxAxes axes = { aMax, bMax, eMax, aAxis, bAxis, eAxis, nA, nB, nE };
+	m->separatingAxis = ~0;
+	PhysicsBoxContacts( m, atx, btx, eA, eB, axes );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Resources:
+// http://www.randygaul.net/2014/05/22/deriving-obb-to-obb-intersection-sat/
+// https://box2d.googlecode.com/files/GDC2007_ErinCatto.zip
+// https://box2d.googlecode.com/files/Box2D_Lite.zip
+void PhysicsBoxtoBox( PhysicsManifold* m, PhysicsBox* a, PhysicsBox* b )
+{
+	PhysicsTransform atx = a->body->GetTransform( );
+	PhysicsTransform btx = b->body->GetTransform( );
+	PhysicsTransform aL = a->local;
+	PhysicsTransform bL = b->local;
+	atx = TransformMul( atx, aL );
+	btx = TransformMul( btx, bL );
+	glm::vec3 eA = a->e;
+	glm::vec3 eB = b->e;
+
+	glm::mat3 C;
+	glm::mat3 absC;
+	bool parallel;
+	glm::vec3 t;
+	PhysicsBoxRelativeFrame( atx, btx, &C, &absC, &parallel, &t );
+
+	if ( PhysicsBoxTestCache( m, C, absC, parallel, t, eA, eB ) )
+		return;
+
+	PhysicsBoxtoBoxFull( m, atx, btx, eA, eB, C, absC, parallel, t );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Running state of the batched separating axis test, one lane per pair
+struct PhysicsBoxQuery4
+{
+	PhysicsFloat4 separatingAxis;	// First separating axis or -1
+	PhysicsFloat4 aMax;
+	PhysicsFloat4 bMax;
+	PhysicsFloat4 eMax;
+	PhysicsFloat4 aAxis;
+	PhysicsFloat4 bAxis;
+	PhysicsFloat4 eAxis;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Same rules as PhysicsTrackFaceAxis, except that the test goes on for
+// separated lanes, their results are thrown away at the end
+inline void PhysicsTrackFaceAxis4( PhysicsFloat4* axis, int n, PhysicsFloat4 s, PhysicsFloat4* sMax, PhysicsFloat4* separatingAxis )
+{
+	PhysicsFloat4 zero = PhysicsSplat4( float( 0.0 ) );
+	PhysicsFloat4 first = PhysicsAnd4( PhysicsLess4( zero, s ), PhysicsLess4( *separatingAxis, zero ) );
+	*separatingAxis = PhysicsSelect4( first, PhysicsSplat4( float( n ) ), *separatingAxis );
+	PhysicsFloat4 greater = PhysicsLess4( *sMax, s );
+	*sMax = PhysicsSelect4( greater, s, *sMax );
+	*axis = PhysicsSelect4( greater, PhysicsSplat4( float( n ) ), *axis );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Lanes outside of the edges mask hold parallel boxes, the scalar test skips
+// their edge axes entirely
+inline void PhysicsTrackEdgeAxis4( PhysicsFloat4* axis, int n, PhysicsFloat4 s, PhysicsFloat4* sMax, const PhysicsVec3x4& normal, PhysicsFloat4 edges, PhysicsFloat4* separatingAxis )
+{
+	PhysicsFloat4 zero = PhysicsSplat4( float( 0.0 ) );
+	PhysicsFloat4 first = PhysicsAnd4( edges, PhysicsAnd4( PhysicsLess4( zero, s ), PhysicsLess4( *separatingAxis, zero ) ) );
+	*separatingAxis = PhysicsSelect4( first, PhysicsSplat4( float( n ) ), *separatingAxis );
+	s = s * (PhysicsSplat4( float( 1.0 ) ) / PhysicsSqrt4( PhysicsDot4( normal, normal ) ));
+	PhysicsFloat4 greater = PhysicsAnd4( edges, PhysicsLess4( *sMax, s ) );
+	*sMax = PhysicsSelect4( greater, s, *sMax );
+	*axis = PhysicsSelect4( greater, PhysicsSplat4( float( n ) ), *axis );
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 PhysicsEdgeNormal4( PhysicsFloat4 x, PhysicsFloat4 y, PhysicsFloat4 z )
+{
+	PhysicsVec3x4 r;
+	r.x = x;
+	r.y = y;
+	r.z = z;
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Four pairs go through the face and edge axis tests side by side in SoA
+// form. The per pair math and the order of the axes are the same as in the
+// scalar test above, so both pick the same axis. Only pairs without a
+// separating axis reach the scalar contact generation. Unused lanes repeat
+// the last pair so they never see garbage.
+static void PhysicsBoxtoBox4( PhysicsManifold** manifolds, const PhysicsTransform* atx, const PhysicsTransform* btx, int laneCount )
+{
+	glm::vec3 eA[ 4 ];
+	glm::vec3 eB[ 4 ];
+
+	// SoA input, rotations are column major
+	float ra[ 9 ][ 4 ];
+	float rb[ 9 ][ 4 ];
+	float d[ 3 ][ 4 ];
+	float ea[ 3 ][ 4 ];
+	float eb[ 3 ][ 4 ];
+
+	for ( int lane = 0; lane < 4; ++lane )
+	{
+		int i = glm::min( lane, laneCount - 1 );
+		eA[ i ] = manifolds[ i ]->A->e;
+		eB[ i ] = manifolds[ i ]->B->e;
+		glm::vec3 dp = btx[ i ].position - atx[ i ].position;
+
+		for ( int j = 0; j < 3; ++j )
+		{
+			for ( int k = 0; k < 3; ++k )
+			{
+				ra[ j * 3 + k ][ lane ] = atx[ i ].rotation[ j ][ k ];
+				rb[ j * 3 + k ][ lane ] = btx[ i ].rotation[ j ][ k ];
+			}
+
+			d[ j ][ lane ] = dp[ j ];
+			ea[ j ][ lane ] = eA[ i ][ j ];
+			eb[ j ][ lane ] = eB[ i ][ j ];
+		}
+	}
+
+	PhysicsVec3x4 A[ 3 ];
+	PhysicsVec3x4 B[ 3 ];
+	for ( int j = 0; j < 3; ++j )
+	{
+		A[ j ] = PhysicsLoad3x4( ra[ j * 3 ], ra[ j * 3 + 1 ], ra[ j * 3 + 2 ] );
+		B[ j ] = PhysicsLoad3x4( rb[ j * 3 ], rb[ j * 3 + 1 ], rb[ j * 3 + 2 ] );
+	}
+
+	PhysicsFloat4 eA4[ 3 ];
+	PhysicsFloat4 eB4[ 3 ];
+	for ( int j = 0; j < 3; ++j )
+	{
+		eA4[ j ] = PhysicsLoad4( ea[ j ] );
+		eB4[ j ] = PhysicsLoad4( eb[ j ] );
+	}
+
+	// B's frame in A's space, C[ j ][ k ] = dot( A[ k ], B[ j ] ) as in
+	// transpose( atx.rotation ) * btx.rotation
+	const PhysicsFloat4 kZero = PhysicsSplat4( float( 0.0 ) );
+	const PhysicsFloat4 kOne = PhysicsSplat4( float( 1.0 ) );
+	const PhysicsFloat4 kCosTol = PhysicsSplat4( float( 1.0e-6 ) );
+	PhysicsFloat4 C[ 3 ][ 3 ];
+	PhysicsFloat4 absC[ 3 ][ 3 ];
+	// Lanes stay in the edges mask as long as no two axes are parallel
+	PhysicsFloat4 edges = PhysicsLess4( kZero, kOne );
+	for ( int j = 0; j < 3; ++j )
+	{
+		for ( int k = 0; k < 3; ++k )
+		{
+			C[ j ][ k ] = PhysicsDot4( A[ k ], B[ j ] );
+			absC[ j ][ k ] = PhysicsAbs4( C[ j ][ k ] );
+			edges = PhysicsAnd4( edges, PhysicsLess4( absC[ j ][ k ] + kCosTol, kOne ) );
+		}
+	}
+
+	// Vector from center A to center B in A's space
+	PhysicsVec3x4 dv = PhysicsLoad3x4( d[ 0 ], d[ 1 ], d[ 2 ] );
+	PhysicsFloat4 t[ 3 ];
+	for ( int j = 0; j < 3; ++j )
+		t[ j ] = PhysicsDot4( A[ j ], dv );
+
+	PhysicsBoxQuery4 q;
+	q.aMax = q.bMax = q.eMax = PhysicsSplat4( -Q3_R32_MAX );
+	q.separatingAxis = q.aAxis = q.bAxis = q.eAxis = PhysicsSplat4( float( -1.0 ) );
+
+	// Face axis checks
+	for ( int j = 0; j < 3; ++j )
+	{
+		PhysicsFloat4 s = PhysicsAbs4( t[ j ] ) - (eA4[ j ] + (absC[ 0 ][ j ] * eB4[ 0 ] + absC[ 1 ][ j ] * eB4[ 1 ] + absC[ 2 ][ j ] * eB4[ 2 ]));
+		PhysicsTrackFaceAxis4( &q.aAxis, j, s, &q.aMax, &q.separatingAxis );
+	}
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		PhysicsFloat4 s = PhysicsAbs4( t[ 0 ] * C[ j ][ 0 ] + t[ 1 ] * C[ j ][ 1 ] + t[ 2 ] * C[ j ][ 2 ] ) - (eB4[ j ] + (absC[ j ][ 0 ] * eA4[ 0 ] + absC[ j ][ 1 ] * eA4[ 1 ] + absC[ j ][ 2 ] * eA4[ 2 ]));
+		PhysicsTrackFaceAxis4( &q.bAxis, 3 + j, s, &q.bMax, &q.separatingAxis );
+	}
+
+	// Edge axis checks, Cross( a[ j ], b[ k ] ) is axis 6 + 3 * j + k
+	PhysicsFloat4 rA;
+	PhysicsFloat4 rB;
+	PhysicsFloat4 s;
+
+	// Cross( a.x, b.x )
+	rA = eA4[ 1 ] * absC[ 0 ][ 2 ] + eA4[ 2 ] * absC[ 0 ][ 1 ];
+	rB = eB4[ 1 ] * absC[ 2 ][ 0 ] + eB4[ 2 ] * absC[ 1 ][ 0 ];
+	s = PhysicsAbs4( t[ 2 ] * C[ 0 ][ 1 ] - t[ 1 ] * C[ 0 ][ 2 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 6, s, &q.eMax, PhysicsEdgeNormal4( kZero, -C[ 0 ][ 2 ], C[ 0 ][ 1 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.x, b.y )
+	rA = eA4[ 1 ] * absC[ 1 ][ 2 ] + eA4[ 2 ] * absC[ 1 ][ 1 ];
+	rB = eB4[ 0 ] * absC[ 2 ][ 0 ] + eB4[ 2 ] * absC[ 0 ][ 0 ];
+	s = PhysicsAbs4( t[ 2 ] * C[ 1 ][ 1 ] - t[ 1 ] * C[ 1 ][ 2 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 7, s, &q.eMax, PhysicsEdgeNormal4( kZero, -C[ 1 ][ 2 ], C[ 1 ][ 1 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.x, b.z )
+	rA = eA4[ 1 ] * absC[ 2 ][ 2 ] + eA4[ 2 ] * absC[ 2 ][ 1 ];
+	rB = eB4[ 0 ] * absC[ 1 ][ 0 ] + eB4[ 1 ] * absC[ 0 ][ 0 ];
+	s = PhysicsAbs4( t[ 2 ] * C[ 2 ][ 1 ] - t[ 1 ] * C[ 2 ][ 2 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 8, s, &q.eMax, PhysicsEdgeNormal4( kZero, -C[ 2 ][ 2 ], C[ 2 ][ 1 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.y, b.x )
+	rA = eA4[ 0 ] * absC[ 0 ][ 2 ] + eA4[ 2 ] * absC[ 0 ][ 0 ];
+	rB = eB4[ 1 ] * absC[ 2 ][ 1 ] + eB4[ 2 ] * absC[ 1 ][ 1 ];
+	s = PhysicsAbs4( t[ 0 ] * C[ 0 ][ 2 ] - t[ 2 ] * C[ 0 ][ 0 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 9, s, &q.eMax, PhysicsEdgeNormal4( C[ 0 ][ 2 ], kZero, -C[ 0 ][ 0 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.y, b.y )
+	rA = eA4[ 0 ] * absC[ 1 ][ 2 ] + eA4[ 2 ] * absC[ 1 ][ 0 ];
+	rB = eB4[ 0 ] * absC[ 2 ][ 1 ] + eB4[ 2 ] * absC[ 0 ][ 1 ];
+	s = PhysicsAbs4( t[ 0 ] * C[ 1 ][ 2 ] - t[ 2 ] * C[ 1 ][ 0 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 10, s, &q.eMax, PhysicsEdgeNormal4( C[ 1 ][ 2 ], kZero, -C[ 1 ][ 0 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.y, b.z )
+	rA = eA4[ 0 ] * absC[ 2 ][ 2 ] + eA4[ 2 ] * absC[ 2 ][ 0 ];
+	rB = eB4[ 0 ] * absC[ 1 ][ 1 ] + eB4[ 1 ] * absC[ 0 ][ 1 ];
+	s = PhysicsAbs4( t[ 0 ] * C[ 2 ][ 2 ] - t[ 2 ] * C[ 2 ][ 0 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 11, s, &q.eMax, PhysicsEdgeNormal4( C[ 2 ][ 2 ], kZero, -C[ 2 ][ 0 ] ), edges, &q.separatingAxis );
+
+	// Cross( a.z, b.x )
+	rA = eA4[ 0 ] * absC[ 0 ][ 1 ] + eA4[ 1 ] * absC[ 0 ][ 0 ];
+	rB = eB4[ 1 ] * absC[ 2 ][ 2 ] + eB4[ 2 ] * absC[ 1 ][ 2 ];
+	s = PhysicsAbs4( t[ 1 ] * C[ 0 ][ 0 ] - t[ 0 ] * C[ 0 ][ 1 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 12, s, &q.eMax, PhysicsEdgeNormal4( -C[ 0 ][ 1 ], C[ 0 ][ 0 ], kZero ), edges, &q.separatingAxis );
+
+	// Cross( a.z, b.y )
+	rA = eA4[ 0 ] * absC[ 1 ][ 1 ] + eA4[ 1 ] * absC[ 1 ][ 0 ];
+	rB = eB4[ 0 ] * absC[ 2 ][ 2 ] + eB4[ 2 ] * absC[ 0 ][ 2 ];
+	s = PhysicsAbs4( t[ 1 ] * C[ 1 ][ 0 ] - t[ 0 ] * C[ 1 ][ 1 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 13, s, &q.eMax, PhysicsEdgeNormal4( -C[ 1 ][ 1 ], C[ 1 ][ 0 ], kZero ), edges, &q.separatingAxis );
+
+	// Cross( a.z, b.z )
+	rA = eA4[ 0 ] * absC[ 2 ][ 1 ] + eA4[ 1 ] * absC[ 2 ][ 0 ];
+	rB = eB4[ 0 ] * absC[ 1 ][ 2 ] + eB4[ 1 ] * absC[ 0 ][ 2 ];
+	s = PhysicsAbs4( t[ 1 ] * C[ 2 ][ 0 ] - t[ 0 ] * C[ 2 ][ 1 ] ) - (rA + rB);
+	PhysicsTrackEdgeAxis4( &q.eAxis, 14, s, &q.eMax, PhysicsEdgeNormal4( -C[ 2 ][ 1 ], C[ 2 ][ 0 ], kZero ), edges, &q.separatingAxis );
+
+	float separatingAxis[ 4 ];
+	PhysicsStore4( separatingAxis, q.separatingAxis );
+
+	float aMax[ 4 ], bMax[ 4 ], eMax[ 4 ];
+	float aAxis[ 4 ], bAxis[ 4 ], eAxis[ 4 ];
+	PhysicsStore4( aMax, q.aMax );
+	PhysicsStore4( bMax, q.bMax );
+	PhysicsStore4( eMax, q.eMax );
+	PhysicsStore4( aAxis, q.aAxis );
+	PhysicsStore4( bAxis, q.bAxis );
+	PhysicsStore4( eAxis, q.eAxis );
+
+	float c[ 3 ][ 3 ][ 4 ];
+	for ( int j = 0; j < 3; ++j )
+		for ( int k = 0; k < 3; ++k )
+			PhysicsStore4( c[ j ][ k ], C[ j ][ k ] );
+
+	for ( int lane = 0; lane < laneCount; ++lane )
+	{
+		PhysicsManifold* m = manifolds[ lane ];
+
+		if ( separatingAxis[ lane ] >= float( 0.0 ) )
+		{
+			m->separatingAxis = int( separatingAxis[ lane ] );
+			continue;
+		}
+
+		glm::mat3 laneC;
+		for ( int j = 0; j < 3; ++j )
+			for ( int k = 0; k < 3; ++k )
+				laneC[ j ][ k ] = c[ j ][ k ][ lane ];
+
+		PhysicsBoxAxes axes;
+		axes.aMax = aMax[ lane ];
+		axes.bMax = bMax[ lane ];
+		axes.eMax = eMax[ lane ];
+		axes.aAxis = int( aAxis[ lane ] );
+		axes.bAxis = int( bAxis[ lane ] );
+		axes.eAxis = int( eAxis[ lane ] );
+		axes.nA = axes.aAxis != ~0 ? atx[ lane ].rotation[ axes.aAxis ] : glm::vec3( float( 0.0 ) );
+		axes.nB = axes.bAxis != ~0 ? btx[ lane ].rotation[ axes.bAxis - 3 ] : glm::vec3( float( 0.0 ) );
+		axes.nE = glm::vec3( float( 0.0 ) );
+
+		if ( axes.eAxis != ~0 )
+		{
+			glm::vec3 normal = PhysicsEdgeNormal( laneC, axes.eAxis );
+			axes.nE = normal * (float( 1.0 ) / glm::length( normal ));
+		}
+
+		m->separatingAxis = ~0;
+		PhysicsBoxContacts( m, atx[ lane ], btx[ lane ], eA[ lane ], eB[ lane ], axes );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBoxtoBox( PhysicsManifold** manifolds, int count, PhysicsCollisionCacheStats* stats )
+{
+	PhysicsManifold* batch[ 4 ];
+	PhysicsTransform atx[ 4 ];
+	PhysicsTransform btx[ 4 ];
+	int batchCount = 0;
+
+	for ( int i = 0; i < count; ++i )
+	{
+		PhysicsManifold* m = manifolds[ i ];
+		PhysicsBox* a = m->A;
+		PhysicsBox* b = m->B;
+		atx[ batchCount ] = TransformMul( a->body->GetTransform( ), a->local );
+		btx[ batchCount ] = TransformMul( b->body->GetTransform( ), b->local );
+
+		// Speculative pairs need the margin, which only the scalar test has
+		bool speculative = m->speculativeDistance > float( 0.0 );
+
+		if ( m->separatingAxis != ~0 || speculative )
+		{
+			glm::mat3 C;
+			glm::mat3 absC;
+			bool parallel;
+			glm::vec3 t;
+			PhysicsBoxRelativeFrame( atx[ batchCount ], btx[ batchCount ], &C, &absC, &parallel, &t );
+
+			if ( PhysicsBoxTestCache( m, C, absC, parallel, t, a->e, b->e ) )
+			{
+				++stats->separatedHits;
+				continue;
+			}
+
+			if ( speculative )
+			{
+				PhysicsBoxtoBoxFull( m, atx[ batchCount ], btx[ batchCount ], a->e, b->e, C, absC, parallel, t );
+				continue;
+			}
+		}
+
+		m->contactCount = 0;
+		batch[ batchCount++ ] = m;
+
+		if ( batchCount == 4 )
+		{
+			PhysicsBoxtoBox4( batch, atx, btx, batchCount );
+			batchCount = 0;
+		}
+	}
+
+	if ( batchCount )
+		PhysicsBoxtoBox4( batch, atx, btx, batchCount );
+
+	stats->pairCount += count;
+}
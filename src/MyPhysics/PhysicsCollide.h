@@ -31,6 +31,17 @@
 
 struct PhysicsManifold;
 
+// Counts of the collision cache of the manifolds, see PhysicsBoxtoBox
+struct PhysicsCollisionCacheStats
+{
+	int pairCount;			// Box pairs tested
+	int separatedHits;		// Pairs still separated by the axis cached last time
+};
+
+// Both versions first test the axis that separated the pair last time. The
+// batched version collides the remaining pairs four at a time and adds its
+// cache hits to stats.
 void PhysicsBoxtoBox( PhysicsManifold* m, PhysicsBox* a, PhysicsBox* b );
+void PhysicsBoxtoBox( PhysicsManifold** manifolds, int count, PhysicsCollisionCacheStats* stats );
 
 
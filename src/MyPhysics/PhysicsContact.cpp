@@ -45,10 +45,13 @@ void PhysicsManifold::SetPair( PhysicsBox *a, PhysicsBox *b )
 
 void PhysicsContactConstraint::SolveCollision( void )
 {
-	manifold.contactCount = 0;
-
 	PhysicsBoxtoBox( &manifold, A, B );
 
+	UpdateCollisionFlags( );
+}
+
+void PhysicsContactConstraint::UpdateCollisionFlags( void )
+{
 	if ( manifold.contactCount > 0 )
 	{
 		if ( m_flags & eColliding )
@@ -29,6 +29,7 @@
 
 #include <glm/glm.hpp>
 #include "PhysicsBox.h"
+#include "PhysicsSettings.h"
 
 class PhysicsBody;
 class PhysicsContactEdge;
@@ -95,12 +96,18 @@ class PhysicsManifold
 
 	glm::vec3 normal;				// From A to B
 	glm::vec3 tangentVectors[ 2 ];	// Tangent vectors
-	PhysicsContact contacts[ 8 ];
+	PhysicsContact contacts[ Q3_MAX_MANIFOLD_CONTACTS ];
 	int contactCount;
 
 	PhysicsManifold* next;
 	PhysicsManifold* prev;
 
+	// Collision cache, kept by PhysicsBoxtoBox
+	int separatingAxis;			// Axis that separated the boxes last time or ~0
+
+	// Contacts this far apart are kept, non-zero for continuous bodies
+	float speculativeDistance;
+
 	bool sensor;
 };
 
@@ -109,6 +116,9 @@ class PhysicsContactConstraint
     public:
 	void SolveCollision( void );
 
+	// Sets eColliding and eWasColliding from the current manifold
+	void UpdateCollisionFlags( void );
+
 	PhysicsBox *A, *B;
 	PhysicsBody *bodyA, *bodyB;
 
@@ -117,6 +127,10 @@ class PhysicsContactConstraint
 	PhysicsContactConstraint* next;
 	PhysicsContactConstraint* prev;
 
+	// Contact list of the persistent island, valid while eIsland is set
+	PhysicsContactConstraint* islandNext;
+	PhysicsContactConstraint* islandPrev;
+
 	float friction;
 	float restitution;
 
@@ -126,7 +140,9 @@ class PhysicsContactConstraint
 	{
 		eColliding    = 0x00000001, // Set when contact collides during a step
 		eWasColliding = 0x00000002, // Set when two objects stop colliding
-		eIsland       = 0x00000004, // For internal marking during island forming
+		eIsland       = 0x00000004, // Linked into the island of its bodies
+		eGathered     = 0x00000008, // For internal marking while an island is gathered
+		eSleeping     = 0x00000010, // Kept in the sleeping contact list
 	};
 
 	int m_flags;
@@ -30,20 +30,64 @@
 #include "PhysicsBox.h"
 #include "PhysicsBody.h"
 #include "PhysicsContact.h"
+#include "PhysicsCollide.h"
 #include "PhysicsScene.h"
 #include "PhysicsRender.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsSettings.h"
+
+//--------------------------------------------------------------------------------------------------
+inline void PhysicsPushContact( PhysicsContactConstraint** list, PhysicsContactConstraint* contact )
+{
+	contact->prev = NULL;
+	contact->next = *list;
+
+	if ( *list )
+		(*list)->prev = contact;
+
+	*list = contact;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline void PhysicsUnlinkContact( PhysicsContactConstraint** list, PhysicsContactConstraint* contact )
+{
+	if ( contact->prev )
+		contact->prev->next = contact->next;
+
+	if ( contact->next )
+		contact->next->prev = contact->prev;
+
+	if ( contact == *list )
+		*list = contact->next;
+}
 
 //--------------------------------------------------------------------------------------------------
 // PhysicsContactManager
 //--------------------------------------------------------------------------------------------------
-PhysicsContactManager::PhysicsContactManager( PhysicsStack* stack )
+PhysicsContactManager::PhysicsContactManager( PhysicsStack* stack, PhysicsJobPool* jobPool, PhysicsBroadPhaseType broadPhase )
 	: m_stack( stack )
+	, m_jobPool( jobPool )
 	, m_allocator( sizeof( PhysicsContactConstraint ), 256 )
-	, m_broadphase( this )
+	, m_broadphase( PhysicsBroadPhase::Create( broadPhase, this ) )
+	, m_islands( stack )
 {
 	m_contactList = NULL;
+	m_sleepingContactList = NULL;
 	m_contactCount = 0;
+	m_awakeContactCount = 0;
 	m_contactListener = NULL;
+	m_activeContacts = NULL;
+	m_activeContactCount = 0;
+	m_dt = float( 0.0 );
+	m_jobCacheStats = NULL;
+	m_cacheStats.pairCount = 0;
+	m_cacheStats.separatedHits = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsContactManager::~PhysicsContactManager( )
+{
+	PhysicsBroadPhase::Destroy( m_broadphase );
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -54,24 +98,10 @@ void PhysicsContactManager::AddContact( PhysicsBox *A, PhysicsBox *B )
 	if ( !bodyA->CanCollide( bodyB ) )
 		return;
 
-	// Search for existing matching contact
 	// Return if found duplicate to avoid duplicate constraints
-	// Mark pre-existing duplicates as active
-	PhysicsContactEdge* edge = A->body->m_contactList;
-	while ( edge )
-	{
-		if ( edge->other == bodyB )
-		{
-			PhysicsBox *shapeA = edge->constraint->A;
-			PhysicsBox *shapeB = edge->constraint->B;
-
-			// @TODO: Verify this against Box2D; not sure if this is all we need here
-			if( (A == shapeA) && (B == shapeB) )
-				return;
-		}
-
-		edge = edge->next;
-	}
+	PhysicsPairKey key = PhysicsMakePairKey( A->broadPhaseIndex, B->broadPhaseIndex );
+	if ( m_pairTable.Find( key ) )
+		return;
 
 	// Create new contact
 	PhysicsContactConstraint *contact = (PhysicsContactConstraint*)m_allocator.Allocate( );
@@ -84,15 +114,18 @@ void PhysicsContactManager::AddContact( PhysicsBox *A, PhysicsBox *B )
 	contact->friction = PhysicsMixFriction( A, B );
 	contact->restitution = PhysicsMixRestitution( A, B );
 	contact->manifold.contactCount = 0;
+	contact->manifold.separatingAxis = ~0;
+	contact->manifold.speculativeDistance = float( 0.0 );
 
-	for ( int i = 0; i < 8; ++i )
+	for ( int i = 0; i < Q3_MAX_MANIFOLD_CONTACTS; ++i )
 		contact->manifold.contacts[ i ].warmStarted = 0;
 
-	contact->prev = NULL;
-	contact->next = m_contactList;
-	if ( m_contactList )
-		m_contactList->prev = contact;
-	m_contactList = contact;
+	contact->islandPrev = NULL;
+	contact->islandNext = NULL;
+
+	// New contacts always wake their bodies, so they start out awake
+	PhysicsPushContact( &m_contactList, contact );
+	++m_awakeContactCount;
 
 	// Connect A
 	contact->edgeA.constraint = contact;
@@ -117,13 +150,15 @@ void PhysicsContactManager::AddContact( PhysicsBox *A, PhysicsBox *B )
 	bodyA->SetToAwake( );
 	bodyB->SetToAwake( );
 
+	m_pairTable.Insert( key, contact );
+
 	++m_contactCount;
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsContactManager::FindNewContacts( )
 {
-	m_broadphase.UpdatePairs( );
+	m_broadphase->UpdatePairs( );
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -132,6 +167,9 @@ void PhysicsContactManager::RemoveContact( PhysicsContactConstraint *contact )
 	PhysicsBody *A = contact->bodyA;
 	PhysicsBody *B = contact->bodyB;
 
+	if ( contact->m_flags & PhysicsContactConstraint::eIsland )
+		m_islands.UnlinkContact( contact );
+
 	// Remove from A
 	if ( contact->edgeA.prev )
 		contact->edgeA.prev->next = contact->edgeA.next;
@@ -156,14 +194,18 @@ void PhysicsContactManager::RemoveContact( PhysicsContactConstraint *contact )
 	B->SetToAwake( );
 
 	// Remove contact from the manager
-	if ( contact->prev )
-		contact->prev->next = contact->next;
+	if ( contact->m_flags & PhysicsContactConstraint::eSleeping )
+	{
+		PhysicsUnlinkContact( &m_sleepingContactList, contact );
+	}
 
-	if ( contact->next )
-		contact->next->prev = contact->prev;
+	else
+	{
+		PhysicsUnlinkContact( &m_contactList, contact );
+		--m_awakeContactCount;
+	}
 
-	if ( contact == m_contactList )
-		m_contactList = contact->next;
+	m_pairTable.Remove( PhysicsMakePairKey( contact->A->broadPhaseIndex, contact->B->broadPhaseIndex ) );
 
 	--m_contactCount;
 
@@ -190,14 +232,62 @@ void PhysicsContactManager::RemoveFromBroadphase( PhysicsBody *body )
 
 	while ( box )
 	{
-		m_broadphase.RemoveBox( box );
+		m_broadphase->RemoveBox( box );
 		box = box->next;
 	}
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsContactManager::TestCollisions( void )
+void PhysicsContactManager::WakeContacts( PhysicsBody *body )
 {
+	for ( PhysicsContactEdge* edge = body->m_contactList; edge; edge = edge->next )
+	{
+		PhysicsContactConstraint* contact = edge->constraint;
+
+		if ( !(contact->m_flags & PhysicsContactConstraint::eSleeping) )
+			continue;
+
+		PhysicsUnlinkContact( &m_sleepingContactList, contact );
+		PhysicsPushContact( &m_contactList, contact );
+		contact->m_flags &= ~PhysicsContactConstraint::eSleeping;
+		++m_awakeContactCount;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::SleepContacts( PhysicsBody *body )
+{
+	for ( PhysicsContactEdge* edge = body->m_contactList; edge; edge = edge->next )
+	{
+		PhysicsContactConstraint* contact = edge->constraint;
+		PhysicsBody* other = edge->other;
+
+		if ( contact->m_flags & PhysicsContactConstraint::eSleeping )
+			continue;
+
+		// Static bodies do not move, so only the other body keeps it awake
+		if ( !(other->m_flags & PhysicsBody::eStatic) && other->IsAwake( ) )
+			continue;
+
+		PhysicsUnlinkContact( &m_contactList, contact );
+		PhysicsPushContact( &m_sleepingContactList, contact );
+		contact->m_flags |= PhysicsContactConstraint::eSleeping;
+		--m_awakeContactCount;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::TestCollisions( float dt )
+{
+	m_dt = dt;
+
+	int maxJobCount = (m_awakeContactCount + Q3_NARROWPHASE_JOB_SIZE - 1) / Q3_NARROWPHASE_JOB_SIZE;
+	m_stack->Reserve( sizeof( PhysicsContactConstraint* ) * m_awakeContactCount + sizeof( PhysicsCollisionCacheStats ) * maxJobCount );
+	m_activeContacts = (PhysicsContactConstraint**)m_stack->Allocate( sizeof( PhysicsContactConstraint* ) * m_awakeContactCount );
+	m_activeContactCount = 0;
+
+	// Structural changes first, these touch the contact and edge lists.
+	// Contacts of sleeping bodies are kept in their own list and skipped.
 	PhysicsContactConstraint* constraint = m_contactList;
 
 	while( constraint )
@@ -207,14 +297,6 @@ void PhysicsContactManager::TestCollisions( void )
 		PhysicsBody *bodyA = A->body;
 		PhysicsBody *bodyB = B->body;
 
-		constraint->m_flags &= ~PhysicsContactConstraint::eIsland;
-
-		if( !bodyA->IsAwake( ) && !bodyB->IsAwake( ) )
-		{
-			constraint = constraint->next;
-			continue;
-		}
-
 		if ( !bodyA->CanCollide( bodyB ) )
 		{
 			PhysicsContactConstraint* next = constraint->next;
@@ -224,100 +306,217 @@ void PhysicsContactManager::TestCollisions( void )
 		}
 
 		// Check if contact should persist
-		if ( !m_broadphase.TestOverlap( A->broadPhaseIndex, B->broadPhaseIndex ) )
+		if ( !m_broadphase->TestOverlap( A->broadPhaseIndex, B->broadPhaseIndex ) )
 		{
 			PhysicsContactConstraint* next = constraint->next;
 			RemoveContact( constraint );
 			constraint = next;
 			continue;
 		}
-		PhysicsManifold* manifold = &constraint->manifold;
-		PhysicsManifold oldManifold = constraint->manifold;
-		glm::vec3 ot0 = oldManifold.tangentVectors[ 0 ];
-		glm::vec3 ot1 = oldManifold.tangentVectors[ 1 ];
-		constraint->SolveCollision( );
-		PhysicsComputeBasis( manifold->normal, manifold->tangentVectors, manifold->tangentVectors + 1 );
-
-		for ( int i = 0; i < manifold->contactCount; ++i )
-		{
-			PhysicsContact *c = manifold->contacts + i;
-			c->tangentImpulse[ 0 ] = c->tangentImpulse[ 1 ] = c->normalImpulse = float( 0.0 );
-			unsigned char oldWarmStart = c->warmStarted;
-			c->warmStarted = 0;
 
-			for ( int j = 0; j < oldManifold.contactCount; ++j )
-			{
-				PhysicsContact *oc = oldManifold.contacts + j;
-				if ( c->fp.key == oc->fp.key )
-				{
-					c->normalImpulse = oc->normalImpulse;
-
-					// Attempt to re-project old friction solutions
-					glm::vec3 friction = ot0 * oc->tangentImpulse[ 0 ] + ot1 * oc->tangentImpulse[ 1 ];
-					c->tangentImpulse[ 0 ] = glm::dot( friction, manifold->tangentVectors[ 0 ] );
-					c->tangentImpulse[ 1 ] = glm::dot( friction, manifold->tangentVectors[ 1 ] );
-					c->warmStarted = glm::max( (int)oldWarmStart, (int)(oldWarmStart + 1) );
-					break;
-				}
-			}
-		}
+		m_activeContacts[ m_activeContactCount++ ] = constraint;
+		constraint = constraint->next;
+	}
+
+	// Manifolds only read the boxes and write their own constraint
+	int jobCount = (m_activeContactCount + Q3_NARROWPHASE_JOB_SIZE - 1) / Q3_NARROWPHASE_JOB_SIZE;
+	m_jobCacheStats = (PhysicsCollisionCacheStats*)m_stack->Allocate( sizeof( PhysicsCollisionCacheStats ) * jobCount );
+	m_jobPool->Run( SolveCollision, this, jobCount );
+
+	m_cacheStats.pairCount = 0;
+	m_cacheStats.separatedHits = 0;
+
+	for ( int i = 0; i < jobCount; ++i )
+	{
+		m_cacheStats.pairCount += m_jobCacheStats[ i ].pairCount;
+		m_cacheStats.separatedHits += m_jobCacheStats[ i ].separatedHits;
+	}
+
+	m_stack->Free( m_jobCacheStats );
+	m_jobCacheStats = NULL;
+
+	// Island links follow the touching state of the updated manifolds
+	for ( int i = 0; i < m_activeContactCount; ++i )
+	{
+		constraint = m_activeContacts[ i ];
+		int now_colliding = constraint->m_flags & PhysicsContactConstraint::eColliding;
+		int was_colliding = constraint->m_flags & PhysicsContactConstraint::eWasColliding;
+		bool touching = now_colliding && !constraint->A->sensor && !constraint->B->sensor;
+		bool linked = (constraint->m_flags & PhysicsContactConstraint::eIsland) != 0;
+
+		if ( touching && !linked )
+			m_islands.LinkContact( constraint );
+
+		else if ( !touching && linked )
+			m_islands.UnlinkContact( constraint );
 
 		if ( m_contactListener )
 		{
-			int now_colliding = constraint->m_flags & PhysicsContactConstraint::eColliding;
-			int was_colliding = constraint->m_flags & PhysicsContactConstraint::eWasColliding;
-
 			if ( now_colliding && !was_colliding )
 				m_contactListener->BeginContact( constraint );
 
 			else if ( !now_colliding && was_colliding )
 				m_contactListener->EndContact( constraint );
 		}
-
-		constraint = constraint->next;
 	}
+
+	m_stack->Free( m_activeContacts );
+	m_activeContacts = NULL;
+	m_activeContactCount = 0;
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsContactManager::RenderContacts( PhysicsRender* render ) const
+// Rotation moves no point of a box faster than its distance to the body
+// center times the angular speed
+float PhysicsContactManager::SpeculativeDistance( const PhysicsContactConstraint* constraint, float dt )
 {
-	const PhysicsContactConstraint *contact = m_contactList;
+	const PhysicsBody* bodyA = constraint->bodyA;
+	const PhysicsBody* bodyB = constraint->bodyB;
+
+	if ( constraint->manifold.sensor || !(bodyA->IsContinuous( ) || bodyB->IsContinuous( )) )
+		return float( 0.0 );
 
-	while ( contact )
+	const PhysicsBox* A = constraint->A;
+	const PhysicsBox* B = constraint->B;
+	float rA = glm::length( A->e ) + glm::length( A->local.position - bodyA->m_localCenter );
+	float rB = glm::length( B->e ) + glm::length( B->local.position - bodyB->m_localCenter );
+	float speed = glm::length( bodyB->m_linearVelocity - bodyA->m_linearVelocity );
+	speed += glm::length( bodyA->m_angularVelocity ) * rA + glm::length( bodyB->m_angularVelocity ) * rB;
+
+	return speed * dt;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::SolveCollision( void* param, int index, int threadIndex )
+{
+	PhysicsContactManager* manager = (PhysicsContactManager*)param;
+	int begin = index * Q3_NARROWPHASE_JOB_SIZE;
+	int end = glm::min( begin + Q3_NARROWPHASE_JOB_SIZE, manager->m_activeContactCount );
+	PhysicsCollisionCacheStats* stats = manager->m_jobCacheStats + index;
+	stats->pairCount = 0;
+	stats->separatedHits = 0;
+
+	// Pairs go through the separating axis test four at a time
+	for ( int first = begin; first < end; first += 4 )
 	{
-		const PhysicsManifold *m = &contact->manifold;
+		int count = glm::min( end - first, 4 );
+		PhysicsManifold oldManifolds[ 4 ];
+		PhysicsManifold* manifolds[ 4 ];
 
-		if ( !(contact->m_flags & PhysicsContactConstraint::eColliding) )
+		for ( int k = 0; k < count; ++k )
 		{
-			contact = contact->next;
-			continue;
+			PhysicsContactConstraint* constraint = manager->m_activeContacts[ first + k ];
+			constraint->manifold.speculativeDistance = SpeculativeDistance( constraint, manager->m_dt );
+			oldManifolds[ k ] = constraint->manifold;
+			manifolds[ k ] = &constraint->manifold;
 		}
 
-		for ( int j = 0; j < m->contactCount; ++j)
+		PhysicsBoxtoBox( manifolds, count, stats );
+
+		for ( int k = 0; k < count; ++k )
 		{
-			const PhysicsContact *c = m->contacts + j;
-			float blue = (float)(255 - c->warmStarted) / 255.0f;
-			float red = 1.0f - blue;
-			render->SetScale( 10.0f, 10.0f, 10.0f );
-			render->SetPenColor( red, blue, blue );
-			render->SetPenPosition( c->position.x, c->position.y, c->position.z );
-			render->Point( );
-
-			if ( m->A->body->IsAwake( ) )
-				render->SetPenColor( 1.0f, 1.0f, 1.0f );
-			else
-				render->SetPenColor( 0.2f, 0.2f, 0.2f );
-
-			render->SetPenPosition( c->position.x, c->position.y, c->position.z );
-			render->Line(
-				c->position.x + m->normal.x * 0.5f,
-				c->position.y + m->normal.y * 0.5f,
-				c->position.z + m->normal.z * 0.5f
-				);
+			PhysicsContactConstraint* constraint = manager->m_activeContacts[ first + k ];
+			PhysicsManifold* manifold = manifolds[ k ];
+			const PhysicsManifold& oldManifold = oldManifolds[ k ];
+			glm::vec3 ot0 = oldManifold.tangentVectors[ 0 ];
+			glm::vec3 ot1 = oldManifold.tangentVectors[ 1 ];
+			constraint->UpdateCollisionFlags( );
+			PhysicsComputeBasis( manifold->normal, manifold->tangentVectors, manifold->tangentVectors + 1 );
+
+			for ( int i = 0; i < manifold->contactCount; ++i )
+			{
+				PhysicsContact *c = manifold->contacts + i;
+				c->tangentImpulse[ 0 ] = c->tangentImpulse[ 1 ] = c->normalImpulse = float( 0.0 );
+				unsigned char oldWarmStart = c->warmStarted;
+				c->warmStarted = 0;
+
+				for ( int j = 0; j < oldManifold.contactCount; ++j )
+				{
+					const PhysicsContact *oc = oldManifold.contacts + j;
+					if ( c->fp.key == oc->fp.key )
+					{
+						c->normalImpulse = oc->normalImpulse;
+
+						// Attempt to re-project old friction solutions
+						glm::vec3 friction = ot0 * oc->tangentImpulse[ 0 ] + ot1 * oc->tangentImpulse[ 1 ];
+						c->tangentImpulse[ 0 ] = glm::dot( friction, manifold->tangentVectors[ 0 ] );
+						c->tangentImpulse[ 1 ] = glm::dot( friction, manifold->tangentVectors[ 1 ] );
+						c->warmStarted = glm::max( (int)oldWarmStart, (int)(oldWarmStart + 1) );
+						break;
+					}
+				}
+			}
 		}
+	}
+}
 
-		contact = contact->next;
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::RenderContacts( PhysicsRender* render ) const
+{
+	// Sleeping contacts are drawn as well, see the pen color below
+	for ( int list = 0; list < 2; ++list )
+	{
+		const PhysicsContactConstraint *contact = list ? m_sleepingContactList : m_contactList;
+
+		while ( contact )
+		{
+			const PhysicsManifold *m = &contact->manifold;
+
+			if ( !(contact->m_flags & PhysicsContactConstraint::eColliding) )
+			{
+				contact = contact->next;
+				continue;
+			}
+
+			for ( int j = 0; j < m->contactCount; ++j)
+			{
+				const PhysicsContact *c = m->contacts + j;
+				float blue = (float)(255 - c->warmStarted) / 255.0f;
+				float red = 1.0f - blue;
+				render->SetScale( 10.0f, 10.0f, 10.0f );
+				render->SetPenColor( red, blue, blue );
+				render->SetPenPosition( c->position.x, c->position.y, c->position.z );
+				render->Point( );
+
+				if ( m->A->body->IsAwake( ) )
+					render->SetPenColor( 1.0f, 1.0f, 1.0f );
+				else
+					render->SetPenColor( 0.2f, 0.2f, 0.2f );
+
+				render->SetPenPosition( c->position.x, c->position.y, c->position.z );
+				render->Line(
+					c->position.x + m->normal.x * 0.5f,
+					c->position.y + m->normal.y * 0.5f,
+					c->position.z + m->normal.z * 0.5f
+					);
+			}
+
+			contact = contact->next;
+		}
 	}
 
 	render->SetScale( 1.0f, 1.0f, 1.0f );
 }
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::Reserve( int bodyCount, int boxCount, int contactCount )
+{
+	m_allocator.Reserve( contactCount );
+	m_pairTable.Reserve( contactCount );
+	m_islands.Reserve( bodyCount );
+
+	// Pairs of two moved boxes are found from both sides
+	m_broadphase->Reserve( boxCount, 2 * contactCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::GetPairTableStats( PhysicsPairTableStats* stats ) const
+{
+	m_pairTable.GetStats( stats );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactManager::GetCollisionCacheStats( PhysicsCollisionCacheStats* stats ) const
+{
+	*stats = m_cacheStats;
+}
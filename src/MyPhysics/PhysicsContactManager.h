@@ -29,7 +29,10 @@
 
 
 #include "PhysicsBroadPhase.h"
+#include "PhysicsCollide.h"
+#include "PhysicsIslandManager.h"
 #include "PhysicsMemory.h"
+#include "PhysicsPairTable.h"
 
 
 struct PhysicsContactConstraint;
@@ -38,11 +41,13 @@ struct PhysicsBox;
 class PhysicsBody;
 class PhysicsRender;
 class PhysicsStack;
+class PhysicsJobPool;
 
 class PhysicsContactManager
 {
 public:
-	PhysicsContactManager( PhysicsStack* stack );
+	PhysicsContactManager( PhysicsStack* stack, PhysicsJobPool* jobPool, PhysicsBroadPhaseType broadPhase );
+	~PhysicsContactManager( );
 
 	// Add a new contact constraint for a pair of objects
 	// unless the contact constraint already exists
@@ -59,22 +64,71 @@ public:
 	void RemoveContactsFromBody( PhysicsBody *body );
 	void RemoveFromBroadphase( PhysicsBody *body );
 
+	// Move the contacts of a non-static body between the awake and the
+	// sleeping list, called when the body wakes up or falls asleep. A
+	// contact sleeps once none of its non-static bodies is awake.
+	void WakeContacts( PhysicsBody *body );
+	void SleepContacts( PhysicsBody *body );
+
 	// Remove contacts without broadphase overlap
 	// Solves contact manifolds
-	void TestCollisions( void );
-	static void SolveCollision( void* param );
+	// Only walks the awake contact list
+	// Removal runs first, then manifolds of the remaining awake contacts
+	// are updated in parallel, then island links and listeners are
+	// updated serially in contact list order. Pairs with a continuous body
+	// get speculative contacts for a step of dt.
+	void TestCollisions( float dt );
+
+	// Job entry point, updates one slice of m_activeContacts
+	static void SolveCollision( void* param, int index, int threadIndex );
 
 	void RenderContacts( PhysicsRender* debugDrawer ) const;
 
+	// Sizes contact memory, the pair table, the islands and the broadphase
+	// buffers for up to the given counts. The stack is left to the scene.
+	void Reserve( int bodyCount, int boxCount, int contactCount );
+
+	void GetPairTableStats( PhysicsPairTableStats* stats ) const;
+
+	// Collision cache counts of the last TestCollisions
+	void GetCollisionCacheStats( PhysicsCollisionCacheStats* stats ) const;
+
 private:
+	// Bound on how far the boxes of a contact can close within dt, zero
+	// unless one of the bodies is continuous
+	static float SpeculativeDistance( const PhysicsContactConstraint* constraint, float dt );
+
+	// Contacts with at least one awake non-static body, the rest is kept
+	// in the sleeping list until one of their bodies wakes up
 	PhysicsContactConstraint* m_contactList;
+	PhysicsContactConstraint* m_sleepingContactList;
 	int m_contactCount;
+	int m_awakeContactCount;
 	PhysicsStack* m_stack;
+	PhysicsJobPool* m_jobPool;
 	PhysicsPagedAllocator m_allocator;
-	PhysicsBroadPhase m_broadphase;
+	PhysicsBroadPhase* m_broadphase;
 	PhysicsContactListener *m_contactListener;
 
+	// Islands of touching bodies, kept in sync with the contact list
+	PhysicsIslandManager m_islands;
+
+	// Every contact constraint keyed on the proxy ids of its two boxes
+	PhysicsPairTable m_pairTable;
+
+	// Contacts whose manifolds get updated by the current TestCollisions
+	PhysicsContactConstraint** m_activeContacts;
+	int m_activeContactCount;
+	float m_dt;
+
+	// One entry per narrowphase job, summed into m_cacheStats afterwards
+	PhysicsCollisionCacheStats* m_jobCacheStats;
+	PhysicsCollisionCacheStats m_cacheStats;
+
 	friend class PhysicsBroadPhase;
+	friend class PhysicsTreeBroadPhase;
+	friend class PhysicsSAPBroadPhase;
+	friend class PhysicsGridBroadPhase;
 	friend class PhysicsScene;
 	friend struct PhysicsBox;
 	friend class PhysicsBody;
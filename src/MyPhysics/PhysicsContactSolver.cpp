@@ -37,6 +37,10 @@
 
 #include "Common.h"
 #include "PhysicsSettings.h"
+#include "PhysicsMemory.h"
+#include "PhysicsSimd.h"
+
+#include <string.h>
 
 
 //--------------------------------------------------------------------------------------------------
@@ -49,11 +53,29 @@ void PhysicsContactSolver::Initialize( PhysicsIsland *island )
 	m_contacts = island->m_contactStates;
 	m_velocities = m_island->m_velocities;
 	m_enableFriction = island->m_enableFriction;
+	m_order = NULL;
+	m_overflowStart = m_contactCount;
+	m_batches = NULL;
+	m_batchCount = 0;
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsContactSolver::ShutDown( void )
 {
+	if ( m_order )
+	{
+		StoreBatches( );
+
+		PhysicsStack *stack = m_island->m_stack;
+		if ( m_batches )
+			stack->Free( m_batches );
+		stack->Free( m_order );
+
+		m_order = NULL;
+		m_batches = NULL;
+		m_batchCount = 0;
+	}
+
 	for ( int i = 0; i < m_contactCount; ++i )
 	{
 		PhysicsContactConstraintState *c = m_contacts + i;
@@ -70,6 +92,29 @@ void PhysicsContactSolver::ShutDown( void )
 	}
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::ComputeMass( PhysicsContactConstraintState *cs, PhysicsContactState *c )
+{
+	// Precalculate JM^-1JT for contact and friction constraints
+	glm::vec3 raCn = glm::cross( c->ra, cs->normal );
+	glm::vec3 rbCn = glm::cross( c->rb, cs->normal );
+	float nm = cs->mA + cs->mB;
+	float tm[ 2 ];
+	tm[ 0 ] = nm;
+	tm[ 1 ] = nm;
+
+	nm += glm::dot( raCn, cs->iA * raCn ) + glm::dot( rbCn, cs->iB * rbCn );
+	c->normalMass = InvertFloat( nm );
+
+	for ( int i = 0; i < 2; ++i )
+	{
+		glm::vec3 raCt = glm::cross( cs->tangentVectors[ i ], c->ra );
+		glm::vec3 rbCt = glm::cross( cs->tangentVectors[ i ], c->rb );
+		tm[ i ] += glm::dot( raCt, cs->iA * raCt ) + glm::dot( rbCt, cs->iB * rbCt );
+		c->tangentMass[ i ] = InvertFloat( tm[ i ] );
+	}
+}
+
 //--------------------------------------------------------------------------------------------------
 void PhysicsContactSolver::PreSolve( float dt )
 {
@@ -85,28 +130,17 @@ void PhysicsContactSolver::PreSolve( float dt )
 		for ( int j = 0; j < cs->contactCount; ++j )
 		{
 			PhysicsContactState *c = cs->contacts + j;
+			ComputeMass( cs, c );
 
-			// Precalculate JM^-1JT for contact and friction constraints
-			glm::vec3 raCn = glm::cross( c->ra, cs->normal );
-			glm::vec3 rbCn = glm::cross( c->rb, cs->normal );
-			float nm = cs->mA + cs->mB;
-			float tm[ 2 ];
-			tm[ 0 ] = nm;
-			tm[ 1 ] = nm;
+			// Precalculate bias factor. Speculative contacts of continuous
+			// bodies are still apart, they may close the gap but no more.
+			bool speculative = c->penetration > float( 0.0 );
 
-			nm += glm::dot( raCn, cs->iA * raCn ) + glm::dot( rbCn, cs->iB * rbCn );
-			c->normalMass = InvertFloat( nm );
+			if ( speculative )
+				c->bias = -c->penetration * (float( 1.0 ) / dt);
 
-			for ( int i = 0; i < 2; ++i )
-			{
-				glm::vec3 raCt = glm::cross( cs->tangentVectors[ i ], c->ra );
-				glm::vec3 rbCt = glm::cross( cs->tangentVectors[ i ], c->rb );
-				tm[ i ] += glm::dot( raCt, cs->iA * raCt ) + glm::dot( rbCt, cs->iB * rbCt );
-				c->tangentMass[ i ] = InvertFloat( tm[ i ] );
-			}
-
-			// Precalculate bias factor
-			c->bias = -Q3_BAUMGARTE * (float( 1.0 ) / dt) * glm::min( float( 0.0 ), c->penetration + Q3_PENETRATION_SLOP );
+			else
+				c->bias = -Q3_BAUMGARTE * (float( 1.0 ) / dt) * glm::min( float( 0.0 ), c->penetration + Q3_PENETRATION_SLOP );
 
 			// Warm start contact
 			glm::vec3 P = cs->normal * c->normalImpulse;
@@ -126,7 +160,7 @@ void PhysicsContactSolver::PreSolve( float dt )
 			// Add in restitution bias
 			float dv = glm::dot( vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra ), cs->normal );
 
-			if ( dv < -float( 1.0 ) )
+			if ( dv < -float( 1.0 ) && !speculative )
 				c->bias += -(cs->restitution) * dv;
 		}
 
@@ -138,11 +172,127 @@ void PhysicsContactSolver::PreSolve( float dt )
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsContactSolver::Solve( )
+float PhysicsContactSolver::Solve( )
 {
+	m_residual = float( 0.0 );
+
+	if ( !m_order )
+	{
+		for ( int i = 0; i < m_contactCount; ++i )
+			SolveConstraint( m_contacts + i );
+
+		return m_residual;
+	}
+
+	// Batches are sorted by color. Constraints within a color never share a
+	// dynamic body, so the order batches are solved in only matters across
+	// colors, same as the order of constraints in the scalar path.
+	for ( int i = 0; i < m_batchCount; ++i )
+		SolveBatch( m_batches + i );
+
+	for ( int i = m_overflowStart; i < m_contactCount; ++i )
+		SolveConstraint( m_contacts + m_order[ i ] );
+
+	return m_residual;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::SolveConstraint( PhysicsContactConstraintState *cs )
+{
+	glm::vec3 vA = m_velocities[ cs->indexA ].v;
+	glm::vec3 wA = m_velocities[ cs->indexA ].w;
+	glm::vec3 vB = m_velocities[ cs->indexB ].v;
+	glm::vec3 wB = m_velocities[ cs->indexB ].w;
+
+	for ( int j = 0; j < cs->contactCount; ++j )
+	{
+		PhysicsContactState *c = cs->contacts + j;
+
+		// relative velocity at contact
+		glm::vec3 dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+
+		// Friction
+		if ( m_enableFriction )
+		{
+			for ( int i = 0; i < 2; ++i )
+			{
+				float lambda = -glm::dot( dv, cs->tangentVectors[ i ] ) * c->tangentMass[ i ];
+
+				// Calculate frictional impulse
+				float maxLambda = cs->friction * c->normalImpulse;
+
+				// Clamp frictional impulse
+				float oldPT = c->tangentImpulse[ i ];
+				c->tangentImpulse[ i ] = glm::clamp( oldPT + lambda, -maxLambda, maxLambda );
+				lambda = c->tangentImpulse[ i ] - oldPT;
+				m_residual = glm::max( m_residual, Abs( lambda ) );
+
+				// Apply friction impulse
+				glm::vec3 impulse = cs->tangentVectors[ i ] * lambda;
+				vA -= impulse * cs->mA;
+				wA -= cs->iA * glm::cross( c->ra, impulse );
+
+				vB += impulse * cs->mB;
+				wB += cs->iB * glm::cross( c->rb, impulse );
+			}
+		}
+
+		// Normal
+		{
+			dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+
+			// Normal impulse
+			float vn = glm::dot( dv, cs->normal );
+
+			// Factor in positional bias to calculate impulse scalar j
+			float lambda = c->normalMass * (-vn + c->bias);
+
+			// Clamp impulse
+			float tempPN = c->normalImpulse;
+			c->normalImpulse = glm::max( tempPN + lambda, float( 0.0 ) );
+			lambda = c->normalImpulse - tempPN;
+			m_residual = glm::max( m_residual, Abs( lambda ) );
+
+			// Apply impulse
+			glm::vec3 impulse = cs->normal * lambda;
+			vA -= impulse * cs->mA;
+			wA -= cs->iA * glm::cross( c->ra, impulse );
+
+			vB += impulse * cs->mB;
+			wB += cs->iB * glm::cross( c->rb, impulse );
+		}
+	}
+
+	m_velocities[ cs->indexA ].v = vA;
+	m_velocities[ cs->indexA ].w = wA;
+	m_velocities[ cs->indexB ].v = vB;
+	m_velocities[ cs->indexB ].w = wB;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::PrepareSubsteps( float h )
+{
+	// Soft constraint coefficients, from Box2D v3's soft step solver
+	float hertz = glm::min( Q3_CONTACT_HERTZ, float( 0.25 ) / h );
+	float zeta = Q3_CONTACT_DAMPING_RATIO;
+	float omega = float( 2.0 ) * glm::pi<float>( ) * hertz;
+	float a1 = float( 2.0 ) * zeta + h * omega;
+	float a2 = h * omega * a1;
+	float a3 = float( 1.0 ) / (float( 1.0 ) + a2);
+	m_invH = float( 1.0 ) / h;
+	m_biasRate = omega / a1;
+	m_massScale = a2 * a3;
+	m_impulseScale = a3;
+
+	PhysicsBody **bodies = m_island->m_bodies;
+
 	for ( int i = 0; i < m_contactCount; ++i )
 	{
 		PhysicsContactConstraintState *cs = m_contacts + i;
+		const PhysicsBody *bodyA = bodies[ cs->indexA ];
+		const PhysicsBody *bodyB = bodies[ cs->indexB ];
+		glm::mat3 rotationA = glm::transpose( bodyA->m_tx.rotation );
+		glm::mat3 rotationB = glm::transpose( bodyB->m_tx.rotation );
 
 		glm::vec3 vA = m_velocities[ cs->indexA ].v;
 		glm::vec3 wA = m_velocities[ cs->indexA ].w;
@@ -152,52 +302,102 @@ void PhysicsContactSolver::Solve( )
 		for ( int j = 0; j < cs->contactCount; ++j )
 		{
 			PhysicsContactState *c = cs->contacts + j;
+			ComputeMass( cs, c );
 
-			// relative velocity at contact
-			glm::vec3 dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+			// The separation follows the anchors as the bodies move
+			c->localRa = rotationA * c->ra;
+			c->localRb = rotationB * c->rb;
+			c->adjustedSeparation = c->penetration - glm::dot( cs->normal, (cs->centerB + c->rb) - (cs->centerA + c->ra) );
+
+			// Only restitution is kept in the bias
+			float dv = glm::dot( vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra ), cs->normal );
+			c->bias = float( 0.0 );
+
+			if ( dv < -float( 1.0 ) && c->penetration <= float( 0.0 ) )
+				c->bias = -(cs->restitution) * dv;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::WarmStart( void )
+{
+	for ( int i = 0; i < m_contactCount; ++i )
+	{
+		PhysicsContactConstraintState *cs = m_contacts + i;
+
+		glm::vec3 vA = m_velocities[ cs->indexA ].v;
+		glm::vec3 wA = m_velocities[ cs->indexA ].w;
+		glm::vec3 vB = m_velocities[ cs->indexB ].v;
+		glm::vec3 wB = m_velocities[ cs->indexB ].w;
+
+		for ( int j = 0; j < cs->contactCount; ++j )
+		{
+			PhysicsContactState *c = cs->contacts + j;
+			glm::vec3 P = cs->normal * c->normalImpulse;
 
-			// Friction
 			if ( m_enableFriction )
 			{
-				for ( int i = 0; i < 2; ++i )
-				{
-					float lambda = -glm::dot( dv, cs->tangentVectors[ i ] ) * c->tangentMass[ i ];
+				P += cs->tangentVectors[ 0 ] * c->tangentImpulse[ 0 ];
+				P += cs->tangentVectors[ 1 ] * c->tangentImpulse[ 1 ];
+			}
 
-					// Calculate frictional impulse
-					float maxLambda = cs->friction * c->normalImpulse;
+			vA -= P * cs->mA;
+			wA -= cs->iA * glm::cross( c->ra, P );
 
-					// Clamp frictional impulse
-					float oldPT = c->tangentImpulse[ i ];
-					c->tangentImpulse[ i ] = glm::clamp( -maxLambda, maxLambda, oldPT + lambda );
-					lambda = c->tangentImpulse[ i ] - oldPT;
+			vB += P * cs->mB;
+			wB += cs->iB * glm::cross( c->rb, P );
+		}
 
-					// Apply friction impulse
-					glm::vec3 impulse = cs->tangentVectors[ i ] * lambda;
-					vA -= impulse * cs->mA;
-					wA -= cs->iA * glm::cross( c->ra, impulse );
+		m_velocities[ cs->indexA ].v = vA;
+		m_velocities[ cs->indexA ].w = wA;
+		m_velocities[ cs->indexB ].v = vB;
+		m_velocities[ cs->indexB ].w = wB;
+	}
+}
 
-					vB += impulse * cs->mB;
-					wB += cs->iB * glm::cross( c->rb, impulse );
-				}
-			}
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::SolveSoft( bool useBias )
+{
+	for ( int i = 0; i < m_contactCount; ++i )
+		SolveSoftConstraint( m_contacts + i, useBias );
+}
 
-			// Normal
-			{
-				dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::SolveSoftConstraint( PhysicsContactConstraintState *cs, bool useBias )
+{
+	const PhysicsBody *bodyA = m_island->m_bodies[ cs->indexA ];
+	const PhysicsBody *bodyB = m_island->m_bodies[ cs->indexB ];
 
-				// Normal impulse
-				float vn = glm::dot( dv, cs->normal );
+	glm::vec3 vA = m_velocities[ cs->indexA ].v;
+	glm::vec3 wA = m_velocities[ cs->indexA ].w;
+	glm::vec3 vB = m_velocities[ cs->indexB ].v;
+	glm::vec3 wB = m_velocities[ cs->indexB ].w;
+
+	for ( int j = 0; j < cs->contactCount; ++j )
+	{
+		PhysicsContactState *c = cs->contacts + j;
 
-				// Factor in positional bias to calculate impulse scalar j
-				float lambda = c->normalMass * (-vn + c->bias);
+		// relative velocity at contact
+		glm::vec3 dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+
+		// Friction
+		if ( m_enableFriction )
+		{
+			for ( int i = 0; i < 2; ++i )
+			{
+				float lambda = -glm::dot( dv, cs->tangentVectors[ i ] ) * c->tangentMass[ i ];
 
-				// Clamp impulse
-				float tempPN = c->normalImpulse;
-				c->normalImpulse = glm::max( tempPN + lambda, float( 0.0 ) );
-				lambda = c->normalImpulse - tempPN;
+				// Calculate frictional impulse
+				float maxLambda = cs->friction * c->normalImpulse;
 
-				// Apply impulse
-				glm::vec3 impulse = cs->normal * lambda;
+				// Clamp frictional impulse
+				float oldPT = c->tangentImpulse[ i ];
+				c->tangentImpulse[ i ] = glm::clamp( oldPT + lambda, -maxLambda, maxLambda );
+				lambda = c->tangentImpulse[ i ] - oldPT;
+
+				// Apply friction impulse
+				glm::vec3 impulse = cs->tangentVectors[ i ] * lambda;
 				vA -= impulse * cs->mA;
 				wA -= cs->iA * glm::cross( c->ra, impulse );
 
@@ -206,9 +406,423 @@ void PhysicsContactSolver::Solve( )
 			}
 		}
 
+		// Normal
+		{
+			dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+			float vn = glm::dot( dv, cs->normal );
+
+			// Current separation of the anchors
+			glm::vec3 pA = bodyA->m_worldCenter + bodyA->m_tx.rotation * c->localRa;
+			glm::vec3 pB = bodyB->m_worldCenter + bodyB->m_tx.rotation * c->localRb;
+			float s = glm::dot( cs->normal, pB - pA ) + c->adjustedSeparation;
+
+			float bias = float( 0.0 );
+			float massScale = float( 1.0 );
+			float impulseScale = float( 0.0 );
+
+			// Speculative contacts may close their gap within the substep,
+			// overlap is only pushed out while solving with bias
+			if ( s > float( 0.0 ) )
+				bias = -s * m_invH;
+
+			else if ( useBias )
+			{
+				bias = glm::min( -m_biasRate * glm::min( float( 0.0 ), s + Q3_CONTACT_SLOP ), Q3_CONTACT_PUSH_VELOCITY );
+				massScale = m_massScale;
+				impulseScale = m_impulseScale;
+			}
+
+			float lambda = c->normalMass * massScale * (-vn + bias) - impulseScale * c->normalImpulse;
+
+			// Clamp impulse
+			float tempPN = c->normalImpulse;
+			c->normalImpulse = glm::max( tempPN + lambda, float( 0.0 ) );
+			lambda = c->normalImpulse - tempPN;
+
+			// Apply impulse
+			glm::vec3 impulse = cs->normal * lambda;
+			vA -= impulse * cs->mA;
+			wA -= cs->iA * glm::cross( c->ra, impulse );
+
+			vB += impulse * cs->mB;
+			wB += cs->iB * glm::cross( c->rb, impulse );
+		}
+	}
+
+	m_velocities[ cs->indexA ].v = vA;
+	m_velocities[ cs->indexA ].w = wA;
+	m_velocities[ cs->indexB ].v = vB;
+	m_velocities[ cs->indexB ].w = wB;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::ApplyRestitution( void )
+{
+	for ( int i = 0; i < m_contactCount; ++i )
+	{
+		PhysicsContactConstraintState *cs = m_contacts + i;
+
+		glm::vec3 vA = m_velocities[ cs->indexA ].v;
+		glm::vec3 wA = m_velocities[ cs->indexA ].w;
+		glm::vec3 vB = m_velocities[ cs->indexB ].v;
+		glm::vec3 wB = m_velocities[ cs->indexB ].w;
+
+		for ( int j = 0; j < cs->contactCount; ++j )
+		{
+			PhysicsContactState *c = cs->contacts + j;
+
+			// Bias holds the bounce velocity of contacts that hit hard enough
+			if ( c->bias == float( 0.0 ) || c->normalImpulse == float( 0.0 ) )
+				continue;
+
+			glm::vec3 dv = vB + glm::cross( wB, c->rb ) - vA - glm::cross( wA, c->ra );
+			float vn = glm::dot( dv, cs->normal );
+			float lambda = c->normalMass * (-vn + c->bias);
+
+			float tempPN = c->normalImpulse;
+			c->normalImpulse = glm::max( tempPN + lambda, float( 0.0 ) );
+			lambda = c->normalImpulse - tempPN;
+
+			glm::vec3 impulse = cs->normal * lambda;
+			vA -= impulse * cs->mA;
+			wA -= cs->iA * glm::cross( c->ra, impulse );
+
+			vB += impulse * cs->mB;
+			wB += cs->iB * glm::cross( c->rb, impulse );
+		}
+
 		m_velocities[ cs->indexA ].v = vA;
 		m_velocities[ cs->indexA ].w = wA;
 		m_velocities[ cs->indexB ].v = vB;
 		m_velocities[ cs->indexB ].w = wB;
 	}
 }
+
+//--------------------------------------------------------------------------------------------------
+unsigned int PhysicsContactSolver::GetBatchMemorySize( int bodyCount, int contactCount )
+{
+	// Every color wastes at most three lanes in its last batch
+	int maxBatches = contactCount / 4 + Q3_BATCH_COLORS;
+
+	unsigned int coloring = sizeof( unsigned int ) * bodyCount + sizeof( int ) * contactCount;
+	unsigned int batches = sizeof( PhysicsContactBatch ) * maxBatches;
+
+	return sizeof( int ) * contactCount + glm::max( coloring, batches );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::InitializeBatches( void )
+{
+	PhysicsStack *stack = m_island->m_stack;
+	int bodyCount = m_island->m_bodyCount;
+
+	m_order = (int *)stack->Allocate( sizeof( int ) * m_contactCount );
+	unsigned int *bodyColors = (unsigned int *)stack->Allocate( sizeof( unsigned int ) * bodyCount );
+	int *colors = (int *)stack->Allocate( sizeof( int ) * m_contactCount );
+	memset( bodyColors, 0, sizeof( unsigned int ) * bodyCount );
+
+	// Greedy coloring, every body keeps a mask of the colors its constraints
+	// already use. Bodies without mass are never written to by the solver,
+	// any number of constraints in a color may share them.
+	int colorCounts[ Q3_BATCH_COLORS + 1 ] = { 0 };
+
+	for ( int i = 0; i < m_contactCount; ++i )
+	{
+		PhysicsContactConstraintState *cs = m_contacts + i;
+		bool dynamicA = cs->mA > float( 0.0 );
+		bool dynamicB = cs->mB > float( 0.0 );
+
+		unsigned int used = 0;
+		if ( dynamicA )
+			used |= bodyColors[ cs->indexA ];
+		if ( dynamicB )
+			used |= bodyColors[ cs->indexB ];
+
+		int color = 0;
+		while ( color < Q3_BATCH_COLORS && (used & (1u << color)) )
+			++color;
+
+		if ( color < Q3_BATCH_COLORS )
+		{
+			if ( dynamicA )
+				bodyColors[ cs->indexA ] |= 1u << color;
+			if ( dynamicB )
+				bodyColors[ cs->indexB ] |= 1u << color;
+		}
+
+		colors[ i ] = color;
+		++colorCounts[ color ];
+	}
+
+	// Sort constraints by color, the overflow color comes last
+	int colorStarts[ Q3_BATCH_COLORS + 1 ];
+	int offset = 0;
+	m_batchCount = 0;
+
+	for ( int i = 0; i <= Q3_BATCH_COLORS; ++i )
+	{
+		colorStarts[ i ] = offset;
+		offset += colorCounts[ i ];
+
+		if ( i < Q3_BATCH_COLORS )
+			m_batchCount += (colorCounts[ i ] + 3) / 4;
+	}
+
+	m_overflowStart = colorStarts[ Q3_BATCH_COLORS ];
+
+	{
+		int fill[ Q3_BATCH_COLORS + 1 ];
+		memcpy( fill, colorStarts, sizeof( fill ) );
+
+		for ( int i = 0; i < m_contactCount; ++i )
+			m_order[ fill[ colors[ i ] ]++ ] = i;
+	}
+
+	stack->Free( colors );
+	stack->Free( bodyColors );
+
+	if ( !m_batchCount )
+		return;
+
+	m_batches = (PhysicsContactBatch *)stack->Allocate( sizeof( PhysicsContactBatch ) * m_batchCount );
+	memset( m_batches, 0, sizeof( PhysicsContactBatch ) * m_batchCount );
+
+	// Pack every color into SoA batches of four
+	PhysicsContactBatch *b = m_batches;
+
+	for ( int color = 0; color < Q3_BATCH_COLORS; ++color )
+	{
+		int start = colorStarts[ color ];
+		int end = start + colorCounts[ color ];
+
+		for ( int first = start; first < end; first += 4, ++b )
+		{
+			for ( int lane = 0; lane < 4; ++lane )
+			{
+				if ( first + lane >= end )
+				{
+					b->constraints[ lane ] = -1;
+					b->indexA[ lane ] = -1;
+					b->indexB[ lane ] = -1;
+					continue;
+				}
+
+				int index = m_order[ first + lane ];
+				PhysicsContactConstraintState *cs = m_contacts + index;
+
+				b->constraints[ lane ] = index;
+				b->indexA[ lane ] = cs->indexA;
+				b->indexB[ lane ] = cs->indexB;
+				b->contactCount = glm::max( b->contactCount, cs->contactCount );
+
+				b->normalX[ lane ] = cs->normal.x;
+				b->normalY[ lane ] = cs->normal.y;
+				b->normalZ[ lane ] = cs->normal.z;
+
+				for ( int t = 0; t < 2; ++t )
+				{
+					b->tangentX[ t ][ lane ] = cs->tangentVectors[ t ].x;
+					b->tangentY[ t ][ lane ] = cs->tangentVectors[ t ].y;
+					b->tangentZ[ t ][ lane ] = cs->tangentVectors[ t ].z;
+				}
+
+				for ( int col = 0; col < 3; ++col )
+				{
+					for ( int row = 0; row < 3; ++row )
+					{
+						b->iA[ col * 3 + row ][ lane ] = cs->iA[ col ][ row ];
+						b->iB[ col * 3 + row ][ lane ] = cs->iB[ col ][ row ];
+					}
+				}
+
+				b->mA[ lane ] = cs->mA;
+				b->mB[ lane ] = cs->mB;
+				b->friction[ lane ] = cs->friction;
+
+				for ( int j = 0; j < cs->contactCount; ++j )
+				{
+					PhysicsContactState *c = cs->contacts + j;
+					PhysicsContactBatchPoint *p = b->points + j;
+
+					p->raX[ lane ] = c->ra.x;
+					p->raY[ lane ] = c->ra.y;
+					p->raZ[ lane ] = c->ra.z;
+					p->rbX[ lane ] = c->rb.x;
+					p->rbY[ lane ] = c->rb.y;
+					p->rbZ[ lane ] = c->rb.z;
+					p->normalMass[ lane ] = c->normalMass;
+					p->tangentMass[ 0 ][ lane ] = c->tangentMass[ 0 ];
+					p->tangentMass[ 1 ][ lane ] = c->tangentMass[ 1 ];
+					p->bias[ lane ] = c->bias;
+					p->normalImpulse[ lane ] = c->normalImpulse;
+					p->tangentImpulse[ 0 ][ lane ] = c->tangentImpulse[ 0 ];
+					p->tangentImpulse[ 1 ][ lane ] = c->tangentImpulse[ 1 ];
+				}
+			}
+		}
+	}
+
+	assert( b == m_batches + m_batchCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::SolveBatch( PhysicsContactBatch *b )
+{
+	// Gather velocities, unused lanes stay zero
+	float v[ 12 ][ 4 ];
+	memset( v, 0, sizeof( v ) );
+
+	for ( int lane = 0; lane < 4; ++lane )
+	{
+		if ( b->constraints[ lane ] < 0 )
+			continue;
+
+		const PhysicsVelocityState *a = m_velocities + b->indexA[ lane ];
+		const PhysicsVelocityState *c = m_velocities + b->indexB[ lane ];
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			v[ k ][ lane ] = a->v[ k ];
+			v[ 3 + k ][ lane ] = a->w[ k ];
+			v[ 6 + k ][ lane ] = c->v[ k ];
+			v[ 9 + k ][ lane ] = c->w[ k ];
+		}
+	}
+
+	PhysicsVec3x4 vA = PhysicsLoad3x4( v[ 0 ], v[ 1 ], v[ 2 ] );
+	PhysicsVec3x4 wA = PhysicsLoad3x4( v[ 3 ], v[ 4 ], v[ 5 ] );
+	PhysicsVec3x4 vB = PhysicsLoad3x4( v[ 6 ], v[ 7 ], v[ 8 ] );
+	PhysicsVec3x4 wB = PhysicsLoad3x4( v[ 9 ], v[ 10 ], v[ 11 ] );
+
+	PhysicsVec3x4 normal = PhysicsLoad3x4( b->normalX, b->normalY, b->normalZ );
+	PhysicsVec3x4 tangents[ 2 ];
+	tangents[ 0 ] = PhysicsLoad3x4( b->tangentX[ 0 ], b->tangentY[ 0 ], b->tangentZ[ 0 ] );
+	tangents[ 1 ] = PhysicsLoad3x4( b->tangentX[ 1 ], b->tangentY[ 1 ], b->tangentZ[ 1 ] );
+
+	PhysicsFloat4 iA[ 9 ];
+	PhysicsFloat4 iB[ 9 ];
+	for ( int k = 0; k < 9; ++k )
+	{
+		iA[ k ] = PhysicsLoad4( b->iA[ k ] );
+		iB[ k ] = PhysicsLoad4( b->iB[ k ] );
+	}
+
+	PhysicsFloat4 mA = PhysicsLoad4( b->mA );
+	PhysicsFloat4 mB = PhysicsLoad4( b->mB );
+	PhysicsFloat4 friction = PhysicsLoad4( b->friction );
+	PhysicsFloat4 zero = PhysicsSplat4( float( 0.0 ) );
+	PhysicsFloat4 residual = zero;
+
+	// Same steps as SolveConstraint, four constraints at a time. Padded
+	// contact slots have zero mass terms and never produce an impulse.
+	for ( int j = 0; j < b->contactCount; ++j )
+	{
+		PhysicsContactBatchPoint *p = b->points + j;
+
+		PhysicsVec3x4 ra = PhysicsLoad3x4( p->raX, p->raY, p->raZ );
+		PhysicsVec3x4 rb = PhysicsLoad3x4( p->rbX, p->rbY, p->rbZ );
+
+		// relative velocity at contact
+		PhysicsVec3x4 dv = vB + PhysicsCross4( wB, rb ) - vA - PhysicsCross4( wA, ra );
+
+		// Friction
+		if ( m_enableFriction )
+		{
+			PhysicsFloat4 maxLambda = friction * PhysicsLoad4( p->normalImpulse );
+
+			for ( int i = 0; i < 2; ++i )
+			{
+				PhysicsFloat4 lambda = -PhysicsDot4( dv, tangents[ i ] ) * PhysicsLoad4( p->tangentMass[ i ] );
+
+				PhysicsFloat4 oldPT = PhysicsLoad4( p->tangentImpulse[ i ] );
+				PhysicsFloat4 newPT = PhysicsMax4( PhysicsMin4( oldPT + lambda, maxLambda ), -maxLambda );
+				PhysicsStore4( p->tangentImpulse[ i ], newPT );
+				lambda = newPT - oldPT;
+				residual = PhysicsMax4( residual, PhysicsAbs4( lambda ) );
+
+				PhysicsVec3x4 impulse = tangents[ i ] * lambda;
+				vA = vA - impulse * mA;
+				wA = wA - PhysicsMul3x4( iA, PhysicsCross4( ra, impulse ) );
+
+				vB = vB + impulse * mB;
+				wB = wB + PhysicsMul3x4( iB, PhysicsCross4( rb, impulse ) );
+			}
+		}
+
+		// Normal
+		{
+			dv = vB + PhysicsCross4( wB, rb ) - vA - PhysicsCross4( wA, ra );
+
+			PhysicsFloat4 vn = PhysicsDot4( dv, normal );
+			PhysicsFloat4 lambda = PhysicsLoad4( p->normalMass ) * (PhysicsLoad4( p->bias ) - vn);
+
+			PhysicsFloat4 oldPN = PhysicsLoad4( p->normalImpulse );
+			PhysicsFloat4 newPN = PhysicsMax4( oldPN + lambda, zero );
+			PhysicsStore4( p->normalImpulse, newPN );
+			lambda = newPN - oldPN;
+			residual = PhysicsMax4( residual, PhysicsAbs4( lambda ) );
+
+			PhysicsVec3x4 impulse = normal * lambda;
+			vA = vA - impulse * mA;
+			wA = wA - PhysicsMul3x4( iA, PhysicsCross4( ra, impulse ) );
+
+			vB = vB + impulse * mB;
+			wB = wB + PhysicsMul3x4( iB, PhysicsCross4( rb, impulse ) );
+		}
+	}
+
+	float residuals[ 4 ];
+	PhysicsStore4( residuals, residual );
+	for ( int lane = 0; lane < 4; ++lane )
+		m_residual = glm::max( m_residual, residuals[ lane ] );
+
+	// Scatter, only the lanes in use
+	PhysicsStore3x4( v[ 0 ], v[ 1 ], v[ 2 ], vA );
+	PhysicsStore3x4( v[ 3 ], v[ 4 ], v[ 5 ], wA );
+	PhysicsStore3x4( v[ 6 ], v[ 7 ], v[ 8 ], vB );
+	PhysicsStore3x4( v[ 9 ], v[ 10 ], v[ 11 ], wB );
+
+	for ( int lane = 0; lane < 4; ++lane )
+	{
+		if ( b->constraints[ lane ] < 0 )
+			continue;
+
+		PhysicsVelocityState *a = m_velocities + b->indexA[ lane ];
+		PhysicsVelocityState *c = m_velocities + b->indexB[ lane ];
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			a->v[ k ] = v[ k ][ lane ];
+			a->w[ k ] = v[ 3 + k ][ lane ];
+			c->v[ k ] = v[ 6 + k ][ lane ];
+			c->w[ k ] = v[ 9 + k ][ lane ];
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsContactSolver::StoreBatches( void )
+{
+	for ( int i = 0; i < m_batchCount; ++i )
+	{
+		PhysicsContactBatch *b = m_batches + i;
+
+		for ( int lane = 0; lane < 4; ++lane )
+		{
+			if ( b->constraints[ lane ] < 0 )
+				continue;
+
+			PhysicsContactConstraintState *cs = m_contacts + b->constraints[ lane ];
+
+			for ( int j = 0; j < cs->contactCount; ++j )
+			{
+				PhysicsContactState *c = cs->contacts + j;
+				PhysicsContactBatchPoint *p = b->points + j;
+
+				c->normalImpulse = p->normalImpulse[ lane ];
+				c->tangentImpulse[ 0 ] = p->tangentImpulse[ 0 ][ lane ];
+				c->tangentImpulse[ 1 ] = p->tangentImpulse[ 1 ][ lane ];
+			}
+		}
+	}
+}
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include "PhysicsSettings.h"
 
 struct PhysicsIsland;
 struct PhysicsVelocityState;
@@ -42,11 +43,14 @@ struct PhysicsContactState
 	float bias;					// Restitution + baumgarte
 	float normalMass;			// Normal constraint mass
 	float tangentMass[ 2 ];		// Tangent constraint mass
+	glm::vec3 localRa;			// ra in A's frame, for the substepped solver
+	glm::vec3 localRb;			// rb in B's frame
+	float adjustedSeparation;	// Penetration minus the initial anchor separation
 };
 
 struct PhysicsContactConstraintState
 {
-	PhysicsContactState contacts[ 8 ];
+	PhysicsContactState contacts[ Q3_MAX_MANIFOLD_CONTACTS ];
 	int contactCount;
 	glm::vec3 tangentVectors[ 2 ];	// Tangent vectors
 	glm::vec3 normal;				// From A to B
@@ -62,18 +66,95 @@ struct PhysicsContactConstraintState
 	int indexB;
 };
 
+// One contact point slot of four constraints, SoA packed
+struct PhysicsContactBatchPoint
+{
+	float raX[ 4 ], raY[ 4 ], raZ[ 4 ];
+	float rbX[ 4 ], rbY[ 4 ], rbZ[ 4 ];
+	float normalMass[ 4 ];
+	float tangentMass[ 2 ][ 4 ];
+	float bias[ 4 ];
+	float normalImpulse[ 4 ];
+	float tangentImpulse[ 2 ][ 4 ];
+};
+
+// Four constraints of one color, none of them share a dynamic body. Unused
+// lanes and contact slots are zero filled, which turns them into no-ops.
+struct PhysicsContactBatch
+{
+	int constraints[ 4 ];	// Index into m_contacts, -1 for unused lanes
+	int indexA[ 4 ];
+	int indexB[ 4 ];
+	int contactCount;		// Largest contact count of all lanes
+
+	float normalX[ 4 ], normalY[ 4 ], normalZ[ 4 ];
+	float tangentX[ 2 ][ 4 ], tangentY[ 2 ][ 4 ], tangentZ[ 2 ][ 4 ];
+	float iA[ 9 ][ 4 ];		// Column major
+	float iB[ 9 ][ 4 ];
+	float mA[ 4 ];
+	float mB[ 4 ];
+	float friction[ 4 ];
+
+	PhysicsContactBatchPoint points[ Q3_MAX_MANIFOLD_CONTACTS ];
+};
+
 struct PhysicsContactSolver
 {
 	void Initialize( PhysicsIsland *island );
 	void ShutDown( void );
 
 	void PreSolve( float dt );
-	void Solve( void );
+
+	// Runs one iteration, returns the largest change of any accumulated
+	// normal or friction impulse
+	float Solve( void );
+
+	// Substepped solver, see PhysicsScene::SetSubsteps. PrepareSubsteps
+	// replaces PreSolve, h is the length of one substep. Every substep the
+	// island integrates velocities, calls WarmStart and SolveSoft with bias,
+	// integrates positions and relaxes with SolveSoft without bias.
+	// Constraints read the body positions to track the separation of their
+	// contacts, restitution is applied once after the last substep. Batches
+	// are not used.
+	void PrepareSubsteps( float h );
+	void WarmStart( void );
+	void SolveSoft( bool useBias );
+	void ApplyRestitution( void );
+
+	// Scratch memory InitializeBatches needs from the island stack
+	static unsigned int GetBatchMemorySize( int bodyCount, int contactCount );
+
+	// Colors the constraint graph so that no two constraints of a color
+	// share a dynamic body and packs every color into batches of four.
+	// Must run after PreSolve. Solve then works on the batches and
+	// ShutDown copies the batched impulses back.
+	void InitializeBatches( void );
 
 	PhysicsIsland *m_island;
 	PhysicsContactConstraintState *m_contacts;
 	int m_contactCount;
 	PhysicsVelocityState *m_velocities;
 
+	// Constraint indices sorted by color, constraints that did not get a
+	// color are at the end and get solved one by one
+	int *m_order;
+	int m_overflowStart;
+	PhysicsContactBatch *m_batches;
+	int m_batchCount;
+
 	bool m_enableFriction;
+	float m_residual;
+
+	// Soft contact parameters of the substepped solver
+	float m_invH;
+	float m_biasRate;
+	float m_massScale;
+	float m_impulseScale;
+
+private:
+	void ComputeMass( PhysicsContactConstraintState *cs, PhysicsContactState *c );
+	void SolveConstraint( PhysicsContactConstraintState *cs );
+	void SolveSoftConstraint( PhysicsContactConstraintState *cs, bool useBias );
+	void SolveBatch( PhysicsContactBatch *b );
+	void StoreBatches( void );
 };
\ No newline at end of file
@@ -31,7 +31,10 @@
 
 #include "PhysicsRender.h"
 #include "PhysicsMemory.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsSettings.h"
 
+#include <algorithm>
 #include <string.h>
 #include "Common.h"
 
@@ -56,6 +59,18 @@ PhysicsDynamicAABBTree::PhysicsDynamicAABBTree( )
 	m_capacity = 1024;
 	m_count = 0;
 	m_nodes = (Node *)PhysicsAlloc( sizeof( Node ) * m_capacity );
+	m_buildArea = float( 0.0 );
+
+	m_buildLeaves = NULL;
+	m_buildCenters = NULL;
+	m_buildSlots = NULL;
+	m_buildTasks = NULL;
+	m_buildBranches = NULL;
+	m_buildLeafCapacity = 0;
+	m_buildCenterCapacity = 0;
+	m_buildSlotCapacity = 0;
+	m_buildTaskCapacity = 0;
+	m_buildBranchCapacity = 0;
 
 	AddToFreeList( 0 );
 }
@@ -63,9 +78,30 @@ PhysicsDynamicAABBTree::PhysicsDynamicAABBTree( )
 //--------------------------------------------------------------------------------------------------
 PhysicsDynamicAABBTree::~PhysicsDynamicAABBTree( )
 {
+	PhysicsFree( m_buildBranches );
+	PhysicsFree( m_buildTasks );
+	PhysicsFree( m_buildSlots );
+	PhysicsFree( m_buildCenters );
+	PhysicsFree( m_buildLeaves );
 	PhysicsFree( m_nodes );
 }
 
+//--------------------------------------------------------------------------------------------------
+// Grows a scratch array to hold at least needed items, the old contents are
+// dropped
+template <typename T>
+static T* ReserveScratch( T*& data, int& capacity, int needed )
+{
+	if ( needed > capacity )
+	{
+		PhysicsFree( data );
+		capacity = glm::max( needed, 2 * capacity );
+		data = (T *)PhysicsAlloc( sizeof( T ) * capacity );
+	}
+
+	return data;
+}
+
 //--------------------------------------------------------------------------------------------------
 int PhysicsDynamicAABBTree::Insert( const PhysicsAABB& aabb, void *userData )
 {
@@ -123,6 +159,73 @@ const PhysicsAABB& PhysicsDynamicAABBTree::GetFatAABB( int id ) const
 	return m_nodes[ id ].aabb;
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::Build( std::span<PhysicsTreeProxy> proxies, PhysicsJobPool *jobPool )
+{
+	int leafCount = (int)proxies.size( );
+
+	m_root = Node::Null;
+	m_count = 0;
+	AddToFreeList( 0 );
+	ReserveNodes( glm::max( 2 * leafCount - 1, 0 ) );
+
+	int *leaves = ReserveScratch( m_buildLeaves, m_buildLeafCapacity, glm::max( leafCount, 1 ) );
+
+	for ( int i = 0; i < leafCount; ++i )
+	{
+		int id = AllocateNode( );
+		m_nodes[ id ].aabb = proxies[ i ].aabb;
+		FattenAABB( m_nodes[ id ].aabb );
+		m_nodes[ id ].userData = proxies[ i ].userData;
+		m_nodes[ id ].height = 0;
+
+		proxies[ i ].id = id;
+		leaves[ i ] = id;
+	}
+
+	BuildBranches( leaves, leafCount, jobPool );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::Rebuild( PhysicsJobPool *jobPool )
+{
+	int leafCount = 0;
+	int *leaves = ReserveScratch( m_buildLeaves, m_buildLeafCapacity, m_capacity );
+
+	// Leaves have height 0, branches more and free nodes -1
+	for ( int i = 0; i < m_capacity; ++i )
+	{
+		if ( m_nodes[ i ].height == 0 )
+			leaves[ leafCount++ ] = i;
+
+		else if ( m_nodes[ i ].height > 0 )
+			DeallocateNode( i );
+	}
+
+	BuildBranches( leaves, leafCount, jobPool );
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsDynamicAABBTree::GetInternalArea( ) const
+{
+	float area = float( 0.0 );
+
+	for ( int i = 0; i < m_capacity; ++i )
+	{
+		if ( m_nodes[ i ].height > 0 )
+			area += m_nodes[ i ].aabb.SurfaceArea( );
+	}
+
+	return area;
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsDynamicAABBTree::GetBuildArea( ) const
+{
+	return m_buildArea;
+}
+
+//--------------------------------------------------------------------------------------------------
 void PhysicsDynamicAABBTree::Render( PhysicsRender *render ) const
 {
 	if ( m_root != Node::Null )
@@ -532,3 +635,297 @@ void PhysicsDynamicAABBTree::SyncHeirarchy( int index )
 		index = m_nodes[ index ].parent;
 	}
 }
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::InsertBulk( std::span<PhysicsTreeProxy> proxies, PhysicsJobPool *jobPool )
+{
+	int count = (int)proxies.size( );
+	int leafCount = (m_count + 1) / 2;
+
+	// A rebuild touches every leaf, a few new ones are cheaper to insert
+	if ( count < leafCount / 4 )
+	{
+		for ( int i = 0; i < count; ++i )
+			proxies[ i ].id = Insert( proxies[ i ].aabb, proxies[ i ].userData );
+
+		return;
+	}
+
+	ReserveNodes( 2 * count );
+
+	for ( int i = 0; i < count; ++i )
+	{
+		int id = AllocateNode( );
+		m_nodes[ id ].aabb = proxies[ i ].aabb;
+		FattenAABB( m_nodes[ id ].aabb );
+		m_nodes[ id ].userData = proxies[ i ].userData;
+		m_nodes[ id ].height = 0;
+
+		proxies[ i ].id = id;
+	}
+
+	Rebuild( jobPool );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::Reserve( int leafCount )
+{
+	ReserveNodes( 2 * leafCount - 1 - m_count );
+
+	ReserveScratch( m_buildLeaves, m_buildLeafCapacity, m_capacity );
+	ReserveScratch( m_buildCenters, m_buildCenterCapacity, m_capacity );
+	ReserveScratch( m_buildSlots, m_buildSlotCapacity, leafCount );
+	ReserveScratch( m_buildTasks, m_buildTaskCapacity, leafCount );
+	ReserveScratch( m_buildBranches, m_buildBranchCapacity, leafCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::ReserveNodes( int count )
+{
+	if ( m_capacity - m_count >= count )
+		return;
+
+	int oldCapacity = m_capacity;
+	int oldFreeList = m_freeList;
+
+	while ( m_capacity - m_count < count )
+		m_capacity *= 2;
+
+	// Free nodes may sit anywhere in the old array, copy all of it
+	Node *newNodes = (Node *)PhysicsAlloc( sizeof( Node ) * m_capacity );
+	memcpy( newNodes, m_nodes, sizeof( Node ) * oldCapacity );
+	PhysicsFree( m_nodes );
+	m_nodes = newNodes;
+
+	AddToFreeList( oldCapacity );
+	m_nodes[ m_capacity - 1 ].next = oldFreeList;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::BuildBranches( int *leaves, int leafCount, PhysicsJobPool *jobPool )
+{
+	if ( leafCount == 0 )
+	{
+		m_root = Node::Null;
+		m_buildArea = float( 0.0 );
+		return;
+	}
+
+	// Every branch node is allocated up front so that tasks can fill in
+	// their own slice of them without touching the free list
+	ReserveNodes( leafCount - 1 );
+
+	BuildContext context;
+	context.tree = this;
+	context.leaves = leaves;
+	context.centers = ReserveScratch( m_buildCenters, m_buildCenterCapacity, m_capacity );
+	context.slots = ReserveScratch( m_buildSlots, m_buildSlotCapacity, leafCount );
+	context.tasks = NULL;
+	context.taskCount = 0;
+	context.taskSize = 0;
+	context.branches = NULL;
+	context.branchCount = 0;
+
+	for ( int i = 0; i < leafCount; ++i )
+	{
+		const PhysicsAABB& aabb = m_nodes[ leaves[ i ] ].aabb;
+		context.centers[ leaves[ i ] ] = (aabb.min + aabb.max) * float( 0.5 );
+	}
+
+	for ( int i = 0; i < leafCount - 1; ++i )
+		context.slots[ i ] = AllocateNode( );
+
+	if ( jobPool && jobPool->GetThreadCount( ) > 1 && leafCount > Q3_TREE_BUILD_TASK_SIZE )
+	{
+		context.taskSize = glm::max( Q3_TREE_BUILD_TASK_SIZE, leafCount / (4 * jobPool->GetThreadCount( )) );
+		context.tasks = ReserveScratch( m_buildTasks, m_buildTaskCapacity, leafCount );
+		context.branches = ReserveScratch( m_buildBranches, m_buildBranchCapacity, leafCount );
+	}
+
+	m_root = BuildRange( &context, 0, leafCount, Node::Null, false );
+
+	if ( context.tasks )
+	{
+		jobPool->Run( BuildJob, &context, context.taskCount );
+
+		for ( int i = 0; i < context.taskCount; ++i )
+		{
+			BuildTask *task = context.tasks + i;
+
+			if ( task->parent == Node::Null )
+				m_root = task->root;
+
+			else if ( task->left )
+				m_nodes[ task->parent ].left = task->root;
+
+			else
+				m_nodes[ task->parent ].right = task->root;
+		}
+
+		// Branches were recorded children first
+		for ( int i = 0; i < context.branchCount; ++i )
+		{
+			Node *n = m_nodes + context.branches[ i ];
+			n->aabb = PhysicsCombine( m_nodes[ n->left ].aabb, m_nodes[ n->right ].aabb );
+			n->height = 1 + glm::max( m_nodes[ n->left ].height, m_nodes[ n->right ].height );
+		}
+	}
+
+	m_buildArea = GetInternalArea( );
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsDynamicAABBTree::BuildRange( BuildContext *context, int begin, int end, int parent, bool left )
+{
+	int count = end - begin;
+	int *leaves = context->leaves;
+	const glm::vec3 *centers = context->centers;
+
+	if ( count == 1 )
+	{
+		m_nodes[ leaves[ begin ] ].parent = parent;
+		return leaves[ begin ];
+	}
+
+	if ( count <= context->taskSize )
+	{
+		BuildTask *task = context->tasks + context->taskCount++;
+		task->begin = begin;
+		task->end = end;
+		task->parent = parent;
+		task->left = left;
+		task->root = Node::Null;
+		return Node::Null;
+	}
+
+	// Split along the longest axis of the leaf centers
+	glm::vec3 cmin = centers[ leaves[ begin ] ];
+	glm::vec3 cmax = cmin;
+
+	for ( int i = begin + 1; i < end; ++i )
+	{
+		cmin = glm::min( cmin, centers[ leaves[ i ] ] );
+		cmax = glm::max( cmax, centers[ leaves[ i ] ] );
+	}
+
+	glm::vec3 extent = cmax - cmin;
+	int axis = 0;
+	if ( extent.y > extent[ axis ] )
+		axis = 1;
+	if ( extent.z > extent[ axis ] )
+		axis = 2;
+
+	int split = begin + count / 2;
+
+	if ( extent[ axis ] > float( 1.0e-6 ) )
+	{
+		const int k_binCount = 16;
+		PhysicsAABB bins[ k_binCount ];
+		int binCounts[ k_binCount ] = { 0 };
+		float scale = float( k_binCount ) * float( 0.9999 ) / extent[ axis ];
+		float origin = cmin[ axis ];
+
+		for ( int i = begin; i < end; ++i )
+		{
+			int b = (int)((centers[ leaves[ i ] ][ axis ] - origin) * scale);
+			const PhysicsAABB& aabb = m_nodes[ leaves[ i ] ].aabb;
+
+			bins[ b ] = binCounts[ b ] ? PhysicsCombine( bins[ b ], aabb ) : aabb;
+			++binCounts[ b ];
+		}
+
+		// Sweep from the right to get the area of everything right of a split
+		float rightArea[ k_binCount ];
+		int rightCount[ k_binCount ];
+		PhysicsAABB bounds;
+		int boundsCount = 0;
+
+		for ( int b = k_binCount - 1; b > 0; --b )
+		{
+			if ( binCounts[ b ] )
+			{
+				bounds = boundsCount ? PhysicsCombine( bounds, bins[ b ] ) : bins[ b ];
+				boundsCount += binCounts[ b ];
+			}
+
+			rightArea[ b ] = boundsCount ? bounds.SurfaceArea( ) : float( 0.0 );
+			rightCount[ b ] = boundsCount;
+		}
+
+		// Then sweep from the left, the split goes in front of bin b
+		float bestCost = Q3_R32_MAX;
+		int bestBin = 0;
+		boundsCount = 0;
+
+		for ( int b = 1; b < k_binCount; ++b )
+		{
+			if ( binCounts[ b - 1 ] )
+			{
+				bounds = boundsCount ? PhysicsCombine( bounds, bins[ b - 1 ] ) : bins[ b - 1 ];
+				boundsCount += binCounts[ b - 1 ];
+			}
+
+			if ( !boundsCount || !rightCount[ b ] )
+				continue;
+
+			float cost = bounds.SurfaceArea( ) * float( boundsCount ) + rightArea[ b ] * float( rightCount[ b ] );
+
+			if ( cost < bestCost )
+			{
+				bestCost = cost;
+				bestBin = b;
+			}
+		}
+
+		if ( bestBin )
+		{
+			int *middle = std::partition( leaves + begin, leaves + end, [ & ]( int leaf ) {
+				return (int)((centers[ leaf ][ axis ] - origin) * scale) < bestBin;
+			} );
+
+			split = (int)(middle - leaves);
+		}
+	}
+
+	// All centers in one spot, fall back to an even split
+	if ( split == begin || split == end || extent[ axis ] <= float( 1.0e-6 ) )
+	{
+		split = begin + count / 2;
+		std::nth_element( leaves + begin, leaves + split, leaves + end, [ & ]( int a, int b ) {
+			return centers[ a ][ axis ] < centers[ b ][ axis ];
+		} );
+	}
+
+	int id = context->slots[ split - 1 ];
+	Node *n = m_nodes + id;
+	n->parent = parent;
+	n->userData = NULL;
+	n->left = BuildRange( context, begin, split, id, true );
+	n->right = BuildRange( context, split, end, id, false );
+
+	if ( context->taskSize )
+	{
+		context->branches[ context->branchCount++ ] = id;
+	}
+
+	else
+	{
+		n->aabb = PhysicsCombine( m_nodes[ n->left ].aabb, m_nodes[ n->right ].aabb );
+		n->height = 1 + glm::max( m_nodes[ n->left ].height, m_nodes[ n->right ].height );
+	}
+
+	return id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsDynamicAABBTree::BuildJob( void *param, int index, int threadIndex )
+{
+	BuildContext *context = (BuildContext *)param;
+	BuildTask *task = context->tasks + index;
+
+	// Subtrees below the task size are built serially
+	BuildContext local = *context;
+	local.taskSize = 0;
+
+	task->root = context->tree->BuildRange( &local, task->begin, task->end, task->parent, task->left );
+}
@@ -30,8 +30,19 @@
 #include "Common.h"
 #include "PhysicsRaycastData.h"
 
+#include <span>
+
 
 class PhysicsRender;
+class PhysicsJobPool;
+
+// Input of PhysicsDynamicAABBTree::Build, id receives the leaf id
+struct PhysicsTreeProxy
+{
+	PhysicsAABB aabb;
+	void *userData;
+	int id;
+};
 
 class PhysicsDynamicAABBTree
 {
@@ -46,6 +57,30 @@ public:
 
 	void *GetUserData( int id ) const;
 	const PhysicsAABB& GetFatAABB( int id ) const;
+
+	// Replaces the whole tree with one built top-down with binned SAH. Takes
+	// tight AABBs like Insert. The subtrees below the top levels are built
+	// as jobs when a job pool is passed.
+	void Build( std::span<PhysicsTreeProxy> proxies, PhysicsJobPool *jobPool = NULL );
+
+	// Rebuilds all branches with binned SAH, leaf ids stay valid
+	void Rebuild( PhysicsJobPool *jobPool = NULL );
+
+	// Inserts all proxies like Insert, id receives the leaf id. When there
+	// are many proxies compared to the leaves already in the tree they are
+	// added as plain leaves and the branches are rebuilt once.
+	void InsertBulk( std::span<PhysicsTreeProxy> proxies, PhysicsJobPool *jobPool = NULL );
+
+	// Makes room for leafCount leaves and sizes the scratch of Rebuild for
+	// them, so that neither inserting up to that many nor rebuilding
+	// allocates afterwards
+	void Reserve( int leafCount );
+
+	// Total surface area of all branch nodes, lower is better. Compare to
+	// GetBuildArea( ) to find out how much incremental updates degraded
+	// the tree since the last Build or Rebuild.
+	float GetInternalArea( ) const;
+	float GetBuildArea( ) const;
 	
     void Render( PhysicsRender *render ) const;
 
@@ -54,10 +89,26 @@ public:
 	template <typename T>
 	void Query( T *cb, PhysicsRaycastData& rayCast ) const;
 
+	// Closest and any hit ray casts. Calls t = cb->RayCastCallBack( id, t )
+	// for leaves touching the ray, t being the current end of the ray. The
+	// callback returns the new end, the ray is clipped to it and children
+	// are visited near to far. Returning 0 ends the traversal. Returns the
+	// final end of the ray.
+	template <typename T>
+	float RayCast( T *cb, const PhysicsRaycastData& rayCast ) const;
+
+	// Traverses the tree once for all rays of the packet. Calls
+	// cb->TreeCallBack( id, lanes ) with the mask of lanes touching the
+	// leaf, the callback may shrink packet.t to cull the rest of the tree.
+	template <typename T>
+	void Query( T *cb, PhysicsRayPacket& packet ) const;
+
 	// For testing
 	void Validate( ) const;
 
 private:
+	friend class PhysicsBVH4;
+
 	struct Node
 	{
 		bool IsLeaf( void ) const
@@ -110,11 +161,52 @@ private:
 	// Insert nodes at a given index until m_capacity into the free list
 	void AddToFreeList( int index );
 
+	struct BuildTask
+	{
+		int begin;
+		int end;
+		int parent;
+		bool left;
+		int root;
+	};
+
+	struct BuildContext
+	{
+		PhysicsDynamicAABBTree *tree;
+		int *leaves;
+		glm::vec3 *centers;
+		int *slots;			// Branch node ids, the range [ b, e ) uses slots [ b, e - 1 )
+		BuildTask *tasks;
+		int taskCount;
+		int taskSize;		// Ranges up to this size become tasks, 0 builds serially
+		int *branches;		// Branches above the tasks, fixed up after the tasks ran
+		int branchCount;
+	};
+
+	void ReserveNodes( int count );
+	void BuildBranches( int *leaves, int leafCount, PhysicsJobPool *jobPool );
+	int BuildRange( BuildContext *context, int begin, int end, int parent, bool left );
+	static void BuildJob( void *param, int index, int threadIndex );
+
 	int m_root;
 	Node *m_nodes;
 	int m_count;	// Number of active nodes
 	int m_capacity;	// Max capacity of nodes
 	int m_freeList;
+	float m_buildArea;
+
+	// Scratch of Build and Rebuild, kept between builds so that rebuilding
+	// during a step does not allocate
+	int *m_buildLeaves;
+	glm::vec3 *m_buildCenters;
+	int *m_buildSlots;
+	BuildTask *m_buildTasks;
+	int *m_buildBranches;
+	int m_buildLeafCapacity;
+	int m_buildCenterCapacity;
+	int m_buildSlotCapacity;
+	int m_buildTaskCapacity;
+	int m_buildBranchCapacity;
 };
 
 
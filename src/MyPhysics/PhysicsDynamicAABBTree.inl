@@ -56,6 +56,9 @@ inline void PhysicsDynamicAABBTree::DeallocateNode( int index )
 template <typename T>
 inline void PhysicsDynamicAABBTree::Query( T *cb, const PhysicsAABB& aabb ) const
 {
+	if ( m_root == Node::Null )
+		return;
+
 	const int k_stackCapacity = 256;
 	int stack[ k_stackCapacity ];
 	int sp = 1;
@@ -90,6 +93,9 @@ inline void PhysicsDynamicAABBTree::Query( T *cb, const PhysicsAABB& aabb ) cons
 template <typename T>
 void PhysicsDynamicAABBTree::Query( T *cb, PhysicsRaycastData& rayCast ) const
 {
+	if ( m_root == Node::Null )
+		return;
+
 	const float k_epsilon = float( 1.0e-6 );
 	const int k_stackCapacity = 256;
 	int stack[ k_stackCapacity ];
@@ -157,3 +163,131 @@ void PhysicsDynamicAABBTree::Query( T *cb, PhysicsRaycastData& rayCast ) const
 		}
 	}
 }
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline void PhysicsDynamicAABBTree::Query( T *cb, PhysicsRayPacket& packet ) const
+{
+	if ( m_root == Node::Null )
+		return;
+
+	const int k_stackCapacity = 256;
+	int stack[ k_stackCapacity ];
+	int sp = 1;
+
+	*stack = m_root;
+
+	while ( sp )
+	{
+		const Node *n = m_nodes + stack[ --sp ];
+
+		// Reads packet.t every time, hits reported so far cull the rest
+		int lanes = PhysicsRayPacketOverlap( packet, PhysicsSplat3x4( n->aabb.min ), PhysicsSplat3x4( n->aabb.max ) );
+
+		if ( !lanes )
+			continue;
+
+		if ( n->IsLeaf( ) )
+		{
+			if ( !cb->TreeCallBack( (int)(n - m_nodes), lanes ) )
+				return;
+		}
+
+		else
+		{
+			// k_stackCapacity too small
+			assert( sp + 1 < k_stackCapacity );
+			stack[ sp++ ] = n->left;
+			stack[ sp++ ] = n->right;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+inline float PhysicsDynamicAABBTree::RayCast( T *cb, const PhysicsRaycastData& rayCast ) const
+{
+	float maxT = rayCast.t;
+
+	if ( m_root == Node::Null )
+		return maxT;
+
+	glm::vec3 start = rayCast.start;
+	glm::vec3 invDir = PhysicsRayInvDir( rayCast.dir );
+
+	// Entry times are kept with the nodes, a hit found after a node was
+	// pushed may already rule it out
+	struct Entry
+	{
+		int id;
+		float t;
+	};
+
+	const int k_stackCapacity = 256;
+	Entry stack[ k_stackCapacity ];
+	int sp = 0;
+
+	float rootT;
+	if ( !PhysicsRayOverlap( start, invDir, maxT, m_nodes[ m_root ].aabb.min, m_nodes[ m_root ].aabb.max, &rootT ) )
+		return maxT;
+
+	stack[ sp ].id = m_root;
+	stack[ sp ].t = rootT;
+	++sp;
+
+	while ( sp )
+	{
+		Entry entry = stack[ --sp ];
+
+		if ( entry.t > maxT )
+			continue;
+
+		const Node *n = m_nodes + entry.id;
+
+		if ( n->IsLeaf( ) )
+		{
+			maxT = cb->RayCastCallBack( entry.id, maxT );
+
+			if ( maxT <= float( 0.0 ) )
+				return maxT;
+
+			continue;
+		}
+
+		float tLeft;
+		float tRight;
+		const Node *left = m_nodes + n->left;
+		const Node *right = m_nodes + n->right;
+		bool hitLeft = PhysicsRayOverlap( start, invDir, maxT, left->aabb.min, left->aabb.max, &tLeft );
+		bool hitRight = PhysicsRayOverlap( start, invDir, maxT, right->aabb.min, right->aabb.max, &tRight );
+
+		// k_stackCapacity too small
+		assert( sp + 1 < k_stackCapacity );
+
+		// Far child first so the near one is popped next
+		if ( hitLeft && hitRight && tLeft < tRight )
+		{
+			stack[ sp ].id = n->right;
+			stack[ sp++ ].t = tRight;
+			stack[ sp ].id = n->left;
+			stack[ sp++ ].t = tLeft;
+		}
+
+		else
+		{
+			if ( hitLeft )
+			{
+				stack[ sp ].id = n->left;
+				stack[ sp++ ].t = tLeft;
+			}
+
+			if ( hitRight )
+			{
+				stack[ sp ].id = n->right;
+				stack[ sp++ ].t = tRight;
+			}
+		}
+	}
+
+	return maxT;
+}
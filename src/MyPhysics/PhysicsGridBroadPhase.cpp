@@ -0,0 +1,1041 @@
+#include "PhysicsGridBroadPhase.h"
+
+#include "PhysicsBox.h"
+#include "PhysicsContactManager.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsMemory.h"
+#include "PhysicsSettings.h"
+
+#include <cassert>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Cell coordinates are stored with this bias in 21 bits per axis
+static const int k_cellCoordBias = 1 << 20;
+
+//--------------------------------------------------------------------------------------------------
+// Same margin as the tree, small moves do not touch the cells
+static inline void FattenAABB( PhysicsAABB& aabb )
+{
+	const float k_fattener = float( 0.5 );
+	glm::vec3 v( k_fattener, k_fattener, k_fattener );
+
+	aabb.min -= v;
+	aabb.max += v;
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline PhysicsPairKey MakeCellKey( int x, int y, int z )
+{
+	return ((PhysicsPairKey)(uint32_t)(x + k_cellCoordBias) << 42)
+		| ((PhysicsPairKey)(uint32_t)(y + k_cellCoordBias) << 21)
+		| (PhysicsPairKey)(uint32_t)(z + k_cellCoordBias);
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline bool RangeContains( const int *min, const int *max, int x, int y, int z )
+{
+	return x >= min[ 0 ] && x <= max[ 0 ]
+		&& y >= min[ 1 ] && y <= max[ 1 ]
+		&& z >= min[ 2 ] && z <= max[ 2 ];
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline bool RangeIsEmpty( const int *min, const int *max )
+{
+	return min[ 0 ] > max[ 0 ];
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline long long RangeCellCount( const int *min, const int *max )
+{
+	return (long long)(max[ 0 ] - min[ 0 ] + 1) * (max[ 1 ] - min[ 1 ] + 1) * (max[ 2 ] - min[ 2 ] + 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Grows an array allocated with PhysicsAlloc to hold at least needed items
+template <typename T>
+static void GrowArray( T*& data, int count, int& capacity, int needed )
+{
+	if ( needed <= capacity )
+		return;
+
+	int newCapacity = capacity ? capacity : 64;
+	while ( newCapacity < needed )
+		newCapacity *= 2;
+
+	T* old = data;
+	data = (T*)PhysicsAlloc( sizeof( T ) * newCapacity );
+
+	if ( old )
+	{
+		memcpy( data, old, sizeof( T ) * count );
+		PhysicsFree( old );
+	}
+
+	capacity = newCapacity;
+}
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsGridPairQuery
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridPairQuery::Push( PhysicsPairKey key )
+{
+	GrowArray( pairs, pairCount, pairCapacity, pairCount + 1 );
+
+	pairs[ pairCount++ ] = key;
+	keyAnd &= key;
+	keyOr |= key;
+}
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsGridBroadPhase
+//--------------------------------------------------------------------------------------------------
+PhysicsGridBroadPhase::PhysicsGridBroadPhase( PhysicsContactManager *manager )
+	: PhysicsBroadPhase( manager )
+{
+	m_proxies = NULL;
+	m_proxyCapacity = 0;
+	m_freeList = -1;
+
+	m_cells = NULL;
+	m_cellCount = 0;
+	m_cellCapacity = 0;
+	m_cellFreeList = -1;
+
+	m_largeProxies = NULL;
+	m_largeCount = 0;
+	m_largeCapacity = 0;
+
+	m_moveBuffer = NULL;
+	m_moveCount = 0;
+	m_moveCapacity = 0;
+
+	m_dirtyCells = NULL;
+	m_dirtyCount = 0;
+	m_dirtyCapacity = 0;
+	m_stamp = 0;
+
+	m_queries = NULL;
+	m_queryCount = 0;
+
+	m_cellSize = float( 0.0 );
+	m_invCellSize = float( 0.0 );
+
+	m_extentSum = float( 0.0 );
+	m_dynamicExtentSum = float( 0.0 );
+	m_proxyCount = 0;
+	m_dynamicCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsGridBroadPhase::~PhysicsGridBroadPhase( )
+{
+	SetQueryCount( 0 );
+
+	// Cells on the free list keep their arrays for reuse
+	for ( int i = 0; i < m_cellCount; ++i )
+	{
+		if ( m_cells[ i ].proxies )
+			PhysicsFree( m_cells[ i ].proxies );
+	}
+
+	if ( m_cells )
+		PhysicsFree( m_cells );
+
+	if ( m_largeProxies )
+		PhysicsFree( m_largeProxies );
+
+	if ( m_moveBuffer )
+		PhysicsFree( m_moveBuffer );
+
+	if ( m_dirtyCells )
+		PhysicsFree( m_dirtyCells );
+
+	if ( m_proxies )
+		PhysicsFree( m_proxies );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::InsertBox( PhysicsBox *box, const PhysicsAABB& aabb )
+{
+	int id = AllocateProxy( );
+	PhysicsGridProxy *proxy = m_proxies + id;
+
+	proxy->aabb = aabb;
+	FattenAABB( proxy->aabb );
+	proxy->box = box;
+	proxy->isDynamic = IsDynamic( box );
+	proxy->moved = false;
+	proxy->large = -1;
+	proxy->min[ 0 ] = 1;
+	proxy->max[ 0 ] = 0;
+	box->broadPhaseIndex = id;
+
+	glm::vec3 size = proxy->aabb.max - proxy->aabb.min;
+	proxy->extent = glm::max( size.x, glm::max( size.y, size.z ) );
+
+	m_extentSum += proxy->extent;
+	++m_proxyCount;
+
+	if ( proxy->isDynamic )
+	{
+		m_dynamicExtentSum += proxy->extent;
+		++m_dynamicCount;
+	}
+
+	// The first box picks a cell size, UpdatePairs adjusts it once more
+	// boxes are known
+	if ( m_cellSize == float( 0.0 ) )
+	{
+		m_cellSize = GetIdealCellSize( );
+		m_invCellSize = float( 1.0 ) / m_cellSize;
+	}
+
+	SyncCells( id );
+
+	// New statics are buffered too, sleeping bodies next to them would
+	// never find the pair otherwise
+	BufferMove( id );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::RemoveBox( const PhysicsBox *box )
+{
+	int id = box->broadPhaseIndex;
+	PhysicsGridProxy *proxy = m_proxies + id;
+
+	RemoveFromCells( id );
+
+	if ( proxy->moved )
+	{
+		for ( int i = 0; i < m_moveCount; ++i )
+		{
+			if ( m_moveBuffer[ i ] == id )
+			{
+				m_moveBuffer[ i ] = m_moveBuffer[ --m_moveCount ];
+				break;
+			}
+		}
+	}
+
+	m_extentSum -= proxy->extent;
+	--m_proxyCount;
+
+	if ( proxy->isDynamic )
+	{
+		m_dynamicExtentSum -= proxy->extent;
+		--m_dynamicCount;
+	}
+
+	FreeProxy( id );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::UpdatePairs( )
+{
+	PhysicsJobPool* jobPool = m_manager->m_jobPool;
+	SetQueryCount( jobPool->GetThreadCount( ) );
+
+	float cellSize = GetIdealCellSize( );
+	if ( cellSize > float( 2.0 ) * m_cellSize || cellSize < float( 0.5 ) * m_cellSize )
+		RebuildGrid( cellSize );
+
+	PhysicsPairKey keyAnd = ~(PhysicsPairKey)0;
+	PhysicsPairKey keyOr = 0;
+
+	// Queue every cell holding a moved proxy once. Large proxies are not
+	// in any cell and are tested against everything here.
+	++m_stamp;
+	m_dirtyCount = 0;
+
+	for ( int i = 0; i < m_moveCount; ++i )
+	{
+		int id = m_moveBuffer[ i ];
+		const PhysicsGridProxy *proxy = m_proxies + id;
+
+		for ( int j = 0; j < m_largeCount; ++j )
+		{
+			int other = m_largeProxies[ j ];
+			const PhysicsGridProxy *large = m_proxies + other;
+
+			if ( other == id || (!proxy->isDynamic && !large->isDynamic) )
+				continue;
+
+			if ( !PhysicsAABBtoAABB( proxy->aabb, large->aabb ) )
+				continue;
+
+			PhysicsPairKey key = PhysicsMakePairKey( id, other );
+			PushPair( key );
+			keyAnd &= key;
+			keyOr |= key;
+		}
+
+		if ( proxy->large != -1 )
+		{
+			for ( int other = 0; other < m_proxyCapacity; ++other )
+			{
+				const PhysicsGridProxy *small = m_proxies + other;
+
+				if ( !small->box || small->large != -1 || (!proxy->isDynamic && !small->isDynamic) )
+					continue;
+
+				if ( !PhysicsAABBtoAABB( proxy->aabb, small->aabb ) )
+					continue;
+
+				PhysicsPairKey key = PhysicsMakePairKey( id, other );
+				PushPair( key );
+				keyAnd &= key;
+				keyOr |= key;
+			}
+
+			continue;
+		}
+
+		for ( int x = proxy->min[ 0 ]; x <= proxy->max[ 0 ]; ++x )
+		{
+			for ( int y = proxy->min[ 1 ]; y <= proxy->max[ 1 ]; ++y )
+			{
+				for ( int z = proxy->min[ 2 ]; z <= proxy->max[ 2 ]; ++z )
+				{
+					int cell = FindCell( x, y, z );
+					assert( cell != -1 );
+
+					if ( m_cells[ cell ].stamp == m_stamp )
+						continue;
+
+					m_cells[ cell ].stamp = m_stamp;
+					GrowArray( m_dirtyCells, m_dirtyCount, m_dirtyCapacity, m_dirtyCount + 1 );
+					m_dirtyCells[ m_dirtyCount++ ] = cell;
+				}
+			}
+		}
+	}
+
+	for ( int i = 0; i < m_queryCount; ++i )
+	{
+		m_queries[ i ].pairCount = 0;
+		m_queries[ i ].keyAnd = ~(PhysicsPairKey)0;
+		m_queries[ i ].keyOr = 0;
+	}
+
+	int jobCount = (m_dirtyCount + Q3_GRID_JOB_SIZE - 1) / Q3_GRID_JOB_SIZE;
+	jobPool->Run( PairJob, this, jobCount );
+
+	for ( int i = 0; i < m_moveCount; ++i )
+		m_proxies[ m_moveBuffer[ i ] ].moved = false;
+
+	m_moveCount = 0;
+
+	// Merge the thread buffers
+	int pairCount = m_pairCount;
+	for ( int i = 0; i < m_queryCount; ++i )
+		pairCount += m_queries[ i ].pairCount;
+
+	ReservePairs( pairCount );
+
+	for ( int i = 0; i < m_queryCount; ++i )
+	{
+		PhysicsGridPairQuery* query = m_queries + i;
+		memcpy( m_pairBuffer + m_pairCount, query->pairs, query->pairCount * sizeof( PhysicsPairKey ) );
+		m_pairCount += query->pairCount;
+
+		keyAnd &= query->keyAnd;
+		keyOr |= query->keyOr;
+	}
+
+	AddPairs( keyAnd ^ keyOr );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::Update( int id, const PhysicsAABB& aabb )
+{
+	PhysicsGridProxy *proxy = m_proxies + id;
+
+	if ( proxy->aabb.Contains( aabb ) )
+		return;
+
+	proxy->aabb = aabb;
+	FattenAABB( proxy->aabb );
+
+	SyncCells( id );
+	BufferMove( id );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::Reserve( int proxyCount, int pairCount )
+{
+	PhysicsBroadPhase::Reserve( proxyCount, pairCount );
+
+	GrowArray( m_moveBuffer, m_moveCount, m_moveCapacity, proxyCount );
+	GrowArray( m_largeProxies, m_largeCount, m_largeCapacity, proxyCount );
+
+	// Boxes no larger than a cell touch up to 8 cells. The extra cells wait
+	// on the free list with a list as long as AddToCell would give them.
+	int cellCount = 8 * proxyCount;
+	GrowArray( m_cells, m_cellCount, m_cellCapacity, cellCount );
+	GrowArray( m_dirtyCells, m_dirtyCount, m_dirtyCapacity, cellCount );
+	m_cellTable.Reserve( cellCount );
+
+	while ( m_cellCount < cellCount )
+	{
+		PhysicsGridCell *c = m_cells + m_cellCount;
+		c->proxies = NULL;
+		c->count = 0;
+		c->capacity = 0;
+		GrowArray( c->proxies, c->count, c->capacity, 1 );
+
+		c->next = m_cellFreeList;
+		m_cellFreeList = m_cellCount++;
+	}
+
+	// Any one thread may end up with all pairs
+	SetQueryCount( m_manager->m_jobPool->GetThreadCount( ) );
+	for ( int i = 0; i < m_queryCount; ++i )
+		GrowArray( m_queries[ i ].pairs, m_queries[ i ].pairCount, m_queries[ i ].pairCapacity, pairCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsGridBroadPhase::TestOverlap( int A, int B ) const
+{
+	return PhysicsAABBtoAABB( m_proxies[ A ].aabb, m_proxies[ B ].aabb );
+}
+
+//--------------------------------------------------------------------------------------------------
+void *PhysicsGridBroadPhase::GetUserData( int id ) const
+{
+	return m_proxies[ id ].box;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const
+{
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int id = m_largeProxies[ i ];
+
+		if ( PhysicsAABBtoAABB( m_proxies[ id ].aabb, aabb ) )
+		{
+			if ( !cb->TreeCallBack( id ) )
+				return;
+		}
+	}
+
+	if ( m_cellSize == float( 0.0 ) )
+		return;
+
+	int min[ 3 ];
+	int max[ 3 ];
+	GetCellRange( aabb, min, max );
+
+	// Queries covering more cells than there are in use test every proxy
+	if ( RangeCellCount( min, max ) > m_cellTable.GetCount( ) )
+	{
+		for ( int id = 0; id < m_proxyCapacity; ++id )
+		{
+			const PhysicsGridProxy *proxy = m_proxies + id;
+
+			if ( !proxy->box || proxy->large != -1 )
+				continue;
+
+			if ( PhysicsAABBtoAABB( proxy->aabb, aabb ) )
+			{
+				if ( !cb->TreeCallBack( id ) )
+					return;
+			}
+		}
+
+		return;
+	}
+
+	for ( int x = min[ 0 ]; x <= max[ 0 ]; ++x )
+	{
+		for ( int y = min[ 1 ]; y <= max[ 1 ]; ++y )
+		{
+			for ( int z = min[ 2 ]; z <= max[ 2 ]; ++z )
+			{
+				int cell = FindCell( x, y, z );
+
+				if ( cell == -1 )
+					continue;
+
+				const PhysicsGridCell *c = m_cells + cell;
+
+				for ( int i = 0; i < c->count; ++i )
+				{
+					int id = c->proxies[ i ];
+					const PhysicsGridProxy *proxy = m_proxies + id;
+
+					// Report each proxy from the first cell it shares with the query
+					if ( glm::max( proxy->min[ 0 ], min[ 0 ] ) != x
+						|| glm::max( proxy->min[ 1 ], min[ 1 ] ) != y
+						|| glm::max( proxy->min[ 2 ], min[ 2 ] ) != z )
+						continue;
+
+					if ( PhysicsAABBtoAABB( proxy->aabb, aabb ) )
+					{
+						if ( !cb->TreeCallBack( id ) )
+							return;
+					}
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+template <typename T>
+void PhysicsGridBroadPhase::WalkRay( T *visitor, const glm::vec3& start, const glm::vec3& dir, float maxT ) const
+{
+	// Large proxies are in no cell and can be anywhere along the ray
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		maxT = visitor->Visit( m_largeProxies[ i ], maxT );
+
+		if ( maxT <= float( 0.0 ) )
+			return;
+	}
+
+	if ( m_cellSize == float( 0.0 ) )
+		return;
+
+	// A long ray through a fine grid would step through more cells than
+	// there are in use, test every proxy instead
+	glm::vec3 span = glm::abs( dir * maxT ) * m_invCellSize;
+
+	if ( span.x + span.y + span.z > float( m_cellTable.GetCount( ) ) )
+	{
+		for ( int id = 0; id < m_proxyCapacity; ++id )
+		{
+			const PhysicsGridProxy *proxy = m_proxies + id;
+
+			if ( !proxy->box || proxy->large != -1 )
+				continue;
+
+			maxT = visitor->Visit( id, maxT );
+
+			if ( maxT <= float( 0.0 ) )
+				return;
+		}
+
+		return;
+	}
+
+	// Cell by cell walk along the ray, one axis step at a time
+	int cell[ 3 ];
+	int step[ 3 ];
+	float tMax[ 3 ];
+	float tDelta[ 3 ];
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		cell[ i ] = GetCellCoord( start[ i ] );
+
+		if ( dir[ i ] > float( 0.0 ) )
+		{
+			step[ i ] = 1;
+			tMax[ i ] = (float( cell[ i ] + 1 ) * m_cellSize - start[ i ]) / dir[ i ];
+			tDelta[ i ] = m_cellSize / dir[ i ];
+		}
+
+		else if ( dir[ i ] < float( 0.0 ) )
+		{
+			step[ i ] = -1;
+			tMax[ i ] = (float( cell[ i ] ) * m_cellSize - start[ i ]) / dir[ i ];
+			tDelta[ i ] = -m_cellSize / dir[ i ];
+		}
+
+		else
+		{
+			step[ i ] = 0;
+			tMax[ i ] = Q3_R32_MAX;
+			tDelta[ i ] = Q3_R32_MAX;
+		}
+	}
+
+	int prev[ 3 ] = { cell[ 0 ], cell[ 1 ], cell[ 2 ] };
+	bool first = true;
+
+	for ( ;; )
+	{
+		int index = FindCell( cell[ 0 ], cell[ 1 ], cell[ 2 ] );
+
+		if ( index != -1 )
+		{
+			const PhysicsGridCell *c = m_cells + index;
+
+			for ( int i = 0; i < c->count; ++i )
+			{
+				int id = c->proxies[ i ];
+				const PhysicsGridProxy *proxy = m_proxies + id;
+
+				// The walk enters the cells of a proxy once, it was already
+				// visited when the previous cell is one of them
+				if ( !first && RangeContains( proxy->min, proxy->max, prev[ 0 ], prev[ 1 ], prev[ 2 ] ) )
+					continue;
+
+				maxT = visitor->Visit( id, maxT );
+
+				if ( maxT <= float( 0.0 ) )
+					return;
+			}
+		}
+
+		int axis = tMax[ 0 ] < tMax[ 1 ] ? (tMax[ 0 ] < tMax[ 2 ] ? 0 : 2) : (tMax[ 1 ] < tMax[ 2 ] ? 1 : 2);
+
+		if ( tMax[ axis ] > maxT )
+			return;
+
+		prev[ 0 ] = cell[ 0 ];
+		prev[ 1 ] = cell[ 1 ];
+		prev[ 2 ] = cell[ 2 ];
+		first = false;
+
+		cell[ axis ] += step[ axis ];
+		tMax[ axis ] += tDelta[ axis ];
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const
+{
+	struct RayVisitor
+	{
+		float Visit( int id, float maxT )
+		{
+			const PhysicsAABB& aabb = proxies[ id ].aabb;
+			float tEnter;
+
+			if ( !PhysicsRayOverlap( start, invDir, maxT, aabb.min, aabb.max, &tEnter ) )
+				return maxT;
+
+			return cb->TreeCallBack( id ) ? maxT : float( -1.0 );
+		}
+
+		PhysicsBroadPhaseCallback *cb;
+		const PhysicsGridProxy *proxies;
+		glm::vec3 start;
+		glm::vec3 invDir;
+	};
+
+	RayVisitor visitor;
+	visitor.cb = cb;
+	visitor.proxies = m_proxies;
+	visitor.start = rayCast.start;
+	visitor.invDir = PhysicsRayInvDir( rayCast.dir );
+
+	WalkRay( &visitor, rayCast.start, rayCast.dir, rayCast.t );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const
+{
+	// Every ray walks the grid on its own and only reports its own lane
+	struct LaneVisitor
+	{
+		float Visit( int id, float maxT )
+		{
+			const PhysicsAABB& aabb = proxies[ id ].aabb;
+			float tEnter;
+
+			if ( !PhysicsRayOverlap( start, invDir, maxT, aabb.min, aabb.max, &tEnter ) )
+				return maxT;
+
+			if ( !cb->TreeCallBack( id, 1 << lane ) )
+			{
+				stop = true;
+				return float( -1.0 );
+			}
+
+			// Hits shorten the ray of the lane
+			return glm::min( maxT, packet->t[ lane ] );
+		}
+
+		PhysicsBroadPhaseCallback *cb;
+		const PhysicsGridProxy *proxies;
+		PhysicsRayPacket *packet;
+		glm::vec3 start;
+		glm::vec3 invDir;
+		int lane;
+		bool stop;
+	};
+
+	LaneVisitor visitor;
+	visitor.cb = cb;
+	visitor.proxies = m_proxies;
+	visitor.packet = &packet;
+	visitor.stop = false;
+
+	for ( int i = 0; i < 4 && !visitor.stop; ++i )
+	{
+		if ( packet.t[ i ] < float( 0.0 ) )
+			continue;
+
+		glm::vec3 dir( packet.dirX[ i ], packet.dirY[ i ], packet.dirZ[ i ] );
+
+		visitor.start = glm::vec3( packet.startX[ i ], packet.startY[ i ], packet.startZ[ i ] );
+		visitor.invDir = glm::vec3( packet.invDirX[ i ], packet.invDirY[ i ], packet.invDirZ[ i ] );
+		visitor.lane = i;
+		WalkRay( &visitor, visitor.start, dir, packet.t[ i ] );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsGridBroadPhase::RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const
+{
+	struct ClipVisitor
+	{
+		float Visit( int id, float maxT )
+		{
+			const PhysicsAABB& aabb = proxies[ id ].aabb;
+			float tEnter;
+
+			if ( PhysicsRayOverlap( start, invDir, maxT, aabb.min, aabb.max, &tEnter ) )
+				maxT = cb->RayCastCallBack( id, maxT );
+
+			t = maxT;
+			return maxT;
+		}
+
+		PhysicsBroadPhaseCallback *cb;
+		const PhysicsGridProxy *proxies;
+		glm::vec3 start;
+		glm::vec3 invDir;
+		float t;
+	};
+
+	ClipVisitor visitor;
+	visitor.cb = cb;
+	visitor.proxies = m_proxies;
+	visitor.start = rayCast.start;
+	visitor.invDir = PhysicsRayInvDir( rayCast.dir );
+	visitor.t = rayCast.t;
+
+	WalkRay( &visitor, rayCast.start, rayCast.dir, rayCast.t );
+
+	return visitor.t;
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsGridBroadPhase::GetCellSize( ) const
+{
+	return m_cellSize;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsGridBroadPhase::AllocateProxy( )
+{
+	if ( m_freeList == -1 )
+	{
+		int oldCapacity = m_proxyCapacity;
+		GrowArray( m_proxies, oldCapacity, m_proxyCapacity, oldCapacity + 1 );
+
+		for ( int i = oldCapacity; i < m_proxyCapacity; ++i )
+		{
+			m_proxies[ i ].box = NULL;
+			m_proxies[ i ].next = i + 1 < m_proxyCapacity ? i + 1 : -1;
+		}
+
+		m_freeList = oldCapacity;
+	}
+
+	int id = m_freeList;
+	m_freeList = m_proxies[ id ].next;
+	return id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::FreeProxy( int id )
+{
+	m_proxies[ id ].box = NULL;
+	m_proxies[ id ].next = m_freeList;
+	m_freeList = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::BufferMove( int id )
+{
+	if ( m_proxies[ id ].moved )
+		return;
+
+	m_proxies[ id ].moved = true;
+
+	GrowArray( m_moveBuffer, m_moveCount, m_moveCapacity, m_moveCount + 1 );
+	m_moveBuffer[ m_moveCount++ ] = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::SetQueryCount( int count )
+{
+	if ( count == m_queryCount )
+		return;
+
+	for ( int i = 0; i < m_queryCount; ++i )
+		PhysicsFree( m_queries[ i ].pairs );
+
+	if ( m_queries )
+		PhysicsFree( m_queries );
+
+	m_queries = NULL;
+	m_queryCount = count;
+
+	if ( !count )
+		return;
+
+	m_queries = (PhysicsGridPairQuery*)PhysicsAlloc( sizeof( PhysicsGridPairQuery ) * count );
+
+	for ( int i = 0; i < count; ++i )
+	{
+		PhysicsGridPairQuery* query = m_queries + i;
+		query->pairCount = 0;
+		query->pairCapacity = 64;
+		query->pairs = (PhysicsPairKey*)PhysicsAlloc( query->pairCapacity * sizeof( PhysicsPairKey ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsGridBroadPhase::GetCellCoord( float value ) const
+{
+	float coord = floorf( value * m_invCellSize );
+	coord = glm::clamp( coord, float( -k_cellCoordBias ), float( k_cellCoordBias - 1 ) );
+
+	return (int)coord;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::GetCellRange( const PhysicsAABB& aabb, int *min, int *max ) const
+{
+	for ( int i = 0; i < 3; ++i )
+	{
+		min[ i ] = GetCellCoord( aabb.min[ i ] );
+		max[ i ] = GetCellCoord( aabb.max[ i ] );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsGridBroadPhase::FindCell( int x, int y, int z ) const
+{
+	return (int)(intptr_t)m_cellTable.Find( MakeCellKey( x, y, z ) ) - 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::AddToCell( int x, int y, int z, int id )
+{
+	int index = FindCell( x, y, z );
+
+	if ( index == -1 )
+	{
+		if ( m_cellFreeList == -1 )
+		{
+			GrowArray( m_cells, m_cellCount, m_cellCapacity, m_cellCount + 1 );
+
+			index = m_cellCount++;
+			m_cells[ index ].proxies = NULL;
+			m_cells[ index ].capacity = 0;
+		}
+
+		else
+		{
+			index = m_cellFreeList;
+			m_cellFreeList = m_cells[ index ].next;
+		}
+
+		PhysicsGridCell *c = m_cells + index;
+		c->coord[ 0 ] = x;
+		c->coord[ 1 ] = y;
+		c->coord[ 2 ] = z;
+		c->count = 0;
+		c->stamp = m_stamp;
+		c->next = -1;
+
+		m_cellTable.Insert( MakeCellKey( x, y, z ), (void*)(intptr_t)(index + 1) );
+	}
+
+	PhysicsGridCell *c = m_cells + index;
+	GrowArray( c->proxies, c->count, c->capacity, c->count + 1 );
+	c->proxies[ c->count++ ] = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::RemoveFromCell( int x, int y, int z, int id )
+{
+	int index = FindCell( x, y, z );
+	assert( index != -1 );
+
+	PhysicsGridCell *c = m_cells + index;
+
+	for ( int i = 0; i < c->count; ++i )
+	{
+		if ( c->proxies[ i ] == id )
+		{
+			c->proxies[ i ] = c->proxies[ --c->count ];
+			break;
+		}
+	}
+
+	// Empty cells leave the table, their array is kept for the next cell
+	if ( !c->count )
+	{
+		m_cellTable.Remove( MakeCellKey( x, y, z ) );
+		c->next = m_cellFreeList;
+		m_cellFreeList = index;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::SyncCells( int id )
+{
+	PhysicsGridProxy *proxy = m_proxies + id;
+
+	int min[ 3 ];
+	int max[ 3 ];
+	GetCellRange( proxy->aabb, min, max );
+
+	if ( RangeCellCount( min, max ) > Q3_GRID_MAX_PROXY_CELLS )
+	{
+		if ( proxy->large == -1 )
+		{
+			RemoveFromCells( id );
+
+			GrowArray( m_largeProxies, m_largeCount, m_largeCapacity, m_largeCount + 1 );
+			proxy->large = m_largeCount;
+			m_largeProxies[ m_largeCount++ ] = id;
+		}
+
+		return;
+	}
+
+	if ( proxy->large != -1 )
+		RemoveFromCells( id );
+
+	// Only cells entered or left change
+	for ( int x = proxy->min[ 0 ]; x <= proxy->max[ 0 ]; ++x )
+		for ( int y = proxy->min[ 1 ]; y <= proxy->max[ 1 ]; ++y )
+			for ( int z = proxy->min[ 2 ]; z <= proxy->max[ 2 ]; ++z )
+				if ( !RangeContains( min, max, x, y, z ) )
+					RemoveFromCell( x, y, z, id );
+
+	for ( int x = min[ 0 ]; x <= max[ 0 ]; ++x )
+		for ( int y = min[ 1 ]; y <= max[ 1 ]; ++y )
+			for ( int z = min[ 2 ]; z <= max[ 2 ]; ++z )
+				if ( RangeIsEmpty( proxy->min, proxy->max ) || !RangeContains( proxy->min, proxy->max, x, y, z ) )
+					AddToCell( x, y, z, id );
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		proxy->min[ i ] = min[ i ];
+		proxy->max[ i ] = max[ i ];
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::RemoveFromCells( int id )
+{
+	PhysicsGridProxy *proxy = m_proxies + id;
+
+	if ( proxy->large != -1 )
+	{
+		int last = m_largeProxies[ --m_largeCount ];
+		m_largeProxies[ proxy->large ] = last;
+		m_proxies[ last ].large = proxy->large;
+		proxy->large = -1;
+	}
+
+	for ( int x = proxy->min[ 0 ]; x <= proxy->max[ 0 ]; ++x )
+		for ( int y = proxy->min[ 1 ]; y <= proxy->max[ 1 ]; ++y )
+			for ( int z = proxy->min[ 2 ]; z <= proxy->max[ 2 ]; ++z )
+				RemoveFromCell( x, y, z, id );
+
+	proxy->min[ 0 ] = 1;
+	proxy->max[ 0 ] = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::RebuildGrid( float cellSize )
+{
+	m_cellSize = cellSize;
+	m_invCellSize = float( 1.0 ) / cellSize;
+
+	m_cellTable.Clear( );
+	m_cellFreeList = -1;
+
+	for ( int i = m_cellCount - 1; i >= 0; --i )
+	{
+		m_cells[ i ].next = m_cellFreeList;
+		m_cellFreeList = i;
+	}
+
+	m_largeCount = 0;
+
+	for ( int id = 0; id < m_proxyCapacity; ++id )
+	{
+		PhysicsGridProxy *proxy = m_proxies + id;
+
+		if ( !proxy->box )
+			continue;
+
+		proxy->large = -1;
+		proxy->min[ 0 ] = 1;
+		proxy->max[ 0 ] = 0;
+
+		// Every proxy looks for pairs again, existing contacts are kept
+		SyncCells( id );
+		BufferMove( id );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsGridBroadPhase::GetIdealCellSize( ) const
+{
+	// Sized for the dynamic boxes when there are any, statics tend to be
+	// few and large
+	float extent = m_cellSize;
+
+	if ( m_dynamicCount )
+		extent = m_dynamicExtentSum / float( m_dynamicCount );
+	else if ( m_proxyCount )
+		extent = m_extentSum / float( m_proxyCount );
+
+	return Q3_GRID_CELL_SCALE * extent;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGridBroadPhase::PairJob( void* param, int index, int threadIndex )
+{
+	PhysicsGridBroadPhase* broadphase = (PhysicsGridBroadPhase*)param;
+	PhysicsGridPairQuery* query = broadphase->m_queries + threadIndex;
+	const PhysicsGridProxy* proxies = broadphase->m_proxies;
+	int begin = index * Q3_GRID_JOB_SIZE;
+	int end = glm::min( begin + Q3_GRID_JOB_SIZE, broadphase->m_dirtyCount );
+
+	for ( int i = begin; i < end; ++i )
+	{
+		const PhysicsGridCell *cell = broadphase->m_cells + broadphase->m_dirtyCells[ i ];
+
+		for ( int a = 0; a < cell->count; ++a )
+		{
+			int idA = cell->proxies[ a ];
+			const PhysicsGridProxy *A = proxies + idA;
+
+			for ( int b = a + 1; b < cell->count; ++b )
+			{
+				int idB = cell->proxies[ b ];
+				const PhysicsGridProxy *B = proxies + idB;
+
+				if ( (!A->moved && !B->moved) || (!A->isDynamic && !B->isDynamic) )
+					continue;
+
+				// Pairs sharing several cells are only reported by the
+				// lowest of them
+				if ( glm::max( A->min[ 0 ], B->min[ 0 ] ) != cell->coord[ 0 ]
+					|| glm::max( A->min[ 1 ], B->min[ 1 ] ) != cell->coord[ 1 ]
+					|| glm::max( A->min[ 2 ], B->min[ 2 ] ) != cell->coord[ 2 ] )
+					continue;
+
+				if ( PhysicsAABBtoAABB( A->aabb, B->aabb ) )
+					query->Push( PhysicsMakePairKey( idA, idB ) );
+			}
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "PhysicsBroadPhase.h"
+#include "Common.h"
+
+struct PhysicsGridProxy
+{
+	PhysicsAABB aabb;	// Fat AABB
+	PhysicsBox *box;	// NULL while on the free list
+	int min[ 3 ];		// Range of covered cells, empty when min > max
+	int max[ 3 ];
+	int large;			// Index into the large proxy list, -1 when in cells
+	int next;			// Free list
+	float extent;		// Longest side when inserted, feeds the cell size
+	bool isDynamic;
+	bool moved;
+};
+
+struct PhysicsGridCell
+{
+	int coord[ 3 ];
+	int *proxies;
+	int count;
+	int capacity;
+	int stamp;			// Last UpdatePairs that queued the cell
+	int next;			// Free list
+};
+
+// Per thread pairs of the cell jobs
+struct PhysicsGridPairQuery
+{
+	void Push( PhysicsPairKey key );
+
+	PhysicsPairKey *pairs;
+	int pairCount;
+	int pairCapacity;
+
+	// Bitwise and / or of all keys, bytes where they agree are not sorted
+	PhysicsPairKey keyAnd;
+	PhysicsPairKey keyOr;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsGridBroadPhase
+//--------------------------------------------------------------------------------------------------
+// Uniform grid stored as a spatial hash. Every proxy is listed in all cells
+// its fat AABB touches, the lists are patched in place when a proxy moves
+// into other cells. UpdatePairs only looks at cells holding a moved proxy,
+// each of them is handled by a job on its own. A pair sharing several
+// cells is only reported by the cell at the lower corner of the overlap.
+//
+// The cell size follows the average size of the dynamic boxes and the grid
+// is rebuilt when that drifts too far. Boxes much larger than a cell, like
+// the ground, are kept out of the grid in a list tested by brute force.
+// Meant for many boxes of about the same size.
+class PhysicsGridBroadPhase : public PhysicsBroadPhase
+{
+public:
+	PhysicsGridBroadPhase( PhysicsContactManager *manager );
+	~PhysicsGridBroadPhase( );
+
+	void InsertBox( PhysicsBox *shape, const PhysicsAABB& aabb );
+	void RemoveBox( const PhysicsBox *shape );
+	void UpdatePairs( void );
+	void Update( int id, const PhysicsAABB& aabb );
+	void Reserve( int proxyCount, int pairCount );
+	bool TestOverlap( int A, int B ) const;
+	void *GetUserData( int id ) const;
+
+	void Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const;
+	float RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const;
+
+	float GetCellSize( ) const;
+
+private:
+	int AllocateProxy( );
+	void FreeProxy( int id );
+	void BufferMove( int id );
+	void SetQueryCount( int count );
+
+	// Cell coordinates are clamped so they fit into a cell key
+	int GetCellCoord( float value ) const;
+	void GetCellRange( const PhysicsAABB& aabb, int *min, int *max ) const;
+	int FindCell( int x, int y, int z ) const;
+	void AddToCell( int x, int y, int z, int id );
+	void RemoveFromCell( int x, int y, int z, int id );
+
+	// Moves the proxy into the cells of its current fat AABB
+	void SyncCells( int id );
+	void RemoveFromCells( int id );
+
+	// Changes the cell size and puts every proxy into the new cells
+	void RebuildGrid( float cellSize );
+	float GetIdealCellSize( ) const;
+
+	// Calls visitor->Visit( id, t ) once for every proxy that may touch
+	// start + dir * [0, t], cells are walked from the start of the ray.
+	// Visit returns the new end of the ray, zero or less stops the walk.
+	template <typename T>
+	void WalkRay( T *visitor, const glm::vec3& start, const glm::vec3& dir, float maxT ) const;
+
+	static void PairJob( void* param, int index, int threadIndex );
+
+	PhysicsGridProxy *m_proxies;
+	int m_proxyCapacity;
+	int m_freeList;
+
+	// Cell key -> index into m_cells + 1
+	PhysicsPairTable m_cellTable;
+	PhysicsGridCell *m_cells;
+	int m_cellCount;
+	int m_cellCapacity;
+	int m_cellFreeList;
+
+	int *m_largeProxies;
+	int m_largeCount;
+	int m_largeCapacity;
+
+	int *m_moveBuffer;
+	int m_moveCount;
+	int m_moveCapacity;
+
+	// Cells touched by moved proxies, gathered at the start of UpdatePairs
+	int *m_dirtyCells;
+	int m_dirtyCount;
+	int m_dirtyCapacity;
+	int m_stamp;
+
+	PhysicsGridPairQuery *m_queries;
+	int m_queryCount;
+
+	float m_cellSize;
+	float m_invCellSize;
+
+	// Sums of PhysicsGridProxy::extent
+	float m_extentSum;
+	float m_dynamicExtentSum;
+	int m_proxyCount;
+	int m_dynamicCount;
+};
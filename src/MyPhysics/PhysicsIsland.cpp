@@ -44,6 +44,20 @@
 //--------------------------------------------------------------------------------------------------
 void PhysicsIsland::Solve( float deltaTime)
 {
+	m_sleep = false;
+
+	if ( m_substeps > 0 )
+	{
+		// No batched version, the scene turns batching off for substeps
+		assert( !m_enableBatching );
+
+		m_iterationCount = m_substeps;
+		m_converged = false;
+		SolveSubsteps( deltaTime );
+		UpdateSleep( deltaTime );
+		return;
+	}
+
 	// Apply gravity
 	// Integrate velocities and create state buffers, calculate world inertia
 	for ( int i = 0 ; i < m_bodyCount; ++i )
@@ -85,9 +99,30 @@ void PhysicsIsland::Solve( float deltaTime)
 	contactSolver.Initialize( this );
 	contactSolver.PreSolve( deltaTime );
 
-	// Solve contacts
-	for ( int i = 0; i < m_iterations; ++i )
-		contactSolver.Solve( );
+	if ( m_enableBatching && m_contactCount >= Q3_BATCH_MIN_CONTACTS )
+		contactSolver.InitializeBatches( );
+
+	// Solve contacts until no impulse changes by more than the tolerance.
+	// With a tolerance set, the iteration count also follows the island size.
+	int iterations = m_iterations;
+
+	if ( m_tolerance > float( 0.0 ) )
+		iterations = glm::clamp( Q3_ITERATIONS_PER_BODY * m_bodyCount, glm::min( Q3_MIN_ITERATIONS, m_iterations ), m_iterations );
+
+	m_iterationCount = 0;
+	m_converged = false;
+
+	while ( m_iterationCount < iterations )
+	{
+		float residual = contactSolver.Solve( );
+		++m_iterationCount;
+
+		if ( residual <= m_tolerance )
+		{
+			m_converged = true;
+			break;
+		}
+	}
 
 	contactSolver.ShutDown( );
 
@@ -111,45 +146,129 @@ void PhysicsIsland::Solve( float deltaTime)
 		body->m_tx.rotation = glm::mat3{body->m_q};
 	}
 
-	if ( m_allowSleep )
+	UpdateSleep( deltaTime );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIsland::SolveSubsteps( float deltaTime )
+{
+	float h = deltaTime / float( m_substeps );
+
+	// Forces are constant over the step, inertia is kept from its start
+	for ( int i = 0 ; i < m_bodyCount; ++i )
 	{
-		// Find minimum sleep time of the entire island
-		float minSleepTime = Q3_R32_MAX;
-		for ( int i = 0; i < m_bodyCount; ++i )
+		PhysicsBody *body = m_bodies[ i ];
+		PhysicsVelocityState *v = m_velocities + i;
+
+		if ( body->m_flags & PhysicsBody::eDynamic )
+		{
+			body->ApplyLinearForce( m_gravity * body->m_gravityScale );
+
+			glm::mat3 r = body->m_tx.rotation;
+			body->m_invInertiaWorld = r * body->m_invInertiaModel * glm::transpose( r );
+		}
+
+		v->v = body->m_linearVelocity;
+		v->w = body->m_angularVelocity;
+	}
+
+	PhysicsContactSolver contactSolver;
+	contactSolver.Initialize( this );
+	contactSolver.PrepareSubsteps( h );
+
+	for ( int step = 0; step < m_substeps; ++step )
+	{
+		// Integrate velocities, see Solve for the damping
+		for ( int i = 0 ; i < m_bodyCount; ++i )
+		{
+			PhysicsBody *body = m_bodies[ i ];
+			PhysicsVelocityState *v = m_velocities + i;
+
+			if ( !(body->m_flags & PhysicsBody::eDynamic) )
+				continue;
+
+			v->v += (body->m_force * body->m_invMass) * h;
+			v->w += (body->m_invInertiaWorld * body->m_torque) * h;
+			v->v *= float( 1.0 ) / (float( 1.0 ) + h * body->m_linearDamping);
+			v->w *= float( 1.0 ) / (float( 1.0 ) + h * body->m_angularDamping);
+		}
+
+		contactSolver.WarmStart( );
+		contactSolver.SolveSoft( true );
+
+		// Integrate positions, constraints read them in the next solve
+		for ( int i = 0 ; i < m_bodyCount; ++i )
 		{
-			PhysicsBody* body = m_bodies[ i ];
+			PhysicsBody *body = m_bodies[ i ];
+			PhysicsVelocityState *v = m_velocities + i;
 
 			if ( body->m_flags & PhysicsBody::eStatic )
 				continue;
 
-			const float sqrLinVel = glm::dot( body->m_linearVelocity, body->m_linearVelocity );
-			const float cbAngVel = glm::dot( body->m_angularVelocity, body->m_angularVelocity );
-			const float linTol = Q3_SLEEP_LINEAR;
-			const float angTol = Q3_SLEEP_ANGULAR;
-
-			if ( sqrLinVel > linTol || cbAngVel > angTol )
-			{
-				minSleepTime = float( 0.0 );
-				body->m_sleepTime = float( 0.0 );
-			}
-
-			else
-			{
-				body->m_sleepTime += deltaTime;
-				minSleepTime = glm::min( minSleepTime, body->m_sleepTime );
-			}
+			body->m_worldCenter += v->v * h;
+			Integrate( body->m_q, v->w, h );
+			body->m_q = glm::normalize( body->m_q );
+			body->m_tx.rotation = glm::mat3{ body->m_q };
 		}
 
-		// Put entire island to sleep so long as the minimum found sleep time
-		// is below the threshold. If the minimum sleep time reaches below the
-		// sleeping threshold, the entire island will be reformed next step
-		// and sleep test will be tried again.
-		if ( minSleepTime > Q3_SLEEP_TIME )
+		contactSolver.SolveSoft( false );
+	}
+
+	contactSolver.ApplyRestitution( );
+	contactSolver.ShutDown( );
+
+	for ( int i = 0 ; i < m_bodyCount; ++i )
+	{
+		PhysicsBody *body = m_bodies[ i ];
+		PhysicsVelocityState *v = m_velocities + i;
+
+		if ( body->m_flags & PhysicsBody::eStatic )
+			continue;
+
+		body->m_linearVelocity = v->v;
+		body->m_angularVelocity = v->w;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIsland::UpdateSleep( float deltaTime )
+{
+	if ( !m_allowSleep )
+		return;
+
+	// Find minimum sleep time of the entire island
+	float minSleepTime = Q3_R32_MAX;
+	for ( int i = 0; i < m_bodyCount; ++i )
+	{
+		PhysicsBody* body = m_bodies[ i ];
+
+		if ( body->m_flags & PhysicsBody::eStatic )
+			continue;
+
+		const float sqrLinVel = glm::dot( body->m_linearVelocity, body->m_linearVelocity );
+		const float cbAngVel = glm::dot( body->m_angularVelocity, body->m_angularVelocity );
+		const float linTol = Q3_SLEEP_LINEAR;
+		const float angTol = Q3_SLEEP_ANGULAR;
+
+		if ( sqrLinVel > linTol || cbAngVel > angTol )
+		{
+			minSleepTime = float( 0.0 );
+			body->m_sleepTime = float( 0.0 );
+		}
+
+		else
 		{
-			for ( int i = 0; i < m_bodyCount; ++i )
-				m_bodies[ i ]->SetToSleep( );
+			body->m_sleepTime += deltaTime;
+			minSleepTime = glm::min( minSleepTime, body->m_sleepTime );
 		}
 	}
+
+	// Put entire island to sleep so long as the minimum found sleep time
+	// is below the threshold. If the minimum sleep time reaches below the
+	// sleeping threshold, the entire island will be reformed next step
+	// and sleep test will be tried again.
+	if ( minSleepTime > Q3_SLEEP_TIME )
+		m_sleep = true;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -187,8 +306,19 @@ void PhysicsIsland::Initialize( )
 		c->mB = cc->bodyB->m_invMass;
 		c->restitution = cc->restitution;
 		c->friction = cc->friction;
-		c->indexA = cc->bodyA->m_islandIndex;
-		c->indexB = cc->bodyB->m_islandIndex;
+
+		if ( m_contactIndices )
+		{
+			c->indexA = m_contactIndices[ 2 * i ];
+			c->indexB = m_contactIndices[ 2 * i + 1 ];
+		}
+
+		else
+		{
+			c->indexA = cc->bodyA->m_islandIndex;
+			c->indexB = cc->bodyB->m_islandIndex;
+		}
+
 		c->normal = cc->manifold.normal;
 		c->tangentVectors[ 0 ] = cc->manifold.tangentVectors[ 0 ];
 		c->tangentVectors[ 1 ] = cc->manifold.tangentVectors[ 1 ];
@@ -31,8 +31,20 @@
 #include <glm/glm.hpp>
 
 class PhysicsBody;
+class PhysicsStack;
 class PhysicsContactConstraint;
 struct PhysicsContactConstraintState;
+struct PhysicsPersistentIsland;
+
+// Contact solver iterations of the islands solved by the last step, see
+// PhysicsScene::SetSolverTolerance
+struct PhysicsSolverStats
+{
+	int islandCount;
+	int iterationCount;		// Summed over all islands
+	int maxIterationCount;	// Most any single island used
+	int convergedCount;		// Islands that stopped below the tolerance
+};
 
 struct PhysicsVelocityState
 {
@@ -40,11 +52,26 @@ struct PhysicsVelocityState
 	glm::vec3 v;
 };
 
+// Slice of the scene wide island buffers. Used when all islands are built
+// up front and then solved concurrently.
+struct PhysicsIslandRange
+{
+	PhysicsPersistentIsland* source;
+	int bodyStart;
+	int bodyCount;
+	int contactStart;
+	int contactCount;
+	bool sleep;
+	int iterationCount;
+	bool converged;
+};
+
 
 class PhysicsIsland
 {
     public:
 	void Solve( float deltaTime);
+
 	void Add( PhysicsBody *body );
 	void Add( PhysicsContactConstraint *contact );
 	void Initialize( );
@@ -56,13 +83,40 @@ class PhysicsIsland
 
 	PhysicsContactConstraint **m_contacts;
 	PhysicsContactConstraintState *m_contactStates;
+
+	// Optional island indices of bodyA and bodyB for every contact. Static
+	// bodies can be part of several islands, so their m_islandIndex is
+	// only valid while their island is being built.
+	int *m_contactIndices;
 	int m_contactCount;
 	int m_contactCapacity;
 
+	// Scratch memory for the batched contact solver, needs room for
+	// PhysicsContactSolver::GetBatchMemorySize bytes when batching is enabled
+	PhysicsStack *m_stack;
+
 	float m_dt;
 	glm::vec3 m_gravity;
 	int m_iterations;
+	int m_substeps;
+
+	// Solving stops early once no impulse changes by more than this
+	float m_tolerance;
 
 	bool m_allowSleep;
 	bool m_enableFriction;
+	bool m_enableBatching;
+
+	// Set by Solve when the island has been resting for long enough
+	bool m_sleep;
+
+	// Iterations Solve ran, substeps in the substepped mode, and whether
+	// it stopped below the tolerance
+	int m_iterationCount;
+	bool m_converged;
+
+private:
+	// Used by Solve when m_substeps is not zero, see PhysicsScene::SetSubsteps
+	void SolveSubsteps( float deltaTime );
+	void UpdateSleep( float deltaTime );
 };
\ No newline at end of file
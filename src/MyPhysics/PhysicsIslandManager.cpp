@@ -0,0 +1,433 @@
+#include "PhysicsIslandManager.h"
+
+#include "PhysicsBody.h"
+#include "PhysicsContact.h"
+
+#include <cassert>
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsIslandManager
+//--------------------------------------------------------------------------------------------------
+PhysicsIslandManager::PhysicsIslandManager( PhysicsStack* stack )
+	: m_stack( stack )
+	, m_allocator( sizeof( PhysicsPersistentIsland ), 256 )
+	, m_awakeList( NULL )
+	, m_sleepingList( NULL )
+	, m_awakeCount( 0 )
+	, m_islandCount( 0 )
+	, m_creationCount( 0 )
+{
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::AddBody( PhysicsBody* body )
+{
+	body->m_island = NULL;
+	body->m_islandPrev = NULL;
+	body->m_islandNext = NULL;
+	body->m_creationIndex = m_creationCount++;
+
+	if ( body->m_flags & PhysicsBody::eStatic )
+		return;
+
+	PhysicsPersistentIsland* island = CreateIsland( body->IsAwake( ) );
+	AddBodyToIsland( island, body );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::RemoveBody( PhysicsBody* body )
+{
+	PhysicsPersistentIsland* island = body->m_island;
+
+	if ( !island )
+		return;
+
+	if ( body->m_islandPrev )
+		body->m_islandPrev->m_islandNext = body->m_islandNext;
+
+	if ( body->m_islandNext )
+		body->m_islandNext->m_islandPrev = body->m_islandPrev;
+
+	if ( body == island->bodyList )
+		island->bodyList = body->m_islandNext;
+
+	body->m_island = NULL;
+	--island->bodyCount;
+
+	if ( !island->bodyCount )
+	{
+		assert( !island->contactCount );
+		DestroyIsland( island );
+		return;
+	}
+
+	if ( island->seed == body )
+	{
+		island->seed = NULL;
+
+		for ( PhysicsBody* other = island->bodyList; other; other = other->m_islandNext )
+			UpdateSeed( island, other );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::LinkContact( PhysicsContactConstraint* contact )
+{
+	assert( !(contact->m_flags & PhysicsContactConstraint::eIsland) );
+
+	PhysicsPersistentIsland* islandA = contact->bodyA->m_island;
+	PhysicsPersistentIsland* islandB = contact->bodyB->m_island;
+	PhysicsPersistentIsland* island = islandA ? islandA : islandB;
+
+	// Only static bodies have no island
+	assert( island );
+
+	if ( islandA && islandB && islandA != islandB )
+	{
+		// Touching an awake island wakes the other one up
+		if ( islandA->awake || islandB->awake )
+		{
+			WakeIsland( islandA );
+			WakeIsland( islandB );
+		}
+
+		island = MergeIslands( islandA, islandB );
+	}
+
+	AddContactToIsland( island, contact );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::UnlinkContact( PhysicsContactConstraint* contact )
+{
+	assert( contact->m_flags & PhysicsContactConstraint::eIsland );
+
+	PhysicsPersistentIsland* island = GetIsland( contact );
+
+	if ( contact->islandPrev )
+		contact->islandPrev->islandNext = contact->islandNext;
+
+	if ( contact->islandNext )
+		contact->islandNext->islandPrev = contact->islandPrev;
+
+	if ( contact == island->contactList )
+		island->contactList = contact->islandNext;
+
+	contact->islandPrev = NULL;
+	contact->islandNext = NULL;
+	contact->m_flags &= ~PhysicsContactConstraint::eIsland;
+
+	--island->contactCount;
+	++island->constraintRemoveCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::WakeIsland( PhysicsPersistentIsland* island )
+{
+	if ( island->awake )
+		return;
+
+	RemoveFromList( island );
+	island->awake = true;
+	AddToList( island );
+
+	for ( PhysicsBody* body = island->bodyList; body; body = body->m_islandNext )
+		body->SetToAwake( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::SleepIsland( PhysicsPersistentIsland* island )
+{
+	if ( island->awake )
+	{
+		RemoveFromList( island );
+		island->awake = false;
+		AddToList( island );
+	}
+
+	for ( PhysicsBody* body = island->bodyList; body; body = body->m_islandNext )
+		body->SetToSleep( );
+
+	for ( PhysicsContactConstraint* contact = island->contactList; contact; contact = contact->islandNext )
+	{
+		if ( contact->bodyA->m_flags & PhysicsBody::eStatic )
+			contact->bodyA->SetToSleep( );
+
+		if ( contact->bodyB->m_flags & PhysicsBody::eStatic )
+			contact->bodyB->SetToSleep( );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::SplitIslands( )
+{
+	// New islands go to the front of the list and are not visited again
+	PhysicsPersistentIsland* island = m_awakeList;
+
+	while ( island )
+	{
+		PhysicsPersistentIsland* next = island->next;
+
+		if ( island->split )
+			SplitIsland( island );
+
+		island = next;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::SplitIsland( PhysicsPersistentIsland* island )
+{
+	int bodyCount = island->bodyCount;
+	bool awake = island->awake;
+
+	m_stack->Reserve( sizeof( PhysicsBody* ) * 2 * bodyCount );
+	PhysicsBody** bodies = (PhysicsBody**)m_stack->Allocate( sizeof( PhysicsBody* ) * bodyCount );
+	PhysicsBody** stack = (PhysicsBody**)m_stack->Allocate( sizeof( PhysicsBody* ) * bodyCount );
+
+	int count = 0;
+	for ( PhysicsBody* body = island->bodyList; body; body = body->m_islandNext )
+		bodies[ count++ ] = body;
+
+	assert( count == bodyCount );
+
+	// Contacts keep their eIsland flag, they are relinked by the search below
+	DestroyIsland( island );
+
+	// Depth first search over the touching contacts, one island per seed
+	// that was not reached yet. Body eIsland flags mark visited bodies.
+	for ( int i = 0; i < bodyCount; ++i )
+	{
+		PhysicsBody* seed = bodies[ i ];
+
+		if ( seed->m_flags & PhysicsBody::eIsland )
+			continue;
+
+		PhysicsPersistentIsland* part = CreateIsland( awake );
+
+		int stackCount = 0;
+		stack[ stackCount++ ] = seed;
+		seed->m_flags |= PhysicsBody::eIsland;
+
+		while ( stackCount > 0 )
+		{
+			PhysicsBody* body = stack[ --stackCount ];
+			body->m_islandPrev = NULL;
+			body->m_islandNext = NULL;
+			AddBodyToIsland( part, body );
+
+			for ( PhysicsContactEdge* edge = body->m_contactList; edge; edge = edge->next )
+			{
+				PhysicsContactConstraint* contact = edge->constraint;
+
+				if ( !(contact->m_flags & PhysicsContactConstraint::eIsland) )
+					continue;
+
+				PhysicsBody* other = edge->other;
+				bool otherStatic = (other->m_flags & PhysicsBody::eStatic) != 0;
+
+				// Every contact is added once, from one of its non-static bodies
+				if ( otherStatic || body == contact->bodyA )
+					AddContactToIsland( part, contact );
+
+				if ( otherStatic || (other->m_flags & PhysicsBody::eIsland) )
+					continue;
+
+				assert( stackCount < bodyCount );
+				stack[ stackCount++ ] = other;
+				other->m_flags |= PhysicsBody::eIsland;
+			}
+		}
+	}
+
+	for ( int i = 0; i < bodyCount; ++i )
+		bodies[ i ]->m_flags &= ~PhysicsBody::eIsland;
+
+	m_stack->Free( stack );
+	m_stack->Free( bodies );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::Reserve( int bodyCount )
+{
+	m_allocator.Reserve( bodyCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsPersistentIsland* PhysicsIslandManager::GetAwakeIslands( ) const
+{
+	return m_awakeList;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsIslandManager::GetAwakeIslandCount( ) const
+{
+	return m_awakeCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsIslandManager::GetIslandCount( ) const
+{
+	return m_islandCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsPersistentIsland* PhysicsIslandManager::CreateIsland( bool awake )
+{
+	PhysicsPersistentIsland* island = (PhysicsPersistentIsland*)m_allocator.Allocate( );
+	island->bodyList = NULL;
+	island->contactList = NULL;
+	island->seed = NULL;
+	island->bodyCount = 0;
+	island->contactCount = 0;
+	island->constraintRemoveCount = 0;
+	island->awake = awake;
+	island->split = false;
+
+	AddToList( island );
+	++m_islandCount;
+
+	return island;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::DestroyIsland( PhysicsPersistentIsland* island )
+{
+	RemoveFromList( island );
+	--m_islandCount;
+
+	m_allocator.Free( island );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::AddToList( PhysicsPersistentIsland* island )
+{
+	PhysicsPersistentIsland** list = island->awake ? &m_awakeList : &m_sleepingList;
+
+	island->prev = NULL;
+	island->next = *list;
+
+	if ( *list )
+		(*list)->prev = island;
+
+	*list = island;
+
+	if ( island->awake )
+		++m_awakeCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::RemoveFromList( PhysicsPersistentIsland* island )
+{
+	PhysicsPersistentIsland** list = island->awake ? &m_awakeList : &m_sleepingList;
+
+	if ( island->prev )
+		island->prev->next = island->next;
+
+	if ( island->next )
+		island->next->prev = island->prev;
+
+	if ( island == *list )
+		*list = island->next;
+
+	if ( island->awake )
+		--m_awakeCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::AddBodyToIsland( PhysicsPersistentIsland* island, PhysicsBody* body )
+{
+	body->m_island = island;
+	body->m_islandPrev = NULL;
+	body->m_islandNext = island->bodyList;
+
+	if ( island->bodyList )
+		island->bodyList->m_islandPrev = body;
+
+	island->bodyList = body;
+	++island->bodyCount;
+
+	UpdateSeed( island, body );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::UpdateSeed( PhysicsPersistentIsland* island, PhysicsBody* body )
+{
+	if ( !island->seed || body->m_creationIndex > island->seed->m_creationIndex )
+		island->seed = body;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsIslandManager::AddContactToIsland( PhysicsPersistentIsland* island, PhysicsContactConstraint* contact )
+{
+	contact->m_flags |= PhysicsContactConstraint::eIsland;
+	contact->islandPrev = NULL;
+	contact->islandNext = island->contactList;
+
+	if ( island->contactList )
+		island->contactList->islandPrev = contact;
+
+	island->contactList = contact;
+	++island->contactCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsPersistentIsland* PhysicsIslandManager::MergeIslands( PhysicsPersistentIsland* a, PhysicsPersistentIsland* b )
+{
+	assert( a->awake == b->awake );
+
+	if ( a->bodyCount < b->bodyCount )
+	{
+		PhysicsPersistentIsland* t = a;
+		a = b;
+		b = t;
+	}
+
+	// Append the bodies and contacts of b to the front of the lists of a
+	PhysicsBody* lastBody = NULL;
+	for ( PhysicsBody* body = b->bodyList; body; body = body->m_islandNext )
+	{
+		body->m_island = a;
+		lastBody = body;
+	}
+
+	if ( lastBody )
+	{
+		lastBody->m_islandNext = a->bodyList;
+
+		if ( a->bodyList )
+			a->bodyList->m_islandPrev = lastBody;
+
+		a->bodyList = b->bodyList;
+	}
+
+	PhysicsContactConstraint* lastContact = NULL;
+	for ( PhysicsContactConstraint* contact = b->contactList; contact; contact = contact->islandNext )
+		lastContact = contact;
+
+	if ( lastContact )
+	{
+		lastContact->islandNext = a->contactList;
+
+		if ( a->contactList )
+			a->contactList->islandPrev = lastContact;
+
+		a->contactList = b->contactList;
+	}
+
+	UpdateSeed( a, b->seed );
+
+	a->bodyCount += b->bodyCount;
+	a->contactCount += b->contactCount;
+	a->constraintRemoveCount += b->constraintRemoveCount;
+
+	DestroyIsland( b );
+
+	return a;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsPersistentIsland* PhysicsIslandManager::GetIsland( const PhysicsContactConstraint* contact )
+{
+	return contact->bodyA->m_island ? contact->bodyA->m_island : contact->bodyB->m_island;
+}
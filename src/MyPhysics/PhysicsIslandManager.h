@@ -0,0 +1,107 @@
+#pragma once
+
+#include "PhysicsMemory.h"
+
+class PhysicsBody;
+class PhysicsContactConstraint;
+
+// Connected group of non-static bodies together with the touching contacts
+// between them and to static bodies. Islands persist from step to step,
+// bodies and contacts are linked into them through their island pointers.
+// Static bodies belong to no island, so they never connect two islands.
+struct PhysicsPersistentIsland
+{
+	PhysicsBody* bodyList;
+	PhysicsContactConstraint* contactList;
+
+	// Most recently created body. The scene searches the island starting
+	// from it, which gives the solver the order of a search over the scene
+	// body list.
+	PhysicsBody* seed;
+
+	int bodyCount;
+	int contactCount;
+
+	// Contacts unlinked since the island was built. The island may have
+	// fallen apart and has to be split before it is allowed to sleep.
+	int constraintRemoveCount;
+
+	bool awake;
+
+	// Set by the scene when a resting part of the island could go to sleep
+	// on its own, see PhysicsIslandManager::SplitIslands
+	bool split;
+
+	// Awake or sleeping list of the manager
+	PhysicsPersistentIsland* prev;
+	PhysicsPersistentIsland* next;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsIslandManager
+//--------------------------------------------------------------------------------------------------
+// Keeps the islands up to date as contacts begin and end touching. Islands
+// are merged right away when a contact connects two of them, the smaller
+// one is moved into the larger. Ending contacts only mark the island, it is
+// split later by a search over its own bodies.
+class PhysicsIslandManager
+{
+public:
+	PhysicsIslandManager( PhysicsStack* stack );
+
+	// Every non-static body starts out in an island of its own. Bodies
+	// have to lose all contacts before they are removed.
+	void AddBody( PhysicsBody* body );
+	void RemoveBody( PhysicsBody* body );
+
+	// Called when a contact starts or stops touching. The contact manager
+	// keeps sensors and contacts that are not touching out of islands.
+	void LinkContact( PhysicsContactConstraint* contact );
+	void UnlinkContact( PhysicsContactConstraint* contact );
+
+	// Waking sets every body of the island awake. Sleeping also puts the
+	// static bodies touching the island to sleep, they are woken again by
+	// any other island touching them.
+	void WakeIsland( PhysicsPersistentIsland* island );
+	void SleepIsland( PhysicsPersistentIsland* island );
+
+	// Replaces every awake island marked for splitting by one island per
+	// connected group of its bodies. Uses the stack, so it cannot run while
+	// islands are being solved.
+	void SplitIslands( );
+
+	// Makes room for the islands of up to bodyCount bodies
+	void Reserve( int bodyCount );
+
+	PhysicsPersistentIsland* GetAwakeIslands( ) const;
+	int GetAwakeIslandCount( ) const;
+	int GetIslandCount( ) const;
+
+private:
+	void SplitIsland( PhysicsPersistentIsland* island );
+
+	PhysicsPersistentIsland* CreateIsland( bool awake );
+	void DestroyIsland( PhysicsPersistentIsland* island );
+
+	void AddToList( PhysicsPersistentIsland* island );
+	void RemoveFromList( PhysicsPersistentIsland* island );
+
+	void AddBodyToIsland( PhysicsPersistentIsland* island, PhysicsBody* body );
+	static void UpdateSeed( PhysicsPersistentIsland* island, PhysicsBody* body );
+	void AddContactToIsland( PhysicsPersistentIsland* island, PhysicsContactConstraint* contact );
+
+	// Moves everything of the smaller island into the larger one, returns
+	// the island left over
+	PhysicsPersistentIsland* MergeIslands( PhysicsPersistentIsland* a, PhysicsPersistentIsland* b );
+
+	static PhysicsPersistentIsland* GetIsland( const PhysicsContactConstraint* contact );
+
+	PhysicsStack* m_stack;
+	PhysicsPagedAllocator m_allocator;
+
+	PhysicsPersistentIsland* m_awakeList;
+	PhysicsPersistentIsland* m_sleepingList;
+	int m_awakeCount;
+	int m_islandCount;
+	int m_creationCount;
+};
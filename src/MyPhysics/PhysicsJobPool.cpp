@@ -0,0 +1,235 @@
+#include "PhysicsJobPool.h"
+
+#include "PhysicsMemory.h"
+
+#include <cassert>
+#include <new>
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsJobPool
+//--------------------------------------------------------------------------------------------------
+PhysicsJobPool::PhysicsJobPool( )
+	: m_queues( NULL )
+	, m_threads( NULL )
+	, m_threadCount( 0 )
+	, m_generation( 0 )
+	, m_activeWorkers( 0 )
+	, m_shutdown( false )
+	, m_fn( NULL )
+	, m_param( NULL )
+{
+	StartWorkers( 1 );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsJobPool::~PhysicsJobPool( )
+{
+	StopWorkers( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::SetThreadCount( int threadCount )
+{
+	if ( threadCount < 1 )
+		threadCount = 1;
+
+	if ( threadCount == m_threadCount )
+		return;
+
+	StopWorkers( );
+	StartWorkers( threadCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsJobPool::GetThreadCount( ) const
+{
+	return m_threadCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::Run( PhysicsJobFunction fn, void* param, int count )
+{
+	if ( count <= 0 )
+		return;
+
+	if ( m_threadCount == 1 || count == 1 )
+	{
+		for ( int i = 0; i < count; ++i )
+			fn( param, i, 0 );
+
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock( m_lock );
+
+		// A worker that woke up late for the previous batch may still be
+		// scanning the queues, let it leave before they are refilled
+		m_done.wait( lock, [ this ]( ) { return m_activeWorkers == 0; } );
+
+		m_fn = fn;
+		m_param = param;
+
+		// Hand every thread an equal contiguous slice, stealing evens
+		// out the imbalance later on
+		for ( int i = 0; i < m_threadCount; ++i )
+		{
+			PhysicsJobQueue* queue = m_queues + i;
+			std::lock_guard<std::mutex> queueLock( queue->lock );
+			queue->begin = (int)((long long)count * i / m_threadCount);
+			queue->end = (int)((long long)count * (i + 1) / m_threadCount);
+		}
+
+		++m_generation;
+	}
+
+	m_wake.notify_all( );
+
+	Execute( 0 );
+
+	std::unique_lock<std::mutex> lock( m_lock );
+	m_done.wait( lock, [ this ]( ) { return m_activeWorkers == 0; } );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::StartWorkers( int threadCount )
+{
+	m_threadCount = threadCount;
+	m_shutdown = false;
+
+	m_queues = (PhysicsJobQueue*)PhysicsAlloc( sizeof( PhysicsJobQueue ) * threadCount );
+	for ( int i = 0; i < threadCount; ++i )
+	{
+		new (m_queues + i) PhysicsJobQueue;
+		m_queues[ i ].begin = 0;
+		m_queues[ i ].end = 0;
+	}
+
+	// Thread 0 is the caller of Run and has no std::thread of its own
+	m_threads = NULL;
+	if ( threadCount > 1 )
+	{
+		m_threads = (std::thread*)PhysicsAlloc( sizeof( std::thread ) * (threadCount - 1) );
+		for ( int i = 1; i < threadCount; ++i )
+			new (m_threads + i - 1) std::thread( &PhysicsJobPool::WorkerMain, this, i );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::StopWorkers( )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_lock );
+		m_shutdown = true;
+	}
+
+	m_wake.notify_all( );
+
+	if ( m_threads )
+	{
+		for ( int i = 0; i < m_threadCount - 1; ++i )
+		{
+			m_threads[ i ].join( );
+			m_threads[ i ].~thread( );
+		}
+
+		PhysicsFree( m_threads );
+		m_threads = NULL;
+	}
+
+	for ( int i = 0; i < m_threadCount; ++i )
+		m_queues[ i ].~PhysicsJobQueue( );
+
+	PhysicsFree( m_queues );
+	m_queues = NULL;
+	m_threadCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::WorkerMain( int threadIndex )
+{
+	int generation = 0;
+
+	for ( ;; )
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_lock );
+			m_wake.wait( lock, [ this, generation ]( ) { return m_shutdown || m_generation != generation; } );
+
+			if ( m_shutdown )
+				return;
+
+			generation = m_generation;
+			++m_activeWorkers;
+		}
+
+		Execute( threadIndex );
+
+		{
+			std::lock_guard<std::mutex> lock( m_lock );
+			--m_activeWorkers;
+		}
+
+		m_done.notify_all( );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsJobPool::Execute( int threadIndex )
+{
+	int job;
+
+	while ( PopJob( threadIndex, &job ) || StealJob( threadIndex, &job ) )
+		m_fn( m_param, job, threadIndex );
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsJobPool::PopJob( int threadIndex, int* job )
+{
+	PhysicsJobQueue* queue = m_queues + threadIndex;
+	std::lock_guard<std::mutex> lock( queue->lock );
+
+	if ( queue->begin == queue->end )
+		return false;
+
+	*job = queue->begin++;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsJobPool::StealJob( int threadIndex, int* job )
+{
+	for ( int i = 1; i < m_threadCount; ++i )
+	{
+		PhysicsJobQueue* victim = m_queues + (threadIndex + i) % m_threadCount;
+		int begin;
+		int end;
+
+		{
+			std::lock_guard<std::mutex> lock( victim->lock );
+
+			int remaining = victim->end - victim->begin;
+			if ( remaining <= 0 )
+				continue;
+
+			// Take the back half, the owner keeps working from the front
+			begin = victim->end - (remaining + 1) / 2;
+			end = victim->end;
+			victim->end = begin;
+		}
+
+		// Run the first stolen job right away and queue up the rest
+		// so that other idle threads can steal from us in turn
+		PhysicsJobQueue* queue = m_queues + threadIndex;
+		std::lock_guard<std::mutex> lock( queue->lock );
+		assert( queue->begin == queue->end );
+		queue->begin = begin + 1;
+		queue->end = end;
+		*job = begin;
+
+		return true;
+	}
+
+	return false;
+}
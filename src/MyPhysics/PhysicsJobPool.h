@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Job entry point. index is in [0, count) of the PhysicsJobPool::Run call,
+// threadIndex is in [0, GetThreadCount( )) and is never shared by two jobs
+// running at the same time, so it can be used to pick per thread scratch data.
+typedef void (*PhysicsJobFunction)( void* param, int index, int threadIndex );
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsJobPool
+//--------------------------------------------------------------------------------------------------
+// Fixed set of worker threads. Every thread owns a queue holding a contiguous
+// range of job indices. Owners pop from the front of their own range, idle
+// threads steal the back half of another thread's range.
+class PhysicsJobPool
+{
+public:
+	PhysicsJobPool( );
+	~PhysicsJobPool( );
+
+	// Total number of threads used to run jobs, including the thread calling
+	// Run. A count of 1 (the default) runs every job on the calling thread.
+	void SetThreadCount( int threadCount );
+	int GetThreadCount( ) const;
+
+	// Calls fn( param, i, threadIndex ) for every i in [0, count) and returns
+	// once all of them have finished. Not reentrant.
+	void Run( PhysicsJobFunction fn, void* param, int count );
+
+private:
+	struct PhysicsJobQueue
+	{
+		std::mutex lock;
+		int begin;
+		int end;
+	};
+
+	void StartWorkers( int threadCount );
+	void StopWorkers( );
+	void WorkerMain( int threadIndex );
+	void Execute( int threadIndex );
+	bool PopJob( int threadIndex, int* job );
+	bool StealJob( int threadIndex, int* job );
+
+	PhysicsJobQueue* m_queues;
+	std::thread* m_threads;
+	int m_threadCount;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	int m_generation;
+	int m_activeWorkers;
+	bool m_shutdown;
+
+	PhysicsJobFunction m_fn;
+	void* m_param;
+};
@@ -26,56 +26,141 @@
 
 
 #include "PhysicsMemory.h"
+#include "PhysicsSettings.h"
 
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 
 #include <string.h>
 
 
+//--------------------------------------------------------------------------------------------------
+// PhysicsAllocator
+//--------------------------------------------------------------------------------------------------
+class PhysicsMallocAllocator : public PhysicsAllocator
+{
+public:
+	void* Allocate( int bytes ) override
+	{
+		return malloc( bytes );
+	}
+
+	void Free( void* memory ) override
+	{
+		free( memory );
+	}
+};
+
+static PhysicsMallocAllocator s_mallocAllocator;
+static PhysicsAllocator* s_allocator = &s_mallocAllocator;
+
+static std::atomic<long long> s_allocationCount( 0 );
+static std::atomic<long long> s_freeCount( 0 );
+static std::atomic<long long> s_allocatedBytes( 0 );
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSetAllocator( PhysicsAllocator* allocator )
+{
+	s_allocator = allocator ? allocator : &s_mallocAllocator;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsAllocator* PhysicsGetAllocator( )
+{
+	return s_allocator;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsGetAllocationStats( PhysicsAllocationStats* stats )
+{
+	stats->allocationCount = s_allocationCount.load( std::memory_order_relaxed );
+	stats->freeCount = s_freeCount.load( std::memory_order_relaxed );
+	stats->allocatedBytes = s_allocatedBytes.load( std::memory_order_relaxed );
+}
+
+//--------------------------------------------------------------------------------------------------
+void* PhysicsAlloc( int bytes )
+{
+	s_allocationCount.fetch_add( 1, std::memory_order_relaxed );
+	s_allocatedBytes.fetch_add( bytes, std::memory_order_relaxed );
+
+	return s_allocator->Allocate( bytes );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsFree( void* memory )
+{
+	// Matches free, which accepts NULL as well
+	if ( !memory )
+		return;
+
+	s_freeCount.fetch_add( 1, std::memory_order_relaxed );
+	s_allocator->Free( memory );
+}
+
 //--------------------------------------------------------------------------------------------------
 // PhysicsStack
+//--------------------------------------------------------------------------------------------------
+#define Q3_STACK_ROUND( BYTES ) \
+	(((BYTES) + Physicsk_stackAlignment - 1) & ~(Physicsk_stackAlignment - 1))
+
 //--------------------------------------------------------------------------------------------------
 PhysicsStack::PhysicsStack( )
-	: m_memory( 0 )
+	: m_chunks( NULL )
+	, m_chunk( NULL )
 	, m_entries( (PhysicsStackEntry*)PhysicsAlloc( sizeof( PhysicsStackEntry ) * 64 ) )
 	, m_index( 0 )
 	, m_allocation( 0 )
 	, m_entryCount( 0 )
 	, m_entryCapacity( 64 )
-	, m_stackSize( 0 )
+	, m_capacity( 0 )
+	, m_chunkCount( 0 )
+	, m_peakSize( 0 )
+	, m_stepPeakSize( 0 )
+	, m_stepSize( 0 )
+	, m_stepGrowCount( 0 )
 {
 }
 
 //--------------------------------------------------------------------------------------------------
 PhysicsStack::~PhysicsStack( )
 {
-	if (m_memory) PhysicsFree( m_memory );
 	assert( m_index == 0 );
 	assert( m_entryCount == 0 );
+
+	ReleaseChunks( );
+	PhysicsFree( m_entries );
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsStack::Reserve( unsigned int size )
 {
-	assert( !m_index );
+	assert( m_entryCount == 0 );
 
 	if ( size == 0 )
 		return;
 
-	if ( size >= m_stackSize )
-	{
-		if ( m_memory ) PhysicsFree( m_memory );
-		m_memory = (unsigned char*)PhysicsAlloc( size );
-		m_stackSize = size;
-	}
+	if ( m_chunkCount == 1 && m_chunks->size >= (int)size )
+		return;
+
+	// Keep everything needed so far in one chunk, the next steps will most
+	// likely need as much again. Growing adds headroom, hints tend to creep
+	// up step by step.
+	int chunkSize = m_capacity > Physicsk_stackChunkSize ? m_capacity : Physicsk_stackChunkSize;
+
+	if ( (int)size > chunkSize )
+		chunkSize = (int)size > chunkSize + chunkSize / 2 ? (int)size : chunkSize + chunkSize / 2;
+	ReleaseChunks( );
+	m_chunks = CreateChunk( chunkSize );
+	m_chunk = m_chunks;
 }
 
 //--------------------------------------------------------------------------------------------------
 void *PhysicsStack::Allocate( int size )
 {
-	assert( m_index + size <= m_stackSize );
+	size = Q3_STACK_ROUND( size );
 
 	if ( m_entryCount == m_entryCapacity )
 	{
@@ -87,14 +172,46 @@ void *PhysicsStack::Allocate( int size )
 	}
 
 	PhysicsStackEntry* entry = m_entries + m_entryCount;
+	entry->chunk = m_chunk;
+	entry->index = m_index;
 	entry->size = size;
 
-	entry->data = m_memory + m_index;
+	// Move on to the next chunk when the current one is full, the rest of
+	// the current chunk stays unused until this allocation is freed
+	if ( !m_chunk || m_index + size > m_chunk->size )
+	{
+		PhysicsStackChunk* next = m_chunk ? m_chunk->next : m_chunks;
+
+		if ( !next || next->size < size )
+		{
+			// Grow geometrically so a step outgrowing its hint only needs a
+			// few chunks
+			int chunkSize = m_capacity / 2 > Physicsk_stackChunkSize ? m_capacity / 2 : Physicsk_stackChunkSize;
+			PhysicsStackChunk* chunk = CreateChunk( size > chunkSize ? size : chunkSize );
+			chunk->next = next;
+
+			if ( m_chunk )
+				m_chunk->next = chunk;
+			else
+				m_chunks = chunk;
+
+			next = chunk;
+		}
+
+		m_chunk = next;
+		m_index = 0;
+	}
+
+	entry->data = GetData( m_chunk ) + m_index;
 	m_index += size;
 
 	m_allocation += size;
 	++m_entryCount;
 
+	m_stepSize += size;
+	m_stepPeakSize = m_allocation > m_stepPeakSize ? m_allocation : m_stepPeakSize;
+	m_peakSize = m_allocation > m_peakSize ? m_allocation : m_peakSize;
+
 	return entry->data;
 }
 
@@ -110,169 +227,342 @@ void PhysicsStack::Free( void *data )
 	// Must be in reverse order of allocation.
 	assert( data == entry->data );
 
-	m_index -= entry->size;
+	m_chunk = entry->chunk;
+	m_index = entry->index;
 
 	m_allocation -= entry->size;
 	--m_entryCount;
 }
 
 //--------------------------------------------------------------------------------------------------
-// PhysicsHeap
+void PhysicsStack::ResetStepStats( )
+{
+	m_stepPeakSize = m_allocation;
+	m_stepSize = 0;
+	m_stepGrowCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsStack::GetStats( PhysicsStackStats* stats ) const
+{
+	stats->capacity = m_capacity;
+	stats->chunkCount = m_chunkCount;
+	stats->peakSize = m_peakSize;
+	stats->stepPeakSize = m_stepPeakSize;
+	stats->stepSize = m_stepSize;
+	stats->stepGrowCount = m_stepGrowCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsStack::PhysicsStackChunk* PhysicsStack::CreateChunk( int size )
+{
+	PhysicsStackChunk* chunk = (PhysicsStackChunk*)PhysicsAlloc( Q3_STACK_ROUND( sizeof( PhysicsStackChunk ) ) + size );
+	chunk->next = NULL;
+	chunk->size = size;
+
+	m_capacity += size;
+	++m_chunkCount;
+	++m_stepGrowCount;
+
+	return chunk;
+}
+
 //--------------------------------------------------------------------------------------------------
-PhysicsHeap::PhysicsHeap( )
+void PhysicsStack::ReleaseChunks( )
 {
-	m_memory = (PhysicsHeader*)PhysicsAlloc( Physicsk_heapSize );
-	m_memory->next = NULL;
-	m_memory->prev = NULL;
-	m_memory->size = Physicsk_heapSize;
+	PhysicsStackChunk* chunk = m_chunks;
 
-	m_freeBlocks = (PhysicsFreeBlock*)PhysicsAlloc( sizeof( PhysicsFreeBlock ) * Physicsk_heapInitialCapacity );
-	m_freeBlockCount = 1;
-	m_freeBlockCapacity = Physicsk_heapInitialCapacity;
+	while ( chunk )
+	{
+		PhysicsStackChunk* next = chunk->next;
+		PhysicsFree( chunk );
+		chunk = next;
+	}
 
-	m_freeBlocks->header = m_memory;
-	m_freeBlocks->size = Physicsk_heapSize;
+	m_chunks = NULL;
+	m_chunk = NULL;
+	m_index = 0;
+	m_capacity = 0;
+	m_chunkCount = 0;
 }
 
 //--------------------------------------------------------------------------------------------------
-PhysicsHeap::~PhysicsHeap( )
+unsigned char* PhysicsStack::GetData( PhysicsStackChunk* chunk )
 {
-	PhysicsFree( m_memory );
-	PhysicsFree( m_freeBlocks );
+	return (unsigned char*)Q3_PTR_ADD( chunk, Q3_STACK_ROUND( sizeof( PhysicsStackChunk ) ) );
 }
 
 //--------------------------------------------------------------------------------------------------
-void *PhysicsHeap::Allocate( int size )
+// PhysicsSlabAllocator
+//--------------------------------------------------------------------------------------------------
+// Keeps the blocks following the headers aligned
+#define Q3_SLAB_ROUND( BYTES ) \
+	(((BYTES) + Physicsk_slabAlignment - 1) & ~(Physicsk_slabAlignment - 1))
+
+//--------------------------------------------------------------------------------------------------
+PhysicsSlabAllocator::PhysicsSlabAllocator( )
 {
-	int sizeNeeded = size + sizeof( PhysicsHeader );
-	PhysicsFreeBlock* firstFit = NULL;
+	memset( m_classes, 0, sizeof( m_classes ) );
+	m_pages = NULL;
+	m_largeCount = 0;
+	m_releasePages = false;
+}
 
-	for ( int i = 0; i < m_freeBlockCount; ++i )
+//--------------------------------------------------------------------------------------------------
+PhysicsSlabAllocator::~PhysicsSlabAllocator( )
+{
+	PhysicsSlabPage* page = m_pages;
+
+	while ( page )
 	{
-		PhysicsFreeBlock* block = m_freeBlocks + i;
+		PhysicsSlabPage* next = page->next;
+		PhysicsFree( page );
+		page = next;
+	}
 
-		if ( block->size >= sizeNeeded )
-		{
-			firstFit = block;
-			break;
-		}
+	assert( m_largeCount == 0 );
+}
+
+//--------------------------------------------------------------------------------------------------
+void *PhysicsSlabAllocator::Allocate( int size )
+{
+	int blockSize = Q3_SLAB_ROUND( size + (int)Q3_SLAB_ROUND( sizeof( PhysicsSlabHeader ) ) );
+
+	if ( blockSize > Physicsk_slabMaxBlockSize )
+	{
+		PhysicsSlabHeader* header = (PhysicsSlabHeader*)PhysicsAlloc( blockSize );
+		header->page = NULL;
+		header->size = blockSize;
+		++m_largeCount;
+
+		return Q3_PTR_ADD( header, Q3_SLAB_ROUND( sizeof( PhysicsSlabHeader ) ) );
 	}
 
-	if ( !firstFit )
-		return NULL;
+	int sizeClass = blockSize / Physicsk_slabAlignment - 1;
+	PhysicsSlabClass* c = m_classes + sizeClass;
+	PhysicsSlabPage* page = c->available;
+
+	if ( !page )
+		page = CreatePage( sizeClass );
 
-	PhysicsHeader* node = firstFit->header;
-	PhysicsHeader* newNode = Q3_PTR_ADD( node, sizeNeeded );
-	node->size = sizeNeeded;
+	// Reuse freed blocks first, then carve new ones off the page
+	PhysicsSlabHeader* header;
 
-	firstFit->size -= sizeNeeded;
-	firstFit->header = newNode;
+	if ( page->freeList )
+	{
+		header = (PhysicsSlabHeader*)page->freeList;
+		page->freeList = page->freeList->next;
+	}
+
+	else
+	{
+		header = (PhysicsSlabHeader*)page->top;
+		page->top += blockSize;
+	}
 
-	newNode->next = node->next;
-	if ( node->next )
-		node->next->prev = newNode;
-	node->next = newNode;
-	newNode->prev = node;
+	++page->liveCount;
 
-	return Q3_PTR_ADD( node, sizeof( PhysicsHeader ) );
+	if ( !page->freeList && page->top + blockSize > page->end )
+		UnlinkAvailable( page );
+
+	header->page = page;
+	header->size = blockSize;
+
+	++c->allocationCount;
+	++c->liveCount;
+	c->peakCount = c->liveCount > c->peakCount ? c->liveCount : c->peakCount;
+
+	return Q3_PTR_ADD( header, Q3_SLAB_ROUND( sizeof( PhysicsSlabHeader ) ) );
 }
 
 //--------------------------------------------------------------------------------------------------
-void PhysicsHeap::Free( void *memory )
+void PhysicsSlabAllocator::Free( void *memory )
 {
 	assert( memory );
-	PhysicsHeader* node = (PhysicsHeader*)Q3_PTR_ADD( memory, -int( sizeof( PhysicsHeader ) ) );
+	PhysicsSlabHeader* header = (PhysicsSlabHeader*)Q3_PTR_ADD( memory, -int( Q3_SLAB_ROUND( sizeof( PhysicsSlabHeader ) ) ) );
+	PhysicsSlabPage* page = header->page;
+
+	if ( !page )
+	{
+		assert( m_largeCount > 0 );
+		--m_largeCount;
+		PhysicsFree( header );
+		return;
+	}
+
+	PhysicsSlabClass* c = m_classes + page->sizeClass;
+	assert( page->liveCount > 0 );
+
+	// A full page has room again
+	bool full = !page->freeList && page->top + header->size > page->end;
+
+	PhysicsSlabBlock* block = (PhysicsSlabBlock*)header;
+	block->next = page->freeList;
+	page->freeList = block;
+	--page->liveCount;
+	--c->liveCount;
+
+	if ( full )
+		LinkAvailable( page );
+
+	if ( m_releasePages && page->liveCount == 0 && c->pageCount > 1 )
+		DestroyPage( page );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSlabAllocator::SetReleasePages( bool release )
+{
+	m_releasePages = release;
+}
 
-	PhysicsHeader* next = node->next;
-	PhysicsHeader* prev = node->prev;
-	PhysicsFreeBlock* nextBlock = NULL;
-	int prevBlockIndex = ~0;
-	PhysicsFreeBlock* prevBlock = NULL;
-	int freeBlockCount = m_freeBlockCount;
+//--------------------------------------------------------------------------------------------------
+int PhysicsSlabAllocator::GetStats( PhysicsSlabStats* stats, int capacity ) const
+{
+	int count = 0;
 
-	for ( int i = 0; i < freeBlockCount; ++i )
+	for ( int i = 0; i < Physicsk_slabClassCount && count < capacity; ++i )
 	{
-		PhysicsFreeBlock* block = m_freeBlocks + i;
-		PhysicsHeader* header = block->header;
+		const PhysicsSlabClass* c = m_classes + i;
 
-		if ( header == next )
-			nextBlock = block;
+		if ( !c->pageCount )
+			continue;
 
-		else if ( header == prev )
-		{
-			prevBlock = block;
-			prevBlockIndex = i;
-		}
+		PhysicsSlabStats* s = stats + count++;
+		s->blockSize = (i + 1) * Physicsk_slabAlignment;
+		s->pageCount = c->pageCount;
+		s->liveCount = c->liveCount;
+		s->peakCount = c->peakCount;
+		s->allocationCount = c->allocationCount;
 	}
 
-	bool merged = false;
+	return count;
+}
 
-	if ( prevBlock )
-	{
-		merged = true;
+//--------------------------------------------------------------------------------------------------
+int PhysicsSlabAllocator::GetLargeCount( ) const
+{
+	return m_largeCount;
+}
 
-		prev->next = next;
-		if ( next )
-			next->prev = prev;
+//--------------------------------------------------------------------------------------------------
+PhysicsSlabAllocator::PhysicsSlabPage* PhysicsSlabAllocator::CreatePage( int sizeClass )
+{
+	PhysicsSlabPage* page = (PhysicsSlabPage*)PhysicsAlloc( Physicsk_slabPageSize );
+	page->freeList = NULL;
+	page->top = (unsigned char*)Q3_PTR_ADD( page, Q3_SLAB_ROUND( sizeof( PhysicsSlabPage ) ) );
+	page->end = (unsigned char*)Q3_PTR_ADD( page, Physicsk_slabPageSize );
+	page->sizeClass = sizeClass;
+	page->liveCount = 0;
+
+	page->prev = NULL;
+	page->next = m_pages;
+	if ( m_pages )
+		m_pages->prev = page;
+	m_pages = page;
+
+	++m_classes[ sizeClass ].pageCount;
+	LinkAvailable( page );
+
+	return page;
+}
 
-		prevBlock->size += node->size;
-		prev->size = prevBlock->size;
+//--------------------------------------------------------------------------------------------------
+void PhysicsSlabAllocator::DestroyPage( PhysicsSlabPage* page )
+{
+	assert( page->liveCount == 0 );
 
-		if ( nextBlock )
-		{
-			nextBlock->header = prev;
-			nextBlock->size += prev->size;
-			prev->size = nextBlock->size;
+	UnlinkAvailable( page );
+	--m_classes[ page->sizeClass ].pageCount;
 
-			PhysicsHeader* nextnext = next->next;
-			prev->next = nextnext;
+	if ( page->prev )
+		page->prev->next = page->next;
+	else
+		m_pages = page->next;
 
-			if ( nextnext )
-				nextnext->prev = prev;
+	if ( page->next )
+		page->next->prev = page->prev;
 
-			// Remove the nextBlock from the freeBlocks array
-			assert( m_freeBlockCount );
-			assert( prevBlockIndex != ~0 );
-			--m_freeBlockCount;
-			m_freeBlocks[ prevBlockIndex ] = m_freeBlocks[ m_freeBlockCount ];
-		}
-	}
+	PhysicsFree( page );
+}
 
-	else if ( nextBlock )
-	{
-		merged = true;
+//--------------------------------------------------------------------------------------------------
+void PhysicsSlabAllocator::LinkAvailable( PhysicsSlabPage* page )
+{
+	PhysicsSlabClass* c = m_classes + page->sizeClass;
 
-		nextBlock->header = node;
-		nextBlock->size += node->size;
-		node->size = nextBlock->size;
+	page->availablePrev = NULL;
+	page->availableNext = c->available;
+	if ( c->available )
+		c->available->availablePrev = page;
+	c->available = page;
+}
 
-		PhysicsHeader* nextnext = next->next;
+//--------------------------------------------------------------------------------------------------
+void PhysicsSlabAllocator::UnlinkAvailable( PhysicsSlabPage* page )
+{
+	PhysicsSlabClass* c = m_classes + page->sizeClass;
 
-		if ( nextnext )
-			nextnext->prev = node;
+	if ( page->availablePrev )
+		page->availablePrev->availableNext = page->availableNext;
+	else
+		c->available = page->availableNext;
 
-		node->next = nextnext;
-	}
+	if ( page->availableNext )
+		page->availableNext->availablePrev = page->availablePrev;
+}
 
-	if ( !merged )
+//--------------------------------------------------------------------------------------------------
+// PhysicsBlockCache
+//--------------------------------------------------------------------------------------------------
+PhysicsBlockCache::PhysicsBlockCache( )
+	: m_freeList( NULL )
+	, m_size( 0 )
+{
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBlockCache::~PhysicsBlockCache( )
+{
+	assert( !m_freeList );
+}
+
+//--------------------------------------------------------------------------------------------------
+void *PhysicsBlockCache::Allocate( PhysicsSlabAllocator* allocator, std::mutex* mutex, int size )
+{
+	assert( !m_freeList || size == m_size );
+	m_size = size;
+
+	if ( !m_freeList )
 	{
-		PhysicsFreeBlock block;
-		block.header = node;
-		block.size = node->size;
+		std::lock_guard<std::mutex> lock( *mutex );
 
-		if ( m_freeBlockCount == m_freeBlockCapacity )
+		for ( int i = 0; i < Q3_BLOCK_CACHE_SIZE; ++i )
 		{
-			PhysicsFreeBlock* oldBlocks = m_freeBlocks;
-			int oldCapacity = m_freeBlockCapacity;
+			PhysicsBlock* block = (PhysicsBlock*)allocator->Allocate( size );
+			block->next = m_freeList;
+			m_freeList = block;
+		}
+	}
 
-			m_freeBlockCapacity *= 2;
-			m_freeBlocks = (PhysicsFreeBlock*)PhysicsAlloc( sizeof( PhysicsFreeBlock ) * m_freeBlockCapacity );
+	PhysicsBlock* block = m_freeList;
+	m_freeList = block->next;
 
-			memcpy( m_freeBlocks, oldBlocks, sizeof( PhysicsFreeBlock ) * oldCapacity );
-			PhysicsFree( oldBlocks );
-		}
+	return block;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsBlockCache::Clear( PhysicsSlabAllocator* allocator, std::mutex* mutex )
+{
+	if ( !m_freeList )
+		return;
 
-		m_freeBlocks[ m_freeBlockCount++ ] = block;
+	std::lock_guard<std::mutex> lock( *mutex );
+
+	while ( m_freeList )
+	{
+		PhysicsBlock* next = m_freeList->next;
+		allocator->Free( m_freeList );
+		m_freeList = next;
 	}
 }
 
@@ -299,38 +589,13 @@ PhysicsPagedAllocator::~PhysicsPagedAllocator( )
 //--------------------------------------------------------------------------------------------------
 void* PhysicsPagedAllocator::Allocate( )
 {
-	if ( m_freeList )
-	{
-		PhysicsBlock* data = m_freeList;
-		m_freeList = data->next;
-
-		return data;
-	}
+	if ( !m_freeList )
+		AddPage( );
 
-	else
-	{
-		PhysicsPage* page = (PhysicsPage*)PhysicsAlloc( m_blockSize * m_blocksPerPage + sizeof( PhysicsPage ) );
-		++m_pageCount;
-
-		page->next = m_pages;
-		page->data = (PhysicsBlock*)Q3_PTR_ADD( page, sizeof( PhysicsPage ) );
-		m_pages = page;
-
-		int blocksPerPageMinusOne = m_blocksPerPage - 1;
-		for ( int i = 0; i < blocksPerPageMinusOne; ++i )
-		{
-			PhysicsBlock *node = Q3_PTR_ADD( page->data, m_blockSize * i );
-			PhysicsBlock *next = Q3_PTR_ADD( page->data, m_blockSize * (i + 1) );
-			node->next = next;
-		}
+	PhysicsBlock* data = m_freeList;
+	m_freeList = data->next;
 
-		PhysicsBlock *last = Q3_PTR_ADD( page->data, m_blockSize * (blocksPerPageMinusOne) );
-		last->next = NULL;
-
-		m_freeList = page->data->next;
-
-		return page->data;
-	}
+	return data;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -371,3 +636,35 @@ void PhysicsPagedAllocator::Clear( )
 	m_freeList = NULL;
 	m_pageCount = 0;
 }
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPagedAllocator::Reserve( int count )
+{
+	while ( m_pageCount * m_blocksPerPage < count )
+		AddPage( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPagedAllocator::AddPage( )
+{
+	PhysicsPage* page = (PhysicsPage*)PhysicsAlloc( m_blockSize * m_blocksPerPage + sizeof( PhysicsPage ) );
+	++m_pageCount;
+
+	page->next = m_pages;
+	page->data = (PhysicsBlock*)Q3_PTR_ADD( page, sizeof( PhysicsPage ) );
+	m_pages = page;
+
+	// New blocks go in front of the free list
+	int blocksPerPageMinusOne = m_blocksPerPage - 1;
+	for ( int i = 0; i < blocksPerPageMinusOne; ++i )
+	{
+		PhysicsBlock *node = Q3_PTR_ADD( page->data, m_blockSize * i );
+		PhysicsBlock *next = Q3_PTR_ADD( page->data, m_blockSize * (i + 1) );
+		node->next = next;
+	}
+
+	PhysicsBlock *last = Q3_PTR_ADD( page->data, m_blockSize * (blocksPerPageMinusOne) );
+	last->next = m_freeList;
+
+	m_freeList = page->data;
+}
@@ -28,19 +28,43 @@
 #pragma once
 
 #include <stdlib.h>
+#include <mutex>
 
 //--------------------------------------------------------------------------------------------------
-// Memory Macros
+// PhysicsAllocator
 //--------------------------------------------------------------------------------------------------
-inline void* PhysicsAlloc( int bytes )
+// Source of all memory the engine takes from the system. Worker threads
+// allocate as well, implementations have to be thread safe.
+class PhysicsAllocator
 {
-	return malloc( bytes );
-}
+public:
+	virtual ~PhysicsAllocator( ) { }
+
+	virtual void* Allocate( int bytes ) = 0;
+	virtual void Free( void* memory ) = 0;
+};
 
-inline void PhysicsFree( void* memory )
+// Counted across all scenes since the program started
+struct PhysicsAllocationStats
 {
-	free( memory );
-}
+	long long allocationCount;
+	long long freeCount;
+	long long allocatedBytes;	// Total requested, freeing does not subtract
+};
+
+// Installs the allocator PhysicsAlloc and PhysicsFree forward to, NULL
+// restores the default one built on malloc. Memory has to be freed by the
+// allocator it came from, so only switch while no scene exists.
+void PhysicsSetAllocator( PhysicsAllocator* allocator );
+PhysicsAllocator* PhysicsGetAllocator( );
+
+void PhysicsGetAllocationStats( PhysicsAllocationStats* stats );
+
+//--------------------------------------------------------------------------------------------------
+// Memory Macros
+//--------------------------------------------------------------------------------------------------
+void* PhysicsAlloc( int bytes );
+void PhysicsFree( void* memory );
 
 #define Q3_PTR_ADD( P, BYTES ) \
 	((decltype( P ))(((unsigned char *)P) + (BYTES)))
@@ -48,13 +72,38 @@ inline void PhysicsFree( void* memory )
 //--------------------------------------------------------------------------------------------------
 // PhysicsStack
 //--------------------------------------------------------------------------------------------------
+// Smallest chunk the stack allocates, allocations are aligned to 16 bytes
+const int Physicsk_stackChunkSize = 16 * 1024;
+const int Physicsk_stackAlignment = 16;
+
+struct PhysicsStackStats
+{
+	int capacity;			// Bytes held in chunks
+	int chunkCount;
+	int peakSize;			// Most bytes in use at once since creation
+	int stepPeakSize;		// Most bytes in use at once since ResetStepStats
+	int stepSize;			// Bytes handed out since ResetStepStats
+	int stepGrowCount;		// Chunks allocated since ResetStepStats
+};
 
+// Linear arena freed in reverse order of allocation. Running out of room
+// adds a chunk instead of moving the memory, so pointers stay valid while
+// the stack grows. Chunks are only ever merged or released while nothing
+// is allocated, the stack keeps the largest capacity it needed so far.
 class PhysicsStack
 {
 private:
+	struct PhysicsStackChunk
+	{
+		PhysicsStackChunk* next;
+		int size;
+	};
+
 	struct PhysicsStackEntry
 	{
 		unsigned char *data;
+		PhysicsStackChunk* chunk;	// Chunk and index before the allocation
+		int index;
 		int size;
 	};
 
@@ -62,59 +111,164 @@ public:
 	PhysicsStack( );
 	~PhysicsStack( );
 
+	// Size hint for the allocations to come, must be called while nothing
+	// is allocated. Merges the chunks into a single one of at least size
+	// bytes, or does nothing when the first chunk is large enough already.
 	void Reserve( unsigned int  size );
 	void *Allocate( int size );
 	void Free( void *data );
 
+	void ResetStepStats( );
+	void GetStats( PhysicsStackStats* stats ) const;
+
 private:
-	unsigned char* m_memory;
+	PhysicsStackChunk* CreateChunk( int size );
+	void ReleaseChunks( );
+
+	static unsigned char* GetData( PhysicsStackChunk* chunk );
+
+	PhysicsStackChunk* m_chunks;
+	PhysicsStackChunk* m_chunk;
 	PhysicsStackEntry* m_entries;
 
-	unsigned int  m_index;
+	int m_index;
 
 	int m_allocation;
 	int m_entryCount;
 	int m_entryCapacity;
-	unsigned int  m_stackSize;
+	int m_capacity;
+	int m_chunkCount;
+
+	int m_peakSize;
+	int m_stepPeakSize;
+	int m_stepSize;
+	int m_stepGrowCount;
 };
 
 //--------------------------------------------------------------------------------------------------
-// PhysicsHeap
+// PhysicsSlabAllocator
 //--------------------------------------------------------------------------------------------------
-// 20 MB heap size, change as necessary
-const int Physicsk_heapSize = 1024 * 1024 * 20;
-const int Physicsk_heapInitialCapacity = 1024;
+// Pages are split into blocks of one size class each, classes are spaced
+// by the alignment. Larger allocations go straight to PhysicsAlloc.
+const int Physicsk_slabPageSize = 64 * 1024;
+const int Physicsk_slabAlignment = 16;
+const int Physicsk_slabMaxBlockSize = 2048;
+const int Physicsk_slabClassCount = Physicsk_slabMaxBlockSize / Physicsk_slabAlignment;
+
+// Usage of one size class
+struct PhysicsSlabStats
+{
+	int blockSize;			// Including the block header
+	int pageCount;
+	int liveCount;			// Blocks in use
+	int peakCount;			// Most blocks in use at once
+	int allocationCount;	// Calls to Allocate served by this class
+};
 
-// Operates on first fit basis in attempt to improve cache coherency
-class PhysicsHeap
+// Grows a page at a time and never moves or merges blocks, so allocating
+// and freeing are constant time and churn cannot fragment it. Every block
+// knows its page, freed blocks go back to the free list of their page.
+// Pages left empty are kept for reuse, unless releasing pages is enabled.
+class PhysicsSlabAllocator
 {
 private:
-	struct PhysicsHeader
+	struct PhysicsSlabPage;
+
+	// Precedes every block, large allocations have no page
+	struct PhysicsSlabHeader
 	{
-		PhysicsHeader* next;
-		PhysicsHeader* prev;
+		PhysicsSlabPage* page;
 		int size;
 	};
 
-	struct PhysicsFreeBlock
+	struct PhysicsSlabBlock
 	{
-		PhysicsHeader* header;
-		int size;
+		PhysicsSlabBlock* next;
+	};
+
+	struct PhysicsSlabPage
+	{
+		// All pages of the allocator
+		PhysicsSlabPage* next;
+		PhysicsSlabPage* prev;
+
+		// Pages of the size class with free blocks
+		PhysicsSlabPage* availableNext;
+		PhysicsSlabPage* availablePrev;
+
+		PhysicsSlabBlock* freeList;
+		unsigned char* top;		// Blocks from here on were never handed out
+		unsigned char* end;
+		int sizeClass;
+		int liveCount;
+	};
+
+	struct PhysicsSlabClass
+	{
+		PhysicsSlabPage* available;
+		int pageCount;
+		int liveCount;
+		int peakCount;
+		int allocationCount;
 	};
 
 public:
-	PhysicsHeap( );
-	~PhysicsHeap( );
+	PhysicsSlabAllocator( );
+	~PhysicsSlabAllocator( );
 
 	void *Allocate( int size );
 	void Free( void *memory );
 
+	// Gives pages back to the system once their last block is freed. Every
+	// size class keeps one page. The default is disabled.
+	void SetReleasePages( bool release );
+
+	// Fills in the classes that have pages, at most capacity of them, in
+	// order of block size. Returns the number of classes filled in.
+	int GetStats( PhysicsSlabStats* stats, int capacity ) const;
+
+	// Allocations too large for any size class
+	int GetLargeCount( ) const;
+
+private:
+	PhysicsSlabPage* CreatePage( int sizeClass );
+	void DestroyPage( PhysicsSlabPage* page );
+
+	void LinkAvailable( PhysicsSlabPage* page );
+	void UnlinkAvailable( PhysicsSlabPage* page );
+
+	PhysicsSlabClass m_classes[ Physicsk_slabClassCount ];
+	PhysicsSlabPage* m_pages;
+	int m_largeCount;
+	bool m_releasePages;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsBlockCache
+//--------------------------------------------------------------------------------------------------
+// Free list of blocks of one size in front of a slab allocator shared
+// between threads. Each thread owns its own cache, the mutex of the slab
+// allocator is only taken to move a batch of Q3_BLOCK_CACHE_SIZE blocks.
+// Blocks handed out are freed to the slab allocator directly.
+class PhysicsBlockCache
+{
+public:
+	PhysicsBlockCache( );
+	~PhysicsBlockCache( );
+
+	void *Allocate( PhysicsSlabAllocator* allocator, std::mutex* mutex, int size );
+
+	// Gives the cached blocks back to the slab allocator
+	void Clear( PhysicsSlabAllocator* allocator, std::mutex* mutex );
+
 private:
-	PhysicsHeader* m_memory;
+	struct PhysicsBlock
+	{
+		PhysicsBlock* next;
+	};
 
-	PhysicsFreeBlock* m_freeBlocks;
-	int m_freeBlockCount;
-	int m_freeBlockCapacity;
+	PhysicsBlock* m_freeList;
+	int m_size;
 };
 
 //--------------------------------------------------------------------------------------------------
@@ -140,9 +294,14 @@ public:
 	void* Allocate( );
 	void Free( void* data );
 
+	// Adds pages until count blocks fit, blocks in use count as well
+	void Reserve( int count );
+
 	void Clear( );
 
 private:
+	void AddPage( );
+
 	int m_blockSize;
 	int m_blocksPerPage;
 
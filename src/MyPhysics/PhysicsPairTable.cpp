@@ -0,0 +1,199 @@
+#include "PhysicsPairTable.h"
+
+#include "PhysicsMemory.h"
+
+#include <cassert>
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsPairTable
+//--------------------------------------------------------------------------------------------------
+PhysicsPairTable::PhysicsPairTable( )
+	: m_entries( NULL )
+	, m_capacity( 64 )
+	, m_count( 0 )
+{
+	m_entries = (PhysicsPairEntry*)PhysicsAlloc( sizeof( PhysicsPairEntry ) * m_capacity );
+	Clear( );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsPairTable::~PhysicsPairTable( )
+{
+	PhysicsFree( m_entries );
+}
+
+//--------------------------------------------------------------------------------------------------
+void* PhysicsPairTable::Find( PhysicsPairKey key ) const
+{
+	assert( key != k_empty );
+
+	int mask = m_capacity - 1;
+	int i = Hash( key ) & mask;
+
+	while ( m_entries[ i ].key != k_empty )
+	{
+		if ( m_entries[ i ].key == key )
+			return m_entries[ i ].value;
+
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsPairTable::Insert( PhysicsPairKey key, void* value )
+{
+	assert( key != k_empty );
+
+	if ( (m_count + 1) * 2 > m_capacity )
+		Resize( m_capacity * 2 );
+
+	int mask = m_capacity - 1;
+	int i = Hash( key ) & mask;
+
+	while ( m_entries[ i ].key != k_empty )
+	{
+		if ( m_entries[ i ].key == key )
+			return false;
+
+		i = (i + 1) & mask;
+	}
+
+	m_entries[ i ].key = key;
+	m_entries[ i ].value = value;
+	++m_count;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsPairTable::Remove( PhysicsPairKey key )
+{
+	assert( key != k_empty );
+
+	int mask = m_capacity - 1;
+	int i = Hash( key ) & mask;
+
+	while ( m_entries[ i ].key != key )
+	{
+		if ( m_entries[ i ].key == k_empty )
+			return false;
+
+		i = (i + 1) & mask;
+	}
+
+	// Shift back every following entry of the cluster that would not be
+	// found anymore once slot i is empty
+	int j = i;
+	for ( ;; )
+	{
+		j = (j + 1) & mask;
+
+		if ( m_entries[ j ].key == k_empty )
+			break;
+
+		int home = Hash( m_entries[ j ].key ) & mask;
+
+		// Entry j may move to i only if i lies between its home slot and j
+		if ( ((j - home) & mask) >= ((j - i) & mask) )
+		{
+			m_entries[ i ] = m_entries[ j ];
+			i = j;
+		}
+	}
+
+	m_entries[ i ].key = k_empty;
+	m_entries[ i ].value = NULL;
+	--m_count;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairTable::Clear( )
+{
+	for ( int i = 0; i < m_capacity; ++i )
+	{
+		m_entries[ i ].key = k_empty;
+		m_entries[ i ].value = NULL;
+	}
+
+	m_count = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairTable::Reserve( int count )
+{
+	int capacity = m_capacity;
+	while ( count * 2 > capacity )
+		capacity *= 2;
+
+	if ( capacity != m_capacity )
+		Resize( capacity );
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsPairTable::GetCount( ) const
+{
+	return m_count;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairTable::GetStats( PhysicsPairTableStats* stats ) const
+{
+	int mask = m_capacity - 1;
+	long long probeSum = 0;
+
+	stats->count = m_count;
+	stats->capacity = m_capacity;
+	stats->occupancy = (float)m_count / (float)m_capacity;
+	stats->maxProbe = 0;
+
+	for ( int i = 0; i < m_capacity; ++i )
+	{
+		if ( m_entries[ i ].key == k_empty )
+			continue;
+
+		int probe = (i - (int)(Hash( m_entries[ i ].key ) & mask)) & mask;
+		probeSum += probe;
+
+		if ( probe > stats->maxProbe )
+			stats->maxProbe = probe;
+	}
+
+	stats->averageProbe = m_count ? (float)probeSum / (float)m_count : 0.0f;
+}
+
+//--------------------------------------------------------------------------------------------------
+uint32_t PhysicsPairTable::Hash( PhysicsPairKey key )
+{
+	// 64 bit finalizer of MurmurHash3, proxy ids are small and sequential
+	// so the bits need a good mix before masking
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return (uint32_t)key;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairTable::Resize( int capacity )
+{
+	PhysicsPairEntry* oldEntries = m_entries;
+	int oldCapacity = m_capacity;
+
+	m_capacity = capacity;
+	m_entries = (PhysicsPairEntry*)PhysicsAlloc( sizeof( PhysicsPairEntry ) * m_capacity );
+	Clear( );
+
+	for ( int i = 0; i < oldCapacity; ++i )
+	{
+		if ( oldEntries[ i ].key != k_empty )
+			Insert( oldEntries[ i ].key, oldEntries[ i ].value );
+	}
+
+	PhysicsFree( oldEntries );
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+// Pair of proxy ids packed as ( min << 32 ) | max, sorting the keys sorts
+// pairs by A first and B second
+typedef uint64_t PhysicsPairKey;
+
+inline PhysicsPairKey PhysicsMakePairKey( int a, int b )
+{
+	int lo = a < b ? a : b;
+	int hi = a < b ? b : a;
+	return ((PhysicsPairKey)(uint32_t)lo << 32) | (PhysicsPairKey)(uint32_t)hi;
+}
+
+struct PhysicsPairTableStats
+{
+	int count;
+	int capacity;
+	float occupancy;		// count / capacity
+	float averageProbe;		// Mean distance of an entry from its home slot
+	int maxProbe;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsPairTable
+//--------------------------------------------------------------------------------------------------
+// Open addressing hash map from pair keys to user pointers. Uses linear
+// probing, the table doubles once it is half full, and erasing shifts the
+// following entries back so no tombstones are left behind.
+class PhysicsPairTable
+{
+public:
+	PhysicsPairTable( );
+	~PhysicsPairTable( );
+
+	// Returns NULL when the key is not in the table
+	void* Find( PhysicsPairKey key ) const;
+
+	// Returns false and leaves the table as is when the key already exists
+	bool Insert( PhysicsPairKey key, void* value );
+
+	// Returns false when the key is not in the table
+	bool Remove( PhysicsPairKey key );
+
+	void Clear( );
+
+	// Grows the table so that count keys fit without growing again
+	void Reserve( int count );
+
+	int GetCount( ) const;
+
+	// Walks the whole table, meant for profiling and debug output
+	void GetStats( PhysicsPairTableStats* stats ) const;
+
+private:
+	struct PhysicsPairEntry
+	{
+		PhysicsPairKey key;
+		void* value;
+	};
+
+	static const PhysicsPairKey k_empty = ~(PhysicsPairKey)0;
+
+	static uint32_t Hash( PhysicsPairKey key );
+	void Resize( int capacity );
+
+	PhysicsPairEntry* m_entries;
+	int m_capacity;
+	int m_count;
+};
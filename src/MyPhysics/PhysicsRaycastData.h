@@ -29,6 +29,10 @@
 
 #include <glm/glm.hpp>
 
+#include "PhysicsSimd.h"
+
+class PhysicsBox;
+
 class PhysicsRaycastData
 {
 
@@ -46,4 +50,76 @@ public:
     // only be called after a raycast has been conducted with a
     // return value of true.
     const glm::vec3 GetImpactPoint() const;
-};
\ No newline at end of file
+};
+
+// Result of one ray of PhysicsScene::RayCastBatch. box is NULL and toi is
+// the ray's t when nothing was hit.
+struct PhysicsRayHit
+{
+    PhysicsBox *box;
+    float toi;
+    glm::vec3 normal;
+};
+
+// Four rays in SoA form, traversed and tested together by the packet
+// queries. Lanes with a negative t are unused.
+struct PhysicsRayPacket
+{
+    float startX[4];
+    float startY[4];
+    float startZ[4];
+    float dirX[4];
+    float dirY[4];
+    float dirZ[4];
+    float invDirX[4]; // 1 / dir, huge where dir is zero
+    float invDirY[4];
+    float invDirZ[4];
+    float t[4];       // Closest hit so far, shrinks as hits are found
+};
+
+// 1 / dir per axis, huge where dir is zero so slab tests stay finite
+inline glm::vec3 PhysicsRayInvDir(const glm::vec3 &dir)
+{
+    const float k_huge = float(1.0e30);
+    glm::vec3 inv;
+
+    for (int i = 0; i < 3; ++i)
+        inv[i] = (dir[i] > float(1.0e-12) || dir[i] < float(-1.0e-12)) ? float(1.0) / dir[i] : k_huge;
+
+    return inv;
+}
+
+// Slab test of start + dir * [ 0, maxT ] against the AABB min, max. Fills in
+// the time the ray enters the box when they overlap.
+inline bool PhysicsRayOverlap(const glm::vec3 &start, const glm::vec3 &invDir, float maxT, const glm::vec3 &min, const glm::vec3 &max, float *tEnter)
+{
+    glm::vec3 t0 = (min - start) * invDir;
+    glm::vec3 t1 = (max - start) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, float(0.0)));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+
+    *tEnter = enter;
+    return enter <= exit;
+}
+
+// Returns the mask of lanes whose ray [ 0, t ] touches the AABB
+inline int PhysicsRayPacketOverlap(const PhysicsRayPacket &packet, const PhysicsVec3x4 &min, const PhysicsVec3x4 &max)
+{
+    PhysicsVec3x4 start = PhysicsLoad3x4(packet.startX, packet.startY, packet.startZ);
+    PhysicsVec3x4 inv = PhysicsLoad3x4(packet.invDirX, packet.invDirY, packet.invDirZ);
+
+    PhysicsFloat4 x0 = (min.x - start.x) * inv.x;
+    PhysicsFloat4 x1 = (max.x - start.x) * inv.x;
+    PhysicsFloat4 y0 = (min.y - start.y) * inv.y;
+    PhysicsFloat4 y1 = (max.y - start.y) * inv.y;
+    PhysicsFloat4 z0 = (min.z - start.z) * inv.z;
+    PhysicsFloat4 z1 = (max.z - start.z) * inv.z;
+
+    PhysicsFloat4 tEnter = PhysicsMax4(PhysicsMax4(PhysicsMin4(x0, x1), PhysicsMin4(y0, y1)), PhysicsMax4(PhysicsMin4(z0, z1), PhysicsSplat4(float(0.0))));
+    PhysicsFloat4 tExit = PhysicsMin4(PhysicsMin4(PhysicsMax4(x0, x1), PhysicsMax4(y0, y1)), PhysicsMin4(PhysicsMax4(z0, z1), PhysicsLoad4(packet.t)));
+
+    return PhysicsMask4(PhysicsLessEqual4(tEnter, tExit));
+}
@@ -0,0 +1,667 @@
+#include "PhysicsSAPBroadPhase.h"
+
+#include "PhysicsBox.h"
+#include "PhysicsMemory.h"
+#include "PhysicsSettings.h"
+
+#include <math.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------------------------
+// Same margin as the tree, small moves do not touch the endpoints
+static inline void FattenAABB( PhysicsAABB& aabb )
+{
+	const float k_fattener = float( 0.5 );
+	glm::vec3 v( k_fattener, k_fattener, k_fattener );
+
+	aabb.min -= v;
+	aabb.max += v;
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline int EndpointProxy( const PhysicsSAPEndpoint& e )
+{
+	return e.data >> 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+static inline bool EndpointIsMax( const PhysicsSAPEndpoint& e )
+{
+	return (e.data & 1) != 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Min endpoints go before max endpoints of the same value, touching
+// proxies count as overlapping like in PhysicsAABBtoAABB
+static inline bool EndpointLess( const PhysicsSAPEndpoint& a, const PhysicsSAPEndpoint& b )
+{
+	if ( a.value != b.value )
+		return a.value < b.value;
+
+	return !EndpointIsMax( a ) && EndpointIsMax( b );
+}
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsSAPBroadPhase
+//--------------------------------------------------------------------------------------------------
+PhysicsSAPBroadPhase::PhysicsSAPBroadPhase( PhysicsContactManager *manager )
+	: PhysicsBroadPhase( manager )
+{
+	m_proxyCapacity = 0;
+	m_proxies = NULL;
+	m_freeList = -1;
+
+	m_endpointCount = 0;
+	m_endpointCapacity = 128;
+
+	for ( int axis = 0; axis < 3; ++axis )
+		m_endpoints[ axis ] = (PhysicsSAPEndpoint*)PhysicsAlloc( sizeof( PhysicsSAPEndpoint ) * m_endpointCapacity );
+
+	m_largeProxies = NULL;
+	m_largeCount = 0;
+	m_largeCapacity = 0;
+	m_smallExtent = float( 0.0 );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsSAPBroadPhase::~PhysicsSAPBroadPhase( )
+{
+	for ( int axis = 0; axis < 3; ++axis )
+		PhysicsFree( m_endpoints[ axis ] );
+
+	if ( m_proxies )
+		PhysicsFree( m_proxies );
+
+	if ( m_largeProxies )
+		PhysicsFree( m_largeProxies );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::InsertBox( PhysicsBox *box, const PhysicsAABB& aabb )
+{
+	int id = AllocateProxy( );
+	PhysicsSAPProxy *proxy = m_proxies + id;
+
+	proxy->aabb = aabb;
+	FattenAABB( proxy->aabb );
+	proxy->box = box;
+	proxy->isDynamic = IsDynamic( box );
+	proxy->large = -1;
+	box->broadPhaseIndex = id;
+	UpdateLarge( id );
+
+	if ( m_endpointCount + 2 > m_endpointCapacity )
+	{
+		m_endpointCapacity *= 2;
+
+		for ( int axis = 0; axis < 3; ++axis )
+		{
+			PhysicsSAPEndpoint *old = m_endpoints[ axis ];
+			m_endpoints[ axis ] = (PhysicsSAPEndpoint*)PhysicsAlloc( sizeof( PhysicsSAPEndpoint ) * m_endpointCapacity );
+			memcpy( m_endpoints[ axis ], old, sizeof( PhysicsSAPEndpoint ) * m_endpointCount );
+			PhysicsFree( old );
+		}
+	}
+
+	// Append both ends and sort them into place. The min end passes the max
+	// end of every proxy it overlaps on the axis, which adds the pairs.
+	int minIndex = m_endpointCount;
+	int maxIndex = m_endpointCount + 1;
+	m_endpointCount += 2;
+
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		PhysicsSAPEndpoint *endpoints = m_endpoints[ axis ];
+
+		endpoints[ minIndex ].value = proxy->aabb.min[ axis ];
+		endpoints[ minIndex ].data = id << 1;
+		endpoints[ maxIndex ].value = proxy->aabb.max[ axis ];
+		endpoints[ maxIndex ].data = (id << 1) | 1;
+		proxy->min[ axis ] = minIndex;
+		proxy->max[ axis ] = maxIndex;
+
+		SortDown( axis, proxy->min[ axis ] );
+		SortDown( axis, proxy->max[ axis ] );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::RemoveBox( const PhysicsBox *box )
+{
+	int id = box->broadPhaseIndex;
+	PhysicsSAPProxy *proxy = m_proxies + id;
+
+	// Every pair of the proxy overlaps it on x, those are the proxies with
+	// a min end before our max end and a max end after our min end
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int other = m_largeProxies[ i ];
+		if ( other != id && m_proxies[ other ].min[ 0 ] < proxy->max[ 0 ] && m_proxies[ other ].max[ 0 ] > proxy->min[ 0 ] )
+			m_pairs.Remove( PhysicsMakePairKey( id, other ) );
+	}
+
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+	for ( int i = FirstEndpoint( proxy->aabb.min.x ); i < proxy->max[ 0 ]; ++i )
+	{
+		if ( EndpointIsMax( xAxis[ i ] ) )
+			continue;
+
+		int other = EndpointProxy( xAxis[ i ] );
+		if ( other != id && m_proxies[ other ].large == -1 && m_proxies[ other ].max[ 0 ] > proxy->min[ 0 ] )
+			m_pairs.Remove( PhysicsMakePairKey( id, other ) );
+	}
+
+	if ( proxy->large != -1 )
+	{
+		int last = m_largeProxies[ --m_largeCount ];
+		m_largeProxies[ proxy->large ] = last;
+		m_proxies[ last ].large = proxy->large;
+		proxy->large = -1;
+	}
+
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		PhysicsSAPEndpoint *endpoints = m_endpoints[ axis ];
+		int write = proxy->min[ axis ];
+
+		for ( int read = write; read < m_endpointCount; ++read )
+		{
+			if ( EndpointProxy( endpoints[ read ] ) == id )
+				continue;
+
+			PhysicsSAPEndpoint e = endpoints[ read ];
+			PhysicsSAPProxy *moved = m_proxies + EndpointProxy( e );
+
+			if ( EndpointIsMax( e ) )
+				moved->max[ axis ] = write;
+			else
+				moved->min[ axis ] = write;
+
+			endpoints[ write++ ] = e;
+		}
+	}
+
+	m_endpointCount -= 2;
+	FreeProxy( id );
+
+	if ( m_endpointCount == 0 )
+		m_smallExtent = float( 0.0 );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::UpdatePairs( )
+{
+	// Pairs that began and ended again since the last call are dropped,
+	// everything else is still overlapping
+	PhysicsPairKey keyAnd = ~(PhysicsPairKey)0;
+	PhysicsPairKey keyOr = 0;
+	int count = 0;
+
+	for ( int i = 0; i < m_pairCount; ++i )
+	{
+		PhysicsPairKey key = m_pairBuffer[ i ];
+
+		if ( !m_pairs.Find( key ) )
+			continue;
+
+		m_pairBuffer[ count++ ] = key;
+		keyAnd &= key;
+		keyOr |= key;
+	}
+
+	m_pairCount = count;
+	AddPairs( keyAnd ^ keyOr );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::Update( int id, const PhysicsAABB& aabb )
+{
+	PhysicsSAPProxy *proxy = m_proxies + id;
+
+	if ( proxy->aabb.Contains( aabb ) )
+		return;
+
+	proxy->aabb = aabb;
+	FattenAABB( proxy->aabb );
+	UpdateLarge( id );
+
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		PhysicsSAPEndpoint *endpoints = m_endpoints[ axis ];
+		endpoints[ proxy->min[ axis ] ].value = proxy->aabb.min[ axis ];
+		endpoints[ proxy->max[ axis ] ].value = proxy->aabb.max[ axis ];
+
+		// The leading end moves first, otherwise the trailing one would
+		// stop at it. Ends that are already in order do not move.
+		SortUp( axis, proxy->max[ axis ] );
+		SortUp( axis, proxy->min[ axis ] );
+		SortDown( axis, proxy->min[ axis ] );
+		SortDown( axis, proxy->max[ axis ] );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::Reserve( int proxyCount, int pairCount )
+{
+	PhysicsBroadPhase::Reserve( proxyCount, pairCount );
+	m_pairs.Reserve( pairCount );
+
+	// Turning boxes can become large while stepping
+	ReserveLarge( proxyCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsSAPBroadPhase::TestOverlap( int A, int B ) const
+{
+	return PhysicsAABBtoAABB( m_proxies[ A ].aabb, m_proxies[ B ].aabb );
+}
+
+//--------------------------------------------------------------------------------------------------
+void *PhysicsSAPBroadPhase::GetUserData( int id ) const
+{
+	return m_proxies[ id ].box;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const
+{
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int id = m_largeProxies[ i ];
+
+		if ( PhysicsAABBtoAABB( m_proxies[ id ].aabb, aabb ) )
+		{
+			if ( !cb->TreeCallBack( id ) )
+				return;
+		}
+	}
+
+	// Endpoints are sorted on x, everything past the query's max can not
+	// overlap it
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+	for ( int i = FirstEndpoint( aabb.min.x ); i < m_endpointCount && xAxis[ i ].value <= aabb.max.x; ++i )
+	{
+		if ( EndpointIsMax( xAxis[ i ] ) )
+			continue;
+
+		int id = EndpointProxy( xAxis[ i ] );
+		if ( m_proxies[ id ].large != -1 )
+			continue;
+
+		if ( PhysicsAABBtoAABB( m_proxies[ id ].aabb, aabb ) )
+		{
+			if ( !cb->TreeCallBack( id ) )
+				return;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const
+{
+	glm::vec3 end = rayCast.start + rayCast.dir * rayCast.t;
+	glm::vec3 invDir = PhysicsRayInvDir( rayCast.dir );
+	float minX = glm::min( rayCast.start.x, end.x );
+	float maxX = glm::max( rayCast.start.x, end.x );
+	float tEnter;
+
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int id = m_largeProxies[ i ];
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+
+		if ( PhysicsRayOverlap( rayCast.start, invDir, rayCast.t, aabb.min, aabb.max, &tEnter ) )
+		{
+			if ( !cb->TreeCallBack( id ) )
+				return;
+		}
+	}
+
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+	for ( int i = FirstEndpoint( minX ); i < m_endpointCount && xAxis[ i ].value <= maxX; ++i )
+	{
+		if ( EndpointIsMax( xAxis[ i ] ) )
+			continue;
+
+		int id = EndpointProxy( xAxis[ i ] );
+		if ( m_proxies[ id ].large != -1 )
+			continue;
+
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+
+		if ( PhysicsRayOverlap( rayCast.start, invDir, rayCast.t, aabb.min, aabb.max, &tEnter ) )
+		{
+			if ( !cb->TreeCallBack( id ) )
+				return;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const
+{
+	// Bound of all rays of the packet on x
+	float minX = Q3_R32_MAX;
+	float maxX = -Q3_R32_MAX;
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( packet.t[ i ] < float( 0.0 ) )
+			continue;
+
+		minX = glm::min( minX, packet.startX[ i ] + glm::min( packet.dirX[ i ] * packet.t[ i ], float( 0.0 ) ) );
+		maxX = glm::max( maxX, packet.startX[ i ] + glm::max( packet.dirX[ i ] * packet.t[ i ], float( 0.0 ) ) );
+	}
+
+	if ( minX > maxX )
+		return;
+
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int id = m_largeProxies[ i ];
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+		int lanes = PhysicsRayPacketOverlap( packet, PhysicsSplat3x4( aabb.min ), PhysicsSplat3x4( aabb.max ) );
+
+		if ( lanes )
+		{
+			if ( !cb->TreeCallBack( id, lanes ) )
+				return;
+		}
+	}
+
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+	for ( int i = FirstEndpoint( minX ); i < m_endpointCount && xAxis[ i ].value <= maxX; ++i )
+	{
+		if ( EndpointIsMax( xAxis[ i ] ) )
+			continue;
+
+		int id = EndpointProxy( xAxis[ i ] );
+		if ( m_proxies[ id ].large != -1 )
+			continue;
+
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+		int lanes = PhysicsRayPacketOverlap( packet, PhysicsSplat3x4( aabb.min ), PhysicsSplat3x4( aabb.max ) );
+
+		if ( lanes )
+		{
+			if ( !cb->TreeCallBack( id, lanes ) )
+				return;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsSAPBroadPhase::RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const
+{
+	glm::vec3 invDir = PhysicsRayInvDir( rayCast.dir );
+	float maxT = rayCast.t;
+	float minX = rayCast.start.x + glm::min( rayCast.dir.x * maxT, float( 0.0 ) );
+	float maxX = rayCast.start.x + glm::max( rayCast.dir.x * maxT, float( 0.0 ) );
+	float tEnter;
+
+	for ( int i = 0; i < m_largeCount; ++i )
+	{
+		int id = m_largeProxies[ i ];
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+
+		if ( !PhysicsRayOverlap( rayCast.start, invDir, maxT, aabb.min, aabb.max, &tEnter ) )
+			continue;
+
+		maxT = cb->RayCastCallBack( id, maxT );
+
+		if ( maxT <= float( 0.0 ) )
+			return maxT;
+	}
+
+	maxX = rayCast.start.x + glm::max( rayCast.dir.x * maxT, float( 0.0 ) );
+
+	// No near to far order here, hits still clip the ray and the scan
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+	for ( int i = FirstEndpoint( minX ); i < m_endpointCount && xAxis[ i ].value <= maxX; ++i )
+	{
+		if ( EndpointIsMax( xAxis[ i ] ) )
+			continue;
+
+		int id = EndpointProxy( xAxis[ i ] );
+		if ( m_proxies[ id ].large != -1 )
+			continue;
+
+		const PhysicsAABB& aabb = m_proxies[ id ].aabb;
+
+		if ( !PhysicsRayOverlap( rayCast.start, invDir, maxT, aabb.min, aabb.max, &tEnter ) )
+			continue;
+
+		maxT = cb->RayCastCallBack( id, maxT );
+
+		if ( maxT <= float( 0.0 ) )
+			return maxT;
+
+		maxX = rayCast.start.x + glm::max( rayCast.dir.x * maxT, float( 0.0 ) );
+	}
+
+	return maxT;
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsSAPBroadPhase::AllocateProxy( )
+{
+	if ( m_freeList == -1 )
+	{
+		int oldCapacity = m_proxyCapacity;
+		PhysicsSAPProxy *oldProxies = m_proxies;
+
+		m_proxyCapacity = oldCapacity ? oldCapacity * 2 : 64;
+		m_proxies = (PhysicsSAPProxy*)PhysicsAlloc( sizeof( PhysicsSAPProxy ) * m_proxyCapacity );
+
+		if ( oldProxies )
+		{
+			memcpy( m_proxies, oldProxies, sizeof( PhysicsSAPProxy ) * oldCapacity );
+			PhysicsFree( oldProxies );
+		}
+
+		for ( int i = oldCapacity; i < m_proxyCapacity; ++i )
+		{
+			m_proxies[ i ].box = NULL;
+			m_proxies[ i ].next = i + 1 < m_proxyCapacity ? i + 1 : -1;
+		}
+
+		m_freeList = oldCapacity;
+	}
+
+	int id = m_freeList;
+	m_freeList = m_proxies[ id ].next;
+	return id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::FreeProxy( int id )
+{
+	m_proxies[ id ].box = NULL;
+	m_proxies[ id ].next = m_freeList;
+	m_freeList = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::UpdateLarge( int id )
+{
+	PhysicsSAPProxy *proxy = m_proxies + id;
+
+	// Rounded up, the bound must never start after a proxy
+	float width = nextafterf( proxy->aabb.max.x - proxy->aabb.min.x, Q3_R32_MAX );
+
+	if ( width <= Q3_SAP_LARGE_EXTENT )
+	{
+		m_smallExtent = glm::max( m_smallExtent, width );
+
+		if ( proxy->large != -1 )
+		{
+			int last = m_largeProxies[ --m_largeCount ];
+			m_largeProxies[ proxy->large ] = last;
+			m_proxies[ last ].large = proxy->large;
+			proxy->large = -1;
+		}
+
+		return;
+	}
+
+	if ( proxy->large != -1 )
+		return;
+
+	ReserveLarge( m_largeCount + 1 );
+	proxy->large = m_largeCount;
+	m_largeProxies[ m_largeCount++ ] = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::ReserveLarge( int count )
+{
+	if ( count <= m_largeCapacity )
+		return;
+
+	int capacity = m_largeCapacity ? m_largeCapacity : 16;
+	while ( capacity < count )
+		capacity *= 2;
+
+	int *old = m_largeProxies;
+	m_largeCapacity = capacity;
+	m_largeProxies = (int*)PhysicsAlloc( sizeof( int ) * m_largeCapacity );
+
+	if ( old )
+	{
+		memcpy( m_largeProxies, old, sizeof( int ) * m_largeCount );
+		PhysicsFree( old );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsSAPBroadPhase::FirstEndpoint( float minX ) const
+{
+	// A small proxy reaching minX starts at most m_smallExtent before it.
+	// In double the difference of the two floats is exact enough to never
+	// round past a min endpoint.
+	double bound = double( minX ) - double( m_smallExtent );
+	const PhysicsSAPEndpoint *xAxis = m_endpoints[ 0 ];
+
+	int first = 0;
+	int count = m_endpointCount;
+
+	while ( count > 0 )
+	{
+		int half = count >> 1;
+
+		if ( double( xAxis[ first + half ].value ) < bound )
+		{
+			first += half + 1;
+			count -= half + 1;
+		}
+		else
+		{
+			count = half;
+		}
+	}
+
+	return first;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::SortDown( int axis, int index )
+{
+	PhysicsSAPEndpoint *endpoints = m_endpoints[ axis ];
+	PhysicsSAPEndpoint e = endpoints[ index ];
+	int id = EndpointProxy( e );
+	bool isMax = EndpointIsMax( e );
+
+	while ( index > 0 && EndpointLess( e, endpoints[ index - 1 ] ) )
+	{
+		PhysicsSAPEndpoint prev = endpoints[ index - 1 ];
+		int other = EndpointProxy( prev );
+		bool prevIsMax = EndpointIsMax( prev );
+
+		// A min passing a max to the left starts an overlap on this axis,
+		// a max passing a min ends one
+		if ( other != id )
+		{
+			if ( !isMax && prevIsMax )
+				BeginOverlap( id, other );
+			else if ( isMax && !prevIsMax )
+				EndOverlap( id, other );
+		}
+
+		if ( prevIsMax )
+			m_proxies[ other ].max[ axis ] = index;
+		else
+			m_proxies[ other ].min[ axis ] = index;
+
+		endpoints[ index ] = prev;
+		--index;
+	}
+
+	endpoints[ index ] = e;
+
+	if ( isMax )
+		m_proxies[ id ].max[ axis ] = index;
+	else
+		m_proxies[ id ].min[ axis ] = index;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::SortUp( int axis, int index )
+{
+	PhysicsSAPEndpoint *endpoints = m_endpoints[ axis ];
+	PhysicsSAPEndpoint e = endpoints[ index ];
+	int id = EndpointProxy( e );
+	bool isMax = EndpointIsMax( e );
+
+	while ( index + 1 < m_endpointCount && EndpointLess( endpoints[ index + 1 ], e ) )
+	{
+		PhysicsSAPEndpoint next = endpoints[ index + 1 ];
+		int other = EndpointProxy( next );
+		bool nextIsMax = EndpointIsMax( next );
+
+		// A max passing a min to the right starts an overlap on this axis,
+		// a min passing a max ends one
+		if ( other != id )
+		{
+			if ( isMax && !nextIsMax )
+				BeginOverlap( id, other );
+			else if ( !isMax && nextIsMax )
+				EndOverlap( id, other );
+		}
+
+		if ( nextIsMax )
+			m_proxies[ other ].max[ axis ] = index;
+		else
+			m_proxies[ other ].min[ axis ] = index;
+
+		endpoints[ index ] = next;
+		++index;
+	}
+
+	endpoints[ index ] = e;
+
+	if ( isMax )
+		m_proxies[ id ].max[ axis ] = index;
+	else
+		m_proxies[ id ].min[ axis ] = index;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::BeginOverlap( int A, int B )
+{
+	// Overlapping on this axis only, the other two have to agree as well
+	if ( !m_proxies[ A ].isDynamic && !m_proxies[ B ].isDynamic )
+		return;
+
+	if ( !PhysicsAABBtoAABB( m_proxies[ A ].aabb, m_proxies[ B ].aabb ) )
+		return;
+
+	PhysicsPairKey key = PhysicsMakePairKey( A, B );
+
+	if ( m_pairs.Insert( key, m_proxies[ A ].box ) )
+		PushPair( key );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsSAPBroadPhase::EndOverlap( int A, int B )
+{
+	m_pairs.Remove( PhysicsMakePairKey( A, B ) );
+}
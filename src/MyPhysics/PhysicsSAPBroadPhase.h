@@ -0,0 +1,99 @@
+#pragma once
+
+#include "PhysicsBroadPhase.h"
+#include "Common.h"
+
+struct PhysicsSAPProxy
+{
+	PhysicsAABB aabb;	// Fat AABB
+	PhysicsBox *box;	// NULL while on the free list
+	int min[ 3 ];		// Endpoint indices per axis
+	int max[ 3 ];
+	int next;			// Free list
+	int large;			// Index into the large proxy list, -1 when small
+	bool isDynamic;
+};
+
+// One end of a proxy on one axis, data holds ( proxy << 1 ) | isMax
+struct PhysicsSAPEndpoint
+{
+	float value;
+	int data;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsSAPBroadPhase
+//--------------------------------------------------------------------------------------------------
+// Persistent sweep and prune on all three axes. Every axis keeps the
+// endpoints of all proxies sorted, moved proxies are put back in order with
+// insertion sort. A swap of a min and a max endpoint is where two proxies
+// start or stop overlapping, so the set of overlapping pairs is kept up to
+// date as a side effect of sorting and UpdatePairs only reports the new
+// ones. Cheap when most proxies move a little each step.
+//
+// Scene queries binary search the x axis for the first endpoint a proxy
+// reaching the query can start at, the widest proxy on x bounds how far
+// back that is. Proxies wider than Q3_SAP_LARGE_EXTENT, like the ground,
+// would push the bound back to the start of the axis. They are kept in a
+// list instead and every query tests them one by one.
+//
+// Pairs rejected by PhysicsBody::CanCollide stay in the pair set and are
+// only retried after they stopped overlapping.
+class PhysicsSAPBroadPhase : public PhysicsBroadPhase
+{
+public:
+	PhysicsSAPBroadPhase( PhysicsContactManager *manager );
+	~PhysicsSAPBroadPhase( );
+
+	void InsertBox( PhysicsBox *shape, const PhysicsAABB& aabb );
+	void RemoveBox( const PhysicsBox *shape );
+	void UpdatePairs( void );
+	void Update( int id, const PhysicsAABB& aabb );
+	void Reserve( int proxyCount, int pairCount );
+	bool TestOverlap( int A, int B ) const;
+	void *GetUserData( int id ) const;
+
+	void Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const;
+	float RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const;
+
+private:
+	int AllocateProxy( );
+	void FreeProxy( int id );
+
+	// Moves the endpoint at index towards the front or the back of the axis
+	// until it is in order again, updating the pair set on the way
+	void SortDown( int axis, int index );
+	void SortUp( int axis, int index );
+
+	void BeginOverlap( int A, int B );
+	void EndOverlap( int A, int B );
+
+	// Moves the proxy into or out of the large proxy list after its AABB
+	// changed
+	void UpdateLarge( int id );
+	void ReserveLarge( int count );
+
+	// Index of the first x endpoint a small proxy overlapping x = minX or
+	// anything after it can have
+	int FirstEndpoint( float minX ) const;
+
+	PhysicsSAPProxy *m_proxies;
+	int m_proxyCapacity;
+	int m_freeList;
+
+	PhysicsSAPEndpoint *m_endpoints[ 3 ];
+	int m_endpointCount;
+	int m_endpointCapacity;
+
+	// Proxies wider than Q3_SAP_LARGE_EXTENT on x, and the widest of the
+	// others. The width only grows until the broadphase empties.
+	int *m_largeProxies;
+	int m_largeCount;
+	int m_largeCapacity;
+	float m_smallExtent;
+
+	// Every pair of proxies currently overlapping on all three axes
+	PhysicsPairTable m_pairs;
+};
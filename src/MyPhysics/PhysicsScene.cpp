@@ -29,6 +29,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "PhysicsBody.h"
 #include "PhysicsIsland.h"
@@ -40,96 +41,126 @@
 //--------------------------------------------------------------------------------------------------
 // PhysicsScene
 //--------------------------------------------------------------------------------------------------
-PhysicsScene::PhysicsScene( float dt, const glm::vec3& gravity, int iterations )
-	: m_contactManager( &m_stack )
+PhysicsScene::PhysicsScene( float dt, const glm::vec3& gravity, int iterations, PhysicsBroadPhaseType broadPhase )
+	: m_contactManager( &m_stack, &m_jobPool, broadPhase )
 	, m_boxAllocator( sizeof( PhysicsBox ), 256 )
 	, m_bodyCount( 0 )
 	, m_bodyList( NULL )
 	, m_gravity( gravity )
 	, m_dt( dt )
 	, m_iterations( iterations )
+	, m_substeps( 0 )
+	, m_tolerance( float( 0.0 ) )
 	, m_newBox( false )
 	, m_allowSleep( true )
 	, m_enableFriction( true )
+	, m_enableBatching( false )
+	, m_workerStacks( NULL )
+	, m_workerStackCount( 0 )
+	, m_creationContexts( NULL )
+	, m_creationContextCount( 0 )
 {
+	m_solverStats.islandCount = 0;
+	m_solverStats.iterationCount = 0;
+	m_solverStats.maxIterationCount = 0;
+	m_solverStats.convergedCount = 0;
 }
 
 //--------------------------------------------------------------------------------------------------
 PhysicsScene::~PhysicsScene( )
 {
 	Shutdown( );
+
+	SetThreadCount( 1 );
+	SetCreationThreadCount( 0 );
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::Step( float deltaTime)
 {
+	AddPendingBodies( );
+
 	if ( m_newBox )
 	{
-		m_contactManager.m_broadphase.UpdatePairs( );
+		m_contactManager.m_broadphase->UpdatePairs( );
 		m_newBox = false;
 	}
 
-	m_contactManager.TestCollisions( );
+	m_stack.ResetStepStats( );
+	for ( int i = 0; i < m_workerStackCount; ++i )
+		m_workerStacks[ i ].ResetStepStats( );
 
-	for ( PhysicsBody* body = m_bodyList; body; body = body->m_next )
-		body->m_flags &= ~PhysicsBody::eIsland;
+	m_contactManager.TestCollisions( deltaTime );
 
-	// Size the stack island, pick worst case size
-	m_stack.Reserve(
-		sizeof( PhysicsBody* ) * m_bodyCount
-		+ sizeof( PhysicsVelocityState ) * m_bodyCount
-		+ sizeof( PhysicsContactConstraint* ) * m_contactManager.m_contactCount
-		+ sizeof( PhysicsContactConstraintState ) * m_contactManager.m_contactCount
-		+ sizeof( PhysicsBody* ) * m_bodyCount
-	);
+	m_solverStats.islandCount = 0;
+	m_solverStats.iterationCount = 0;
+	m_solverStats.maxIterationCount = 0;
+	m_solverStats.convergedCount = 0;
 
-	PhysicsIsland island;
-	island.m_bodyCapacity = m_bodyCount;
-	island.m_contactCapacity = m_contactManager.m_contactCount;
-	island.m_bodies = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * m_bodyCount );
-	island.m_velocities = (PhysicsVelocityState *)m_stack.Allocate( sizeof( PhysicsVelocityState ) * m_bodyCount );
-	island.m_contacts = (PhysicsContactConstraint **)m_stack.Allocate( sizeof( PhysicsContactConstraint* ) * island.m_contactCapacity );
-	island.m_contactStates = (PhysicsContactConstraintState *)m_stack.Allocate( sizeof( PhysicsContactConstraintState ) * island.m_contactCapacity );
-	island.m_allowSleep = m_allowSleep;
-	island.m_enableFriction = m_enableFriction;
-	island.m_bodyCount = 0;
-	island.m_contactCount = 0;
-	island.m_dt = m_dt;
-	island.m_gravity = m_gravity;
-	island.m_iterations = m_iterations;
+	if ( m_jobPool.GetThreadCount( ) > 1 )
+		SolveIslandsParallel( deltaTime );
+	else
+		SolveIslands( deltaTime );
 
-	// Build each active island and then solve each built island
-	int stackSize = m_bodyCount;
-	PhysicsBody** stack = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * stackSize );
-	for ( PhysicsBody* seed = m_bodyList; seed; seed = seed->m_next )
+	// Update the broadphase AABBs
+	for ( PhysicsBody* body = m_bodyList; body; body = body->m_next )
 	{
-		// Seed cannot be apart of an island already
-		if ( seed->m_flags & PhysicsBody::eIsland )
+		if ( body->m_flags & PhysicsBody::eStatic )
 			continue;
 
-		// Seed must be awake
-		if ( !(seed->m_flags & PhysicsBody::eAwake) )
-			continue;
+		body->SynchronizeProxies( deltaTime );
+	}
 
-		// Seed cannot be a static body in order to keep islands
-		// as small as possible
-		if ( seed->m_flags & PhysicsBody::eStatic )
-			continue;
+	// Look for new contacts
+	m_contactManager.FindNewContacts( );
+
+	// Clear all forces
+	for ( PhysicsBody* body = m_bodyList; body; body = body->m_next )
+	{
+		 body->m_force  = glm::vec3{0};
+		 body->m_torque = glm::vec3{0}; 
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsScene::BuildIsland( PhysicsPersistentIsland* source, PhysicsIsland* island, PhysicsBody** stack, int stackSize )
+{
+	// Islands with no awake body left were put to sleep from the outside
+	bool awake = false;
+	for ( PhysicsBody* body = source->bodyList; body; body = body->m_islandNext )
+	{
+		if ( body->m_flags & PhysicsBody::eAwake )
+		{
+			awake = true;
+			break;
+		}
+	}
 
+	if ( !awake )
+		return false;
+
+	island->m_bodyCount = 0;
+	island->m_contactCount = 0;
+
+	// Islands that lost contacts may be in several pieces until they are
+	// split, each piece is searched in turn
+	PhysicsBody* seed = source->seed;
+	PhysicsBody* nextSeed = source->bodyList;
+	while ( seed )
+	{
 		int stackCount = 0;
 		stack[ stackCount++ ] = seed;
-		island.m_bodyCount = 0;
-		island.m_contactCount = 0;
 
 		// Mark seed as apart of island
 		seed->m_flags |= PhysicsBody::eIsland;
 
-		// Perform DFS on constraint graph
+		// Perform DFS on the contacts linked into the island. Membership is
+		// already known, the search only fixes the order the solver sees.
 		while( stackCount > 0 )
 		{
 			// Decrement stack to implement iterative backtracking
 			PhysicsBody *body = stack[ --stackCount ];
-			island.Add( body );
+			island->Add( body );
 
 			// Awaken all bodies connected to the island
 			body->SetToAwake( );
@@ -147,21 +178,16 @@ void PhysicsScene::Step( float deltaTime)
 			{
 				PhysicsContactConstraint *contact = edge->constraint;
 
-				// Skip contacts that have been added to an island already
-				if ( contact->m_flags & PhysicsContactConstraint::eIsland )
-					continue;
-
-				// Can safely skip this contact if it didn't actually collide with anything
-				if ( !(contact->m_flags & PhysicsContactConstraint::eColliding) )
+				// Only touching contacts are linked into the island
+				if ( !(contact->m_flags & PhysicsContactConstraint::eIsland) )
 					continue;
 
-				// Skip sensors
-				if ( contact->A->sensor || contact->B->sensor )
+				// Skip contacts that have been added to the island already
+				if ( contact->m_flags & PhysicsContactConstraint::eGathered )
 					continue;
 
-				// Mark island flag and add to island
-				contact->m_flags |= PhysicsContactConstraint::eIsland;
-				island.Add( contact );
+				contact->m_flags |= PhysicsContactConstraint::eGathered;
+				island->Add( contact );
 
 				// Attempt to add the other body in the contact to the island
 				// to simulate contact awakening propogation
@@ -170,26 +196,125 @@ void PhysicsScene::Step( float deltaTime)
 					continue;
 
 				assert( stackCount < stackSize );
+				(void)stackSize;
 
 				stack[ stackCount++ ] = other;
 				other->m_flags |= PhysicsBody::eIsland;
 			}
 		}
 
-		assert( island.m_bodyCount != 0 );
+		seed = NULL;
+		for ( ; nextSeed; nextSeed = nextSeed->m_islandNext )
+		{
+			if ( !(nextSeed->m_flags & PhysicsBody::eIsland) )
+			{
+				seed = nextSeed;
+				break;
+			}
+		}
+	}
 
-		island.Initialize( );
-		island.Solve( deltaTime);
+	assert( island->m_contactCount == source->contactCount );
+
+	// Reset the marks, static bodies take part in other islands as well
+	for ( int i = 0; i < island->m_bodyCount; ++i )
+		island->m_bodies[ i ]->m_flags &= ~PhysicsBody::eIsland;
+
+	for ( int i = 0; i < island->m_contactCount; ++i )
+		island->m_contacts[ i ]->m_flags &= ~PhysicsContactConstraint::eGathered;
+
+	return true;
+}
 
-		// Reset all static island flags
-		// This allows static bodies to participate in other island formations
-		for ( int i = 0; i < island.m_bodyCount; i++ )
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::FinishIsland( PhysicsPersistentIsland* source, bool sleep )
+{
+	// Islands that lost contacts may have fallen apart, they can only go
+	// to sleep after they were split up again
+	if ( !source->constraintRemoveCount )
+	{
+		if ( sleep )
+			m_contactManager.m_islands.SleepIsland( source );
+
+		return;
+	}
+
+	// Only split once some part of the island has been resting long enough
+	// to fall asleep on its own
+	for ( PhysicsBody* body = source->bodyList; body; body = body->m_islandNext )
+	{
+		if ( body->m_sleepTime > Q3_SLEEP_TIME )
 		{
-			PhysicsBody *body = island.m_bodies[ i ];
+			source->split = true;
+			return;
+		}
+	}
+}
 
-			if ( body->m_flags & PhysicsBody::eStatic )
-				body->m_flags &= ~PhysicsBody::eIsland;
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SolveIslands( float deltaTime )
+{
+	PhysicsIslandManager* islands = &m_contactManager.m_islands;
+
+	// Size the stack island, pick the largest awake island
+	int bodyCapacity = 0;
+	int contactCapacity = 0;
+	for ( PhysicsPersistentIsland* source = islands->GetAwakeIslands( ); source; source = source->next )
+	{
+		bodyCapacity = glm::max( bodyCapacity, source->bodyCount + source->contactCount );
+		contactCapacity = glm::max( contactCapacity, source->contactCount );
+	}
+
+	m_stack.Reserve(
+		sizeof( PhysicsBody* ) * bodyCapacity
+		+ sizeof( PhysicsVelocityState ) * bodyCapacity
+		+ sizeof( PhysicsContactConstraint* ) * contactCapacity
+		+ sizeof( PhysicsContactConstraintState ) * contactCapacity
+		+ sizeof( PhysicsBody* ) * bodyCapacity
+		+ (UseBatchedSolver( ) ? PhysicsContactSolver::GetBatchMemorySize( bodyCapacity, contactCapacity ) : 0)
+	);
+
+	PhysicsIsland island;
+	island.m_bodyCapacity = bodyCapacity;
+	island.m_contactCapacity = contactCapacity;
+	island.m_bodies = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * bodyCapacity );
+	island.m_velocities = (PhysicsVelocityState *)m_stack.Allocate( sizeof( PhysicsVelocityState ) * bodyCapacity );
+	island.m_contacts = (PhysicsContactConstraint **)m_stack.Allocate( sizeof( PhysicsContactConstraint* ) * island.m_contactCapacity );
+	island.m_contactStates = (PhysicsContactConstraintState *)m_stack.Allocate( sizeof( PhysicsContactConstraintState ) * island.m_contactCapacity );
+	island.m_contactIndices = NULL;
+	island.m_stack = &m_stack;
+	island.m_allowSleep = m_allowSleep;
+	island.m_enableFriction = m_enableFriction;
+	island.m_enableBatching = UseBatchedSolver( );
+	island.m_bodyCount = 0;
+	island.m_contactCount = 0;
+	island.m_dt = m_dt;
+	island.m_gravity = m_gravity;
+	island.m_iterations = m_iterations;
+	island.m_substeps = m_substeps;
+	island.m_tolerance = m_tolerance;
+
+	// Solve each awake island, islands going to sleep leave the awake list
+	int stackSize = bodyCapacity;
+	PhysicsBody** stack = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * stackSize );
+	PhysicsPersistentIsland* source = islands->GetAwakeIslands( );
+	while ( source )
+	{
+		PhysicsPersistentIsland* next = source->next;
+
+		if ( !BuildIsland( source, &island, stack, stackSize ) )
+		{
+			islands->SleepIsland( source );
+			source = next;
+			continue;
 		}
+
+		island.Initialize( );
+		island.Solve( deltaTime);
+
+		AddSolverStats( island.m_iterationCount, island.m_converged );
+		FinishIsland( source, island.m_sleep );
+		source = next;
 	}
 
 	m_stack.Free( stack );
@@ -198,24 +323,161 @@ void PhysicsScene::Step( float deltaTime)
 	m_stack.Free( island.m_velocities );
 	m_stack.Free( island.m_bodies );
 
-	// Update the broadphase AABBs
-	for ( PhysicsBody* body = m_bodyList; body; body = body->m_next )
+	islands->SplitIslands( );
+}
+
+//--------------------------------------------------------------------------------------------------
+struct PhysicsIslandJobData
+{
+	PhysicsScene* scene;
+	PhysicsIslandRange* islands;
+	PhysicsBody** bodies;
+	PhysicsContactConstraint** contacts;
+	int* contactIndices;
+	float deltaTime;
+};
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SolveIslandsParallel( float deltaTime )
+{
+	PhysicsIslandManager* islands = &m_contactManager.m_islands;
+
+	// Static bodies show up once in every island touching them, each such
+	// extra entry comes from a contact. So bodies + contacts is enough.
+	int islandCapacity = islands->GetAwakeIslandCount( );
+	int bodyCapacity = 0;
+	int contactCapacity = 0;
+	int stackSize = 0;
+	for ( PhysicsPersistentIsland* source = islands->GetAwakeIslands( ); source; source = source->next )
 	{
-		if ( body->m_flags & PhysicsBody::eStatic )
+		bodyCapacity += source->bodyCount + source->contactCount;
+		contactCapacity += source->contactCount;
+		stackSize = glm::max( stackSize, source->bodyCount + source->contactCount );
+	}
+
+	m_stack.Reserve(
+		sizeof( PhysicsIslandRange ) * islandCapacity
+		+ sizeof( PhysicsBody* ) * bodyCapacity
+		+ sizeof( PhysicsContactConstraint* ) * contactCapacity
+		+ sizeof( int ) * 2 * contactCapacity
+		+ sizeof( PhysicsBody* ) * stackSize
+	);
+
+	PhysicsIslandJobData data;
+	data.scene = this;
+	data.bodies = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * bodyCapacity );
+	data.contacts = (PhysicsContactConstraint**)m_stack.Allocate( sizeof( PhysicsContactConstraint* ) * contactCapacity );
+	PhysicsBody** stack = (PhysicsBody**)m_stack.Allocate( sizeof( PhysicsBody* ) * stackSize );
+	data.islands = (PhysicsIslandRange*)m_stack.Allocate( sizeof( PhysicsIslandRange ) * islandCapacity );
+	data.contactIndices = (int*)m_stack.Allocate( sizeof( int ) * 2 * contactCapacity );
+	data.deltaTime = deltaTime;
+
+	// Collect every island into the shared buffers first. The DFS touches
+	// flags of bodies shared between islands, so it has to stay serial.
+	int islandCount = 0;
+	int bodyCount = 0;
+	int contactCount = 0;
+	PhysicsPersistentIsland* source = islands->GetAwakeIslands( );
+	while ( source )
+	{
+		PhysicsPersistentIsland* next = source->next;
+
+		PhysicsIsland island;
+		island.m_bodies = data.bodies + bodyCount;
+		island.m_bodyCapacity = bodyCapacity - bodyCount;
+		island.m_contacts = data.contacts + contactCount;
+		island.m_contactCapacity = contactCapacity - contactCount;
+
+		if ( !BuildIsland( source, &island, stack, stackSize ) )
+		{
+			islands->SleepIsland( source );
+			source = next;
 			continue;
+		}
 
-		body->SynchronizeProxies( );
+		int* indices = data.contactIndices + 2 * contactCount;
+		for ( int i = 0; i < island.m_contactCount; ++i )
+		{
+			PhysicsContactConstraint* contact = island.m_contacts[ i ];
+			indices[ 2 * i ] = contact->bodyA->m_islandIndex;
+			indices[ 2 * i + 1 ] = contact->bodyB->m_islandIndex;
+		}
+
+		PhysicsIslandRange* range = data.islands + islandCount++;
+		range->source = source;
+		range->bodyStart = bodyCount;
+		range->bodyCount = island.m_bodyCount;
+		range->contactStart = contactCount;
+		range->contactCount = island.m_contactCount;
+		range->sleep = false;
+
+		bodyCount += island.m_bodyCount;
+		contactCount += island.m_contactCount;
+		source = next;
 	}
 
-	// Look for new contacts
-	m_contactManager.FindNewContacts( );
+	m_jobPool.Run( SolveIslandJob, &data, islandCount );
 
-	// Clear all forces
-	for ( PhysicsBody* body = m_bodyList; body; body = body->m_next )
+	// Sleeping touches static bodies, which may be shared between islands
+	for ( int i = 0; i < islandCount; ++i )
 	{
-		 body->m_force  = glm::vec3{0};
-		 body->m_torque = glm::vec3{0}; 
+		PhysicsIslandRange* range = data.islands + i;
+		AddSolverStats( range->iterationCount, range->converged );
+		FinishIsland( range->source, range->sleep );
 	}
+
+	m_stack.Free( data.contactIndices );
+	m_stack.Free( data.islands );
+	m_stack.Free( stack );
+	m_stack.Free( data.contacts );
+	m_stack.Free( data.bodies );
+
+	islands->SplitIslands( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SolveIslandJob( void* param, int index, int threadIndex )
+{
+	PhysicsIslandJobData* data = (PhysicsIslandJobData*)param;
+	PhysicsScene* scene = data->scene;
+	PhysicsIslandRange* range = data->islands + index;
+	PhysicsStack* stack = scene->m_workerStacks + threadIndex;
+
+	stack->Reserve(
+		sizeof( PhysicsVelocityState ) * range->bodyCount
+		+ sizeof( PhysicsContactConstraintState ) * range->contactCount
+		+ (scene->UseBatchedSolver( ) ? PhysicsContactSolver::GetBatchMemorySize( range->bodyCount, range->contactCount ) : 0)
+	);
+
+	PhysicsIsland island;
+	island.m_bodies = data->bodies + range->bodyStart;
+	island.m_bodyCount = range->bodyCount;
+	island.m_bodyCapacity = range->bodyCount;
+	island.m_contacts = data->contacts + range->contactStart;
+	island.m_contactCount = range->contactCount;
+	island.m_contactCapacity = range->contactCount;
+	island.m_contactIndices = data->contactIndices + 2 * range->contactStart;
+	island.m_velocities = (PhysicsVelocityState *)stack->Allocate( sizeof( PhysicsVelocityState ) * range->bodyCount );
+	island.m_contactStates = (PhysicsContactConstraintState *)stack->Allocate( sizeof( PhysicsContactConstraintState ) * range->contactCount );
+	island.m_stack = stack;
+	island.m_allowSleep = scene->m_allowSleep;
+	island.m_enableFriction = scene->m_enableFriction;
+	island.m_enableBatching = scene->UseBatchedSolver( );
+	island.m_dt = scene->m_dt;
+	island.m_gravity = scene->m_gravity;
+	island.m_iterations = scene->m_iterations;
+	island.m_substeps = scene->m_substeps;
+	island.m_tolerance = scene->m_tolerance;
+
+	island.Initialize( );
+	island.Solve( data->deltaTime );
+
+	range->sleep = island.m_sleep;
+	range->iterationCount = island.m_iterationCount;
+	range->converged = island.m_converged;
+
+	stack->Free( island.m_contactStates );
+	stack->Free( island.m_velocities );
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -224,6 +486,136 @@ PhysicsBody* PhysicsScene::CreateBody( const PhysicsBodyDef& def )
 	PhysicsBody* body = (PhysicsBody*)m_heap.Allocate( sizeof( PhysicsBody ) );
 	new (body) PhysicsBody( def, this );
 
+	AddBody( body );
+
+	return body;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::CreateBodies( std::span<const PhysicsBodyDef> bodyDefs, std::span<const PhysicsBoxDef> boxDefs, std::span<const int> boxCounts, std::span<PhysicsBody*> bodies )
+{
+	int bodyCount = (int)bodyDefs.size( );
+	int boxCount = (int)boxDefs.size( );
+	assert( (int)bodies.size( ) >= bodyCount );
+	assert( boxCounts.empty( ) ? boxCount == bodyCount : (int)boxCounts.size( ) == bodyCount );
+
+	if ( !bodyCount )
+		return;
+
+	PhysicsBox** boxes = (PhysicsBox**)m_stack.Allocate( sizeof( PhysicsBox* ) * boxCount );
+	PhysicsAABB* aabbs = (PhysicsAABB*)m_stack.Allocate( sizeof( PhysicsAABB ) * boxCount );
+
+	// Bodies first, then boxes, so each kind comes out of consecutive blocks
+	// of the heap
+	for ( int i = 0; i < bodyCount; ++i )
+	{
+		bodies[ i ] = (PhysicsBody*)m_heap.Allocate( sizeof( PhysicsBody ) );
+		new (bodies[ i ]) PhysicsBody( bodyDefs[ i ], this );
+	}
+
+	for ( int i = 0; i < boxCount; ++i )
+		boxes[ i ] = (PhysicsBox*)m_heap.Allocate( sizeof( PhysicsBox ) );
+
+	int box = 0;
+	for ( int i = 0; i < bodyCount; ++i )
+	{
+		PhysicsBody* body = bodies[ i ];
+		int count = boxCounts.empty( ) ? 1 : boxCounts[ i ];
+		assert( box + count <= boxCount );
+
+		for ( int j = 0; j < count; ++j )
+			body->LinkBox( boxes[ box + j ], boxDefs[ box + j ] );
+
+		body->CalculateMassData( );
+
+		for ( int j = 0; j < count; ++j )
+			boxes[ box + j ]->ComputeAABB( body->m_tx, aabbs + box + j );
+
+		box += count;
+		AddBody( body );
+	}
+
+	assert( box == boxCount );
+
+	if ( boxCount )
+	{
+		m_contactManager.m_broadphase->InsertBoxes( boxes, aabbs, boxCount );
+		m_newBox = true;
+	}
+
+	m_stack.Free( aabbs );
+	m_stack.Free( boxes );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetCreationThreadCount( int threadCount )
+{
+	AddPendingBodies( );
+
+	for ( int i = 0; i < m_creationContextCount; ++i )
+	{
+		PhysicsCreationContext* context = m_creationContexts + i;
+		context->bodyCache.Clear( &m_heap, &m_heapMutex );
+		context->boxCache.Clear( &m_heap, &m_heapMutex );
+
+		if ( context->pendingBodies )
+			PhysicsFree( context->pendingBodies );
+
+		context->~PhysicsCreationContext( );
+	}
+
+	if ( m_creationContexts )
+		PhysicsFree( m_creationContexts );
+
+	m_creationContexts = NULL;
+	m_creationContextCount = 0;
+
+	if ( threadCount <= 0 )
+		return;
+
+	m_creationContextCount = threadCount;
+	m_creationContexts = (PhysicsCreationContext*)PhysicsAlloc( sizeof( PhysicsCreationContext ) * threadCount );
+
+	for ( int i = 0; i < threadCount; ++i )
+	{
+		PhysicsCreationContext* context = new (m_creationContexts + i) PhysicsCreationContext;
+		context->pendingBodies = NULL;
+		context->pendingCount = 0;
+		context->pendingCapacity = 0;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBody* PhysicsScene::CreateBody( const PhysicsBodyDef& def, int threadIndex )
+{
+	assert( threadIndex >= 0 && threadIndex < m_creationContextCount );
+	PhysicsCreationContext* context = m_creationContexts + threadIndex;
+
+	PhysicsBody* body = (PhysicsBody*)context->bodyCache.Allocate( &m_heap, &m_heapMutex, sizeof( PhysicsBody ) );
+	new (body) PhysicsBody( def, this );
+	body->m_flags |= PhysicsBody::ePending;
+
+	if ( context->pendingCount == context->pendingCapacity )
+	{
+		PhysicsBody** old = context->pendingBodies;
+		context->pendingCapacity = context->pendingCapacity ? 2 * context->pendingCapacity : 64;
+		context->pendingBodies = (PhysicsBody**)PhysicsAlloc( sizeof( PhysicsBody* ) * context->pendingCapacity );
+
+		if ( old )
+		{
+			memcpy( context->pendingBodies, old, sizeof( PhysicsBody* ) * context->pendingCount );
+			PhysicsFree( old );
+		}
+	}
+
+	context->pendingBodies[ context->pendingCount++ ] = body;
+
+	return body;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::AddBody( PhysicsBody* body )
+{
 	// Add body to scene bodyList
 	body->m_prev = NULL;
 	body->m_next = m_bodyList;
@@ -234,7 +626,36 @@ PhysicsBody* PhysicsScene::CreateBody( const PhysicsBodyDef& def )
 	m_bodyList = body;
 	++m_bodyCount;
 
-	return body;
+	m_contactManager.m_islands.AddBody( body );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::AddPendingBodies( )
+{
+	// Thread by thread in order of creation, so the scene does not depend
+	// on how the threads were scheduled
+	for ( int i = 0; i < m_creationContextCount; ++i )
+	{
+		PhysicsCreationContext* context = m_creationContexts + i;
+
+		for ( int j = 0; j < context->pendingCount; ++j )
+		{
+			PhysicsBody* body = context->pendingBodies[ j ];
+			body->m_flags &= ~PhysicsBody::ePending;
+
+			AddBody( body );
+
+			for ( PhysicsBox* box = body->m_boxes; box; box = box->next )
+			{
+				PhysicsAABB aabb;
+				box->ComputeAABB( body->m_tx, &aabb );
+				m_contactManager.m_broadphase->InsertBox( box, aabb );
+				m_newBox = true;
+			}
+		}
+
+		context->pendingCount = 0;
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -246,6 +667,8 @@ void PhysicsScene::RemoveBody( PhysicsBody* body )
 
 	body->RemoveAllBoxes( );
 
+	m_contactManager.m_islands.RemoveBody( body );
+
 	// Remove body from scene bodyList
 	if ( body->m_next )
 		body->m_next->m_prev = body->m_prev;
@@ -264,6 +687,8 @@ void PhysicsScene::RemoveBody( PhysicsBody* body )
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::RemoveAllBodies( )
 {
+	AddPendingBodies( );
+
 	PhysicsBody* body = m_bodyList;
 
 	while ( body )
@@ -272,6 +697,8 @@ void PhysicsScene::RemoveAllBodies( )
 
 		body->RemoveAllBoxes( );
 
+		m_contactManager.m_islands.RemoveBody( body );
+
 		m_heap.Free( body );
 
 		body = next;
@@ -298,12 +725,125 @@ void PhysicsScene::SetIterations( int iterations )
 	m_iterations = glm::max( 1, iterations );
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetSubsteps( int substeps )
+{
+	m_substeps = glm::max( 0, substeps );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetSolverTolerance( float tolerance )
+{
+	m_tolerance = glm::max( float( 0.0 ), tolerance );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::GetSolverStats( PhysicsSolverStats* stats ) const
+{
+	*stats = m_solverStats;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::AddSolverStats( int iterationCount, bool converged )
+{
+	++m_solverStats.islandCount;
+	m_solverStats.iterationCount += iterationCount;
+	m_solverStats.maxIterationCount = glm::max( m_solverStats.maxIterationCount, iterationCount );
+
+	if ( converged )
+		++m_solverStats.convergedCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetThreadCount( int threadCount )
+{
+	m_jobPool.SetThreadCount( threadCount );
+
+	for ( int i = 0; i < m_workerStackCount; ++i )
+		m_workerStacks[ i ].~PhysicsStack( );
+
+	if ( m_workerStacks )
+		PhysicsFree( m_workerStacks );
+
+	m_workerStacks = NULL;
+	m_workerStackCount = 0;
+
+	// A single thread solves islands out of m_stack
+	if ( m_jobPool.GetThreadCount( ) == 1 )
+		return;
+
+	m_workerStackCount = m_jobPool.GetThreadCount( );
+	m_workerStacks = (PhysicsStack*)PhysicsAlloc( sizeof( PhysicsStack ) * m_workerStackCount );
+
+	for ( int i = 0; i < m_workerStackCount; ++i )
+		new (m_workerStacks + i) PhysicsStack( );
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsScene::GetThreadCount( ) const
+{
+	return m_jobPool.GetThreadCount( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::Reserve( int bodyCount, int boxCount, int contactCount )
+{
+	m_contactManager.Reserve( bodyCount, boxCount, contactCount );
+
+	// Static bodies show up in an island once per contact touching them.
+	// The batched solver may be turned on later, its memory is always
+	// included. Every stack allocation is rounded up to the alignment.
+	int islandBodyCount = bodyCount + contactCount;
+	unsigned int batchSize = PhysicsContactSolver::GetBatchMemorySize( islandBodyCount, contactCount );
+	unsigned int slack = Physicsk_stackAlignment * 16;
+
+	// TestCollisions, SplitIslands, SolveIslands and SolveIslandsParallel
+	// take turns on the scene stack
+	unsigned int collideSize = sizeof( PhysicsContactConstraint* ) * contactCount
+		+ sizeof( PhysicsCollisionCacheStats ) * (contactCount / Q3_NARROWPHASE_JOB_SIZE + 1);
+	unsigned int splitSize = sizeof( PhysicsBody* ) * 2 * bodyCount;
+	unsigned int solveSize = sizeof( PhysicsBody* ) * 2 * islandBodyCount
+		+ sizeof( PhysicsVelocityState ) * islandBodyCount
+		+ sizeof( PhysicsContactConstraint* ) * contactCount
+		+ sizeof( PhysicsContactConstraintState ) * contactCount
+		+ batchSize;
+	unsigned int gatherSize = sizeof( PhysicsIslandRange ) * bodyCount
+		+ sizeof( PhysicsBody* ) * 2 * islandBodyCount
+		+ sizeof( PhysicsContactConstraint* ) * contactCount
+		+ sizeof( int ) * 2 * contactCount;
+
+	unsigned int stackSize = glm::max( glm::max( collideSize, splitSize ), glm::max( solveSize, gatherSize ) );
+	m_stack.Reserve( stackSize + slack );
+
+	// Any worker may get the largest island, see SolveIslandJob
+	unsigned int jobSize = sizeof( PhysicsVelocityState ) * islandBodyCount
+		+ sizeof( PhysicsContactConstraintState ) * contactCount
+		+ batchSize;
+
+	for ( int i = 0; i < m_workerStackCount; ++i )
+		m_workerStacks[ i ].Reserve( jobSize + slack );
+}
+
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::SetEnableFriction( bool enabled )
 {
 	m_enableFriction = enabled;
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetEnableBatchedSolver( bool enabled )
+{
+	m_enableBatching = enabled;
+}
+
+//--------------------------------------------------------------------------------------------------
+// The substepped solver has no batched version, islands neither need nor
+// get batch scratch memory then
+bool PhysicsScene::UseBatchedSolver( ) const
+{
+	return m_enableBatching && m_substeps == 0;
+}
+
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::Render( PhysicsRender* render ) const
 {
@@ -316,7 +856,7 @@ void PhysicsScene::Render( PhysicsRender* render ) const
 	}
 
 	m_contactManager.RenderContacts( render );
-	//m_contactManager.m_broadphase.m_tree.Render( render );
+	//m_contactManager.m_broadphase->m_dynamicTree.Render( render );
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -345,15 +885,58 @@ void PhysicsScene::SetContactListener( PhysicsContactListener* listener )
 	m_contactManager.m_contactListener = listener;
 }
 
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::GetContactTableStats( PhysicsPairTableStats* stats ) const
+{
+	m_contactManager.GetPairTableStats( stats );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::GetCollisionCacheStats( PhysicsCollisionCacheStats* stats ) const
+{
+	m_contactManager.GetCollisionCacheStats( stats );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::GetStackStats( PhysicsStackStats* stats ) const
+{
+	m_stack.GetStats( stats );
+
+	for ( int i = 0; i < m_workerStackCount; ++i )
+	{
+		PhysicsStackStats worker;
+		m_workerStacks[ i ].GetStats( &worker );
+
+		stats->capacity += worker.capacity;
+		stats->chunkCount += worker.chunkCount;
+		stats->peakSize += worker.peakSize;
+		stats->stepPeakSize += worker.stepPeakSize;
+		stats->stepSize += worker.stepSize;
+		stats->stepGrowCount += worker.stepGrowCount;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+int PhysicsScene::GetHeapStats( PhysicsSlabStats* stats, int capacity ) const
+{
+	return m_heap.GetStats( stats, capacity );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::SetReleaseHeapPages( bool release )
+{
+	m_heap.SetReleasePages( release );
+}
+
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::QueryAABB( PhysicsQueryCallback *cb, const PhysicsAABB& aabb ) const
 {
-	struct SceneQueryWrapper
+	struct SceneQueryWrapper : public PhysicsBroadPhaseCallback
 	{
 		bool TreeCallBack( int id )
 		{
 			PhysicsAABB aabb;
-			PhysicsBox *box = (PhysicsBox *)broadPhase->m_tree.GetUserData( id );
+			PhysicsBox *box = (PhysicsBox *)broadPhase->GetUserData( id );
 
 			box->ComputeAABB( box->body->GetTransform( ), &aabb );
 
@@ -372,19 +955,19 @@ void PhysicsScene::QueryAABB( PhysicsQueryCallback *cb, const PhysicsAABB& aabb
 
 	SceneQueryWrapper wrapper;
 	wrapper.m_aabb = aabb;
-	wrapper.broadPhase = &m_contactManager.m_broadphase;
+	wrapper.broadPhase = m_contactManager.m_broadphase;
 	wrapper.cb = cb;
-	m_contactManager.m_broadphase.m_tree.Query( &wrapper, aabb );
+	m_contactManager.m_broadphase->Query( &wrapper, aabb );
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::QueryPoint( PhysicsQueryCallback *cb, const glm::vec3& point ) const
 {
-	struct SceneQueryWrapper
+	struct SceneQueryWrapper : public PhysicsBroadPhaseCallback
 	{
 		bool TreeCallBack( int id )
 		{
-			PhysicsBox *box = (PhysicsBox *)broadPhase->m_tree.GetUserData( id );
+			PhysicsBox *box = (PhysicsBox *)broadPhase->GetUserData( id );
 
 			if ( box->TestPoint( box->body->GetTransform( ), m_point ) )
 			{
@@ -401,24 +984,24 @@ void PhysicsScene::QueryPoint( PhysicsQueryCallback *cb, const glm::vec3& point
 
 	SceneQueryWrapper wrapper;
 	wrapper.m_point = point;
-	wrapper.broadPhase = &m_contactManager.m_broadphase;
+	wrapper.broadPhase = m_contactManager.m_broadphase;
 	wrapper.cb = cb;
 	const float k_fattener = float( 0.5 );
 	glm::vec3 v( k_fattener, k_fattener, k_fattener );
 	PhysicsAABB aabb;
 	aabb.min = point - v;
 	aabb.max = point + v;
-	m_contactManager.m_broadphase.m_tree.Query( &wrapper, aabb );
+	m_contactManager.m_broadphase->Query( &wrapper, aabb );
 }
 
 //--------------------------------------------------------------------------------------------------
 void PhysicsScene::RayCast( PhysicsQueryCallback *cb, PhysicsRaycastData& rayCast ) const
 {
-	struct SceneQueryWrapper
+	struct SceneQueryWrapper : public PhysicsBroadPhaseCallback
 	{
 		bool TreeCallBack( int id )
 		{
-			PhysicsBox *box = (PhysicsBox *)broadPhase->m_tree.GetUserData( id );
+			PhysicsBox *box = (PhysicsBox *)broadPhase->GetUserData( id );
 
 			if ( box->Raycast( box->body->GetTransform( ), m_rayCast ) )
 			{
@@ -435,9 +1018,167 @@ void PhysicsScene::RayCast( PhysicsQueryCallback *cb, PhysicsRaycastData& rayCas
 	
 	SceneQueryWrapper wrapper;
 	wrapper.m_rayCast = &rayCast;
-	wrapper.broadPhase = &m_contactManager.m_broadphase;
+	wrapper.broadPhase = m_contactManager.m_broadphase;
 	wrapper.cb = cb;
-	m_contactManager.m_broadphase.m_tree.Query( &wrapper, rayCast );
+	m_contactManager.m_broadphase->Query( &wrapper, rayCast );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBox* PhysicsScene::RayCastClosest( PhysicsRaycastData& rayCast ) const
+{
+	return RayCastHit( rayCast, false );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBox* PhysicsScene::RayCastAny( PhysicsRaycastData& rayCast ) const
+{
+	return RayCastHit( rayCast, true );
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsBox* PhysicsScene::RayCastHit( PhysicsRaycastData& rayCast, bool anyHit ) const
+{
+	struct SceneQueryWrapper : public PhysicsBroadPhaseCallback
+	{
+		float RayCastCallBack( int id, float t )
+		{
+			PhysicsBox *box = (PhysicsBox *)broadPhase->GetUserData( id );
+			PhysicsRaycastData clipped = *m_rayCast;
+			clipped.t = t;
+
+			if ( !box->Raycast( box->body->GetTransform( ), &clipped ) )
+				return t;
+
+			hit = box;
+			m_rayCast->toi = clipped.toi;
+			m_rayCast->normal = clipped.normal;
+
+			// Zero ends the traversal
+			return anyHit ? float( 0.0 ) : clipped.toi;
+		}
+
+		const PhysicsBroadPhase *broadPhase;
+		PhysicsRaycastData *m_rayCast;
+		PhysicsBox *hit;
+		bool anyHit;
+	};
+
+	SceneQueryWrapper wrapper;
+	wrapper.broadPhase = m_contactManager.m_broadphase;
+	wrapper.m_rayCast = &rayCast;
+	wrapper.hit = NULL;
+	wrapper.anyHit = anyHit;
+	m_contactManager.m_broadphase->RayCast( &wrapper, rayCast );
+
+	return wrapper.hit;
+}
+
+//--------------------------------------------------------------------------------------------------
+struct PhysicsRayBatchData
+{
+	const PhysicsBroadPhase *broadPhase;
+	const PhysicsRaycastData *rays;
+	PhysicsRayHit *hits;
+	int count;
+};
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::RayCastBatch( std::span<const PhysicsRaycastData> rays, std::span<PhysicsRayHit> hits )
+{
+	assert( hits.size( ) >= rays.size( ) );
+
+	PhysicsRayBatchData data;
+	data.broadPhase = m_contactManager.m_broadphase;
+	data.rays = rays.data( );
+	data.hits = hits.data( );
+	data.count = (int)rays.size( );
+
+	int jobCount = (data.count + Q3_RAYCAST_JOB_SIZE - 1) / Q3_RAYCAST_JOB_SIZE;
+	m_jobPool.Run( RayCastJob, &data, jobCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsScene::RayCastJob( void* param, int index, int threadIndex )
+{
+	struct SceneQueryWrapper : public PhysicsBroadPhaseCallback
+	{
+		bool TreeCallBack( int id, int lanes )
+		{
+			PhysicsBox *box = (PhysicsBox *)broadPhase->GetUserData( id );
+			glm::vec3 normals[ 4 ];
+
+			int hits = box->Raycast( box->body->GetTransform( ), packet, lanes, normals );
+
+			for ( int i = 0; i < 4; ++i )
+			{
+				if ( hits & (1 << i) )
+				{
+					closest[ i ] = box;
+					normal[ i ] = normals[ i ];
+				}
+			}
+
+			return true;
+		}
+
+		const PhysicsBroadPhase *broadPhase;
+		PhysicsRayPacket *packet;
+		PhysicsBox *closest[ 4 ];
+		glm::vec3 normal[ 4 ];
+	};
+
+	PhysicsRayBatchData* data = (PhysicsRayBatchData*)param;
+	int begin = index * Q3_RAYCAST_JOB_SIZE;
+	int end = glm::min( begin + Q3_RAYCAST_JOB_SIZE, data->count );
+
+	for ( int first = begin; first < end; first += 4 )
+	{
+		PhysicsRayPacket packet;
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			if ( first + i >= end )
+			{
+				// Unused lane, a negative t never overlaps anything
+				packet.startX[ i ] = packet.startY[ i ] = packet.startZ[ i ] = float( 0.0 );
+				packet.dirX[ i ] = packet.dirY[ i ] = packet.dirZ[ i ] = float( 0.0 );
+				packet.invDirX[ i ] = packet.invDirY[ i ] = packet.invDirZ[ i ] = float( 0.0 );
+				packet.t[ i ] = float( -1.0 );
+				continue;
+			}
+
+			const PhysicsRaycastData *ray = data->rays + first + i;
+			glm::vec3 inv = PhysicsRayInvDir( ray->dir );
+
+			packet.startX[ i ] = ray->start.x;
+			packet.startY[ i ] = ray->start.y;
+			packet.startZ[ i ] = ray->start.z;
+			packet.dirX[ i ] = ray->dir.x;
+			packet.dirY[ i ] = ray->dir.y;
+			packet.dirZ[ i ] = ray->dir.z;
+			packet.invDirX[ i ] = inv.x;
+			packet.invDirY[ i ] = inv.y;
+			packet.invDirZ[ i ] = inv.z;
+			packet.t[ i ] = ray->t;
+		}
+
+		SceneQueryWrapper wrapper;
+		wrapper.broadPhase = data->broadPhase;
+		wrapper.packet = &packet;
+
+		for ( int i = 0; i < 4; ++i )
+			wrapper.closest[ i ] = NULL;
+
+		data->broadPhase->Query( &wrapper, packet );
+
+		for ( int i = 0; i < 4 && first + i < end; ++i )
+		{
+			PhysicsRayHit *hit = data->hits + first + i;
+			hit->box = wrapper.closest[ i ];
+			hit->toi = packet.t[ i ];
+			hit->normal = hit->box ? wrapper.normal[ i ] : glm::vec3( float( 0.0 ) );
+		}
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -28,11 +28,14 @@
 #pragma once
 
 #include <stdio.h>
+#include <span>
 
 #include "PhysicsSettings.h"
 #include "PhysicsMemory.h"
 #include "PhysicsContactManager.h"
 #include "PhysicsContact.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsIsland.h"
 
 class PhysicsBody;
 struct PhysicsBodyDef;
@@ -64,7 +67,12 @@ public:
 class PhysicsScene
 {
 public:
-	PhysicsScene(float dt, const glm::vec3 &gravity = glm::vec3(float(0.0), float(-9.8), float(0.0)), int iterations = 20);
+	// broadPhase picks the structure used to find overlapping boxes. The
+	// default tree suits most scenes, the grid can be a little faster when
+	// most boxes are about the same size. Sweep and prune is at best on par
+	// with the tree, for scenes that mostly settle and rarely query, see
+	// PhysicsBroadPhaseType.
+	PhysicsScene(float dt, const glm::vec3 &gravity = glm::vec3(float(0.0), float(-9.8), float(0.0)), int iterations = 20, PhysicsBroadPhaseType broadPhase = eTreeBroadPhase);
 	~PhysicsScene();
 
 	// Run the simulation forward in time by dt (fixed timestep). Variable
@@ -75,6 +83,28 @@ public:
 	// discretion, as no reference to the BodyDef is kept.
 	PhysicsBody *CreateBody(const PhysicsBodyDef &def);
 
+	// Creates bodies[i] from bodyDefs[i] for every def. Body i gets the
+	// next boxCounts[i] defs of boxDefs, or a single box each when
+	// boxCounts is empty. Faster than CreateBody and AddBox for many
+	// bodies: mass data is computed once per body, and all boxes enter the
+	// broadphase in one pass, which may rebuild the tree instead of
+	// inserting the boxes one at a time.
+	void CreateBodies(std::span<const PhysicsBodyDef> bodyDefs, std::span<const PhysicsBoxDef> boxDefs, std::span<const int> boxCounts, std::span<PhysicsBody *> bodies);
+
+	// Allows threadCount threads to create bodies at once through the
+	// CreateBody overload taking a thread index. Each thread gets its own
+	// caches of body and box memory and its own list of created bodies.
+	// The default of 0 allows no concurrent creation.
+	void SetCreationThreadCount(int threadCount);
+
+	// Creates a body like CreateBody(def), but may run on several threads
+	// at once, each passing its own index below the creation thread count.
+	// No other function of the scene may run meanwhile. The body joins the
+	// scene and its boxes enter the broadphase at the beginning of the next
+	// Step(). Until then only the creating thread may use the body, and
+	// only to add boxes through PhysicsBody::AddBox(def, threadIndex).
+	PhysicsBody *CreateBody(const PhysicsBodyDef &def, int threadIndex);
+
 	// Frees a body, removes all shapes associated with the body and frees
 	// all shapes and contacts associated and attached to this body.
 	void RemoveBody(PhysicsBody *body);
@@ -93,10 +123,47 @@ public:
 	// inputs set the iteration count to 1.
 	void SetIterations(int iterations);
 
+	// Switches to the substepped solver when substeps is positive. Every
+	// step is split into this many substeps of integrate, one soft solve
+	// iteration and one relax iteration, with the contact separation
+	// updated from the moved bodies in between. Overlap is pushed out by
+	// soft constraints, see Q3_CONTACT_HERTZ, instead of Q3_BAUMGARTE. The
+	// iteration count is not used then, and SetEnableBatchedSolver has no
+	// effect until substeps are set back to 0. 4 substeps suit most scenes,
+	// tall stacks need about 8. Every resting contact keeps an overlap of
+	// about Q3_CONTACT_SLOP, so a box sinks by that once for every box
+	// under it. The default of 0 uses the iterative solver.
+	void SetSubsteps(int substeps);
+
+	// Stops solving an island once an iteration changes no contact impulse
+	// by more than tolerance. Small islands then also get fewer iterations,
+	// see Q3_ITERATIONS_PER_BODY, but never more than the iteration count.
+	// The default of 0 only stops islands that are already solved exactly,
+	// like islands without contacts.
+	void SetSolverTolerance(float tolerance);
+
+	// Fills in how many contact solver iterations the islands of the last
+	// step used
+	void GetSolverStats(PhysicsSolverStats *stats) const;
+
+	// Number of threads used to solve islands, including the thread calling
+	// Step(). With more than one thread all islands are built first and then
+	// solved concurrently, each thread using its own scratch stack. The
+	// default of 1 solves every island on the calling thread.
+	void SetThreadCount(int threadCount);
+	int GetThreadCount() const;
+
 	// Friction occurs when two rigid bodies have shapes that slide along one
 	// another. The friction force resists this sliding motion.
 	void SetEnableFriction(bool enabled);
 
+	// Solves islands with at least Q3_BATCH_MIN_CONTACTS contacts with the
+	// graph colored solver, four constraints at a time in SIMD lanes. Helps
+	// single large islands like stacks and piles. Ignored while substeps
+	// are set, the substepped solver has no batched version. The default is
+	// disabled.
+	void SetEnableBatchedSolver(bool enabled);
+
 	// Render the scene with an interpolated time between the last frame and
 	// the current simulation step.
 	void Render(PhysicsRender *render) const;
@@ -117,6 +184,38 @@ public:
 	// listener.
 	void SetContactListener(PhysicsContactListener *listener);
 
+	// Fills in occupancy and probe length statistics of the hash table
+	// used to look up existing contacts. Walks the whole table.
+	void GetContactTableStats(PhysicsPairTableStats *stats) const;
+
+	// Fills in how many box pairs the last step tested and how many of
+	// them were settled by the collision cache of their manifold. The hit
+	// rate is separatedHits / pairCount.
+	void GetCollisionCacheStats(PhysicsCollisionCacheStats *stats) const;
+
+	// Fills in the memory use of the stacks the last step allocated its
+	// temporary buffers from, summed over the stacks of all threads. Once
+	// the scene stops growing stepGrowCount stays zero, steps then run
+	// without allocating from the system.
+	void GetStackStats(PhysicsStackStats *stats) const;
+
+	// Sizes the memory Step() works in for up to bodyCount bodies with
+	// boxCount boxes in total, whose fat AABBs overlap in up to
+	// contactCount pairs. Steps within these counts then allocate nothing
+	// from PhysicsAlloc, the grid broadphase plans for 8 cells per box
+	// with up to 64 boxes each. Call between steps and after
+	// SetThreadCount, which drops the buffers of the worker threads.
+	void Reserve(int bodyCount, int boxCount, int contactCount);
+
+	// Fills in the size classes of the allocator holding bodies and boxes,
+	// at most capacity of them. Returns the number filled in.
+	int GetHeapStats(PhysicsSlabStats *stats, int capacity) const;
+
+	// Lets the body and box allocator give pages back to the system once
+	// they empty out, instead of keeping them for later bodies. Disabled
+	// by default.
+	void SetReleaseHeapPages(bool release);
+
 	// Query the world to find any shapes that can potentially intersect
 	// the provided AABB. This works by querying the broadphase with an
 	// AAABB -- only *potential* intersections are reported. Perhaps the
@@ -129,6 +228,24 @@ public:
 	// Query the world to find any shapes intersecting a ray.
 	void RayCast(PhysicsQueryCallback *cb, PhysicsRaycastData &rayCast) const;
 
+	// Finds the closest box hit by the ray and fills in toi and normal of
+	// rayCast. Returns NULL when nothing was hit. Unlike RayCast this clips
+	// the ray at every hit, so boxes behind the closest one are mostly
+	// never visited.
+	PhysicsBox *RayCastClosest(PhysicsRaycastData &rayCast) const;
+
+	// Returns the first box found to be hit by the ray, not necessarily the
+	// closest one, and fills in toi and normal for it. Meant for line of
+	// sight checks. Returns NULL when nothing was hit.
+	PhysicsBox *RayCastAny(PhysicsRaycastData &rayCast) const;
+
+	// Casts every ray and stores its closest hit in hits at the same index.
+	// Rays are traversed and tested four at a time, so neighbouring rays
+	// should start close together and point in similar directions. The
+	// rays are split into jobs on the scene's threads, do not call this
+	// from a contact listener or from another thread during Step().
+	void RayCastBatch(std::span<const PhysicsRaycastData> rays, std::span<PhysicsRayHit> hits);
+
 	// Dump all rigid bodies and shapes into a log file. The log can be
 	// used as C++ code to re-create an initial scene setup. Contacts
 	// are *not* logged, meaning any cached resolution solutions will
@@ -140,6 +257,18 @@ public:
 	PhysicsBody *BodyList() { return m_bodyList; }
 
 private:
+	bool BuildIsland(PhysicsPersistentIsland *source, PhysicsIsland *island, PhysicsBody **stack, int stackSize);
+	void FinishIsland(PhysicsPersistentIsland *source, bool sleep);
+	void AddSolverStats(int iterationCount, bool converged);
+	void SolveIslands(float deltaTime);
+	void SolveIslandsParallel(float deltaTime);
+	bool UseBatchedSolver() const;
+	static void SolveIslandJob(void *param, int index, int threadIndex);
+	void AddBody(PhysicsBody *body);
+	void AddPendingBodies();
+	PhysicsBox *RayCastHit(PhysicsRaycastData &rayCast, bool anyHit) const;
+	static void RayCastJob(void *param, int index, int threadIndex);
+
 	PhysicsContactManager m_contactManager;
 	PhysicsPagedAllocator m_boxAllocator;
 
@@ -147,15 +276,39 @@ private:
 	PhysicsBody *m_bodyList;
 
 	PhysicsStack m_stack;
-	PhysicsHeap m_heap;
+	PhysicsSlabAllocator m_heap;
 
 	glm::vec3 m_gravity;
 	float m_dt;
 	int m_iterations;
+	int m_substeps;
+	float m_tolerance;
+	PhysicsSolverStats m_solverStats;
 
 	bool m_newBox;
 	bool m_allowSleep;
 	bool m_enableFriction;
+	bool m_enableBatching;
+
+	PhysicsJobPool m_jobPool;
+	PhysicsStack *m_workerStacks;
+	int m_workerStackCount;
+
+	// State of one thread creating bodies concurrently
+	struct PhysicsCreationContext
+	{
+		PhysicsBlockCache bodyCache;
+		PhysicsBlockCache boxCache;
+
+		// Bodies waiting to join the scene at the next step
+		PhysicsBody **pendingBodies;
+		int pendingCount;
+		int pendingCapacity;
+	};
+
+	PhysicsCreationContext *m_creationContexts;
+	int m_creationContextCount;
+	std::mutex m_heapMutex;
 
 	friend class PhysicsBody;
 };
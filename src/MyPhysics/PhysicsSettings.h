@@ -30,4 +30,74 @@
 
 #define Q3_PENETRATION_SLOP float( 0.05 )
 
-#define Q3_BAUMGARTE float( 0.2 )
\ No newline at end of file
+#define Q3_BAUMGARTE float( 0.2 )
+
+// Soft contacts of the substepped solver, see PhysicsScene::SetSubsteps.
+// Overlapping boxes are pushed apart like by a damped spring of this
+// frequency and damping ratio, but never faster than the push velocity.
+// The frequency is capped at a quarter of the substep rate.
+#define Q3_CONTACT_HERTZ float( 30.0 )
+#define Q3_CONTACT_DAMPING_RATIO float( 10.0 )
+#define Q3_CONTACT_PUSH_VELOCITY float( 3.0 )
+
+// Overlap the soft contacts leave alone, in place of Q3_PENETRATION_SLOP.
+// Resting contacts settle at about this depth and a stack sinks by it once
+// per level, so it is kept far below Q3_PENETRATION_SLOP.
+#define Q3_CONTACT_SLOP float( 0.005 )
+
+// With a solver tolerance set, islands get this many contact solver
+// iterations per body, but at least Q3_MIN_ITERATIONS and at most the
+// scene's iteration count
+#define Q3_ITERATIONS_PER_BODY 4
+#define Q3_MIN_ITERATIONS 4
+
+// Face contacts clip up to 8 points, manifolds keep the deepest point and
+// the ones spanning the largest area
+#define Q3_MAX_MANIFOLD_CONTACTS 4
+
+// Islands with at least this many contact constraints use the graph colored,
+// SIMD batched contact solver when it is enabled on the scene
+#define Q3_BATCH_MIN_CONTACTS 64
+
+// Number of colors used to batch constraints. Constraints that do not fit
+// into any color are solved one by one after all batches.
+#define Q3_BATCH_COLORS 32
+
+// Number of contact constraints one narrowphase job updates
+#define Q3_NARROWPHASE_JOB_SIZE 32
+
+// Number of move buffer entries one broadphase query job handles
+#define Q3_BROADPHASE_JOB_SIZE 64
+
+// Minimum number of pairs per block of the parallel pair sort
+#define Q3_BROADPHASE_SORT_BLOCK 4096
+
+// Smallest subtree the SAH tree build hands to a job
+#define Q3_TREE_BUILD_TASK_SIZE 1024
+
+// The dynamic broadphase tree is rebuilt once the total area of its branch
+// nodes has grown by this factor since the last build
+#define Q3_TREE_REBUILD_RATIO float( 1.5 )
+
+// Number of rays one PhysicsScene::RayCastBatch job casts, a multiple of 4
+#define Q3_RAYCAST_JOB_SIZE 64
+
+// Cell size of the grid broadphase relative to the average fat AABB size
+// of the dynamic boxes
+#define Q3_GRID_CELL_SCALE float( 1.0 )
+
+// Boxes covering more grid cells than this are kept out of the grid and
+// tested against every moved box instead
+#define Q3_GRID_MAX_PROXY_CELLS 64
+
+// Number of grid cells one broadphase pair job handles
+#define Q3_GRID_JOB_SIZE 32
+
+// Boxes whose fat AABB is wider than this on x are tested one by one by
+// every scene query of the sweep and prune broadphase, the others are
+// found by binary searching its x axis
+#define Q3_SAP_LARGE_EXTENT float( 8.0 )
+
+// Blocks a thread creating bodies concurrently takes from the scene heap
+// at once, see PhysicsScene::SetCreationThreadCount
+#define Q3_BLOCK_CACHE_SIZE 32
@@ -0,0 +1,214 @@
+#pragma once
+
+// Four wide float math used by the batched solver and queries. Maps to SSE
+// where available and falls back to plain loops everywhere else.
+#if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+	#define Q3_SIMD_SSE
+	#include <xmmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <math.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsFloat4
+//--------------------------------------------------------------------------------------------------
+struct PhysicsFloat4
+{
+#ifdef Q3_SIMD_SSE
+	__m128 v;
+#else
+	float v[ 4 ];
+#endif
+};
+
+#ifdef Q3_SIMD_SSE
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsFloat4 PhysicsMake4( __m128 v )
+{
+	PhysicsFloat4 r;
+	r.v = v;
+	return r;
+}
+
+// Loads four floats, p does not need to be aligned
+inline PhysicsFloat4 PhysicsLoad4( const float* p ) { return PhysicsMake4( _mm_loadu_ps( p ) ); }
+inline void PhysicsStore4( float* p, PhysicsFloat4 a ) { _mm_storeu_ps( p, a.v ); }
+inline PhysicsFloat4 PhysicsSplat4( float s ) { return PhysicsMake4( _mm_set1_ps( s ) ); }
+inline PhysicsFloat4 PhysicsSet4( float a, float b, float c, float d ) { return PhysicsMake4( _mm_setr_ps( a, b, c, d ) ); }
+
+inline PhysicsFloat4 operator+( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_add_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 operator-( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_sub_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 operator*( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_mul_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 operator/( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_div_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 operator-( PhysicsFloat4 a ) { return PhysicsMake4( _mm_sub_ps( _mm_setzero_ps( ), a.v ) ); }
+
+inline PhysicsFloat4 PhysicsMin4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_min_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 PhysicsMax4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_max_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 PhysicsAbs4( PhysicsFloat4 a ) { return PhysicsMake4( _mm_andnot_ps( _mm_set1_ps( -0.0f ), a.v ) ); }
+inline PhysicsFloat4 PhysicsSqrt4( PhysicsFloat4 a ) { return PhysicsMake4( _mm_sqrt_ps( a.v ) ); }
+
+// Comparisons return all bits set in lanes where the comparison holds
+inline PhysicsFloat4 PhysicsLess4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_cmplt_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 PhysicsLessEqual4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_cmple_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 PhysicsAnd4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_and_ps( a.v, b.v ) ); }
+inline PhysicsFloat4 PhysicsOr4( PhysicsFloat4 a, PhysicsFloat4 b ) { return PhysicsMake4( _mm_or_ps( a.v, b.v ) ); }
+
+// Picks a where mask is set and b everywhere else
+inline PhysicsFloat4 PhysicsSelect4( PhysicsFloat4 mask, PhysicsFloat4 a, PhysicsFloat4 b )
+{
+	return PhysicsMake4( _mm_or_ps( _mm_and_ps( mask.v, a.v ), _mm_andnot_ps( mask.v, b.v ) ) );
+}
+
+// One bit per lane, lane 0 in the lowest bit
+inline int PhysicsMask4( PhysicsFloat4 mask ) { return _mm_movemask_ps( mask.v ); }
+
+#else
+
+//--------------------------------------------------------------------------------------------------
+#define Q3_SIMD_LANES( expr ) \
+	PhysicsFloat4 r; \
+	for ( int i = 0; i < 4; ++i ) r.v[ i ] = (expr); \
+	return r
+
+#define Q3_SIMD_MASK( cond ) \
+	PhysicsFloat4 r; \
+	for ( int i = 0; i < 4; ++i ) { unsigned bits = (cond) ? ~0u : 0u; memcpy( r.v + i, &bits, sizeof( bits ) ); } \
+	return r
+
+inline unsigned PhysicsBits( float f ) { unsigned bits; memcpy( &bits, &f, sizeof( bits ) ); return bits; }
+inline float PhysicsFromBits( unsigned bits ) { float f; memcpy( &f, &bits, sizeof( f ) ); return f; }
+
+inline PhysicsFloat4 PhysicsLoad4( const float* p ) { Q3_SIMD_LANES( p[ i ] ); }
+inline void PhysicsStore4( float* p, PhysicsFloat4 a ) { for ( int i = 0; i < 4; ++i ) p[ i ] = a.v[ i ]; }
+inline PhysicsFloat4 PhysicsSplat4( float s ) { Q3_SIMD_LANES( s ); }
+inline PhysicsFloat4 PhysicsSet4( float a, float b, float c, float d ) { PhysicsFloat4 r = { { a, b, c, d } }; return r; }
+
+inline PhysicsFloat4 operator+( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] + b.v[ i ] ); }
+inline PhysicsFloat4 operator-( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] - b.v[ i ] ); }
+inline PhysicsFloat4 operator*( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] * b.v[ i ] ); }
+inline PhysicsFloat4 operator/( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] / b.v[ i ] ); }
+inline PhysicsFloat4 operator-( PhysicsFloat4 a ) { Q3_SIMD_LANES( -a.v[ i ] ); }
+
+inline PhysicsFloat4 PhysicsMin4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] < b.v[ i ] ? a.v[ i ] : b.v[ i ] ); }
+inline PhysicsFloat4 PhysicsMax4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( a.v[ i ] > b.v[ i ] ? a.v[ i ] : b.v[ i ] ); }
+inline PhysicsFloat4 PhysicsAbs4( PhysicsFloat4 a ) { Q3_SIMD_LANES( a.v[ i ] < 0.0f ? -a.v[ i ] : a.v[ i ] ); }
+inline PhysicsFloat4 PhysicsSqrt4( PhysicsFloat4 a ) { Q3_SIMD_LANES( sqrtf( a.v[ i ] ) ); }
+
+inline PhysicsFloat4 PhysicsLess4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_MASK( a.v[ i ] < b.v[ i ] ); }
+inline PhysicsFloat4 PhysicsLessEqual4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_MASK( a.v[ i ] <= b.v[ i ] ); }
+inline PhysicsFloat4 PhysicsAnd4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( PhysicsFromBits( PhysicsBits( a.v[ i ] ) & PhysicsBits( b.v[ i ] ) ) ); }
+inline PhysicsFloat4 PhysicsOr4( PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( PhysicsFromBits( PhysicsBits( a.v[ i ] ) | PhysicsBits( b.v[ i ] ) ) ); }
+
+inline PhysicsFloat4 PhysicsSelect4( PhysicsFloat4 mask, PhysicsFloat4 a, PhysicsFloat4 b ) { Q3_SIMD_LANES( PhysicsBits( mask.v[ i ] ) ? a.v[ i ] : b.v[ i ] ); }
+
+inline int PhysicsMask4( PhysicsFloat4 mask )
+{
+	int bits = 0;
+	for ( int i = 0; i < 4; ++i )
+		bits |= PhysicsBits( mask.v[ i ] ) ? (1 << i) : 0;
+	return bits;
+}
+
+#undef Q3_SIMD_LANES
+#undef Q3_SIMD_MASK
+
+#endif // Q3_SIMD_SSE
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsVec3x4
+//--------------------------------------------------------------------------------------------------
+// Four vectors in SoA form
+struct PhysicsVec3x4
+{
+	PhysicsFloat4 x;
+	PhysicsFloat4 y;
+	PhysicsFloat4 z;
+};
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 PhysicsLoad3x4( const float* x, const float* y, const float* z )
+{
+	PhysicsVec3x4 r;
+	r.x = PhysicsLoad4( x );
+	r.y = PhysicsLoad4( y );
+	r.z = PhysicsLoad4( z );
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline void PhysicsStore3x4( float* x, float* y, float* z, const PhysicsVec3x4& a )
+{
+	PhysicsStore4( x, a.x );
+	PhysicsStore4( y, a.y );
+	PhysicsStore4( z, a.z );
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 PhysicsSplat3x4( const glm::vec3& v )
+{
+	PhysicsVec3x4 r;
+	r.x = PhysicsSplat4( v.x );
+	r.y = PhysicsSplat4( v.y );
+	r.z = PhysicsSplat4( v.z );
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 operator+( const PhysicsVec3x4& a, const PhysicsVec3x4& b )
+{
+	PhysicsVec3x4 r;
+	r.x = a.x + b.x;
+	r.y = a.y + b.y;
+	r.z = a.z + b.z;
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 operator-( const PhysicsVec3x4& a, const PhysicsVec3x4& b )
+{
+	PhysicsVec3x4 r;
+	r.x = a.x - b.x;
+	r.y = a.y - b.y;
+	r.z = a.z - b.z;
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 operator*( const PhysicsVec3x4& a, PhysicsFloat4 s )
+{
+	PhysicsVec3x4 r;
+	r.x = a.x * s;
+	r.y = a.y * s;
+	r.z = a.z * s;
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsFloat4 PhysicsDot4( const PhysicsVec3x4& a, const PhysicsVec3x4& b )
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsVec3x4 PhysicsCross4( const PhysicsVec3x4& a, const PhysicsVec3x4& b )
+{
+	PhysicsVec3x4 r;
+	r.x = a.y * b.z - a.z * b.y;
+	r.y = a.z * b.x - a.x * b.z;
+	r.z = a.x * b.y - a.y * b.x;
+	return r;
+}
+
+//--------------------------------------------------------------------------------------------------
+// m holds four column major 3x3 matrices, m[ column * 3 + row ]
+inline PhysicsVec3x4 PhysicsMul3x4( const PhysicsFloat4* m, const PhysicsVec3x4& v )
+{
+	PhysicsVec3x4 r;
+	r.x = m[ 0 ] * v.x + m[ 3 ] * v.y + m[ 6 ] * v.z;
+	r.y = m[ 1 ] * v.x + m[ 4 ] * v.y + m[ 7 ] * v.z;
+	r.z = m[ 2 ] * v.x + m[ 5 ] * v.y + m[ 8 ] * v.z;
+	return r;
+}
@@ -0,0 +1,445 @@
+//--------------------------------------------------------------------------------------------------
+/**
+@file	DropBoxes.h
+
+@author	Randy Gaul
+@date	11/25/2014
+
+	Copyright (c) 2014 Randy Gaul http://www.randygaul.net
+
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+		1. The origin of this software must not be misrepresented; you must not
+			 claim that you wrote the original software. If you use this software
+			 in a product, an acknowledgment in the product documentation would be
+			 appreciated but is not required.
+		2. Altered source versions must be plainly marked as such, and must not
+			 be misrepresented as being the original software.
+		3. This notice may not be removed or altered from any source distribution.
+*/
+//--------------------------------------------------------------------------------------------------
+
+
+
+#include "PhysicsTreeBroadPhase.h"
+
+#include "PhysicsBox.h"
+#include "PhysicsContactManager.h"
+#include "PhysicsJobPool.h"
+#include "PhysicsSettings.h"
+
+#include "Common.h"
+
+#include <string.h>
+//--------------------------------------------------------------------------------------------------
+// PhysicsPairQuery
+//--------------------------------------------------------------------------------------------------
+bool PhysicsPairQuery::TreeCallBack( int index )
+{
+	index = PhysicsTreeBroadPhase::MakeProxyId( index, queryStatic );
+
+	// Cannot collide with self
+	if ( index == currentIndex )
+		return true;
+
+	if ( !currentDynamic && !PhysicsBroadPhase::IsDynamic( (PhysicsBox*)broadphase->GetUserData( index ) ) )
+		return true;
+
+	Push( PhysicsMakePairKey( index, currentIndex ) );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairQuery::Push( PhysicsPairKey key )
+{
+	Reserve( pairCount + 1 );
+
+	pairs[ pairCount++ ] = key;
+	keyAnd &= key;
+	keyOr |= key;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsPairQuery::Reserve( int count )
+{
+	if ( count <= pairCapacity )
+		return;
+
+	while ( pairCapacity < count )
+		pairCapacity *= 2;
+
+	PhysicsPairKey* oldPairs = pairs;
+	pairs = (PhysicsPairKey*)PhysicsAlloc( pairCapacity * sizeof( PhysicsPairKey ) );
+	memcpy( pairs, oldPairs, pairCount * sizeof( PhysicsPairKey ) );
+	PhysicsFree( oldPairs );
+}
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsTreeBroadPhase
+//--------------------------------------------------------------------------------------------------
+PhysicsTreeBroadPhase::PhysicsTreeBroadPhase( PhysicsContactManager *manager )
+	: PhysicsBroadPhase( manager )
+{
+	m_queries = NULL;
+	m_queryCount = 0;
+
+	m_moveCount = 0;
+	m_moveCapacity = 64;
+	m_moveBuffer = (int*)PhysicsAlloc( m_moveCapacity * sizeof( int ) );
+
+	m_staticTreeDirty = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+PhysicsTreeBroadPhase::~PhysicsTreeBroadPhase( )
+{
+	SetQueryCount( 0 );
+
+	PhysicsFree( m_moveBuffer );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::InsertBox( PhysicsBox *box, const PhysicsAABB& aabb )
+{
+	bool isStatic = IsStatic( box );
+	PhysicsDynamicAABBTree& tree = isStatic ? m_staticTree : m_dynamicTree;
+
+	int id = MakeProxyId( tree.Insert( aabb, box ), isStatic );
+	box->broadPhaseIndex = id;
+	m_staticTreeDirty |= isStatic;
+
+	// New statics are buffered too, sleeping bodies next to them would
+	// never find the pair otherwise
+	BufferMove( id );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::InsertBoxes( PhysicsBox **boxes, const PhysicsAABB *aabbs, int count )
+{
+	PhysicsStack* stack = m_manager->m_stack;
+	PhysicsTreeProxy* proxies = (PhysicsTreeProxy*)stack->Allocate( sizeof( PhysicsTreeProxy ) * count );
+
+	// Statics first, then everything else, each tree takes its part at once
+	int staticCount = 0;
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( IsStatic( boxes[ i ] ) )
+		{
+			proxies[ staticCount ].aabb = aabbs[ i ];
+			proxies[ staticCount ].userData = boxes[ i ];
+			++staticCount;
+		}
+	}
+
+	int dynamicCount = staticCount;
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( !IsStatic( boxes[ i ] ) )
+		{
+			proxies[ dynamicCount ].aabb = aabbs[ i ];
+			proxies[ dynamicCount ].userData = boxes[ i ];
+			++dynamicCount;
+		}
+	}
+
+	PhysicsJobPool* jobPool = m_manager->m_jobPool;
+	m_staticTree.InsertBulk( std::span<PhysicsTreeProxy>( proxies, staticCount ), jobPool );
+	m_dynamicTree.InsertBulk( std::span<PhysicsTreeProxy>( proxies + staticCount, count - staticCount ), jobPool );
+	m_staticTreeDirty |= staticCount > 0;
+
+	for ( int i = 0; i < count; ++i )
+	{
+		int id = MakeProxyId( proxies[ i ].id, i < staticCount );
+		((PhysicsBox*)proxies[ i ].userData)->broadPhaseIndex = id;
+		BufferMove( id );
+	}
+
+	stack->Free( proxies );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::RemoveBox( const PhysicsBox *box )
+{
+	GetTree( box->broadPhaseIndex ).Remove( GetTreeId( box->broadPhaseIndex ) );
+	m_staticTreeDirty |= IsStaticProxy( box->broadPhaseIndex );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::UpdatePairs( )
+{
+	PhysicsJobPool* jobPool = m_manager->m_jobPool;
+	SetQueryCount( jobPool->GetThreadCount( ) );
+
+	// Statics are rebuilt whenever they changed and then queried through
+	// the collapsed 4-wide copy
+	if ( m_staticTreeDirty )
+	{
+		m_staticTree.Rebuild( jobPool );
+		m_staticBVH.Build( m_staticTree );
+		m_staticTreeDirty = false;
+	}
+
+	for ( int i = 0; i < m_queryCount; ++i )
+	{
+		m_queries[ i ].pairCount = 0;
+		m_queries[ i ].keyAnd = ~(PhysicsPairKey)0;
+		m_queries[ i ].keyOr = 0;
+	}
+
+	// Query the trees with all moving boxs, every thread collects pairs
+	// into its own buffer
+	int jobCount = (m_moveCount + Q3_BROADPHASE_JOB_SIZE - 1) / Q3_BROADPHASE_JOB_SIZE;
+	jobPool->Run( QueryJob, this, jobCount );
+
+	// Reset the move buffer
+	m_moveCount = 0;
+
+	// Merge the thread buffers
+	int pairCount = 0;
+	for ( int i = 0; i < m_queryCount; ++i )
+		pairCount += m_queries[ i ].pairCount;
+
+	ReservePairs( pairCount );
+
+	PhysicsPairKey keyAnd = ~(PhysicsPairKey)0;
+	PhysicsPairKey keyOr = 0;
+
+	for ( int i = 0; i < m_queryCount; ++i )
+	{
+		PhysicsPairQuery* query = m_queries + i;
+		memcpy( m_pairBuffer + m_pairCount, query->pairs, query->pairCount * sizeof( PhysicsPairKey ) );
+		m_pairCount += query->pairCount;
+
+		keyAnd &= query->keyAnd;
+		keyOr |= query->keyOr;
+	}
+
+	AddPairs( keyAnd ^ keyOr );
+
+	// Incremental inserts leave the tree worse than a top-down build, the
+	// dynamic tree is rebuilt once it degraded
+	if ( m_dynamicTree.GetInternalArea( ) > Q3_TREE_REBUILD_RATIO * m_dynamicTree.GetBuildArea( ) )
+		m_dynamicTree.Rebuild( jobPool );
+
+	m_staticTree.Validate( );
+	m_dynamicTree.Validate( );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::Update( int id, const PhysicsAABB& aabb )
+{
+	if ( GetTree( id ).Update( GetTreeId( id ), aabb ) )
+		BufferMove( id );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::Reserve( int proxyCount, int pairCount )
+{
+	PhysicsBroadPhase::Reserve( proxyCount, pairCount );
+
+	// Statics only change when boxes are added or removed, the dynamic tree
+	// also rebuilds while stepping
+	m_dynamicTree.Reserve( proxyCount );
+	ReserveMoves( proxyCount );
+
+	// Any one thread may end up with all pairs
+	SetQueryCount( m_manager->m_jobPool->GetThreadCount( ) );
+	for ( int i = 0; i < m_queryCount; ++i )
+		m_queries[ i ].Reserve( pairCount );
+}
+
+//--------------------------------------------------------------------------------------------------
+bool PhysicsTreeBroadPhase::TestOverlap( int A, int B ) const
+{
+	const PhysicsAABB& aabbA = GetTree( A ).GetFatAABB( GetTreeId( A ) );
+	const PhysicsAABB& aabbB = GetTree( B ).GetFatAABB( GetTreeId( B ) );
+
+	return PhysicsAABBtoAABB( aabbA, aabbB );
+}
+
+//--------------------------------------------------------------------------------------------------
+void *PhysicsTreeBroadPhase::GetUserData( int id ) const
+{
+	return GetTree( id ).GetUserData( GetTreeId( id ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Turns tree ids into proxy ids for the scene query callbacks
+struct PhysicsProxyQueryWrapper
+{
+	bool TreeCallBack( int id )
+	{
+		return cb->TreeCallBack( PhysicsTreeBroadPhase::MakeProxyId( id, isStatic ) );
+	}
+
+	bool TreeCallBack( int id, int lanes )
+	{
+		return cb->TreeCallBack( PhysicsTreeBroadPhase::MakeProxyId( id, isStatic ), lanes );
+	}
+
+	float RayCastCallBack( int id, float t )
+	{
+		return cb->RayCastCallBack( PhysicsTreeBroadPhase::MakeProxyId( id, isStatic ), t );
+	}
+
+	PhysicsBroadPhaseCallback *cb;
+	bool isStatic;
+};
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const
+{
+	PhysicsProxyQueryWrapper wrapper;
+	wrapper.cb = cb;
+
+	wrapper.isStatic = false;
+	m_dynamicTree.Query( &wrapper, aabb );
+
+	wrapper.isStatic = true;
+	if ( m_staticTreeDirty )
+		m_staticTree.Query( &wrapper, aabb );
+	else
+		m_staticBVH.Query( &wrapper, aabb );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const
+{
+	PhysicsProxyQueryWrapper wrapper;
+	wrapper.cb = cb;
+
+	wrapper.isStatic = false;
+	m_dynamicTree.Query( &wrapper, rayCast );
+
+	wrapper.isStatic = true;
+	if ( m_staticTreeDirty )
+		m_staticTree.Query( &wrapper, rayCast );
+	else
+		m_staticBVH.Query( &wrapper, rayCast );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const
+{
+	PhysicsProxyQueryWrapper wrapper;
+	wrapper.cb = cb;
+
+	wrapper.isStatic = false;
+	m_dynamicTree.Query( &wrapper, packet );
+
+	wrapper.isStatic = true;
+	if ( m_staticTreeDirty )
+		m_staticTree.Query( &wrapper, packet );
+	else
+		m_staticBVH.Query( &wrapper, packet );
+}
+
+//--------------------------------------------------------------------------------------------------
+float PhysicsTreeBroadPhase::RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const
+{
+	PhysicsProxyQueryWrapper wrapper;
+	wrapper.cb = cb;
+
+	// The static tree only searches up to the closest dynamic hit
+	PhysicsRaycastData clipped = rayCast;
+
+	wrapper.isStatic = false;
+	clipped.t = m_dynamicTree.RayCast( &wrapper, clipped );
+
+	if ( clipped.t <= float( 0.0 ) )
+		return clipped.t;
+
+	wrapper.isStatic = true;
+	if ( m_staticTreeDirty )
+		return m_staticTree.RayCast( &wrapper, clipped );
+	else
+		return m_staticBVH.RayCast( &wrapper, clipped );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::BufferMove( int id )
+{
+	ReserveMoves( m_moveCount + 1 );
+	m_moveBuffer[ m_moveCount++ ] = id;
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::ReserveMoves( int count )
+{
+	if ( count <= m_moveCapacity )
+		return;
+
+	while ( m_moveCapacity < count )
+		m_moveCapacity *= 2;
+
+	int* oldBuffer = m_moveBuffer;
+	m_moveBuffer = (int*)PhysicsAlloc( m_moveCapacity * sizeof( int ) );
+	memcpy( m_moveBuffer, oldBuffer, m_moveCount * sizeof( int ) );
+	PhysicsFree( oldBuffer );
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::SetQueryCount( int count )
+{
+	if ( count == m_queryCount )
+		return;
+
+	for ( int i = 0; i < m_queryCount; ++i )
+		PhysicsFree( m_queries[ i ].pairs );
+
+	if ( m_queries )
+		PhysicsFree( m_queries );
+
+	m_queries = NULL;
+	m_queryCount = count;
+
+	if ( !count )
+		return;
+
+	m_queries = (PhysicsPairQuery*)PhysicsAlloc( sizeof( PhysicsPairQuery ) * count );
+
+	for ( int i = 0; i < count; ++i )
+	{
+		PhysicsPairQuery* query = m_queries + i;
+		query->broadphase = this;
+		query->pairCount = 0;
+		query->pairCapacity = 64;
+		query->pairs = (PhysicsPairKey*)PhysicsAlloc( query->pairCapacity * sizeof( PhysicsPairKey ) );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void PhysicsTreeBroadPhase::QueryJob( void* param, int index, int threadIndex )
+{
+	PhysicsTreeBroadPhase* broadphase = (PhysicsTreeBroadPhase*)param;
+	PhysicsPairQuery* query = broadphase->m_queries + threadIndex;
+	int begin = index * Q3_BROADPHASE_JOB_SIZE;
+	int end = glm::min( begin + Q3_BROADPHASE_JOB_SIZE, broadphase->m_moveCount );
+
+	for ( int i = begin; i < end; ++i )
+	{
+		int id = broadphase->m_moveBuffer[ i ];
+		PhysicsBox *box = (PhysicsBox*)broadphase->GetUserData( id );
+		PhysicsAABB aabb = broadphase->GetTree( id ).GetFatAABB( GetTreeId( id ) );
+
+		query->currentIndex = id;
+		query->currentDynamic = IsDynamic( box );
+
+		// Only dynamic bodies collide with static and kinematic ones, so
+		// those skip the static tree and only pair up with dynamic proxies
+		query->queryStatic = false;
+		broadphase->m_dynamicTree.Query( query, aabb );
+
+		if ( query->currentDynamic )
+		{
+			query->queryStatic = true;
+			broadphase->m_staticBVH.Query( query, aabb );
+		}
+	}
+}
@@ -0,0 +1,147 @@
+//--------------------------------------------------------------------------------------------------
+/**
+@file	DropBoxes.h
+
+@author	Randy Gaul
+@date	11/25/2014
+
+	Copyright (c) 2014 Randy Gaul http://www.randygaul.net
+
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+		1. The origin of this software must not be misrepresented; you must not
+			 claim that you wrote the original software. If you use this software
+			 in a product, an acknowledgment in the product documentation would be
+			 appreciated but is not required.
+		2. Altered source versions must be plainly marked as such, and must not
+			 be misrepresented as being the original software.
+		3. This notice may not be removed or altered from any source distribution.
+*/
+//--------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include "PhysicsBroadPhase.h"
+#include "PhysicsBVH4.h"
+#include "PhysicsDynamicAABBTree.h"
+
+class PhysicsTreeBroadPhase;
+
+// Per thread state of the move buffer queries
+struct PhysicsPairQuery
+{
+	bool TreeCallBack( int index );
+	void Push( PhysicsPairKey key );
+	void Reserve( int count );
+
+	PhysicsTreeBroadPhase *broadphase;
+
+	PhysicsPairKey *pairs;
+	int pairCount;
+	int pairCapacity;
+
+	int currentIndex;
+	bool currentDynamic;
+	bool queryStatic;
+
+	// Bitwise and / or of all keys, bytes where they agree are not sorted
+	PhysicsPairKey keyAnd;
+	PhysicsPairKey keyOr;
+};
+
+//--------------------------------------------------------------------------------------------------
+// PhysicsTreeBroadPhase
+//--------------------------------------------------------------------------------------------------
+// Dynamic AABB trees, one for static boxes and one for everything else.
+// Moved proxies are buffered and query the trees for new pairs.
+class PhysicsTreeBroadPhase : public PhysicsBroadPhase
+{
+public:
+	PhysicsTreeBroadPhase( PhysicsContactManager *manager );
+	~PhysicsTreeBroadPhase( );
+
+	void InsertBox( PhysicsBox *shape, const PhysicsAABB& aabb );
+	void InsertBoxes( PhysicsBox **boxes, const PhysicsAABB *aabbs, int count );
+	void RemoveBox( const PhysicsBox *shape );
+	void UpdatePairs( void );
+	void Update( int id, const PhysicsAABB& aabb );
+	void Reserve( int proxyCount, int pairCount );
+	bool TestOverlap( int A, int B ) const;
+	void *GetUserData( int id ) const;
+
+	void Query( PhysicsBroadPhaseCallback *cb, const PhysicsAABB& aabb ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRaycastData& rayCast ) const;
+	void Query( PhysicsBroadPhaseCallback *cb, PhysicsRayPacket& packet ) const;
+	float RayCast( PhysicsBroadPhaseCallback *cb, const PhysicsRaycastData& rayCast ) const;
+
+	// Proxy ids handed out by InsertBox hold the tree index in the upper bits
+	// and whether the proxy lives in the static tree in the lowest bit
+	static int MakeProxyId( int treeId, bool isStatic );
+	static int GetTreeId( int id );
+	static bool IsStaticProxy( int id );
+	const PhysicsDynamicAABBTree& GetTree( int id ) const;
+
+private:
+	PhysicsPairQuery* m_queries;
+	int m_queryCount;
+
+	int* m_moveBuffer;
+	int m_moveCount;
+	int m_moveCapacity;
+
+	// Static boxes never move, their tree only changes when statics are
+	// added or removed. Everything else lives in the dynamic tree.
+	PhysicsDynamicAABBTree m_staticTree;
+	PhysicsDynamicAABBTree m_dynamicTree;
+	bool m_staticTreeDirty;
+
+	// 4-wide copy of m_staticTree, out of date while m_staticTreeDirty
+	PhysicsBVH4 m_staticBVH;
+
+	PhysicsDynamicAABBTree& GetTree( int id );
+
+	void BufferMove( int id );
+	void ReserveMoves( int count );
+	void SetQueryCount( int count );
+
+	static void QueryJob( void* param, int index, int threadIndex );
+
+	friend struct PhysicsPairQuery;
+};
+
+//--------------------------------------------------------------------------------------------------
+inline int PhysicsTreeBroadPhase::MakeProxyId( int treeId, bool isStatic )
+{
+	return (treeId << 1) | (isStatic ? 1 : 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+inline int PhysicsTreeBroadPhase::GetTreeId( int id )
+{
+	return id >> 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline bool PhysicsTreeBroadPhase::IsStaticProxy( int id )
+{
+	return (id & 1) != 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline const PhysicsDynamicAABBTree& PhysicsTreeBroadPhase::GetTree( int id ) const
+{
+	return IsStaticProxy( id ) ? m_staticTree : m_dynamicTree;
+}
+
+//--------------------------------------------------------------------------------------------------
+inline PhysicsDynamicAABBTree& PhysicsTreeBroadPhase::GetTree( int id )
+{
+	return IsStaticProxy( id ) ? m_staticTree : m_dynamicTree;
+}
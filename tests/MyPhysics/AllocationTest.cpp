@@ -0,0 +1,126 @@
+// Checks that stepping allocates nothing once the scene is reserved: builds
+// stacks of boxes next to a pile of tumbling boxes, reserves the scene for
+// them, warms up and then steps through a window in which the pile is
+// kicked up every so often. Every allocation goes through a counting
+// allocator, the test fails when any of them falls into the window. Runs
+// every broadphase, on one thread and on threadCount threads.
+//
+//   AllocationTest [steps = 1000] [threadCount = 4]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestScenes.h"
+
+static const int k_stackCount = 20;
+static const int k_stackHeight = 8;
+static const int k_stacksPerRow = 5;
+static const int k_pileCount = 300;
+static const int k_warmUpSteps = 60;
+static const int k_kickInterval = 100;
+
+// Upper bound of the touching box pairs per box in this scene
+static const int k_contactsPerBox = 8;
+
+//--------------------------------------------------------------------------------------------------
+// Counts every allocation and passes it on to malloc
+class CountingAllocator : public PhysicsAllocator
+{
+public:
+	std::atomic<long long> allocationCount { 0 };
+
+	void* Allocate( int bytes )
+	{
+		++allocationCount;
+		return malloc( bytes );
+	}
+
+	void Free( void* memory )
+	{
+		free( memory );
+	}
+};
+
+//--------------------------------------------------------------------------------------------------
+// Returns the number of allocations made while stepping the window
+static long long RunScene( CountingAllocator& allocator, PhysicsBroadPhaseType type, int steps, int threadCount )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ), glm::vec3( float( 0.0 ), float( -9.8 ), float( 0.0 ) ), 10, type );
+	scene.SetThreadCount( threadCount );
+
+	AddGround( scene, float( 200.0 ) );
+
+	// Stacks that come to rest and fall asleep, next to them a pile of
+	// boxes of different sizes dropped at random angles
+	AddStacks( scene, glm::vec3( float( -6.0 ), float( 1.0 ), float( -6.0 ) ), k_stackCount, k_stackHeight, k_stacksPerRow );
+
+	unsigned int seed = 1;
+	std::vector<PhysicsBody*> pile;
+	for ( int i = 0; i < k_pileCount; ++i )
+	{
+		glm::vec3 position( Random( seed, float( 20.0 ), float( 30.0 ) ), float( 2.0 ) + float( i ) * float( 0.1 ), Random( seed, float( -5.0 ), float( 5.0 ) ) );
+		glm::vec3 axis = glm::normalize( glm::vec3( Random( seed, float( -1.0 ), float( 1.0 ) ), float( 1.0 ), Random( seed, float( -1.0 ), float( 1.0 ) ) ) );
+		float angle = Random( seed, float( 0.0 ), float( 6.0 ) );
+		pile.push_back( AddBox( scene, position, glm::vec3( Random( seed, float( 0.5 ), float( 1.5 ) ) ), axis, angle ) );
+	}
+
+	int bodyCount = 1 + k_stackCount * k_stackHeight + k_pileCount;
+	scene.Reserve( bodyCount, bodyCount, k_contactsPerBox * bodyCount );
+
+	for ( int i = 0; i < k_warmUpSteps; ++i )
+		scene.Step( float( 1.0 / 60.0 ) );
+
+	long long before = allocator.allocationCount;
+
+	for ( int i = 0; i < steps; ++i )
+	{
+		// Throws part of the pile up again, which wakes it, breaks and
+		// makes contacts and moves boxes across the broadphase
+		if ( i % k_kickInterval == 0 )
+		{
+			for ( size_t j = i / k_kickInterval % 3; j < pile.size( ); j += 3 )
+				pile[ j ]->SetLinearVelocity( glm::vec3( Random( seed, float( -2.0 ), float( 2.0 ) ), Random( seed, float( 4.0 ), float( 8.0 ) ), Random( seed, float( -2.0 ), float( 2.0 ) ) ) );
+		}
+
+		scene.Step( float( 1.0 / 60.0 ) );
+	}
+
+	return allocator.allocationCount - before;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int steps = argc > 1 ? atoi( argv[ 1 ] ) : 1000;
+	int threadCount = argc > 2 ? atoi( argv[ 2 ] ) : 4;
+
+	CountingAllocator allocator;
+	PhysicsSetAllocator( &allocator );
+
+	printf( "%d boxes, %d warm-up steps, %d steps\n", k_stackCount * k_stackHeight + k_pileCount, k_warmUpSteps, steps );
+	printf( "broadphase  threads  allocations\n" );
+
+	int threadCounts[ 2 ] = { 1, threadCount };
+
+	bool ok = true;
+	for ( int i = 0; i < k_broadPhaseCount; ++i )
+	{
+		for ( int j = 0; j < 2; ++j )
+		{
+			long long count = RunScene( allocator, k_broadPhases[ i ].type, steps, threadCounts[ j ] );
+			printf( "%-10s  %7d  %11lld\n", k_broadPhases[ i ].name, threadCounts[ j ], count );
+
+			if ( count )
+			{
+				printf( "FAILED: %s on %d threads allocated while stepping\n", k_broadPhases[ i ].name, threadCounts[ j ] );
+				ok = false;
+			}
+		}
+	}
+
+	PhysicsSetAllocator( NULL );
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Collides seeded random box pairs once with the single pair PhysicsBoxtoBox
+// and once with the batched one, which runs the separating axis test four
+// pairs at a time. Fails when the two disagree on whether a pair is
+// separated, on the separating axis, or on the normal, count, points,
+// depths or features of the contacts. The batch is handed over in runs of
+// one to seven pairs so that partly filled batches are tested as well.
+//
+//   BoxtoBoxTest [pairCount = 20000] [seed = 1]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestScenes.h"
+#include "MyPhysics/PhysicsCollide.h"
+#include "MyPhysics/PhysicsContact.h"
+
+//--------------------------------------------------------------------------------------------------
+static PhysicsBox* AddPairBox( PhysicsScene& scene, unsigned int& seed, const glm::vec3& position, const glm::vec3& axis, float angle )
+{
+	PhysicsBodyDef bodyDef;
+	bodyDef.bodyType = eDynamicBody;
+	bodyDef.position = position;
+	bodyDef.axis = axis;
+	bodyDef.angle = angle;
+	PhysicsBody* body = scene.CreateBody( bodyDef );
+
+	PhysicsBoxDef boxDef;
+	PhysicsTransform tx;
+	boxDef.Set( tx, glm::vec3( Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ) ) );
+
+	return const_cast<PhysicsBox*>( body->AddBox( boxDef ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+static glm::vec3 RandomAxis( unsigned int& seed )
+{
+	return glm::normalize( glm::vec3( Random( seed, float( -1.0 ), float( 1.0 ) ), Random( seed, float( -1.0 ), float( 1.0 ) ), float( 1.0 ) ) );
+}
+
+//--------------------------------------------------------------------------------------------------
+static bool SameManifold( const PhysicsManifold& a, const PhysicsManifold& b )
+{
+	if ( a.separatingAxis != b.separatingAxis || a.contactCount != b.contactCount )
+		return false;
+
+	if ( a.contactCount && a.normal != b.normal )
+		return false;
+
+	for ( int i = 0; i < a.contactCount; ++i )
+	{
+		const PhysicsContact& ca = a.contacts[ i ];
+		const PhysicsContact& cb = b.contacts[ i ];
+
+		if ( ca.position != cb.position || ca.penetration != cb.penetration || ca.fp.key != cb.fp.key )
+			return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int pairCount = argc > 1 ? atoi( argv[ 1 ] ) : 20000;
+	unsigned int seed = argc > 2 ? (unsigned int)atoi( argv[ 2 ] ) : 1u;
+
+	// Never stepped, the scene only holds the bodies
+	PhysicsScene scene( float( 1.0 / 60.0 ) );
+
+	// B is placed close enough to A for about half of the pairs to touch.
+	// Every fourth pair shares its orientation, which makes all axes
+	// parallel and skips the edge axes.
+	std::vector<PhysicsManifold> scalar( pairCount );
+	std::vector<PhysicsManifold> batched( pairCount );
+	for ( int i = 0; i < pairCount; ++i )
+	{
+		glm::vec3 position( Random( seed, float( -100.0 ), float( 100.0 ) ), Random( seed, float( -100.0 ), float( 100.0 ) ), Random( seed, float( -100.0 ), float( 100.0 ) ) );
+		glm::vec3 offset( Random( seed, float( -1.5 ), float( 1.5 ) ), Random( seed, float( -1.5 ), float( 1.5 ) ), Random( seed, float( -1.5 ), float( 1.5 ) ) );
+		glm::vec3 axisA = RandomAxis( seed );
+		float angleA = Random( seed, float( 0.0 ), float( 6.0 ) );
+		glm::vec3 axisB = RandomAxis( seed );
+		float angleB = Random( seed, float( 0.0 ), float( 6.0 ) );
+
+		if ( i % 4 == 3 )
+		{
+			axisB = axisA;
+			angleB = angleA;
+		}
+
+		PhysicsBox* a = AddPairBox( scene, seed, position, axisA, angleA );
+		PhysicsBox* b = AddPairBox( scene, seed, position + offset, axisB, angleB );
+
+		// Fresh pairs, no cached axis and no speculative margin, so the
+		// batched version tests every one of them four at a time
+		PhysicsManifold* manifolds[ 2 ] = { &scalar[ i ], &batched[ i ] };
+		for ( PhysicsManifold* m : manifolds )
+		{
+			m->SetPair( a, b );
+			m->separatingAxis = ~0;
+			m->speculativeDistance = float( 0.0 );
+			m->contactCount = 0;
+		}
+	}
+
+	for ( int i = 0; i < pairCount; ++i )
+		PhysicsBoxtoBox( &scalar[ i ], scalar[ i ].A, scalar[ i ].B );
+
+	std::vector<PhysicsManifold*> batch( pairCount );
+	for ( int i = 0; i < pairCount; ++i )
+		batch[ i ] = &batched[ i ];
+
+	PhysicsCollisionCacheStats stats = { 0, 0 };
+	for ( int i = 0; i < pairCount; )
+	{
+		int count = glm::min( 1 + int( Random( seed, float( 0.0 ), float( 7.0 ) ) ), pairCount - i );
+		PhysicsBoxtoBox( batch.data( ) + i, count, &stats );
+		i += count;
+	}
+
+	int touching = 0;
+	int contactCount = 0;
+	int mismatches = 0;
+	for ( int i = 0; i < pairCount; ++i )
+	{
+		if ( scalar[ i ].separatingAxis == ~0 )
+			++touching;
+
+		contactCount += scalar[ i ].contactCount;
+
+		if ( SameManifold( scalar[ i ], batched[ i ] ) )
+			continue;
+
+		if ( !mismatches )
+			printf( "pair %d: scalar axis %d with %d contacts, batched axis %d with %d contacts\n", i, scalar[ i ].separatingAxis, scalar[ i ].contactCount, batched[ i ].separatingAxis, batched[ i ].contactCount );
+
+		++mismatches;
+	}
+
+	printf( "%d pairs, %d touching, %d contacts\n", pairCount, touching, contactCount );
+
+	if ( mismatches )
+	{
+		printf( "FAILED: the batched test differs from the single pair test for %d pairs\n", mismatches );
+		return 1;
+	}
+
+	// Every pair must have been tested, the cache had nothing to skip
+	if ( stats.pairCount != pairCount || stats.separatedHits )
+	{
+		printf( "FAILED: the batched test counted %d pairs and %d cache hits\n", stats.pairCount, stats.separatedHits );
+		return 1;
+	}
+
+	return 0;
+}
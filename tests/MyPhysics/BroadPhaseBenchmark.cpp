@@ -0,0 +1,217 @@
+// Times every broadphase on the same scenes: boxes falling onto a pile,
+// a swarm of boxes flying around without gravity, and scene queries on
+// boxes scattered over a ground box. Fails when the broadphases report
+// different query results for the scattered boxes, or when a ray of
+// RayCastBatch hits another box or toi than RayCastClosest.
+//
+//   BroadPhaseBenchmark [boxCount = 4000] [steps = 200] [queryCount = 20000]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestScenes.h"
+
+struct QueryResult
+{
+	double aabbMs;
+	double closestMs;
+	double batchMs;
+	long long aabbHits;
+	long long rayHits;
+	double rayToiSum;
+	int batchMismatches;
+};
+
+//--------------------------------------------------------------------------------------------------
+static double MsSince( std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now( ) - start ).count( );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Boxes rain down from a column and pile up, most of them move a little
+// every step
+static double RunPile( PhysicsBroadPhaseType type, int boxCount, int steps )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ), glm::vec3( float( 0.0 ), float( -9.8 ), float( 0.0 ) ), 10, type );
+	AddGround( scene, float( 200.0 ) );
+
+	unsigned int seed = 1;
+	float side = float( 20.0 );
+	for ( int i = 0; i < boxCount; ++i )
+		AddRandomBox( scene, seed, glm::vec3( Random( seed, -side, side ), float( 2.0 ) + float( i ) * float( 0.02 ), Random( seed, -side, side ) ) );
+
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < steps; ++i )
+		scene.Step( float( 1.0 / 60.0 ) );
+
+	return MsSince( start ) / double( steps );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Boxes fly around in every direction without gravity, moving far enough
+// to leave their fat AABBs every few steps
+static double RunSwarm( PhysicsBroadPhaseType type, int boxCount, int steps )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ), glm::vec3( float( 0.0 ) ), 10, type );
+	scene.SetAllowSleep( false );
+
+	unsigned int seed = 2;
+	float side = float( 40.0 );
+	for ( int i = 0; i < boxCount; ++i )
+	{
+		PhysicsBody* body = AddRandomBox( scene, seed, glm::vec3( Random( seed, -side, side ), Random( seed, -side, side ), Random( seed, -side, side ) ) );
+		body->SetLinearVelocity( glm::vec3( Random( seed, float( -5.0 ), float( 5.0 ) ), Random( seed, float( -5.0 ), float( 5.0 ) ), Random( seed, float( -5.0 ), float( 5.0 ) ) ) );
+	}
+
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < steps; ++i )
+		scene.Step( float( 1.0 / 60.0 ) );
+
+	return MsSince( start ) / double( steps );
+}
+
+//--------------------------------------------------------------------------------------------------
+struct CountCallback : public PhysicsQueryCallback
+{
+	long long count = 0;
+
+	bool ReportShape( PhysicsBox *box )
+	{
+		++count;
+		return true;
+	}
+};
+
+//--------------------------------------------------------------------------------------------------
+// Boxes scattered over a ground box, never stepped so that every
+// broadphase holds exactly the same boxes
+static QueryResult RunQueries( PhysicsBroadPhaseType type, int boxCount, int queryCount )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ), glm::vec3( float( 0.0 ), float( -9.8 ), float( 0.0 ) ), 10, type );
+
+	unsigned int seed = 3;
+	float side = float( 80.0 );
+	for ( int i = 0; i < boxCount; ++i )
+		AddRandomBox( scene, seed, glm::vec3( Random( seed, -side, side ), Random( seed, float( 1.0 ), float( 20.0 ) ), Random( seed, -side, side ) ) );
+
+	// Last, the grid picks its cell size from the first box until a step
+	// adjusts it
+	AddGround( scene, float( 200.0 ) );
+
+	QueryResult result;
+
+	CountCallback counter;
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < queryCount; ++i )
+	{
+		PhysicsAABB aabb;
+		aabb.min = glm::vec3( Random( seed, -side, side ), Random( seed, float( 0.0 ), float( 20.0 ) ), Random( seed, -side, side ) );
+		aabb.max = aabb.min + glm::vec3( Random( seed, float( 0.0 ), float( 6.0 ) ), Random( seed, float( 0.0 ), float( 6.0 ) ), Random( seed, float( 0.0 ), float( 6.0 ) ) );
+		scene.QueryAABB( &counter, aabb );
+	}
+	result.aabbMs = MsSince( start );
+	result.aabbHits = counter.count;
+
+	// Rays from above the boxes, groups of four start close together and
+	// point the same way for the packets of RayCastBatch
+	std::vector<PhysicsRaycastData> rays( queryCount );
+	for ( int i = 0; i < queryCount; ++i )
+	{
+		if ( i % 4 == 0 )
+		{
+			rays[ i ].start = glm::vec3( Random( seed, -side, side ), Random( seed, float( 20.0 ), float( 30.0 ) ), Random( seed, -side, side ) );
+			rays[ i ].dir = glm::normalize( glm::vec3( Random( seed, float( -1.0 ), float( 1.0 ) ), float( -1.0 ), Random( seed, float( -1.0 ), float( 1.0 ) ) ) );
+		}
+		else
+		{
+			rays[ i ].start = rays[ i - 1 ].start + glm::vec3( Random( seed, float( -0.5 ), float( 0.5 ) ), float( 0.0 ), Random( seed, float( -0.5 ), float( 0.5 ) ) );
+			rays[ i ].dir = rays[ i - 1 ].dir;
+		}
+
+		rays[ i ].t = float( 60.0 );
+	}
+
+	result.rayHits = 0;
+	result.rayToiSum = 0.0;
+	std::vector<PhysicsRayHit> closest( queryCount );
+	start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < queryCount; ++i )
+	{
+		PhysicsRaycastData ray = rays[ i ];
+		closest[ i ].box = scene.RayCastClosest( ray );
+		closest[ i ].toi = ray.toi;
+
+		if ( closest[ i ].box )
+		{
+			++result.rayHits;
+			result.rayToiSum += ray.toi;
+		}
+	}
+	result.closestMs = MsSince( start );
+
+	std::vector<PhysicsRayHit> hits( queryCount );
+	start = std::chrono::steady_clock::now( );
+	scene.RayCastBatch( rays, hits );
+	result.batchMs = MsSince( start );
+
+	// Every ray of the batch must find the same box at the same toi as
+	// when cast on its own
+	result.batchMismatches = 0;
+	for ( int i = 0; i < queryCount; ++i )
+	{
+		if ( hits[ i ].box != closest[ i ].box || ( hits[ i ].box && hits[ i ].toi != closest[ i ].toi ) )
+		{
+			if ( !result.batchMismatches )
+				printf( "ray %d: batch hit %p at %f, closest hit %p at %f\n", i, (void*)hits[ i ].box, hits[ i ].toi, (void*)closest[ i ].box, closest[ i ].toi );
+
+			++result.batchMismatches;
+		}
+	}
+
+	return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int boxCount = argc > 1 ? atoi( argv[ 1 ] ) : 4000;
+	int steps = argc > 2 ? atoi( argv[ 2 ] ) : 200;
+	int queryCount = argc > 3 ? atoi( argv[ 3 ] ) : 20000;
+
+	printf( "%d boxes, %d steps, %d queries\n", boxCount, steps, queryCount );
+	printf( "broadphase  pile ms/step  swarm ms/step  aabb ms  closest ms  batch ms\n" );
+
+	QueryResult results[ k_broadPhaseCount ];
+	for ( int i = 0; i < k_broadPhaseCount; ++i )
+	{
+		double pile = RunPile( k_broadPhases[ i ].type, boxCount, steps );
+		double swarm = RunSwarm( k_broadPhases[ i ].type, boxCount, steps );
+		results[ i ] = RunQueries( k_broadPhases[ i ].type, boxCount, queryCount );
+
+		printf( "%-10s  %12.3f  %13.3f  %7.2f  %10.2f  %8.2f\n", k_broadPhases[ i ].name, pile, swarm, results[ i ].aabbMs, results[ i ].closestMs, results[ i ].batchMs );
+	}
+
+	bool ok = true;
+	for ( int i = 0; i < k_broadPhaseCount; ++i )
+	{
+		if ( results[ i ].batchMismatches )
+		{
+			printf( "FAILED: %s batch ray casts differ from closest ray casts for %d of %d rays\n", k_broadPhases[ i ].name, results[ i ].batchMismatches, queryCount );
+			ok = false;
+		}
+	}
+
+	for ( int i = 1; i < k_broadPhaseCount; ++i )
+	{
+		if ( results[ i ].aabbHits != results[ 0 ].aabbHits || results[ i ].rayHits != results[ 0 ].rayHits || results[ i ].rayToiSum != results[ 0 ].rayToiSum )
+		{
+			printf( "FAILED: %s queries found %lld boxes and %lld ray hits, %s found %lld and %lld\n", k_broadPhases[ i ].name, results[ i ].aabbHits, results[ i ].rayHits, k_broadPhases[ 0 ].name, results[ 0 ].aabbHits, results[ 0 ].rayHits );
+			ok = false;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
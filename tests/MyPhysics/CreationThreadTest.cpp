@@ -0,0 +1,123 @@
+// Builds the same pile of random boxes twice, once with CreateBody on this
+// thread and once from threadCount threads at the same time through the
+// CreateBody overload taking a thread index, steps both scenes and fails
+// unless every body ends up with the very same transform. Thread i creates
+// the i-th slice of the boxes, the order the pending bodies join the scene.
+//
+//   CreationThreadTest [boxCount = 2000] [threadCount = 4] [steps = 120]
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "TestScenes.h"
+
+struct BoxSetup
+{
+	glm::vec3 position;
+	glm::vec3 extents;
+	glm::vec3 axis;
+	float angle;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Same body and box as AddBox, created through the given creation thread
+static PhysicsBody* AddBoxOnThread( PhysicsScene& scene, const BoxSetup& setup, int threadIndex )
+{
+	PhysicsBodyDef bodyDef;
+	bodyDef.bodyType = eDynamicBody;
+	bodyDef.position = setup.position;
+	bodyDef.axis = setup.axis;
+	bodyDef.angle = setup.angle;
+	PhysicsBody* body = scene.CreateBody( bodyDef, threadIndex );
+
+	PhysicsBoxDef boxDef;
+	PhysicsTransform tx;
+	boxDef.Set( tx, setup.extents );
+	body->AddBox( boxDef, threadIndex );
+
+	return body;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int boxCount = argc > 1 ? atoi( argv[ 1 ] ) : 2000;
+	int threadCount = argc > 2 ? atoi( argv[ 2 ] ) : 4;
+	int steps = argc > 3 ? atoi( argv[ 3 ] ) : 120;
+
+	// Boxes dropped onto each other at random angles
+	unsigned int seed = 1;
+	std::vector<BoxSetup> setups( boxCount );
+	for ( BoxSetup& setup : setups )
+	{
+		setup.position = glm::vec3( Random( seed, float( -15.0 ), float( 15.0 ) ), Random( seed, float( 2.0 ), float( 40.0 ) ), Random( seed, float( -15.0 ), float( 15.0 ) ) );
+		setup.extents = glm::vec3( Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ) );
+		setup.axis = glm::normalize( glm::vec3( Random( seed, float( -1.0 ), float( 1.0 ) ), float( 1.0 ), Random( seed, float( -1.0 ), float( 1.0 ) ) ) );
+		setup.angle = Random( seed, float( 0.0 ), float( 6.0 ) );
+	}
+
+	PhysicsScene serialScene( float( 1.0 / 60.0 ) );
+	AddGround( serialScene, float( 200.0 ) );
+
+	std::vector<PhysicsBody*> serialBodies;
+	for ( const BoxSetup& setup : setups )
+		serialBodies.push_back( AddBox( serialScene, setup.position, setup.extents, setup.axis, setup.angle ) );
+
+	PhysicsScene threadedScene( float( 1.0 / 60.0 ) );
+	AddGround( threadedScene, float( 200.0 ) );
+	threadedScene.SetCreationThreadCount( threadCount );
+
+	std::vector<PhysicsBody*> threadedBodies( boxCount );
+	std::vector<std::thread> threads;
+	for ( int i = 0; i < threadCount; ++i )
+	{
+		threads.emplace_back( [ &, i ]( )
+		{
+			int begin = boxCount * i / threadCount;
+			int end = boxCount * ( i + 1 ) / threadCount;
+
+			for ( int j = begin; j < end; ++j )
+				threadedBodies[ j ] = AddBoxOnThread( threadedScene, setups[ j ], i );
+		} );
+	}
+
+	for ( std::thread& thread : threads )
+		thread.join( );
+
+	for ( int i = 0; i < steps; ++i )
+	{
+		serialScene.Step( float( 1.0 / 60.0 ) );
+		threadedScene.Step( float( 1.0 / 60.0 ) );
+	}
+
+	int mismatches = 0;
+	for ( int i = 0; i < boxCount; ++i )
+	{
+		const PhysicsTransform& a = serialBodies[ i ]->GetTransform( );
+		const PhysicsTransform& b = threadedBodies[ i ]->GetTransform( );
+
+		bool same = a.position == b.position;
+		for ( int j = 0; j < 3; ++j )
+			same = same && a.rotation[ j ] == b.rotation[ j ];
+
+		if ( same )
+			continue;
+
+		if ( !mismatches )
+			printf( "box %d: serial at ( %f %f %f ), threaded at ( %f %f %f )\n", i, a.position.x, a.position.y, a.position.z, b.position.x, b.position.y, b.position.z );
+
+		++mismatches;
+	}
+
+	printf( "%d boxes created on %d threads, %d steps\n", boxCount, threadCount, steps );
+
+	if ( mismatches )
+	{
+		printf( "FAILED: %d boxes created on threads moved differently from the serially created ones\n", mismatches );
+		return 1;
+	}
+
+	return 0;
+}
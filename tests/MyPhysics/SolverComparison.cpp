@@ -0,0 +1,120 @@
+// Steps the same pyramids of boxes once with the scalar contact solver and
+// once with the batched one, prints the time per step of both and fails
+// when the pyramids the batched solver settles differ from the scalar ones.
+// Every pyramid is one island with far more than Q3_BATCH_MIN_CONTACTS
+// contacts, so all of them take the batched path.
+//
+//   SolverComparison [boxCount = 10000] [steps = 300] [threadCount = 1]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestScenes.h"
+
+static const int k_pyramidBase = 10;
+static const int k_pyramidBoxCount = k_pyramidBase * ( k_pyramidBase + 1 ) / 2;
+static const int k_pyramidsPerRow = 8;
+
+struct SolverResult
+{
+	double msPerStep;
+	double averageHeight;
+	double maxSink;
+	int awakeCount;
+};
+
+//--------------------------------------------------------------------------------------------------
+static SolverResult RunPyramids( bool batched, int boxCount, int steps, int threadCount )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ) );
+	scene.SetThreadCount( threadCount );
+	scene.SetEnableBatchedSolver( batched );
+
+	AddGround( scene, float( 400.0 ) );
+
+	// Every box rests on two boxes of the level below, levels start 0.05
+	// apart and fall onto each other
+	std::vector<PhysicsBody*> bodies;
+	std::vector<int> levels;
+	int pyramidCount = ( boxCount + k_pyramidBoxCount - 1 ) / k_pyramidBoxCount;
+	for ( int i = 0; i < pyramidCount; ++i )
+	{
+		float x = float( i % k_pyramidsPerRow ) * float( 25.0 ) - float( 100.0 );
+		float z = float( i / k_pyramidsPerRow ) * float( 3.0 ) - float( 100.0 );
+
+		for ( int level = 0; level < k_pyramidBase; ++level )
+		{
+			for ( int j = 0; j < k_pyramidBase - level; ++j )
+			{
+				glm::vec3 position(
+					x + ( float( j ) + float( level ) * float( 0.5 ) ) * float( 1.1 ),
+					float( 1.0 ) + float( level ) * float( 1.05 ),
+					z );
+				bodies.push_back( AddBox( scene, position, glm::vec3( float( 1.0 ) ) ) );
+				levels.push_back( level );
+			}
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < steps; ++i )
+		scene.Step( float( 1.0 / 60.0 ) );
+	auto end = std::chrono::steady_clock::now( );
+
+	SolverResult result;
+	result.msPerStep = std::chrono::duration<double, std::milli>( end - start ).count( ) / double( steps );
+	result.averageHeight = 0.0;
+	result.maxSink = 0.0;
+	result.awakeCount = 0;
+
+	// A resting box has its center at 1 + level
+	for ( size_t i = 0; i < bodies.size( ); ++i )
+	{
+		double y = bodies[ i ]->GetTransform( ).position.y;
+		double sink = double( 1 + levels[ i ] ) - y;
+		result.averageHeight += y;
+		result.maxSink = std::max( result.maxSink, sink );
+		result.awakeCount += bodies[ i ]->IsAwake( ) ? 1 : 0;
+	}
+	result.averageHeight /= double( bodies.size( ) );
+
+	return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int boxCount = argc > 1 ? atoi( argv[ 1 ] ) : 10000;
+	int steps = argc > 2 ? atoi( argv[ 2 ] ) : 300;
+	int threadCount = argc > 3 ? atoi( argv[ 3 ] ) : 1;
+
+	SolverResult scalar = RunPyramids( false, boxCount, steps, threadCount );
+	SolverResult batched = RunPyramids( true, boxCount, steps, threadCount );
+
+	printf( "%d pyramids of %d boxes, %d steps, %d threads\n", ( boxCount + k_pyramidBoxCount - 1 ) / k_pyramidBoxCount, k_pyramidBoxCount, steps, threadCount );
+	printf( "solver   ms/step  avg height  max sink  awake\n" );
+	printf( "scalar  %8.3f  %10.5f  %8.5f  %5d\n", scalar.msPerStep, scalar.averageHeight, scalar.maxSink, scalar.awakeCount );
+	printf( "batched %8.3f  %10.5f  %8.5f  %5d\n", batched.msPerStep, batched.averageHeight, batched.maxSink, batched.awakeCount );
+	printf( "speedup %8.2fx\n", scalar.msPerStep / batched.msPerStep );
+
+	// Both solvers run the same number of iterations on the same contacts,
+	// only the order of the constraints differs. The pyramids have to come
+	// to rest at the same height, within the allowed linear slop.
+	bool ok = true;
+	if ( std::fabs( batched.averageHeight - scalar.averageHeight ) > 0.01 )
+	{
+		printf( "FAILED: average heights differ by more than 0.01\n" );
+		ok = false;
+	}
+
+	if ( batched.maxSink > scalar.maxSink + 0.01 )
+	{
+		printf( "FAILED: batched pyramids sink more than scalar ones\n" );
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
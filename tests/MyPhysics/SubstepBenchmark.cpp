@@ -0,0 +1,148 @@
+// Trades penetration error against time per step: steps the same stacks of
+// boxes with the iterative solver at several iteration counts and with the
+// substepped solver at several substep counts. The sink of a box is how far
+// below its resting height it ended up, the penetration of every contact
+// under it added up. Fails when the substep count SetSubsteps recommends
+// for tall stacks lets a box fall off its stack, or when the substepped
+// solver sinks the stacks deeper than Q3_CONTACT_SLOP allows for.
+//
+//   SubstepBenchmark [stackCount = 100] [stackHeight = 10] [steps = 300]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestScenes.h"
+
+struct SolverConfig
+{
+	int iterations;
+	int substeps;
+
+	// Upper bound of the average sink per level of the stacks, 0 for no
+	// bound. Configs that let boxes slide off or drop through their stacks
+	// in some of the scenes sink too erratically to be bounded.
+	float maxSinkPerLevel;
+};
+
+// Resting soft contacts overlap by about Q3_CONTACT_SLOP, the bound leaves
+// room for the sag under the weight of the boxes above
+static const SolverConfig k_configs[] = {
+	{ 5, 0, float( 0.0 ) },
+	{ 10, 0, float( 0.0 ) },
+	{ 20, 0, float( 0.0 ) },
+	{ 40, 0, float( 0.0 ) },
+	{ 20, 2, float( 0.0 ) },
+	{ 20, 4, float( 3.0 ) * Q3_CONTACT_SLOP },
+	{ 20, 8, float( 3.0 ) * Q3_CONTACT_SLOP },
+};
+
+static const int k_configCount = sizeof( k_configs ) / sizeof( k_configs[ 0 ] );
+static const int k_stacksPerRow = 20;
+
+struct StackResult
+{
+	double msPerStep;
+	double averageSink;
+	double maxSink;
+	int fallenCount;
+	int awakeCount;
+};
+
+//--------------------------------------------------------------------------------------------------
+static StackResult RunStacks( const SolverConfig& config, int stackCount, int stackHeight, int steps )
+{
+	PhysicsScene scene( float( 1.0 / 60.0 ) );
+	scene.SetIterations( config.iterations );
+	scene.SetSubsteps( config.substeps );
+
+	AddGround( scene, float( 200.0 ) );
+
+	std::vector<PhysicsBody*> bodies;
+	AddStacks( scene, glm::vec3( float( -30.0 ), float( 1.0 ), float( -30.0 ) ), stackCount, stackHeight, k_stacksPerRow, &bodies );
+
+	std::vector<glm::vec3> starts;
+	for ( PhysicsBody* body : bodies )
+		starts.push_back( body->GetTransform( ).position );
+
+	auto start = std::chrono::steady_clock::now( );
+	for ( int i = 0; i < steps; ++i )
+		scene.Step( float( 1.0 / 60.0 ) );
+	auto end = std::chrono::steady_clock::now( );
+
+	StackResult result;
+	result.msPerStep = std::chrono::duration<double, std::milli>( end - start ).count( ) / double( steps );
+	result.averageSink = 0.0;
+	result.maxSink = 0.0;
+	result.fallenCount = 0;
+	result.awakeCount = 0;
+
+	// A resting box has its center at 1 + level. Boxes that moved sideways
+	// by half their size fell off and are left out of the sink.
+	int standingCount = 0;
+	for ( size_t i = 0; i < bodies.size( ); ++i )
+	{
+		glm::vec3 position = bodies[ i ]->GetTransform( ).position;
+		glm::vec3 drift = position - starts[ i ];
+		result.awakeCount += bodies[ i ]->IsAwake( ) ? 1 : 0;
+
+		if ( drift.x * drift.x + drift.z * drift.z > float( 0.25 ) )
+		{
+			++result.fallenCount;
+			continue;
+		}
+
+		double sink = double( 1 + int( i ) % stackHeight ) - double( position.y );
+		result.averageSink += sink;
+		result.maxSink = std::max( result.maxSink, sink );
+		++standingCount;
+	}
+
+	if ( standingCount )
+		result.averageSink /= double( standingCount );
+
+	return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+	int stackCount = argc > 1 ? atoi( argv[ 1 ] ) : 100;
+	int stackHeight = argc > 2 ? atoi( argv[ 2 ] ) : 10;
+	int steps = argc > 3 ? atoi( argv[ 3 ] ) : 300;
+
+	printf( "%d stacks of %d boxes, %d steps\n", stackCount, stackHeight, steps );
+	printf( "iterations  substeps  ms/step  avg sink  max sink  fallen  awake\n" );
+
+	bool ok = true;
+	for ( int i = 0; i < k_configCount; ++i )
+	{
+		const SolverConfig& config = k_configs[ i ];
+		StackResult result = RunStacks( config, stackCount, stackHeight, steps );
+
+		if ( config.substeps )
+			printf( "%10s  %8d", "-", config.substeps );
+		else
+			printf( "%10d  %8s", config.iterations, "-" );
+
+		printf( "  %7.3f  %8.5f  %8.5f  %6d  %5d\n", result.msPerStep, result.averageSink, result.maxSink, result.fallenCount, result.awakeCount );
+
+		if ( config.substeps >= 8 && result.fallenCount )
+		{
+			printf( "FAILED: %d substeps let boxes fall off their stacks\n", config.substeps );
+			ok = false;
+		}
+
+		// The boxes of level i sink by i + 1 contacts, ( stackHeight + 1 ) / 2
+		// on average
+		float maxSink = config.maxSinkPerLevel * float( stackHeight + 1 ) * float( 0.5 );
+		if ( config.maxSinkPerLevel > float( 0.0 ) && result.averageSink > maxSink )
+		{
+			printf( "FAILED: %d substeps sink by %.5f on average, more than %.5f\n", config.substeps, result.averageSink, maxSink );
+			ok = false;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
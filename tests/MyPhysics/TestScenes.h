@@ -0,0 +1,99 @@
+// Scene building blocks shared by the MyPhysics tests and benchmarks
+
+#pragma once
+
+#include <vector>
+
+#include "MyPhysics/Physics.hpp"
+
+//--------------------------------------------------------------------------------------------------
+// Static box of size x 1 x size centered at the origin, its top is at 0.5
+inline PhysicsBody* AddGround( PhysicsScene& scene, float size )
+{
+	PhysicsBodyDef bodyDef;
+	PhysicsBody* ground = scene.CreateBody( bodyDef );
+
+	PhysicsBoxDef boxDef;
+	PhysicsTransform tx;
+	boxDef.Set( tx, glm::vec3( size, float( 1.0 ), size ) );
+	ground->AddBox( boxDef );
+
+	return ground;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Dynamic body holding a single box of the given size, turned by angle
+// around axis
+inline PhysicsBody* AddBox( PhysicsScene& scene, const glm::vec3& position, const glm::vec3& extents,
+	const glm::vec3& axis = glm::vec3( float( 0.0 ), float( 1.0 ), float( 0.0 ) ), float angle = float( 0.0 ) )
+{
+	PhysicsBodyDef bodyDef;
+	bodyDef.bodyType = eDynamicBody;
+	bodyDef.position = position;
+	bodyDef.axis = axis;
+	bodyDef.angle = angle;
+	PhysicsBody* body = scene.CreateBody( bodyDef );
+
+	PhysicsBoxDef boxDef;
+	PhysicsTransform tx;
+	boxDef.Set( tx, extents );
+	body->AddBox( boxDef );
+
+	return body;
+}
+
+struct BroadPhaseInfo
+{
+	PhysicsBroadPhaseType type;
+	const char *name;
+};
+
+static const BroadPhaseInfo k_broadPhases[] = {
+	{ eTreeBroadPhase, "tree" },
+	{ eSweepAndPruneBroadPhase, "sap" },
+	{ eGridBroadPhase, "grid" },
+};
+
+static const int k_broadPhaseCount = sizeof( k_broadPhases ) / sizeof( k_broadPhases[ 0 ] );
+
+//--------------------------------------------------------------------------------------------------
+// Same sequence on every platform, unlike rand( )
+inline float Random( unsigned int& seed, float min, float max )
+{
+	seed = seed * 1664525u + 1013904223u;
+	return min + ( max - min ) * float( seed >> 8 ) * float( 1.0 / 16777216.0 );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Box with random extents between 0.5 and 1.5, turned by a random angle
+// around a random axis
+inline PhysicsBody* AddRandomBox( PhysicsScene& scene, unsigned int& seed, const glm::vec3& position )
+{
+	glm::vec3 axis = glm::normalize( glm::vec3( Random( seed, float( -1.0 ), float( 1.0 ) ), Random( seed, float( -1.0 ), float( 1.0 ) ), float( 1.0 ) ) );
+	float angle = Random( seed, float( 0.0 ), float( 6.0 ) );
+	glm::vec3 extents( Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ), Random( seed, float( 0.5 ), float( 1.5 ) ) );
+
+	return AddBox( scene, position, extents, axis, angle );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Stacks of unit boxes 3 apart in rows of stacksPerRow, the bottom box of the
+// first stack at corner. Boxes start 0.05 apart and fall onto each other.
+// Appends the bodies to bodies stack by stack, bottom box first.
+inline void AddStacks( PhysicsScene& scene, const glm::vec3& corner, int stackCount, int stackHeight, int stacksPerRow, std::vector<PhysicsBody*>* bodies = NULL )
+{
+	for ( int i = 0; i < stackCount; ++i )
+	{
+		for ( int level = 0; level < stackHeight; ++level )
+		{
+			glm::vec3 position = corner + glm::vec3(
+				float( i % stacksPerRow ) * float( 3.0 ),
+				float( level ) * float( 1.05 ),
+				float( i / stacksPerRow ) * float( 3.0 ) );
+			PhysicsBody* body = AddBox( scene, position, glm::vec3( float( 1.0 ) ) );
+
+			if ( bodies )
+				bodies->push_back( body );
+		}
+	}
+}